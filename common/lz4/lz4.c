@@ -0,0 +1,238 @@
+/*
+ * lz4.c - LZ4 block compression
+ */
+
+/*
+ *  Copyright (C) 2026 agent.  All Rights Reserved.
+ *
+ *  This is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This software is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this software; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ *  USA.
+ */
+
+/*
+ * An LZ4 block is a series of sequences, each of which consists of a token
+ * byte, a run of literal bytes, and a match (a 16-bit little-endian offset
+ * back into the decompressed data, and a length.)  The upper 4 bits of the
+ * token contain the number of literals and the lower 4 bits the match length
+ * minus 4 (the minimum match length.)  A value of 15 in either field means
+ * that the length continues in the following bytes, each of which adds up to
+ * 255.  The last sequence has literals but no match.  The last 5 bytes of the
+ * block must be literals, and the last match must start at least 12 bytes
+ * before the end of the block.
+ */
+
+#include <string.h>
+#include "lz4.h"
+
+#define MINMATCH      4
+#define LASTLITERALS  5
+#define MFLIMIT       12
+#define MAX_DISTANCE  65535
+
+#define HASH_LOG      13
+#define HASH_SIZE     (1 << HASH_LOG)
+
+/* After this many consecutive failed match attempts (in units of 64), the
+   compressor starts skipping bytes, so incompressible data is processed
+   quickly. */
+#define SKIP_TRIGGER  6
+
+typedef unsigned char BYTE;
+typedef unsigned int U32;
+
+
+static U32 Read32(const BYTE *p)
+{
+  U32 v;
+
+  memcpy(&v, p, 4);
+  return v;
+}
+
+
+static U32 Hash(U32 v)
+{
+  return (v * 2654435761U) >> (32 - HASH_LOG);
+}
+
+
+static BYTE *WriteLength(BYTE *op, unsigned len)
+{
+  while (len >= 255) {
+    *op++ = 255;
+    len -= 255;
+  }
+  *op++ = (BYTE)len;
+  return op;
+}
+
+
+int LZ4_compress_default(const char *src, char *dst, int srcSize,
+                         int dstCapacity)
+{
+  const BYTE *base = (const BYTE *)src, *ip = base, *anchor = base;
+  const BYTE *iend = base + srcSize;
+  const BYTE *mflimit = iend - MFLIMIT, *matchlimit = iend - LASTLITERALS;
+  BYTE *op = (BYTE *)dst, *oend = op + dstCapacity;
+  unsigned litLen;
+  U32 table[HASH_SIZE];
+
+  if (srcSize < 0 || srcSize > LZ4_MAX_INPUT_SIZE || dstCapacity <= 0)
+    return 0;
+
+  if (srcSize > MFLIMIT) {
+    unsigned attempts = 1 << SKIP_TRIGGER;
+
+    memset(table, 0, sizeof(table));
+    ip++;
+
+    while (ip <= mflimit) {
+      U32 seq = Read32(ip), h = Hash(seq);
+      const BYTE *ref = base + table[h], *mp, *rp;
+      BYTE *token;
+      unsigned matchLen;
+
+      table[h] = (U32)(ip - base);
+      if (ip - ref > MAX_DISTANCE || Read32(ref) != seq) {
+        ip += attempts++ >> SKIP_TRIGGER;
+        continue;
+      }
+      attempts = 1 << SKIP_TRIGGER;
+
+      /* Extend the match backwards into the pending literals. */
+      while (ip > anchor && ref > base && ip[-1] == ref[-1]) {
+        ip--;  ref--;
+      }
+
+      /* Extend the match forwards. */
+      mp = ip + MINMATCH;  rp = ref + MINMATCH;
+      while (mp < matchlimit && *mp == *rp) {
+        mp++;  rp++;
+      }
+      matchLen = (unsigned)(mp - ip) - MINMATCH;
+      litLen = (unsigned)(ip - anchor);
+
+      if (op + 1 + litLen / 255 + 1 + litLen + 2 + matchLen / 255 + 1 +
+          1 + LASTLITERALS > oend)
+        return 0;
+
+      token = op++;
+      if (litLen >= 15) {
+        *token = 15 << 4;
+        op = WriteLength(op, litLen - 15);
+      } else
+        *token = (BYTE)(litLen << 4);
+      memcpy(op, anchor, litLen);
+      op += litLen;
+
+      *op++ = (BYTE)(ip - ref);
+      *op++ = (BYTE)((ip - ref) >> 8);
+
+      if (matchLen >= 15) {
+        *token |= 15;
+        op = WriteLength(op, matchLen - 15);
+      } else
+        *token |= (BYTE)matchLen;
+
+      ip = anchor = mp;
+
+      /* Index a position inside of the match, which improves the compression
+         ratio of repetitive data at little cost. */
+      if (ip <= mflimit)
+        table[Hash(Read32(ip - 2))] = (U32)(ip - 2 - base);
+    }
+  }
+
+  /* Last literals */
+  litLen = (unsigned)(iend - anchor);
+  if (op + 1 + litLen / 255 + 1 + litLen > oend)
+    return 0;
+  if (litLen >= 15) {
+    *op++ = 15 << 4;
+    op = WriteLength(op, litLen - 15);
+  } else
+    *op++ = (BYTE)(litLen << 4);
+  memcpy(op, anchor, litLen);
+  op += litLen;
+
+  return (int)(op - (BYTE *)dst);
+}
+
+
+int LZ4_decompress_safe(const char *src, char *dst, int compressedSize,
+                        int dstCapacity)
+{
+  const BYTE *ip = (const BYTE *)src, *iend = ip + compressedSize;
+  BYTE *op = (BYTE *)dst, *oend = op + dstCapacity;
+
+  if (compressedSize <= 0 || dstCapacity < 0)
+    return -1;
+
+  for (;;) {
+    unsigned token = *ip++, litLen = token >> 4, matchLen, offset;
+    const BYTE *ref;
+
+    if (litLen == 15) {
+      unsigned b;
+
+      do {
+        if (ip >= iend) return -1;
+        b = *ip++;
+        litLen += b;
+      } while (b == 255);
+    }
+    if (litLen > (unsigned)(iend - ip) || litLen > (unsigned)(oend - op))
+      return -1;
+    memcpy(op, ip, litLen);
+    ip += litLen;
+    op += litLen;
+
+    if (ip == iend) break;             /* Last sequence */
+
+    if (iend - ip < 2) return -1;
+    offset = ip[0] | (ip[1] << 8);
+    ip += 2;
+    ref = op - offset;
+    if (offset == 0 || offset > (unsigned)(op - (BYTE *)dst))
+      return -1;
+
+    matchLen = token & 15;
+    if (matchLen == 15) {
+      unsigned b;
+
+      do {
+        if (ip >= iend) return -1;
+        b = *ip++;
+        matchLen += b;
+      } while (b == 255);
+    }
+    matchLen += MINMATCH;
+    if (matchLen > (unsigned)(oend - op))
+      return -1;
+
+    /* The match may overlap the output, so it must be copied forwards one
+       byte at a time unless the source and destination are far enough
+       apart. */
+    if (offset >= matchLen) {
+      memcpy(op, ref, matchLen);
+      op += matchLen;
+    } else {
+      while (matchLen--) *op++ = *ref++;
+    }
+    if (ip >= iend) return -1;
+  }
+
+  return (int)(op - (BYTE *)dst);
+}
@@ -0,0 +1,61 @@
+/*
+ * lz4.h - LZ4 block compression
+ */
+
+/*
+ *  Copyright (C) 2026 agent.  All Rights Reserved.
+ *
+ *  This is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This software is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this software; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ *  USA.
+ */
+
+/*
+ * This is a compact implementation of the LZ4 block format
+ * (https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md), which trades
+ * compression ratio for speed.  It compresses typically 5-10x faster than
+ * zlib at level 1, so it is used to compress Tight-encoded rectangles when
+ * the network is fast enough that CPU time, rather than bandwidth, limits the
+ * frame rate.  The function names and semantics match the corresponding
+ * subset of the LZ4 library API, so the two are interchangeable.
+ */
+
+#ifndef __LZ4_H__
+#define __LZ4_H__
+
+#define LZ4_MAX_INPUT_SIZE  0x7E000000
+
+/* Maximum size of the compressed data for an input of the given size */
+#define LZ4_COMPRESSBOUND(isize)  \
+  ((unsigned)(isize) > (unsigned)LZ4_MAX_INPUT_SIZE ?  \
+   0 : (isize) + ((isize) / 255) + 16)
+
+/*
+ * Compress srcSize bytes from src into dst, which can hold dstCapacity bytes.
+ * Each call produces an independent block, so blocks can be decompressed in
+ * any order.  Returns the number of bytes written to dst, or 0 if the
+ * compressed data would not fit.
+ */
+int LZ4_compress_default(const char *src, char *dst, int srcSize,
+                         int dstCapacity);
+
+/*
+ * Decompress compressedSize bytes from src into dst, which can hold
+ * dstCapacity bytes.  Returns the number of bytes written to dst, or a
+ * negative value if the compressed data is malformed.
+ */
+int LZ4_decompress_safe(const char *src, char *dst, int compressedSize,
+                        int dstCapacity);
+
+#endif
@@ -529,6 +529,11 @@ typedef struct _rfbInteractionCapsMsg {
 
 /*
  * Special encoding numbers:
+ *   0xFFFFFB00 .. 0xFFFFFB07 -- tile cache size;
+ *   0xFFFFFB10 .. 0xFFFFFB11 -- tile cache operations;
+ *   0xFFFFFB20               -- LZ4 compression for Tight encoding;
+ *   0xFFFFFB30               -- framebuffer contents kept across resizes;
+ *   0xFFFFFC01 .. 0xFFFFFC64 -- server-side scaling factor (1-100 percent);
  *   0xFFFFFD00 .. 0xFFFFFD05 -- subsampling level;
  *   0xFFFFFE00 .. 0xFFFFFE64 -- fine-grained quality level (0-100 scale);
  *   0xFFFFFEC7 .. 0xFFFFFEC8 -- flow control extensions;
@@ -549,6 +554,14 @@ typedef struct _rfbInteractionCapsMsg {
 #define rfbEncodingSubsampGray         0xFFFFFD03
 #define rfbEncodingSubsamp8X           0xFFFFFD04
 #define rfbEncodingSubsamp16X          0xFFFFFD05
+#define rfbEncodingServerScale1        0xFFFFFC01
+#define rfbEncodingServerScale100      0xFFFFFC64
+#define rfbEncodingTileCache256        0xFFFFFB00
+#define rfbEncodingTileCache32768      0xFFFFFB07
+#define rfbEncodingTileCacheStore      0xFFFFFB10
+#define rfbEncodingTileCacheRef        0xFFFFFB11
+#define rfbEncodingTightLZ4            0xFFFFFB20
+#define rfbEncodingResizeKeepContent   0xFFFFFB30
 
 #define rfbEncodingContinuousUpdates   0xFFFFFEC7
 #define rfbEncodingFence               0xFFFFFEC8
@@ -586,6 +599,8 @@ typedef struct _rfbInteractionCapsMsg {
 
 #define rfbEncodingGII             0xFFFFFECF
 
+#define rfbEncodingExtendedClipboard 0xC0A1E5CE
+
 /* signatures for "fake" encoding types */
 #define sig_rfbEncodingCompressLevel0  "COMPRLVL"
 #define sig_rfbEncodingXCursor         "X11CURSR"
@@ -595,6 +610,12 @@ typedef struct _rfbInteractionCapsMsg {
 #define sig_rfbEncodingNewFBSize       "NEWFBSIZ"
 #define sig_rfbEncodingFineQualityLevel0 "FINEQLVL"
 #define sig_rfbEncodingSubsamp1X       "SSAMPLVL"
+#define sig_rfbEncodingServerScale1    "SRVSCALE"
+#define sig_rfbEncodingTileCache256    "TILECACH"
+#define sig_rfbEncodingTileCacheStore  "TCSTORE_"
+#define sig_rfbEncodingTileCacheRef    "TCREF___"
+#define sig_rfbEncodingTightLZ4        "TIGHTLZ4"
+#define sig_rfbEncodingResizeKeepContent "RSZKEEP_"
 #define sig_rfbEncodingQualityLevel0   "JPEGQLVL"
 #define sig_rfbEncodingGII             "GII_____"
 
@@ -658,6 +679,26 @@ typedef struct _rfbCopyRect {
 #define sz_rfbCopyRect 4
 
 
+/*- - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+ * Tile cache.  A client that sends rfbEncodingTileCache256 + n can cache
+ * (256 << n) tiles, in slots numbered from 0.  The server decides which slot
+ * each tile occupies.  A TileCacheStore rectangle tells the client to copy
+ * the pixels that it currently has in the rectangle into the specified slot,
+ * and a TileCacheRef rectangle tells the client to draw the contents of the
+ * specified slot into the rectangle.  The rectangle must have the same
+ * dimensions as the tile that was stored in the slot.  Tiles are at most
+ * rfbTileCacheTileSize x rfbTileCacheTileSize pixels.
+ */
+
+typedef struct _rfbTileCacheRect {
+    CARD32 slot;
+} rfbTileCacheRect;
+
+#define sz_rfbTileCacheRect 4
+
+#define rfbTileCacheTileSize 64
+
+
 /*- - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
  * RRE - Rise-and-Run-length Encoding.  We have an rfbRREHeader structure
  * giving the number of subrectangles following.  Finally the data follows in
@@ -769,12 +810,16 @@ typedef struct _rfbZlibHeader {
  *             if 1001 (0x09), then the compression type is "jpeg",
  *             if 1010 (0x0A), then the compression type is "basic" and no
  *               Zlib compression was used,
+ *             if 1100 (0x0C), then the compression type is "basic", LZ4
+ *               compression was used instead of Zlib, and a "filter id" byte
+ *               follows this byte (TurboVNC extension, only sent if the
+ *               client supports rfbEncodingTightLZ4),
  *             if 1110 (0x0E), then the compression type is "basic", no Zlib
  *               compression was used, and a "filter id" byte follows this
  *               byte,
  *             if 0xxx, then the compression type is "basic" and Zlib
  *               compression was used,
- *             values greater than 1010 are not valid.
+ *             other values are not valid.
  *
  * If the compression type is "basic" and Zlib compression was used, then bits
  * 6..4 of the compression control byte (those xxx in 0xxx) specify the
@@ -867,6 +912,13 @@ typedef struct _rfbZlibHeader {
  * Data size is compactly represented in one, two or three bytes, just like
  * in the "jpeg" compression method (see above).
  *
+ *-- If the compression type is LZ4, then the pixel data is compressed as a
+ * single LZ4 block (see https://github.com/lz4/lz4) instead of using a zlib
+ * stream, so the data stream looks like the one above, except that the N
+ * bytes contain the LZ4 block.  Data that is smaller than 12 bytes is sent
+ * uncompressed, as with zlib.  LZ4 blocks are independent of each other, so
+ * the zlib stream states are unaffected.
+ *
  *-- NOTE 1. If the color depth is 24, and all three color components are
  * 8-bit wide, then one pixel in Tight encoding is always represented by
  * three bytes, where the first byte is red component, the second byte is
@@ -891,6 +943,7 @@ typedef struct _rfbZlibHeader {
 #define rfbTightFill                   0x08
 #define rfbTightJpeg                   0x09
 #define rfbTightNoZlib                 0x0A
+#define rfbTightLZ4                    0x0C
 #define rfbTightMaxSubencoding         0x09
 
 /* Filters to improve compression efficiency */
@@ -1023,6 +1076,41 @@ typedef struct _rfbServerCutTextMsg {
 
 #define sz_rfbServerCutTextMsg 8
 
+/*
+ * Extended Clipboard
+ *
+ * If both endpoints support the extended clipboard pseudo-encoding, then
+ * ServerCutText and ClientCutText messages with a negative length (two's
+ * complement) carry an extended clipboard message of -length bytes instead of
+ * Latin-1 text.  The message begins with a CARD32 containing one action flag
+ * and a set of format flags:
+ *
+ * Caps     -- the sender supports the given actions and formats.  Followed by
+ *             a CARD32 for each format flag (in ascending bit order)
+ *             specifying the maximum size of unsolicited data in that format.
+ * Request  -- the sender wants the data in the given formats.
+ * Peek     -- the sender wants to know which formats are available.
+ * Notify   -- the clipboard has changed, and data in the given formats is
+ *             available.
+ * Provide  -- followed by a zlib stream containing, for each format flag (in
+ *             ascending bit order), a CARD32 length and the data.  Text is
+ *             UTF-8 with CRLF line endings and a terminating NUL character.
+ */
+
+#define rfbExtClipText        (1 << 0)
+#define rfbExtClipRTF         (1 << 1)
+#define rfbExtClipHTML        (1 << 2)
+#define rfbExtClipDIB         (1 << 3)
+#define rfbExtClipFiles       (1 << 4)
+#define rfbExtClipFormatMask  0x0000FFFF
+
+#define rfbExtClipCaps        (1 << 24)
+#define rfbExtClipRequest     (1 << 25)
+#define rfbExtClipPeek        (1 << 26)
+#define rfbExtClipNotify      (1 << 27)
+#define rfbExtClipProvide     (1 << 28)
+#define rfbExtClipActionMask  0xFF000000
+
 /*-----------------------------------------------------------------------------
  * FileListData
  */
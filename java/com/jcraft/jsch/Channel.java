@@ -100,6 +100,15 @@ public abstract class Channel implements Runnable{
   volatile int lwsize_max=0x100000;
   volatile int lwsize=lwsize_max;     // local initial window size
   volatile int lmpsize=0x4000;     // local maximum packet size
+  // If lwsize_limit > lwsize_max, then the local window is allowed to grow
+  // up to lwsize_limit (see growLocalWindowSize().)
+  volatile int lwsize_limit=0;
+  long lastWindowAdjust=0;
+  // If true, then the session thread does not return window space to the
+  // remote side as it receives data.  The application does so instead, as it
+  // reads the data (see consumeLocalWindow().)
+  volatile boolean deferWindowAdjust=false;
+  private int lwsize_consumed=0;
 
   volatile long rwsize=0;         // remote initial window size
   volatile int rmpsize=0;        // remote maximum packet size
@@ -419,6 +428,48 @@ public abstract class Channel implements Runnable{
   void setLocalWindowSizeMax(int foo){ this.lwsize_max=foo; }
   void setLocalWindowSize(int foo){ this.lwsize=foo; }
   void setLocalPacketSize(int foo){ this.lmpsize=foo; }
+  void setLocalWindowSizeLimit(int foo){ this.lwsize_limit=foo; }
+
+  // Called whenever a window adjustment is due.  If half of the local window
+  // was consumed within WINDOW_GROWTH_INTERVAL of the previous adjustment,
+  // then the window (rather than the application) is probably what is
+  // limiting the throughput, so double its size.
+  static final long WINDOW_GROWTH_INTERVAL=250000000L;  // nanoseconds
+  void growLocalWindowSize(){
+    long now=System.nanoTime();
+    if(lwsize_limit>lwsize_max && lastWindowAdjust!=0 &&
+       now-lastWindowAdjust<WINDOW_GROWTH_INTERVAL){
+      lwsize_max=(int)Math.min((long)lwsize_max*2, (long)lwsize_limit);
+    }
+    lastWindowAdjust=now;
+  }
+
+  // Called by the application after it has read len bytes of channel data, if
+  // deferWindowAdjust is set.  Since the window is returned only once the data
+  // has been consumed, a slow reader throttles the remote side without
+  // blocking the session thread.
+  void consumeLocalWindow(int len) throws Exception {
+    int adjust;
+    synchronized(this){
+      lwsize_consumed+=len;
+      if(lwsize_consumed<lwsize_max/2)
+        return;
+      int old_max=lwsize_max;
+      growLocalWindowSize();
+      adjust=lwsize_consumed+(lwsize_max-old_max);
+      lwsize_consumed=0;
+    }
+    Buffer buf=new Buffer(100);
+    Packet packet=new Packet(buf);
+    packet.reset();
+    buf.putByte((byte)Session.SSH_MSG_CHANNEL_WINDOW_ADJUST);
+    buf.putInt(getRecipient());
+    buf.putInt(adjust);
+    synchronized(this){
+      if(!close)
+        getSession().write(packet);
+    }
+  }
   synchronized void setRemoteWindowSize(long foo){ this.rwsize=foo; }
   synchronized void addRemoteWindowSize(long foo){ 
     this.rwsize+=foo; 
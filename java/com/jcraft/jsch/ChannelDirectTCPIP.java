@@ -54,6 +54,42 @@ public class ChannelDirectTCPIP extends Channel{
     io=new IO();
   }
 
+  /**
+   * Sets the initial size of the local window and the size up to which the
+   * window may grow if the channel's throughput is window-limited.  This must
+   * be called before connect().
+   */
+  public void setLocalWindowSize(int initial, int limit){
+    setLocalWindowSizeMax(initial);
+    setLocalWindowSize(initial);
+    setLocalWindowSizeLimit(limit);
+  }
+
+  /**
+   * Sets the maximum size of the packets that the remote side may send on this
+   * channel.  This must be called before connect().
+   */
+  public void setLocalMaxPacketSize(int size){
+    setLocalPacketSize(size);
+  }
+
+  /**
+   * If enabled, the local window is replenished only as the application
+   * reports, by calling windowConsumed(), that it has read the channel's data,
+   * rather than as soon as the data is written to the channel's output stream.
+   * This must be called before connect().
+   */
+  public void setDeferWindowAdjust(boolean defer){
+    deferWindowAdjust=defer;
+  }
+
+  /**
+   * Reports that the application has read len bytes of the channel's data.
+   */
+  public void windowConsumed(int len) throws Exception{
+    consumeLocalWindow(len);
+  }
+
   public void connect(int connectTimeout) throws JSchException{
     this.connectTimeout=connectTimeout;
     try{
@@ -214,7 +214,9 @@ public class Session implements Runnable{
         OutputStream out;
 	if(socket_factory==null){
           socket=Util.createSocket(host, port, connectTimeout);
-	  in=socket.getInputStream();
+	  // The packet reader issues separate small reads for the header and
+	  // the payload of each packet, so buffer the socket input.
+	  in=new BufferedInputStream(socket.getInputStream(), 0x10000);
 	  out=socket.getOutputStream();
 	}
 	else{
@@ -1464,9 +1466,13 @@ catch(Exception e){
   try{channel.disconnect();}catch(Exception ee){}
 break;
 }
+	  if(channel.deferWindowAdjust){
+	    break;
+	  }
 	  int len=length[0];
 	  channel.setLocalWindowSize(channel.lwsize-len);
  	  if(channel.lwsize<channel.lwsize_max/2){
+            channel.growLocalWindowSize();
             packet.reset();
 	    buf.putByte((byte)SSH_MSG_CHANNEL_WINDOW_ADJUST);
 	    buf.putInt(channel.getRecipient());
@@ -1500,6 +1506,7 @@ break;
 	  len=length[0];
 	  channel.setLocalWindowSize(channel.lwsize-len);
  	  if(channel.lwsize<channel.lwsize_max/2){
+            channel.growLocalWindowSize();
             packet.reset();
 	    buf.putByte((byte)SSH_MSG_CHANNEL_WINDOW_ADJUST);
 	    buf.putInt(channel.getRecipient());
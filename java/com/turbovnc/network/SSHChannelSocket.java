@@ -0,0 +1,209 @@
+/* Copyright (C) 2026 agent.  All Rights Reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ */
+
+// -=- SSHChannelSocket - a Socket that reads from and writes to an SSH
+//     "direct-tcpip" channel, rather than to a loopback TCP connection that
+//     JSch forwards to the channel
+
+package com.turbovnc.network;
+
+import java.io.*;
+import java.nio.channels.*;
+import java.util.ArrayDeque;
+
+import com.jcraft.jsch.*;
+import com.turbovnc.rdr.*;
+
+public class SSHChannelSocket extends Socket {
+
+  // host and port are relative to the SSH server.  The local window of the
+  // channel starts at windowSize bytes and grows, as needed, up to
+  // maxWindowSize bytes.
+  public SSHChannelSocket(Session session, String host, int port,
+                          int windowSize, int maxWindowSize, int packetSize) {
+    ChannelDirectTCPIP channel;
+
+    try {
+      channel = (ChannelDirectTCPIP)session.openChannel("direct-tcpip");
+    } catch (JSchException e) {
+      throw new ErrorException("Could not open SSH channel: " +
+                               e.getMessage());
+    }
+    channel.setHost(host);
+    channel.setPort(port);
+    channel.setLocalWindowSize(windowSize, maxWindowSize);
+    channel.setLocalMaxPacketSize(packetSize);
+    channel.setDeferWindowAdjust(true);
+
+    // The JSch session thread writes incoming channel data directly into the
+    // descriptor's queue.  The channel's local window is replenished only as
+    // the data is read from the queue, so the queue never holds more than
+    // maxWindowSize bytes, and a slow reader throttles the SSH server rather
+    // than the session thread.
+    ChannelDescriptor fd = new ChannelDescriptor(channel);
+    channel.setOutputStream(fd.sink);
+
+    try {
+      channel.connect();
+      fd.channelOut = channel.getOutputStream();
+    } catch (Exception e) {
+      channel.disconnect();
+      throw new WarningException("Could not connect to " + host + ":" + port +
+                                 " through SSH channel: " + e.getMessage());
+    }
+
+    peerHost = host;  peerPort = port;
+    instream = new FdInStream(fd);
+    outstream = new FdOutStream(fd);
+    ownStreams = true;
+  }
+
+  public int getMyPort() { return 0; }
+  public String getPeerAddress() { return peerHost; }
+  public String getPeerName() { return peerHost; }
+  public int getPeerPort() { return peerPort; }
+  public String getPeerEndpoint() { return peerHost + "::" + peerPort; }
+  public boolean sameMachine() { return false; }
+
+  public void shutdown() {
+    super.shutdown();
+    getFd().close();
+  }
+
+  static class ChannelDescriptor implements FileDescriptor {
+
+    ChannelDescriptor(ChannelDirectTCPIP channel_) {
+      channel = channel_;
+    }
+
+    // JSch reuses its packet buffer, so each incoming data packet must be
+    // copied.  That copy replaces the two copies (into and out of the kernel)
+    // and the extra thread hop that a loopback TCP connection would require.
+    final OutputStream sink = new OutputStream() {
+      public void write(int b) throws IOException {
+        write(new byte[] { (byte)b }, 0, 1);
+      }
+
+      public void write(byte[] b, int off, int len) throws IOException {
+        if (len <= 0) return;
+        byte[] data = new byte[len];
+        System.arraycopy(b, off, data, 0, len);
+        synchronized (ChannelDescriptor.this) {
+          if (closed)
+            throw new IOException("SSH channel closed");
+          queue.add(data);
+          ChannelDescriptor.this.notifyAll();
+        }
+      }
+
+      public void close() {
+        synchronized (ChannelDescriptor.this) {
+          eof = true;
+          ChannelDescriptor.this.notifyAll();
+        }
+      }
+    };
+
+    // Like SocketDescriptor.read(), this returns -1 if no data is available
+    // and 0 if the remote end has closed the channel.
+    public int read(byte[] buf, int bufPtr, int length) {
+      int n = 0;
+
+      synchronized (this) {
+        while (n < length && (head != null || !queue.isEmpty())) {
+          if (head == null) {
+            head = queue.poll();  headPtr = 0;
+          }
+          int len = Math.min(length - n, head.length - headPtr);
+          System.arraycopy(head, headPtr, buf, bufPtr + n, len);
+          n += len;  headPtr += len;
+          if (headPtr == head.length) head = null;
+        }
+        if (n == 0)
+          return eof || closed ? 0 : -1;
+      }
+      // This may send a window adjustment, so it must not be called while
+      // holding the descriptor's lock, which the session thread needs in order
+      // to deliver data.
+      try {
+        channel.windowConsumed(n);
+      } catch (Exception e) {
+        throw new ErrorException("Read error: " + e.getMessage());
+      }
+      return n;
+    }
+
+    public int write(byte[] buf, int bufPtr, int length) {
+      // The channel's output stream sends the data on this thread and blocks
+      // if the remote window is exhausted.
+      synchronized (writeLock) {
+        try {
+          channelOut.write(buf, bufPtr, length);
+          channelOut.flush();
+        } catch (IOException e) {
+          throw new ErrorException("Write error: " + e.getMessage());
+        }
+      }
+      return length;
+    }
+
+    public int select(int interestOps, Integer timeout) {
+      if ((interestOps & SelectionKey.OP_READ) == 0)
+        return 1;
+
+      synchronized (this) {
+        long deadline = timeout == null ? 0 :
+                        System.currentTimeMillis() + timeout.intValue();
+        while (head == null && queue.isEmpty() && !eof && !closed) {
+          try {
+            if (timeout == null)
+              wait();
+            else {
+              long remaining = deadline - System.currentTimeMillis();
+              if (remaining <= 0) return 0;
+              wait(remaining);
+            }
+          } catch (InterruptedException e) {
+            throw new SystemException(e);
+          }
+        }
+        return 1;
+      }
+    }
+
+    public void close() {
+      synchronized (this) {
+        closed = true;
+        queue.clear();  head = null;
+        notifyAll();
+      }
+      channel.disconnect();
+    }
+
+    private final ChannelDirectTCPIP channel;
+    private OutputStream channelOut;
+    private final Object writeLock = new Object();
+    private final ArrayDeque<byte[]> queue = new ArrayDeque<byte[]>();
+    private byte[] head;
+    private int headPtr;
+    private boolean eof, closed;
+  }
+
+  private String peerHost;
+  private int peerPort;
+}
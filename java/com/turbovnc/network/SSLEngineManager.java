@@ -25,25 +25,36 @@ import javax.net.ssl.SSLEngineResult.*;
 import java.util.concurrent.Executor;
 import java.util.concurrent.Executors;
 
+import com.turbovnc.rdr.EndOfStream;
 import com.turbovnc.rdr.FdInStream;
 import com.turbovnc.rdr.FdOutStream;
 
 public class SSLEngineManager {
 
+  // Size of the TLS record header (content type, version, and length)
+  private static final int RECORD_HEADER_SIZE = 5;
+
   private SSLEngine engine = null;
 
   private int appBufSize;
   private int pktBufSize;
 
-  private ByteBuffer myAppData;
   private ByteBuffer myNetData;
   private ByteBuffer peerAppData;
-  private ByteBuffer peerNetData;
 
   private Executor executor;
   private FdInStream in;
   private FdOutStream os;
 
+  // Time (in nanoseconds) spent encrypting and decrypting data.  Unwrapping is
+  // normally done on the RFB thread and wrapping on any thread that sends an
+  // RFB message, so the two are accumulated separately.
+  private volatile long tUnwrap, tWrap;
+
+  private final Object writeLock = new Object();
+
+  private static final ByteBuffer EMPTY = ByteBuffer.allocate(0);
+
   public SSLEngineManager(SSLEngine sslEngine, FdInStream is_,
                           FdOutStream os_) throws IOException {
 
@@ -56,10 +67,10 @@ public class SSLEngineManager {
     pktBufSize = engine.getSession().getPacketBufferSize();
     appBufSize = engine.getSession().getApplicationBufferSize();
 
-    myAppData = ByteBuffer.allocate(Math.max(appBufSize, os.getBufSize()));
-    myNetData = ByteBuffer.allocate(pktBufSize);
+    // Outgoing TLS records are accumulated in myNetData, so that a batch of
+    // RFB messages can be sent with one write to the socket.
+    myNetData = ByteBuffer.allocate(pktBufSize * 4);
     peerAppData = ByteBuffer.allocate(appBufSize);
-    peerNetData = ByteBuffer.allocate(pktBufSize);
   }
 
   public void doHandshake() throws Exception {
@@ -75,23 +86,17 @@ public class SSLEngineManager {
       switch (hs) {
 
         case NEED_UNWRAP:
-          // Receive handshaking data from peer
-          ((Buffer)peerNetData).flip();
-          SSLEngineResult res = engine.unwrap(peerNetData, peerAppData);
-          peerNetData.compact();
+          // Receive handshaking data from peer.  Any application data that
+          // arrives along with the last handshaking message is left in
+          // peerAppData, which read() drains first.
+          checkRecord(true);
+          SSLEngineResult res = unwrap(peerAppData);
           hs = res.getHandshakeStatus();
 
           // Check status
           switch (res.getStatus()) {
             case BUFFER_UNDERFLOW:
-              int max = Math.min(peerNetData.remaining(), in.getBufSize());
-              int m = in.check(1, max, true);
-              int pos = ((Buffer)peerNetData).position();
-              in.readBytes(peerNetData.array(), pos, m);
-              ((Buffer)peerNetData).position(pos + m);
-              ((Buffer)peerNetData).flip();
-              peerNetData.compact();
-              break;
+              throw new SSLException("Incomplete TLS record");
 
             case OK:
               // Process incoming handshaking data
@@ -108,7 +113,7 @@ public class SSLEngineManager {
           ((Buffer)myNetData).clear();
 
           // Generate handshaking data
-          res = engine.wrap(myAppData, myNetData);
+          res = engine.wrap(EMPTY, myNetData);
           hs = res.getHandshakeStatus();
 
           // Check status
@@ -146,73 +151,180 @@ public class SSLEngineManager {
     }
   }
 
-  public int read(byte[] data, int dataPtr, int length) throws IOException {
-    // Read SSL/TLS encoded data from peer
-    int bytesRead = 0;
-    ((Buffer)peerNetData).flip();
-    SSLEngineResult res = engine.unwrap(peerNetData, peerAppData);
-    peerNetData.compact();
-    switch (res.getStatus()) {
-      case OK:
-        bytesRead = Math.min(length, res.bytesProduced());
-        ((Buffer)peerAppData).flip();
-        peerAppData.get(data, dataPtr, bytesRead);
-        peerAppData.compact();
-        break;
-
-      case BUFFER_UNDERFLOW:
-        // need more net data
-        int pos = ((Buffer)peerNetData).position();
-        // attempt to drain the underlying buffer first
-        int need = peerNetData.remaining();
-        int avail = in.check(1, in.getBufSize(), false);
-        if (avail < need)
-          avail = in.check(1, Math.min(need, in.getBufSize()), true);
-        in.readBytes(peerNetData.array(), pos, Math.min(need, avail));
-        ((Buffer)peerNetData).position(pos + Math.min(need, avail));
-        break;
-
-      case CLOSED:
-        engine.closeInbound();
-        break;
-    }
-    return bytesRead;
+  // Ensure that the FdInStream's buffer contains at least one complete TLS
+  // record, so that the record can be unwrapped in place.  Returns false if
+  // wait is false and a complete record has not yet been received.  nItems is
+  // passed to check() so that, if the FdInStream has to read from the socket,
+  // it reads as much data as is available rather than just one record.
+  private boolean checkRecord(boolean wait) {
+    int bufSize = in.getBufSize();
+    if (in.check(RECORD_HEADER_SIZE, bufSize / RECORD_HEADER_SIZE, wait) == 0)
+      return false;
+    byte[] buf = in.getbuf();
+    int ptr = in.getptr();
+    int recordSize = Math.min(RECORD_HEADER_SIZE +
+      (((buf[ptr + 3] & 0xff) << 8) | (buf[ptr + 4] & 0xff)), bufSize);
+    return in.check(recordSize, bufSize / recordSize, wait) != 0;
   }
 
-  public int write(byte[] data, int dataPtr, int length) throws IOException {
+  // Unwrap one TLS record directly from the FdInStream's buffer.
+  private SSLEngineResult unwrap(ByteBuffer dst) throws IOException {
+    int ptr = in.getptr();
+    ByteBuffer src = ByteBuffer.wrap(in.getbuf(), ptr, in.getend() - ptr);
+    long tStart = System.nanoTime();
+    SSLEngineResult res = engine.unwrap(src, dst);
+    tUnwrap += System.nanoTime() - tStart;
+    in.setptr(((Buffer)src).position());
+    return res;
+  }
+
+  private int drainPeerAppData(byte[] data, int dataPtr, int length) {
+    ((Buffer)peerAppData).flip();
+    int n = Math.min(length, peerAppData.remaining());
+    peerAppData.get(data, dataPtr, n);
+    peerAppData.compact();
+    return n;
+  }
+
+  // Decrypt as many TLS records as are available and will fit into
+  // data[dataPtr .. dataPtr + length - 1].  If wait is true, this blocks until
+  // at least one byte of application data has been decrypted.  When there is
+  // room for a full record, the record is decrypted directly into data, so the
+  // only copy of the incoming data is the one that the cipher makes.
+  public int read(byte[] data, int dataPtr, int length, boolean wait)
+                  throws IOException {
     int n = 0;
-    myAppData.put(data, dataPtr, length);
-    ((Buffer)myAppData).flip();
-    while (myAppData.hasRemaining()) {
-      SSLEngineResult res = engine.wrap(myAppData, myNetData);
-      n += res.bytesConsumed();
+    boolean overflow = false;
+
+    // Return any leftover data from a previous record first.
+    if (((Buffer)peerAppData).position() > 0) {
+      n = drainPeerAppData(data, dataPtr, length);
+      if (((Buffer)peerAppData).position() > 0)
+        return n;
+    }
+
+    while (n < length && checkRecord(wait && n == 0)) {
+      boolean direct = (length - n >= appBufSize && !overflow);
+      ByteBuffer dst = direct ?
+        ByteBuffer.wrap(data, dataPtr + n, length - n) : peerAppData;
+      SSLEngineResult res = unwrap(dst);
+
       switch (res.getStatus()) {
         case OK:
+          if (direct)
+            n += res.bytesProduced();
+          else {
+            n += drainPeerAppData(data, dataPtr + n, length - n);
+            if (((Buffer)peerAppData).position() > 0)
+              return n;
+          }
+          if (res.getHandshakeStatus() ==
+              SSLEngineResult.HandshakeStatus.NEED_TASK)
+            executeTasks();
+          else if (res.getHandshakeStatus() ==
+                   SSLEngineResult.HandshakeStatus.NEED_WRAP)
+            wrapHandshake();
           break;
 
         case BUFFER_OVERFLOW:
-          // Make room in the buffer by flushing the outstream
-          ((Buffer)myNetData).flip();
-          os.writeBytes(myNetData.array(), 0, myNetData.remaining());
-          os.flush();
-          ((Buffer)myNetData).clear();
+          // The record did not fit.  Decrypt it into peerAppData instead,
+          // growing peerAppData if it was already too small.  (It is empty at
+          // this point, so it can simply be replaced.)  Growing the buffer
+          // even if the session's application buffer size has not changed
+          // ensures that this loop cannot spin.
+          if (!direct) {
+            appBufSize =
+              Math.max(engine.getSession().getApplicationBufferSize(),
+                       peerAppData.capacity() * 2);
+            peerAppData = ByteBuffer.allocate(appBufSize);
+          }
+          overflow = true;
           break;
 
+        case BUFFER_UNDERFLOW:
+          // checkRecord() should have prevented this.
+          throw new SSLException("Incomplete TLS record");
+
         case CLOSED:
-          engine.closeOutbound();
+          engine.closeInbound();
+          if (n == 0)
+            throw new EndOfStream();
+          return n;
+      }
+    }
+    return n;
+  }
+
+  // Send any post-handshake messages that the engine has to generate in
+  // response to a message from the peer (for instance, the response to a
+  // TLS 1.3 KeyUpdate request.)
+  private void wrapHandshake() throws IOException {
+    synchronized (writeLock) {
+      while (engine.getHandshakeStatus() ==
+             SSLEngineResult.HandshakeStatus.NEED_WRAP) {
+        SSLEngineResult res = engine.wrap(EMPTY, myNetData);
+        if (res.getStatus() != Status.OK || res.bytesProduced() == 0)
           break;
       }
+      flushNetData(true);
+    }
+  }
+
+  // Encrypt data[dataPtr .. dataPtr + length - 1] without first copying it
+  // into an intermediate buffer, accumulate the resulting TLS records, and
+  // send them with as few socket writes as possible.
+  public int write(byte[] data, int dataPtr, int length) throws IOException {
+    ByteBuffer src = ByteBuffer.wrap(data, dataPtr, length);
+
+    synchronized (writeLock) {
+      while (src.hasRemaining()) {
+        if (myNetData.remaining() < pktBufSize)
+          flushNetData(false);
+
+        long tStart = System.nanoTime();
+        SSLEngineResult res = engine.wrap(src, myNetData);
+        tWrap += System.nanoTime() - tStart;
+
+        switch (res.getStatus()) {
+          case OK:
+            break;
+
+          case BUFFER_OVERFLOW:
+            // The packet buffer size of the session has increased.
+            flushNetData(false);
+            pktBufSize = engine.getSession().getPacketBufferSize();
+            if (myNetData.capacity() < pktBufSize)
+              myNetData = ByteBuffer.allocate(pktBufSize * 4);
+            break;
+
+          case CLOSED:
+            engine.closeOutbound();
+            throw new SSLException("TLS connection closed");
+        }
+      }
+      flushNetData(true);
     }
-    ((Buffer)myAppData).clear();
+    return length;
+  }
+
+  private void flushNetData(boolean flushOutStream) {
     ((Buffer)myNetData).flip();
     os.writeBytes(myNetData.array(), 0, myNetData.remaining());
-    os.flush();
+    if (flushOutStream)
+      os.flush();
     ((Buffer)myNetData).clear();
-    return n;
   }
 
   public SSLSession getSession() {
     return engine.getSession();
   }
 
+  public double getTLSTime() {
+    return (double)(tUnwrap + tWrap) / 1000000000.;
+  }
+
+  public void resetTLSTime() {
+    tUnwrap = tWrap = 0;
+  }
+
 }
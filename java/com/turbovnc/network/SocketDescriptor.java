@@ -76,7 +76,7 @@ public class SocketDescriptor implements FileDescriptor {
 
   public synchronized int read(byte[] buf, int bufPtr, int length) {
     int n;
-    ByteBuffer b = ByteBuffer.allocate(length);
+    ByteBuffer b = ByteBuffer.wrap(buf, bufPtr, length);
     try {
       n = channel.read(b);
     } catch (IOException e) {
@@ -84,11 +84,7 @@ public class SocketDescriptor implements FileDescriptor {
     }
     if (n <= 0)
       return (n == 0) ? -1 : 0;
-    ((Buffer)b).flip();
-    b.get(buf, bufPtr, n);
-    ((Buffer)b).clear();
     return n;
-
   }
 
   public synchronized int write(byte[] buf, int bufPtr, int length) {
@@ -105,7 +101,10 @@ public class SocketDescriptor implements FileDescriptor {
     return n;
   }
 
-  public synchronized int select(int interestOps, Integer timeout) {
+  // The read and write selectors are locked independently, so that a thread
+  // that is waiting for incoming data does not prevent other threads from
+  // writing.
+  public int select(int interestOps, Integer timeout) {
     int n;
     Selector selector;
     if ((interestOps & SelectionKey.OP_READ) != 0) {
@@ -113,23 +112,25 @@ public class SocketDescriptor implements FileDescriptor {
     } else {
       selector = writeSelector;
     }
-    selector.selectedKeys().clear();
-    try {
-      if (timeout == null) {
-        n = selector.select();
-      } else {
-        int tv = timeout.intValue();
-        switch (tv) {
-          case 0:
-            n = selector.selectNow();
-            break;
-          default:
-            n = selector.select((long)tv);
-            break;
+    synchronized (selector) {
+      selector.selectedKeys().clear();
+      try {
+        if (timeout == null) {
+          n = selector.select();
+        } else {
+          int tv = timeout.intValue();
+          switch (tv) {
+            case 0:
+              n = selector.selectNow();
+              break;
+            default:
+              n = selector.select((long)tv);
+              break;
+          }
         }
+      } catch (IOException e) {
+        throw new SystemException(e);
       }
-    } catch (IOException e) {
-      throw new SystemException(e);
     }
     return n;
   }
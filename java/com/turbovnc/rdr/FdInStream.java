@@ -22,11 +22,14 @@ package com.turbovnc.rdr;
 
 import com.turbovnc.network.*;
 import java.nio.channels.SelectionKey;
+import java.util.concurrent.*;
 
 public class FdInStream extends InStream {
 
   static final int DEFAULT_BUF_SIZE = 131072;
   static final int MIN_BULK_SIZE = 1024;
+  static final int RECV_BUFFERS = 8;
+  static final int RECV_POLL_MS = 100;
 
   static final double getTime() {
     return (double)System.nanoTime() / 1.0e9;
@@ -46,6 +49,8 @@ public class FdInStream extends InStream {
   public void resetReadTime() { tRead = 0.0; }
   public double getBytesRead() { return bytesRead; }
   public void resetBytesRead() { bytesRead = 0; }
+  public long getRecvStalls() { return recvStalls; }
+  public void resetRecvStalls() { recvStalls = 0; }
 
   public FdInStream(FileDescriptor fd_) { this(fd_, -1, 0, false); }
 
@@ -173,6 +178,34 @@ public class FdInStream extends InStream {
     if (timing)
       before = System.nanoTime();
 
+    int n;
+    if (recvThread != null)
+      n = readFromRecvThread(buf, bufPtr, len, wait);
+    else
+      n = readFromFd(buf, bufPtr, len, wait);
+    if (n == 0) return 0;
+
+    if (timing) {
+      long after = System.nanoTime();
+      long newTimeWaited = (after - before) / 100000;
+      int newKbits = n * 8 / 1000;
+
+      // limit rate to between 10kbit/s and 40Mbit/s
+
+      if (newTimeWaited > newKbits * 1000) {
+        newTimeWaited = newKbits * 1000;
+      } else if (newTimeWaited < newKbits / 4) {
+        newTimeWaited = newKbits / 4;
+      }
+
+      timeWaitedIn100us += newTimeWaited;
+      timedKbits += newKbits;
+    }
+
+    return n;
+  }
+
+  private int readFromFd(byte[] buf, int bufPtr, int len, boolean wait) {
     int n;
     while (true) {
       do {
@@ -200,29 +233,132 @@ public class FdInStream extends InStream {
     n = fd.read(buf, bufPtr, len);
 
     if (n == 0) throw new EndOfStream();
+    return n;
+  }
 
-    if (timing) {
-      long after = System.nanoTime();
-      long newTimeWaited = (after - before) / 100000;
-      int newKbits = n * 8 / 1000;
+  private int readWithTimeoutOrCallback(byte[] buf, int bufPtr, int len) {
+    return readWithTimeoutOrCallback(buf, bufPtr, len, true);
+  }
 
-      // limit rate to between 10kbit/s and 40Mbit/s
+  // Start a thread that drains the socket into a bounded ring of buffers, so
+  // that the TCP receive window does not fill up while the consumer is busy
+  // decoding.  Once the receive thread is running, all reads from the file
+  // descriptor must go through this stream.
+  public synchronized void startRecvThread() {
+    if (recvThread != null)
+      return;
+    fullBufs = new ArrayBlockingQueue<RecvBuffer>(RECV_BUFFERS);
+    freeBufs = new ArrayBlockingQueue<RecvBuffer>(RECV_BUFFERS);
+    for (int i = 0; i < RECV_BUFFERS; i++)
+      freeBufs.add(new RecvBuffer(bufSize));
+    recvStopped = false;
+    recvThread = new Thread(new Runnable() {
+      public void run() {
+        recvLoop();
+      }
+    }, "RecvThread");
+    recvThread.setDaemon(true);
+    recvThread.start();
+  }
 
-      if (newTimeWaited > newKbits * 1000) {
-        newTimeWaited = newKbits * 1000;
-      } else if (newTimeWaited < newKbits / 4) {
-        newTimeWaited = newKbits / 4;
+  public synchronized void stopRecvThread() {
+    recvStopped = true;
+  }
+
+  private void recvLoop() {
+    try {
+      while (!recvStopped) {
+        RecvBuffer rb = freeBufs.poll();
+        if (rb == null) {
+          // The consumer has fallen behind, and the ring is full.
+          recvStalls++;
+          while (rb == null && !recvStopped)
+            rb = freeBufs.poll(RECV_POLL_MS, TimeUnit.MILLISECONDS);
+          if (rb == null) break;
+        }
+
+        int n;
+        while ((n = fd.read(rb.data, 0, rb.data.length)) < 0) {
+          // Nothing to read.  The select() timeout allows the thread to notice
+          // when it has been stopped.
+          if (recvStopped) return;
+          fd.select(SelectionKey.OP_READ, Integer.valueOf(RECV_POLL_MS));
+        }
+        rb.len = n;
+        rb.pos = 0;
+        if (!queueRecvBuffer(rb)) return;
+        // A zero-length buffer signals the end of the stream.
+        if (n == 0) break;
       }
+    } catch (Exception e) {
+      RecvBuffer rb = new RecvBuffer(0);
+      rb.error = e;
+      try {
+        queueRecvBuffer(rb);
+      } catch (InterruptedException e2) {}
+    }
+  }
 
-      timeWaitedIn100us += newTimeWaited;
-      timedKbits += newKbits;
+  // Pass a buffer to the consumer.  If the ring is full, wait until the
+  // consumer frees a slot, but give up if the thread has been stopped (the
+  // consumer may never read from the ring again.)  Returns false if the
+  // thread was stopped.
+  private boolean queueRecvBuffer(RecvBuffer rb) throws InterruptedException {
+    while (!fullBufs.offer(rb, RECV_POLL_MS, TimeUnit.MILLISECONDS)) {
+      if (recvStopped) return false;
+    }
+    return true;
+  }
+
+  private int readFromRecvThread(byte[] buf, int bufPtr, int len,
+                                 boolean wait) {
+    // This handles timeouts and the block callback in the same way as
+    // readFromFd().
+    while (curBuf == null) {
+      try {
+        if (!wait)
+          curBuf = fullBufs.poll();
+        else if (timeoutms != -1)
+          curBuf = fullBufs.poll(timeoutms, TimeUnit.MILLISECONDS);
+        else
+          curBuf = fullBufs.take();
+      } catch (InterruptedException e) {
+        throw new SystemException(e);
+      }
+      if (curBuf != null) break;
+      if (!wait) return 0;
+      if (blockCallback == null) throw new TimedOut();
+
+      blockCallback.blockCallback();
     }
 
+    // Leave an error or end-of-stream marker in place so that subsequent
+    // reads fail in the same way.
+    if (curBuf.error != null) {
+      if (curBuf.error instanceof RuntimeException)
+        throw (RuntimeException)curBuf.error;
+      throw new SystemException(curBuf.error);
+    }
+    if (curBuf.len == 0) throw new EndOfStream();
+
+    int n = Math.min(len, curBuf.len - curBuf.pos);
+    System.arraycopy(curBuf.data, curBuf.pos, buf, bufPtr, n);
+    curBuf.pos += n;
+    if (curBuf.pos == curBuf.len) {
+      freeBufs.offer(curBuf);
+      curBuf = null;
+    }
     return n;
   }
 
-  private int readWithTimeoutOrCallback(byte[] buf, int bufPtr, int len) {
-    return readWithTimeoutOrCallback(buf, bufPtr, len, true);
+  private static class RecvBuffer {
+    RecvBuffer(int size) {
+      data = new byte[size];
+    }
+
+    byte[] data;
+    int pos, len;
+    Exception error;
   }
 
   public FileDescriptor getFd() {
@@ -250,4 +386,10 @@ public class FdInStream extends InStream {
 
   double tRead;
   long bytesRead;
+
+  private Thread recvThread;
+  private volatile boolean recvStopped;
+  private volatile long recvStalls;
+  private ArrayBlockingQueue<RecvBuffer> fullBufs, freeBufs;
+  private RecvBuffer curBuf;
 }
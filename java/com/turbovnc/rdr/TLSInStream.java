@@ -29,14 +29,17 @@ import com.turbovnc.network.*;
 
 public class TLSInStream extends InStream {
 
-  static final int DEFAULT_BUF_SIZE = 16384;
+  static final int DEFAULT_BUF_SIZE = 131072;
 
   public TLSInStream(InStream in_, SSLEngineManager manager_) {
     in = (FdInStream)in_;
     manager = manager_;
     offset = 0;
+    // The buffer must be large enough to hold several TLS records, so that
+    // SSLEngineManager can usually decrypt records directly into it.
     SSLSession session = manager.getSession();
-    bufSize = session.getApplicationBufferSize();
+    bufSize = Math.max(DEFAULT_BUF_SIZE,
+                       session.getApplicationBufferSize() * 2);
     b = new byte[bufSize];
     ptr = end = start = 0;
   }
@@ -61,6 +64,14 @@ public class TLSInStream extends InStream {
     return in.timeWaited();
   }
 
+  public final double getTLSTime() {
+    return manager.getTLSTime();
+  }
+
+  public final void resetTLSTime() {
+    manager.resetTLSTime();
+  }
+
   protected final int overrun(int itemSize, int nItems, boolean wait) {
     if (itemSize > bufSize)
       throw new ErrorException("TLSInStream overrun: max itemSize exceeded");
@@ -88,12 +99,8 @@ public class TLSInStream extends InStream {
   protected int readTLS(byte[] buf, int bufPtr, int len, boolean wait) {
     int n = -1;
 
-    //n = in.check(1, 1, wait);
-    //if (n == 0)
-    //  return 0;
-
     try {
-      n = manager.read(buf, bufPtr, len);
+      n = manager.read(buf, bufPtr, len, wait);
     } catch (java.io.IOException e) {
       throw new ErrorException("TLS read error: " + e.getMessage());
     }
@@ -29,13 +29,16 @@ import com.turbovnc.network.*;
 
 public class TLSOutStream extends OutStream {
 
-  static final int DEFAULT_BUF_SIZE = 16384;
+  static final int DEFAULT_BUF_SIZE = 65536;
 
   public TLSOutStream(OutStream out_, SSLEngineManager manager_) {
     manager = manager_;
     out = (FdOutStream)out_;
+    // RFB messages are accumulated until the stream is flushed, at which point
+    // SSLEngineManager encrypts them and sends the resulting TLS records
+    // together.
     SSLSession session = manager.getSession();
-    bufSize = session.getApplicationBufferSize();
+    bufSize = Math.max(DEFAULT_BUF_SIZE, session.getApplicationBufferSize());
     b = new byte[bufSize];
     ptr = offset = start = 0;
     end = start + bufSize;
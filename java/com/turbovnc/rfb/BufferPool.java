@@ -0,0 +1,171 @@
+/* Copyright (C) 2026 agent.  All Rights Reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ */
+
+//
+// BufferPool - recycles the temporary buffers used by the decoders
+//
+// Decoding a framebuffer update requires a number of temporary buffers
+// (compressed data, inflated data, palettes, etc.) whose sizes depend on the
+// rectangle being decoded.  Allocating a new buffer for each rectangle causes
+// the Java heap to fill up quickly at high update rates, and the resulting
+// garbage collection pauses are visible as stutter.  Thus, the decoders
+// obtain their temporary buffers from this pool and return them when they are
+// finished with them.
+//
+// Buffers are grouped into power-of-two size classes, so a buffer may be
+// larger than requested.  Each size class retains a limited number of free
+// buffers, and buffers larger than MAX_POOLED_SIZE elements are never pooled.
+// All methods are thread-safe, since buffers are often obtained on the RFB
+// thread and released on a decoding thread.
+//
+
+package com.turbovnc.rfb;
+
+import java.util.*;
+
+public final class BufferPool {
+
+  public static byte[] getBytes(int size) {
+    return (byte[])get(BYTE, size);
+  }
+
+  public static short[] getShorts(int size) {
+    return (short[])get(SHORT, size);
+  }
+
+  public static int[] getInts(int size) {
+    return (int[])get(INT, size);
+  }
+
+  // Return a buffer to the pool.  buf may be null, and it may be a buffer
+  // that was not obtained from the pool, in which case it is discarded.  The
+  // caller must not use the buffer after releasing it.
+  public static void release(Object buf) {
+    if (buf == null)
+      return;
+    int type, length;
+    if (buf instanceof byte[]) {
+      type = BYTE;  length = ((byte[])buf).length;
+    } else if (buf instanceof short[]) {
+      type = SHORT;  length = ((short[])buf).length;
+    } else if (buf instanceof int[]) {
+      type = INT;  length = ((int[])buf).length;
+    } else
+      return;
+    int sizeClass = sizeClass(length);
+    if (sizeClass < 0 || (1 << (sizeClass + MIN_SHIFT)) != length)
+      return;
+    ArrayDeque<Object> list = free[type][sizeClass];
+    int maxFree = (long)length * ELEMENT_SIZE[type] <= LARGE_SIZE ?
+                  MAX_FREE : MAX_FREE_LARGE;
+    synchronized (list) {
+      if (list.size() < maxFree)
+        list.push(buf);
+    }
+  }
+
+  // Replace buf with a pooled buffer of at least the specified size, if it
+  // is too small.  The contents of buf are not preserved.
+  public static byte[] checkBytes(byte[] buf, int size) {
+    if (buf != null && buf.length >= size)
+      return buf;
+    release(buf);
+    return getBytes(size);
+  }
+
+  // Return the number of bytes that the pool has allocated (because no
+  // suitable free buffer was available) and the number of requests that were
+  // satisfied by a free buffer, since the last call to resetStats().
+  public static synchronized long getBytesAllocated() {
+    return bytesAllocated;
+  }
+
+  public static synchronized long getHits() { return hits; }
+
+  public static synchronized void resetStats() {
+    bytesAllocated = hits = 0;
+  }
+
+  private static Object get(int type, int size) {
+    if (size < 0)
+      throw new IllegalArgumentException("Invalid buffer size " + size);
+    int sizeClass = sizeClass(size);
+    if (sizeClass >= 0) {
+      ArrayDeque<Object> list = free[type][sizeClass];
+      synchronized (list) {
+        if (!list.isEmpty()) {
+          countHit();
+          return list.pop();
+        }
+      }
+      size = 1 << (sizeClass + MIN_SHIFT);
+    }
+    countAllocation((long)size * ELEMENT_SIZE[type]);
+    switch (type) {
+      case BYTE:   return new byte[size];
+      case SHORT:  return new short[size];
+      default:     return new int[size];
+    }
+  }
+
+  private static int sizeClass(int size) {
+    if (size > MAX_POOLED_SIZE)
+      return -1;
+    int shift = 32 - Integer.numberOfLeadingZeros(Math.max(size, 1) - 1);
+    return Math.max(shift - MIN_SHIFT, 0);
+  }
+
+  private static synchronized void countAllocation(long bytes) {
+    bytesAllocated += bytes;
+  }
+
+  private static synchronized void countHit() {
+    hits++;
+  }
+
+  private BufferPool() {}
+
+  private static final int BYTE = 0, SHORT = 1, INT = 2;
+  private static final int[] ELEMENT_SIZE = { 1, 2, 4 };
+  // Smallest size class = 256 elements (which is also the size of a Tight
+  // palette)
+  private static final int MIN_SHIFT = 8;
+  // Largest size class = 32 M elements
+  private static final int MAX_SHIFT = 25;
+  private static final int MAX_POOLED_SIZE = 1 << MAX_SHIFT;
+  // Maximum number of free buffers in each size class.  This needs to be at
+  // least as large as the number of rectangles that can be in flight on the
+  // decoding threads.  Fewer buffers larger than LARGE_SIZE bytes are
+  // retained, in order to limit the memory footprint of the pool.
+  private static final int MAX_FREE = 16;
+  private static final int MAX_FREE_LARGE = 2;
+  private static final long LARGE_SIZE = 1 << 20;
+
+  private static final ArrayDeque<Object>[][] free = newFreeLists();
+  private static long bytesAllocated, hits;
+
+  @SuppressWarnings("unchecked")
+  private static ArrayDeque<Object>[][] newFreeLists() {
+    int nClasses = MAX_SHIFT - MIN_SHIFT + 1;
+    ArrayDeque<Object>[][] lists = new ArrayDeque[3][nClasses];
+    for (int type = 0; type < 3; type++)
+      for (int i = 0; i < nClasses; i++)
+        lists[type][i] = new ArrayDeque<Object>();
+    return lists;
+  }
+}
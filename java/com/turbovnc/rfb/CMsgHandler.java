@@ -89,8 +89,19 @@ public abstract class CMsgHandler {
   public abstract void bell();
   public abstract void serverCutText(String str, int len);
 
+  public void handleClipboardCaps(int flags, int[] sizes) {
+    cp.clipboardFlags = flags;
+    cp.clipboardSizes = sizes;
+  }
+
+  public abstract void handleClipboardRequest(int flags);
+  public abstract void handleClipboardPeek(int flags);
+  public abstract void handleClipboardNotify(int flags);
+  public abstract void handleClipboardProvide(int flags, String text);
+
   public abstract void fillRect(Rect r, int pix);
   public abstract void imageRect(Rect r, Object pixels);
+  public abstract void getImageRect(Rect r, int[] pixels);
   public abstract void copyRect(Rect r, int srcX, int srcY);
 
   public abstract Object getRawPixelsRW(int[] stride);
@@ -24,6 +24,12 @@
 
 package com.turbovnc.rfb;
 
+import java.io.ByteArrayInputStream;
+import java.io.DataInputStream;
+import java.io.IOException;
+import java.util.zip.Inflater;
+import java.util.zip.InflaterInputStream;
+
 import com.turbovnc.rdr.*;
 
 public abstract class CMsgReader {
@@ -35,6 +41,7 @@ public abstract class CMsgReader {
     imageBuf = null;
     imageBufSize = 0;
     decoders = new Decoder[RFB.ENCODING_MAX + 1];
+    decodeManager = new DecodeManager(handler);
   }
 
   protected void readSetColourMapEntries() {
@@ -53,7 +60,11 @@ public abstract class CMsgReader {
 
   protected void readServerCutText() {
     is.skip(3);
-    int len = is.readU32();
+    int len = is.readS32();
+    if (len < 0) {
+      readExtendedClipboard(-len);
+      return;
+    }
     if (len > 256 * 1024) {
       is.skip(len);
       vlog.error("cut text too long (" + len + " bytes) - ignoring");
@@ -70,11 +81,89 @@ public abstract class CMsgReader {
     handler.serverCutText(str, len);
   }
 
+  // A ServerCutText message with a negative length is an extended clipboard
+  // message.
+  protected void readExtendedClipboard(int len) {
+    if (len < 4)
+      throw new ErrorException("Invalid extended clipboard message");
+    int flags = is.readU32();
+    len -= 4;
+
+    if ((flags & RFB.EXTCLIP_CAPS) != 0) {
+      int[] sizes = new int[16];
+      for (int i = 0; i < 16; i++) {
+        if ((flags & (1 << i)) == 0) continue;
+        if (len < 4) break;
+        sizes[i] = is.readU32();
+        len -= 4;
+      }
+      is.skip(len);
+      handler.handleClipboardCaps(flags, sizes);
+      return;
+    }
+
+    if ((flags & RFB.EXTCLIP_PROVIDE) == 0) {
+      is.skip(len);
+      if ((flags & RFB.EXTCLIP_REQUEST) != 0)
+        handler.handleClipboardRequest(flags);
+      else if ((flags & RFB.EXTCLIP_PEEK) != 0)
+        handler.handleClipboardPeek(flags);
+      else if ((flags & RFB.EXTCLIP_NOTIFY) != 0)
+        handler.handleClipboardNotify(flags);
+      return;
+    }
+
+    int maxLen = Params.maxClipboard.getValue();
+    if (len > maxLen) {
+      is.skip(len);
+      vlog.error("compressed clipboard data too long (" + len +
+                 " bytes) - ignoring");
+      return;
+    }
+    byte[] zbuf = new byte[len];
+    is.readBytes(zbuf, 0, len);
+    if ((flags & RFB.EXTCLIP_TEXT) == 0)
+      return;
+
+    // The text is UTF-8 with CRLF line endings and a terminating NUL
+    // character.  Decompress no more of it than is necessary to hold
+    // maxLen characters.
+    String str = null;
+    Inflater inflater = new Inflater();
+    try {
+      DataInputStream dis = new DataInputStream(
+        new InflaterInputStream(new ByteArrayInputStream(zbuf), inflater));
+      int textLen = dis.readInt();
+      if (textLen < 0 || textLen > maxLen * 4) {
+        vlog.error("Truncating " + (textLen & 0xFFFFFFFFL) +
+                   "-byte clipboard update to " + maxLen + " characters");
+        textLen = maxLen * 4;
+      }
+      byte[] buf = new byte[textLen];
+      dis.readFully(buf);
+      while (textLen > 0 && buf[textLen - 1] == 0) textLen--;
+      str = new String(buf, 0, textLen, "UTF-8").replace("\r\n", "\n");
+      if (str.length() > maxLen)
+        str = str.substring(0, maxLen);
+    } catch (IOException e) {
+      vlog.error("Invalid clipboard data: " + e.getMessage());
+      return;
+    } finally {
+      inflater.end();
+    }
+    handler.handleClipboardProvide(flags, str);
+  }
+
   protected void readFramebufferUpdateStart() {
     handler.framebufferUpdateStart();
   }
 
   protected void readFramebufferUpdateEnd() {
+    // Any rectangles that are still being decoded must be drawn before the
+    // update is finished.
+    handler.startDecodeTimer();
+    decodeManager.flush();
+    handler.stopDecodeTimer();
     handler.framebufferUpdateEnd();
   }
 
@@ -103,6 +192,10 @@ public abstract class CMsgReader {
         }
       }
       handler.startDecodeTimer();
+      // The Tight decoder manages its own dependencies.  All other decoders
+      // draw directly into the framebuffer.
+      if (encoding != RFB.ENCODING_TIGHT)
+        decodeManager.waitFor(r);
       decoders[encoding].readRect(r, handler);
       handler.stopDecodeTimer();
     }
@@ -113,6 +206,9 @@ public abstract class CMsgReader {
   protected void readCopyRect(Rect r) {
     int srcX = is.readU16();
     int srcY = is.readU16();
+    decodeManager.waitFor(r);
+    decodeManager.waitFor(new Rect(srcX, srcY, srcX + r.width(),
+                                   srcY + r.height()));
     handler.copyRect(r, srcX, srcY);
   }
 
@@ -186,8 +282,9 @@ public abstract class CMsgReader {
       size = requiredBytes;
 
     if (imageBufSize < size) {
-      imageBufSize = size;
-      imageBuf = new int[imageBufSize];
+      BufferPool.release(imageBuf);
+      imageBuf = BufferPool.getInts(size);
+      imageBufSize = imageBuf.length;
     }
     if (nPixels != 0)
       nPixels = imageBufSize / (handler.cp.pf().bpp / 8);
@@ -206,6 +303,7 @@ public abstract class CMsgReader {
   }
 
   public final void reset() {
+    decodeManager.flush();
     for (int i = 0; i < RFB.ENCODING_MAX; i++) {
       if (decoders[i] != null)
         decoders[i].reset();
@@ -213,6 +311,7 @@ public abstract class CMsgReader {
   }
 
   public final void close() {
+    decodeManager.close();
     for (int i = 0; i < RFB.ENCODING_MAX; i++) {
       if (decoders[i] != null)
         decoders[i].close();
@@ -226,11 +325,14 @@ public abstract class CMsgReader {
 
   public InStream getInStream() { return is; }
 
+  public DecodeManager getDecodeManager() { return decodeManager; }
+
   int imageBufIdealSize;
 
   protected CMsgHandler handler;
   protected InStream is;
   protected Decoder[] decoders;
+  protected DecodeManager decodeManager;
   protected int[] imageBuf;
   protected int imageBufSize;
 
@@ -100,6 +100,12 @@ public class CMsgReaderV3 extends CMsgReader {
       int h = is.readU16();
       int encoding = is.readS32();
 
+      // Pseudo-encodings may resize the framebuffer or draw into it, so any
+      // rectangles that are still being decoded must be finished first.
+      if (encoding < 0 && encoding != RFB.ENCODING_DESKTOP_NAME &&
+          encoding != RFB.ENCODING_LAST_RECT)
+        decodeManager.flush();
+
       switch (encoding) {
         case RFB.ENCODING_NEW_FB_SIZE:
           handler.setDesktopSize(w, h);
@@ -122,13 +128,17 @@ public class CMsgReaderV3 extends CMsgReader {
         case RFB.ENCODING_CLIENT_REDIRECT:
           readClientRedirect(x, y, w, h);
           break;
+        case RFB.ENCODING_TILE_CACHE_STORE:
+        case RFB.ENCODING_TILE_CACHE_REF:
+          readTileCacheRect(new Rect(x, y, x + w, y + h), encoding);
+          break;
         default:
           readRect(new Rect(x, y, x + w, y + h), encoding);
           break;
       }
 
       nUpdateRectsLeft--;
-      if (nUpdateRectsLeft == 0) handler.framebufferUpdateEnd();
+      if (nUpdateRectsLeft == 0) readFramebufferUpdateEnd();
     }
   }
 
@@ -138,6 +148,21 @@ public class CMsgReaderV3 extends CMsgReader {
     handler.framebufferUpdateStart();
   }
 
+  void readTileCacheRect(Rect r, int encoding) {
+    int slot = is.readS32();
+
+    if (tileCache == null) {
+      int level = TileCache.getSizeLevel();
+      if (level < 0)
+        throw new ErrorException("Unexpected tile cache rectangle");
+      tileCache = new TileCache(256 << level);
+    }
+    if (encoding == RFB.ENCODING_TILE_CACHE_STORE)
+      tileCache.store(r, slot, handler);
+    else
+      tileCache.draw(r, slot, handler);
+  }
+
   void readSetDesktopName(int x, int y, int w, int h) {
     String name = is.readString();
 
@@ -256,6 +281,7 @@ public class CMsgReaderV3 extends CMsgReader {
   }
 
   int nUpdateRectsLeft;
+  TileCache tileCache;
 
   static LogWriter vlog = new LogWriter("CMsgReaderV3");
 }
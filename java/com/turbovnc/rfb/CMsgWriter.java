@@ -22,8 +22,14 @@
 
 package com.turbovnc.rfb;
 
+import java.io.ByteArrayOutputStream;
+import java.io.DataOutputStream;
+import java.io.IOException;
 import java.nio.ByteBuffer;
 import java.nio.charset.Charset;
+import java.util.zip.Deflater;
+import java.util.zip.DeflaterOutputStream;
+
 import com.turbovnc.rdr.*;
 
 public abstract class CMsgWriter {
@@ -77,6 +83,8 @@ public abstract class CMsgWriter {
     }
     if (Utils.getBooleanProperty("turbovnc.gii", true))
       encodings[nEncodings++] = RFB.ENCODING_GII;
+    if (Utils.getBooleanProperty("turbovnc.extclipboard", true))
+      encodings[nEncodings++] = RFB.ENCODING_EXTENDED_CLIPBOARD;
 
     if (Decoder.supported(preferredEncoding)) {
       encodings[nEncodings++] = preferredEncoding;
@@ -134,6 +142,22 @@ public abstract class CMsgWriter {
       if (qualityLevel > 9) qualityLevel = 9;
       encodings[nEncodings++] = RFB.ENCODING_QUALITY_LEVEL_0 + qualityLevel;
     }
+    // Server-side scaling requires the server to be able to tell us about the
+    // scaled framebuffer size.
+    if (opts.serverScale >= 1 && opts.serverScale < 100 &&
+        (cp.supportsDesktopResize || cp.supportsExtendedDesktopSize))
+      encodings[nEncodings++] =
+        RFB.ENCODING_SERVER_SCALE_1 + opts.serverScale - 1;
+    int tileCacheLevel = TileCache.getSizeLevel();
+    if (tileCacheLevel >= 0)
+      encodings[nEncodings++] = RFB.ENCODING_TILE_CACHE_256 + tileCacheLevel;
+    if (Utils.getBooleanProperty("turbovnc.lz4", true) &&
+        Decoder.supported(RFB.ENCODING_TIGHT))
+      encodings[nEncodings++] = RFB.ENCODING_TIGHT_LZ4;
+    // The viewer's pixel buffer keeps its contents when the remote desktop is
+    // resized, so the server need not resend the whole framebuffer.
+    if (cp.supportsDesktopResize || cp.supportsExtendedDesktopSize)
+      encodings[nEncodings++] = RFB.ENCODING_RESIZE_KEEP_CONTENT;
 
     writeSetEncodings(nEncodings, encodings);
   }
@@ -185,6 +209,80 @@ public abstract class CMsgWriter {
     endMsg();
   }
 
+  public synchronized void writeClipboardCaps(int flags, int[] sizes) {
+    if ((cp.clipboardFlags & RFB.EXTCLIP_CAPS) == 0)
+      throw new ErrorException("Server does not support extended clipboard");
+
+    int count = 0;
+    for (int i = 0; i < 16; i++)
+      if ((flags & (1 << i)) != 0) count++;
+
+    startMsg(RFB.CLIENT_CUT_TEXT);
+    os.pad(3);
+    os.writeS32(-(4 + count * 4));
+    os.writeU32(flags | RFB.EXTCLIP_CAPS);
+    for (int i = 0; i < 16; i++)
+      if ((flags & (1 << i)) != 0) os.writeU32(sizes[i]);
+    endMsg();
+  }
+
+  public synchronized void writeClipboardRequest(int flags) {
+    writeClipboardAction(RFB.EXTCLIP_REQUEST, flags);
+  }
+
+  public synchronized void writeClipboardPeek(int flags) {
+    writeClipboardAction(RFB.EXTCLIP_PEEK, flags);
+  }
+
+  public synchronized void writeClipboardNotify(int flags) {
+    writeClipboardAction(RFB.EXTCLIP_NOTIFY, flags);
+  }
+
+  // Send text using an extended clipboard Provide message.  The text is
+  // converted to UTF-8 with CRLF line endings and compressed using zlib.
+  public synchronized void writeClipboardProvide(String str) {
+    if ((cp.clipboardFlags & RFB.EXTCLIP_PROVIDE) == 0)
+      throw new ErrorException("Server does not support clipboard action " +
+                               Integer.toHexString(RFB.EXTCLIP_PROVIDE));
+
+    byte[] text;
+    ByteArrayOutputStream bos = new ByteArrayOutputStream();
+    Deflater deflater = new Deflater(Deflater.BEST_SPEED);
+    try {
+      text = str.replace("\r\n", "\n").replace("\n", "\r\n")
+                .getBytes("UTF-8");
+      DataOutputStream dos =
+        new DataOutputStream(new DeflaterOutputStream(bos, deflater));
+      dos.writeInt(text.length + 1);
+      dos.write(text);
+      dos.write(0);
+      dos.close();
+    } catch (IOException e) {
+      throw new SystemException(e);
+    } finally {
+      deflater.end();
+    }
+
+    startMsg(RFB.CLIENT_CUT_TEXT);
+    os.pad(3);
+    os.writeS32(-(4 + bos.size()));
+    os.writeU32(RFB.EXTCLIP_PROVIDE | RFB.EXTCLIP_TEXT);
+    os.writeBytes(bos.toByteArray(), 0, bos.size());
+    endMsg();
+  }
+
+  private void writeClipboardAction(int action, int flags) {
+    if ((cp.clipboardFlags & action) == 0)
+      throw new ErrorException("Server does not support clipboard action " +
+                               Integer.toHexString(action));
+
+    startMsg(RFB.CLIENT_CUT_TEXT);
+    os.pad(3);
+    os.writeS32(-4);
+    os.writeU32(action | (flags & RFB.EXTCLIP_FORMAT_MASK));
+    endMsg();
+  }
+
   public abstract void startMsg(int type);
   public abstract void endMsg();
 
@@ -120,6 +120,12 @@ public class ConnParams {
   public boolean supportsLastRect;
   public boolean supportsGII;
 
+  // Extended clipboard capabilities of the server (0 if the server does not
+  // support the extended clipboard extension) and the maximum size of
+  // unsolicited data that the server will accept in each format
+  public int clipboardFlags;
+  public int[] clipboardSizes = new int[16];
+
   public boolean supportsSetDesktopSize;
   // CHECKSTYLE VisibilityModifier:ON
 
@@ -0,0 +1,231 @@
+/* Copyright (C) 2026 agent.  All Rights Reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ */
+
+//
+// DecodeManager - schedules the decoding of independent rectangles on worker
+// threads
+//
+// The RFB thread reads each rectangle from the input stream, then a decoder
+// can hand off the CPU-intensive part of the work (decompressing a JPEG image
+// or inflating and unfiltering zlib data) by calling submit().  JPEG
+// rectangles have no dependencies on each other, so they are decoded on a
+// shared thread pool.  Zlib rectangles depend on the state of the zlib stream
+// that was used to compress them, so each stream has its own single-threaded
+// lane, which ensures that rectangles compressed with the same stream are
+// inflated in order.
+//
+// Rectangles are always applied to the framebuffer in the order in which the
+// server sent them, if they overlap.  Anything that touches the framebuffer
+// synchronously (fill and uncompressed rectangles, CopyRect, other encodings,
+// pseudo-encodings, and the end of the framebuffer update) must call
+// waitFor() or flush() first.
+//
+// close() may be called on a different thread than the RFB thread (for
+// instance, on the event dispatch thread when the viewer window is closed),
+// so the public methods are synchronized.
+//
+
+package com.turbovnc.rfb;
+
+import java.util.*;
+import java.util.concurrent.*;
+import com.turbovnc.rdr.*;
+
+public class DecodeManager {
+
+  public static final int LANE_POOL = -1;
+  public static final int NUM_LANES = 4;
+
+  public DecodeManager(CMsgHandler handler_) {
+    handler = handler_;
+    int defThreads = Math.min(Runtime.getRuntime().availableProcessors(),
+                              MAX_THREADS);
+    nThreads = Utils.getIntProperty("turbovnc.decodethreads", defThreads);
+    if (nThreads < 0) nThreads = 0;
+    if (nThreads > MAX_THREADS) nThreads = MAX_THREADS;
+    // A single decoding thread would only add overhead.
+    if (nThreads < 2)
+      nThreads = 0;
+    else
+      vlog.info("Using " + nThreads + " threads for decoding");
+    pending = new ArrayList<PendingRect>();
+    lanes = new ExecutorService[NUM_LANES];
+  }
+
+  public final boolean isEnabled() { return nThreads > 0; }
+
+  // Queue a task that decodes the rectangle r.  If lane is LANE_POOL, then the
+  // task may run in parallel with any other task.  Otherwise, lane is a zlib
+  // stream ID, and the task will run after all tasks previously submitted to
+  // the same lane.  r may be null if the task does not touch the framebuffer
+  // (for instance, if it resets a zlib stream.)
+  public synchronized void submit(Rect r, int lane, Runnable task) {
+    // The decoders may already have been closed, so a task submitted after
+    // close() is discarded.
+    if (closed)
+      return;
+
+    if (!isEnabled()) {
+      task.run();
+      if (r != null)
+        handler.releaseRawPixels(r);
+      return;
+    }
+
+    if (r != null)
+      waitFor(r);
+
+    ExecutorService executor;
+    if (lane == LANE_POOL) {
+      if (pool == null)
+        pool = Executors.newFixedThreadPool(nThreads,
+                                            new DecodeThreadFactory("pool"));
+      executor = pool;
+    } else {
+      if (lanes[lane] == null)
+        lanes[lane] =
+          Executors.newSingleThreadExecutor(
+            new DecodeThreadFactory("zlib" + lane));
+      executor = lanes[lane];
+    }
+
+    pending.add(new PendingRect(r, executor.submit(task)));
+  }
+
+  // Wait for any pending tasks that touch an area of the framebuffer
+  // overlapping r, and make the result visible.
+  public synchronized void waitFor(Rect r) {
+    if (pending.isEmpty())
+      return;
+    Iterator<PendingRect> iter = pending.iterator();
+    while (iter.hasNext()) {
+      PendingRect p = iter.next();
+      if (p.rect != null && p.rect.overlaps(r)) {
+        iter.remove();
+        complete(p);
+      }
+    }
+  }
+
+  // Wait for all pending tasks.  This must be called before the framebuffer
+  // is resized, before the framebuffer update is finished, and before any
+  // decoder state is reset.
+  public synchronized void flush() {
+    if (pending.isEmpty())
+      return;
+    // Remove the tasks from the list first, so that the list remains
+    // consistent if one of them throws an exception.
+    ArrayList<PendingRect> list = pending;
+    pending = new ArrayList<PendingRect>();
+    RuntimeException error = null;
+    for (PendingRect p : list) {
+      try {
+        complete(p);
+      } catch (RuntimeException e) {
+        if (error == null) error = e;
+      }
+    }
+    if (error != null)
+      throw error;
+  }
+
+  // Wait for all pending tasks and shut down the decoding threads.  When this
+  // returns, no task is running, so the decoders can safely be closed.
+  // NOTE: must be idempotent
+  public synchronized void close() {
+    closed = true;
+    try {
+      flush();
+    } catch (Exception e) {
+      vlog.debug("Ignoring decoding error during shutdown: " + e.getMessage());
+    }
+    if (pool != null) {
+      shutdown(pool);
+      pool = null;
+    }
+    for (int i = 0; i < NUM_LANES; i++) {
+      if (lanes[i] != null) {
+        shutdown(lanes[i]);
+        lanes[i] = null;
+      }
+    }
+  }
+
+  private static void shutdown(ExecutorService executor) {
+    executor.shutdown();
+    try {
+      if (!executor.awaitTermination(SHUTDOWN_TIMEOUT, TimeUnit.SECONDS))
+        vlog.error("Decoding threads did not terminate");
+    } catch (InterruptedException e) {
+      vlog.debug("Interrupted while waiting for decoding threads");
+    }
+  }
+
+  private void complete(PendingRect p) {
+    try {
+      p.future.get();
+    } catch (ExecutionException e) {
+      Throwable cause = e.getCause();
+      if (cause instanceof RuntimeException)
+        throw (RuntimeException)cause;
+      throw new SystemException(cause);
+    } catch (InterruptedException e) {
+      throw new SystemException(e);
+    }
+    if (p.rect != null)
+      handler.releaseRawPixels(p.rect);
+  }
+
+  private static class PendingRect {
+    PendingRect(Rect rect_, Future<?> future_) {
+      rect = rect_;
+      future = future_;
+    }
+
+    final Rect rect;
+    final Future<?> future;
+  }
+
+  private static class DecodeThreadFactory implements ThreadFactory {
+    DecodeThreadFactory(String name_) {
+      name = name_;
+    }
+
+    public Thread newThread(Runnable r) {
+      Thread t = new Thread(r, "Decode-" + name + "-" + count++);
+      // Decoding threads must not prevent the JVM from exiting.
+      t.setDaemon(true);
+      return t;
+    }
+
+    private final String name;
+    private int count;
+  }
+
+  static final int MAX_THREADS = 8;
+  static final int SHUTDOWN_TIMEOUT = 10;
+
+  private CMsgHandler handler;
+  private int nThreads;
+  private ExecutorService pool;
+  private ExecutorService[] lanes;
+  private ArrayList<PendingRect> pending;
+  private boolean closed;
+
+  static LogWriter vlog = new LogWriter("DecodeManager");
+}
@@ -0,0 +1,110 @@
+/* Copyright (C) 2026 agent.  All Rights Reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ */
+
+//
+// LZ4 - decompressor for the LZ4 block format
+//
+// The TurboVNC Server can use LZ4 rather than zlib to compress Tight-encoded
+// rectangles.  Each rectangle is compressed as an independent LZ4 block, so
+// the decompressor has no state and can be used from any decoding thread.
+//
+
+package com.turbovnc.rfb;
+
+import com.turbovnc.rdr.*;
+
+public final class LZ4 {
+
+  static final int MIN_MATCH = 4;
+
+  // Decompress the LZ4 block in src[srcOff .. srcOff + srcLen - 1] into
+  // dst[dstOff .. dstOff + dstLen - 1].  Returns the number of bytes that were
+  // decompressed.  Malformed data causes an ErrorException rather than an
+  // out-of-bounds access.
+  public static int decompress(byte[] src, int srcOff, int srcLen,
+                               byte[] dst, int dstOff, int dstLen) {
+    int ip = srcOff, iend = srcOff + srcLen;
+    int op = dstOff, oend = dstOff + dstLen;
+
+    if (srcLen <= 0)
+      throw new ErrorException("LZ4: empty block");
+
+    while (true) {
+      int token = src[ip++] & 0xff;
+
+      // Literals
+      int litLen = token >>> 4;
+      if (litLen == 15) {
+        int b;
+        do {
+          if (ip >= iend)
+            throw new ErrorException("LZ4: truncated block");
+          b = src[ip++] & 0xff;
+          litLen += b;
+        } while (b == 255);
+      }
+      if (litLen > iend - ip || litLen > oend - op)
+        throw new ErrorException("LZ4: literal run out of bounds");
+      System.arraycopy(src, ip, dst, op, litLen);
+      ip += litLen;
+      op += litLen;
+
+      // The last sequence has no match.
+      if (ip == iend) break;
+
+      // Match
+      if (iend - ip < 2)
+        throw new ErrorException("LZ4: truncated block");
+      int offset = (src[ip] & 0xff) | (src[ip + 1] & 0xff) << 8;
+      ip += 2;
+      if (offset == 0 || offset > op - dstOff)
+        throw new ErrorException("LZ4: invalid match offset");
+
+      int matchLen = token & 15;
+      if (matchLen == 15) {
+        int b;
+        do {
+          if (ip >= iend)
+            throw new ErrorException("LZ4: truncated block");
+          b = src[ip++] & 0xff;
+          matchLen += b;
+        } while (b == 255);
+      }
+      matchLen += MIN_MATCH;
+      if (matchLen > oend - op)
+        throw new ErrorException("LZ4: match out of bounds");
+
+      // The match may overlap the output, in which case it must be copied
+      // forwards one byte at a time.
+      int ref = op - offset;
+      if (offset >= matchLen) {
+        System.arraycopy(dst, ref, dst, op, matchLen);
+        op += matchLen;
+      } else {
+        while (matchLen-- > 0)
+          dst[op++] = dst[ref++];
+      }
+      if (ip >= iend)
+        throw new ErrorException("LZ4: truncated block");
+    }
+
+    return op - dstOff;
+  }
+
+  private LZ4() {}
+}
@@ -77,6 +77,7 @@ public class Options {
     desktopSize = new DesktopSize(old.desktopSize);
     fullScreen = old.fullScreen;
     scalingFactor = old.scalingFactor;
+    serverScale = old.serverScale;
     span = old.span;
     showToolbar = old.showToolbar;
 
@@ -122,6 +123,23 @@ public class Options {
       scalingFactor = sf;
   }
 
+  public static int parseServerScale(String scaleString) {
+    scaleString = scaleString.replaceAll("[^\\d]", "");
+    int sf = -1;
+    try {
+      sf = Integer.parseInt(scaleString);
+    } catch (NumberFormatException e) {}
+    if (sf >= 1 && sf <= 100)
+      return sf;
+    return 0;
+  }
+
+  public void setServerScale(String scaleString) {
+    int sf = parseServerScale(scaleString);
+    if (sf != 0)
+      serverScale = sf;
+  }
+
   public static DesktopSize parseDesktopSize(String sizeString) {
     if (sizeString.toLowerCase().startsWith("a"))
       return new DesktopSize(SIZE_AUTO, 0, 0);
@@ -227,6 +245,8 @@ public class Options {
     else
       UserPreferences.set("global", "Scale", scalingFactor);
 
+    UserPreferences.set("global", "ServerScale", serverScale);
+
     if (span == SPAN_PRIMARY)
       UserPreferences.set("global", "Span", "Primary");
     else if (span == SPAN_ALL)
@@ -305,6 +325,7 @@ public class Options {
       printOpt("desktopSize", desktopSize.mode);
     printOpt("fullScreen", fullScreen);
     printOpt("scalingFactor", scalingFactor);
+    printOpt("serverScale", serverScale);
     printOpt("span", span);
     printOpt("showToolbar", showToolbar);
 
@@ -531,6 +552,7 @@ public class Options {
   public DesktopSize desktopSize = new DesktopSize();
   public boolean fullScreen;
   public int scalingFactor;
+  public int serverScale;
   public int span;
   public boolean showToolbar;
   // ENCODING OPTIONS
@@ -385,7 +385,9 @@ public final class Params {
 
   public static IntParameter maxClipboard =
   new IntParameter("MaxClipboard",
-  "Maximum permitted length of an outgoing clipboard update (in bytes)",
+  "Maximum permitted length of an outgoing clipboard update (in bytes).  " +
+  "If the VNC server supports the extended clipboard extension, then this " +
+  "parameter also limits the length of incoming clipboard updates.",
   1048576);
 
   public static BoolParameter noNewConn =
@@ -622,6 +624,21 @@ public final class Params {
   "Enabling scaling disables automatic desktop resizing.", "100",
   "1-1000, Auto, or FixedRatio");
 
+  public static IntParameter serverScale =
+  new IntParameter("ServerScale",
+  "Ask the VNC server to reduce the remote desktop image before sending " +
+  "it.  The value is interpreted as a scaling factor in percent.  Unlike " +
+  "the Scale parameter, which scales the remote desktop image after it has " +
+  "been received, server-side scaling causes the server to downscale the " +
+  "remote desktop before compressing it, which reduces both the CPU usage " +
+  "of the server and the network usage at the expense of image detail.  " +
+  "The viewer receives a remote desktop with the scaled dimensions, and the " +
+  "server scales mouse events and remote desktop resize requests back to " +
+  "the actual dimensions of the remote desktop.  The default value of 100% " +
+  "disables server-side scaling.  This parameter has no effect unless the " +
+  "VNC server supports both server-side scaling and remote desktop " +
+  "resizing.", 100, 1, 100);
+
   public static StringParameter span =
   new StringParameter("Span",
   "This parameter specifies whether the viewer window should span only the " +
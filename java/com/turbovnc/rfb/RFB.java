@@ -253,6 +253,7 @@ public final class RFB {
   public static final int ENCODING_X_CURSOR              = -240;
   public static final int ENCODING_RICH_CURSOR           = -239;
   public static final int ENCODING_NEW_FB_SIZE           = -223;
+  public static final int ENCODING_EXTENDED_CLIPBOARD    = 0xC0A1E5CE;
 
   // TightVNC-specific
   public static final int ENCODING_COMPRESS_LEVEL_0 = -256;
@@ -270,6 +271,14 @@ public final class RFB {
   public static final int ENCODING_SUBSAMP_GRAY           = -765;
   public static final int ENCODING_SUBSAMP_8X             = -764;
   public static final int ENCODING_SUBSAMP_16X            = -763;
+  public static final int ENCODING_SERVER_SCALE_1         = -1023;
+  public static final int ENCODING_SERVER_SCALE_100       = -924;
+  public static final int ENCODING_TILE_CACHE_256         = -1280;
+  public static final int ENCODING_TILE_CACHE_32768       = -1273;
+  public static final int ENCODING_TILE_CACHE_STORE       = -1264;
+  public static final int ENCODING_TILE_CACHE_REF         = -1263;
+  public static final int ENCODING_TIGHT_LZ4              = -1248;
+  public static final int ENCODING_RESIZE_KEEP_CONTENT    = -1232;
 
   //***************************************************************************
   // Hextile subencoding types
@@ -290,6 +299,7 @@ public final class RFB {
   public static final int TIGHT_FILL            = 0x08;
   public static final int TIGHT_JPEG            = 0x09;
   public static final int TIGHT_NO_ZLIB         = 0x0A;
+  public static final int TIGHT_LZ4             = 0x0C;
   public static final int TIGHT_MAX_SUBENCODING = 0x09;
 
   // Filters to improve compression efficiency
@@ -374,5 +384,25 @@ public final class RFB {
   public static final int GII_DEVTYPE_TOUCH  = 4;
   public static final int GII_DEVTYPE_PAD    = 5;
 
+  //***************************************************************************
+  // Extended clipboard
+  //***************************************************************************
+
+  // Formats
+  public static final int EXTCLIP_TEXT        = (1 << 0);
+  public static final int EXTCLIP_RTF         = (1 << 1);
+  public static final int EXTCLIP_HTML        = (1 << 2);
+  public static final int EXTCLIP_DIB         = (1 << 3);
+  public static final int EXTCLIP_FILES       = (1 << 4);
+  public static final int EXTCLIP_FORMAT_MASK = 0x0000FFFF;
+
+  // Actions
+  public static final int EXTCLIP_CAPS        = (1 << 24);
+  public static final int EXTCLIP_REQUEST     = (1 << 25);
+  public static final int EXTCLIP_PEEK        = (1 << 26);
+  public static final int EXTCLIP_NOTIFY      = (1 << 27);
+  public static final int EXTCLIP_PROVIDE     = (1 << 28);
+  public static final int EXTCLIP_ACTION_MASK = 0xFF000000;
+
   private RFB() {}
 };
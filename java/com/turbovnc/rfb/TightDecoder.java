@@ -24,6 +24,7 @@ package com.turbovnc.rfb;
 
 import com.turbovnc.rdr.*;
 import java.awt.image.*;
+import java.util.ArrayList;
 import java.util.Arrays;
 import java.awt.*;
 import java.util.zip.*;
@@ -48,11 +49,7 @@ public class TightDecoder extends Decoder {
       inflater[i] = new Inflater();
     if (Helper.isAvailable() &&
         Utils.getBooleanProperty("turbovnc.turbojpeg", true)) {
-      try {
-        tjhandle = tjInitDecompress();
-      } catch (Exception e) {
-        throw new SystemException(e);
-      }
+      tjhandle = getTjhandle();
     }
     tightPalette = new byte[256 * 3];
   }
@@ -70,81 +67,120 @@ public class TightDecoder extends Decoder {
       if (inflater[i] != null)
         inflater[i].end();
     }
-    if (tjhandle != 0) {
-      try {
-        tjDestroy(tjhandle);
-      } catch (Exception e) {}
-      tjhandle = 0;
+    synchronized (tjhandles) {
+      for (long handle : tjhandles) {
+        try {
+          tjDestroy(handle);
+        } catch (Exception e) {}
+      }
+      tjhandles.clear();
     }
+    tjhandle = 0;
   }
 
   public boolean isTurboJPEG() {
     return tjhandle != 0;
   }
 
-  short getShort(byte[] src, int srcPtr) {
+  // TurboJPEG instances cannot be shared among threads, so each decoding
+  // thread creates its own.
+  long getTjhandle() {
+    Long handle = threadTjhandle.get();
+    if (handle == null) {
+      try {
+        handle = tjInitDecompress();
+      } catch (Exception e) {
+        throw new SystemException(e);
+      }
+      threadTjhandle.set(handle);
+      synchronized (tjhandles) {
+        tjhandles.add(handle);
+      }
+    }
+    return handle;
+  }
+
+  static short getShort(byte[] src, int srcPtr) {
     return (short)((src[srcPtr++] & 0xff) |
                    (src[srcPtr] & 0xff) << 8);
   }
 
-  void checkPalette(int bpp, boolean cutZeros) {
+  // Palettes that are handed off to a decoding thread cannot be reused, so
+  // newPalette() obtains a new one from the buffer pool, and the decoding
+  // thread releases it.  checkPalette() reuses the palette from the previous
+  // rectangle whenever possible.
+  static Object newPalette(int bpp, boolean cutZeros) {
+    if (cutZeros || bpp > 16)
+      return BufferPool.getInts(256);
+    else if (bpp == 8)
+      return BufferPool.getBytes(256);
+    else if (bpp == 16)
+      return BufferPool.getShorts(256);
+    // We should never get here
+    throw new ErrorException("Unsupported pixel format");
+  }
+
+  Object checkPalette(int bpp, boolean cutZeros) {
     if (cutZeros || bpp > 16) {
       if (palette != null && palette instanceof int[])
-        return;
-      palette = new int[256];
+        return palette;
     } else if (bpp == 8) {
       if (palette != null && palette instanceof byte[])
-        return;
-      palette = new byte[256];
+        return palette;
     } else if (bpp == 16) {
       if (palette != null && palette instanceof short[])
-        return;
-      palette = new short[256];
-    } else {
-      // We should never get here
-      throw new ErrorException("Unsupported pixel format");
+        return palette;
     }
+    BufferPool.release(palette);
+    palette = newPalette(bpp, cutZeros);
+    return palette;
   }
 
   void checkNetbuf(int size) {
-    if (netbufSize < size || netbuf == null) {
-      if (netbuf != null)
-        netbuf = null;
-      netbuf = new byte[size];
-      netbufSize = size;
-    }
+    netbuf = BufferPool.checkBytes(netbuf, size);
   }
 
-  void checkDecodebuf(int size) {
-    if (decodebufSize < size || decodebuf == null) {
-      if (decodebuf != null)
-        decodebuf = null;
-      decodebuf = new byte[size];
-      decodebufSize = size;
+  // Each decoding thread has its own decode buffer.
+  byte[] getDecodebuf(int size) {
+    byte[] decodebuf = threadDecodebuf.get();
+    if (decodebuf == null || decodebuf.length < size) {
+      decodebuf = BufferPool.checkBytes(decodebuf, size);
+      threadDecodebuf.set(decodebuf);
     }
+    return decodebuf;
   }
 
-  @SuppressWarnings("fallthrough")
-  public void readRect(Rect r, CMsgHandler handler) {
+  public void readRect(final Rect r, CMsgHandler handler) {
     InStream is = reader.getInStream();
-    boolean cutZeros = false;
-    serverpf = handler.cp.pf();
-    int bpp = serverpf.bpp;
-    cutZeros = false;
-    if (bpp == 32 && serverpf.is888())
-      cutZeros = true;
+    DecodeManager dm = reader.getDecodeManager();
+    final PixelFormat serverpf = handler.cp.pf();
+    final int bpp = serverpf.bpp;
+    final boolean cutZeros = (bpp == 32 && serverpf.is888());
 
     int compCtl = is.readU8();
 
-    boolean bigEndian = handler.cp.pf().bigEndian;
-
-    // Flush zlib streams if we are told by the server to do so.
+    // Flush zlib streams if we are told by the server to do so.  Rectangles
+    // that were compressed with the old stream may still be waiting to be
+    // inflated, so the reset is queued behind them.
     for (int i = 0; i < 4; i++) {
-      if ((compCtl & 1) != 0)
-        inflater[i].end();
+      if ((compCtl & 1) != 0) {
+        final Inflater inf = inflater[i];
+        dm.submit(null, i, new Runnable() {
+          public void run() {
+            inf.reset();
+          }
+        });
+      }
       compCtl >>= 1;
     }
 
+    // "LZ4" compression type.  This implies an explicit filter.
+    boolean lz4 = false;
+    if (compCtl == RFB.TIGHT_LZ4) {
+      compCtl = RFB.TIGHT_EXPLICIT_FILTER;
+      lz4 = true;
+    }
+
     boolean readUncompressed = false;
     if ((compCtl & RFB.TIGHT_NO_ZLIB) == RFB.TIGHT_NO_ZLIB) {
       compCtl &= ~(RFB.TIGHT_NO_ZLIB);
@@ -153,7 +189,7 @@ public class TightDecoder extends Decoder {
 
     // "JPEG" compression type.
     if (compCtl == RFB.TIGHT_JPEG) {
-      decompressJpegRect(r, is, handler);
+      decompressJpegRect(r, is, handler, dm);
       return;
     }
 
@@ -164,40 +200,46 @@ public class TightDecoder extends Decoder {
 
     int w = r.width(), h = r.height();
     int[] stride = { w };
-    Object buf = handler.getRawPixelsRW(stride);
-    int pad = stride[0] - w;
-    int ptr = r.tl.y * stride[0] + r.tl.x;
 
     // "Fill" compression type.
     if (compCtl == RFB.TIGHT_FILL) {
+      Object buf = handler.getRawPixelsRW(stride);
+      int pix;
+      if (cutZeros) {
+        is.readBytes(fillBuf, 0, 3);
+        pix = (fillBuf[0] & 0xff) << serverpf.redShift |
+              (fillBuf[1] & 0xff) << serverpf.greenShift |
+              (fillBuf[2] & 0xff) << serverpf.blueShift | (0xff << 24);
+      } else if (buf instanceof byte[]) {
+        pix = is.readU8();
+      } else if (buf instanceof short[]) {
+        pix = is.readPixel(bpp / 8, serverpf.bigEndian);
+      } else {
+        // We should never get here
+        throw new ErrorException("Unsupported pixel type");
+      }
+
+      dm.waitFor(r);
+      int ptr = r.tl.y * stride[0] + r.tl.x;
+
       if (cutZeros) {
-        byte[] bytebuf = new byte[3];
-        is.readBytes(bytebuf, 0, 3);
-        int pix = (bytebuf[0] & 0xff) << serverpf.redShift |
-                  (bytebuf[1] & 0xff) << serverpf.greenShift |
-                  (bytebuf[2] & 0xff) << serverpf.blueShift | (0xff << 24);
         while (h > 0) {
           Arrays.fill((int[])buf, ptr, ptr + w, pix);
           ptr += stride[0];
           h--;
         }
       } else if (buf instanceof byte[]) {
-        int pix = is.readU8();
         while (h > 0) {
           Arrays.fill((byte[])buf, ptr, ptr + w, (byte)pix);
           ptr += stride[0];
           h--;
         }
-      } else if (buf instanceof short[]) {
-        int pix = is.readPixel(bpp / 8, serverpf.bigEndian);
+      } else {
         while (h > 0) {
           Arrays.fill((short[])buf, ptr, ptr + w, (short)pix);
           ptr += stride[0];
           h--;
         }
-      } else {
-        // We should never get here
-        throw new ErrorException("Unsupported pixel type");
       }
       handler.releaseRawPixels(r);
       return;
@@ -206,6 +248,7 @@ public class TightDecoder extends Decoder {
     // "Basic" compression type.
     int palSize = 0;
     boolean useGradient = false;
+    Object pal = null;
 
     if ((compCtl & RFB.TIGHT_EXPLICIT_FILTER) != 0) {
       int filterId = is.readU8();
@@ -213,13 +256,15 @@ public class TightDecoder extends Decoder {
       switch (filterId) {
         case RFB.TIGHT_FILTER_PALETTE:
           palSize = is.readU8() + 1;
-          checkPalette(bpp, cutZeros);
+          if (dm.isEnabled())
+            pal = newPalette(bpp, cutZeros);
+          else
+            pal = checkPalette(bpp, cutZeros);
           if (cutZeros) {
             is.readBytes(tightPalette, 0, palSize * 3);
-            serverpf.bufferFromRGB((int[])palette, 0, tightPalette, 0,
-                                   palSize);
+            serverpf.bufferFromRGB((int[])pal, 0, tightPalette, 0, palSize);
           } else
-            is.readPixels(palette, palSize, serverpf.bpp / 8,
+            is.readPixels(pal, palSize, serverpf.bpp / 8,
                           serverpf.bigEndian);
           break;
         case RFB.TIGHT_FILTER_GRADIENT:
@@ -242,37 +287,93 @@ public class TightDecoder extends Decoder {
     // Determine if the data should be decompressed or just copied.
     int rowSize = (r.width() * bppp + 7) / 8;
     int dataSize = r.height() * rowSize;
-    int streamId = -1;
 
-    // Allocate netbuf and read in data
     if (dataSize < TIGHT_MIN_TO_COMPRESS || readUncompressed) {
       if (dataSize >= TIGHT_MIN_TO_COMPRESS)
         dataSize = is.readCompactLength();
-      checkDecodebuf(dataSize);
+      byte[] decodebuf = getDecodebuf(dataSize);
       is.readBytes(decodebuf, 0, dataSize);
+
+      dm.waitFor(r);
+      Object buf = handler.getRawPixelsRW(stride);
+      filterRect(r, serverpf, buf, stride[0], decodebuf, pal, palSize,
+                 useGradient, cutZeros);
+      handler.releaseRawPixels(r);
+      if (dm.isEnabled())
+        BufferPool.release(pal);
+      return;
+    }
+
+    // Read in the compressed data.  If the rectangle is going to be inflated
+    // on another thread, then it needs its own copy.
+    final int length = is.readCompactLength();
+    final byte[] zbuf;
+    if (dm.isEnabled()) {
+      zbuf = BufferPool.getBytes(length);
     } else {
-      int length = is.readCompactLength();
       checkNetbuf(length);
-      is.readBytes(netbuf, 0, length);
-      streamId = compCtl & 0x03;
-      checkDecodebuf(dataSize);
-      inflater[streamId].setInput(netbuf, 0, length);
-      try {
-        inflater[streamId].inflate(decodebuf, 0, dataSize);
-      } catch (DataFormatException e) {
-        throw new ErrorException(e.getMessage());
-      }
+      zbuf = netbuf;
     }
+    is.readBytes(zbuf, 0, length);
+
+    // LZ4 blocks are independent of each other, so they need not be decoded
+    // in the order that they were received.
+    final Inflater inf = lz4 ? null : inflater[compCtl & 0x03];
+    final Object buf = handler.getRawPixelsRW(stride);
+    final int pitch = stride[0];
+    final int size = dataSize;
+    final Object finalPal = pal;
+    final int finalPalSize = palSize;
+    final boolean finalUseGradient = useGradient;
+    final boolean pooled = dm.isEnabled();
+
+    dm.submit(r, lz4 ? DecodeManager.LANE_POOL : compCtl & 0x03,
+              new Runnable() {
+      public void run() {
+        try {
+          byte[] decodebuf = getDecodebuf(size);
+          if (inf == null) {
+            if (LZ4.decompress(zbuf, 0, length, decodebuf, 0, size) != size)
+              throw new ErrorException("TightDecoder: LZ4 block is too short");
+          } else {
+            inf.setInput(zbuf, 0, length);
+            try {
+              inf.inflate(decodebuf, 0, size);
+            } catch (DataFormatException e) {
+              throw new ErrorException(e.getMessage());
+            }
+          }
+          filterRect(r, serverpf, buf, pitch, decodebuf, finalPal,
+                     finalPalSize, finalUseGradient, cutZeros);
+        } finally {
+          if (pooled) {
+            BufferPool.release(zbuf);
+            BufferPool.release(finalPal);
+          }
+        }
+      }
+    });
+  }
 
+  // Convert the decoded data for a "Basic" rectangle to pixels and store them
+  // in the framebuffer.  This may be called from a decoding thread, so it must
+  // not use any decoder state other than its arguments.
+  void filterRect(Rect r, PixelFormat serverpf, Object buf, int stride,
+                  byte[] decodebuf, Object palette, int palSize,
+                  boolean useGradient, boolean cutZeros) {
+    int w = r.width(), h = r.height();
+    int bpp = serverpf.bpp;
+    int pad = stride - w;
+    int ptr = r.tl.y * stride + r.tl.x;
     int srcPtr = 0;
 
     if (palSize == 0) {
       // Truecolor data.
       if (useGradient) {
         if (cutZeros) {
-          filterGradient24((int[])buf, stride[0], r);
+          filterGradient24((int[])buf, stride, r, decodebuf, serverpf);
         } else if (bpp == 16) {
-          filterGradient16((short[])buf, stride[0], r);
+          filterGradient16((short[])buf, stride, r, decodebuf, serverpf);
         } else {
           // We should never get here
           throw new ErrorException("Unsupported pixel type");
@@ -280,12 +381,12 @@ public class TightDecoder extends Decoder {
       } else {
         // Copy
         if (cutZeros) {
-          serverpf.bufferFromRGB((int[])buf, r.tl.x, r.tl.y, stride[0],
+          serverpf.bufferFromRGB((int[])buf, r.tl.x, r.tl.y, stride,
                                  decodebuf, w, h);
         } else if (buf instanceof byte[]) {
           while (h > 0) {
             System.arraycopy(decodebuf, srcPtr, (byte[])buf, ptr, w);
-            ptr += stride[0];
+            ptr += stride;
             srcPtr += w;
             h--;
           }
@@ -416,66 +517,102 @@ public class TightDecoder extends Decoder {
         }
       }
     }
+  }
+
+  static int getTJPF(PixelFormat pf) {
+    int tjpf = TJPF_RGB;
+
+    if (pf.is888()) {
+      int redShift, greenShift, blueShift;
+
+      if (pf.bigEndian) {
+        redShift = 24 - pf.redShift;
+        greenShift = 24 - pf.greenShift;
+        blueShift = 24 - pf.blueShift;
+      } else {
+        redShift = pf.redShift;
+        greenShift = pf.greenShift;
+        blueShift = pf.blueShift;
+      }
 
-    handler.releaseRawPixels(r);
+      if (redShift == 0 && greenShift == 8 && blueShift == 16)
+        tjpf = TJPF_RGBX;
+      if (redShift == 16 && greenShift == 8 && blueShift == 0)
+        tjpf = TJPF_BGRX;
+      if (redShift == 24 && greenShift == 16 && blueShift == 8)
+        tjpf = TJPF_XBGR;
+      if (redShift == 8 && greenShift == 16 && blueShift == 24)
+        tjpf = TJPF_XRGB;
+    }
+    return tjpf;
   }
 
-  private void decompressJpegRect(Rect r, InStream is,
-                                  CMsgHandler handler) {
+  private void decompressJpegRect(final Rect r, InStream is,
+                                  CMsgHandler handler, DecodeManager dm) {
     // Read length
-    int compressedLen = is.readCompactLength();
+    final int compressedLen = is.readCompactLength();
     if (compressedLen <= 0)
       vlog.info("Incorrect data received from the server.");
 
+    PixelFormat pf = handler.cp.pf();
+
+    // JPEG rectangles do not depend on any other rectangles, so if TurboJPEG
+    // can decompress them directly into the framebuffer, then they can be
+    // decompressed on any decoding thread.
+    if (tjhandle != 0 && pf.is888() && dm.isEnabled()) {
+      final byte[] jpegBuf = BufferPool.getBytes(compressedLen);
+      is.readBytes(jpegBuf, 0, compressedLen);
+
+      final int[] stride = new int[1];
+      final int[] data = (int[])handler.getRawPixelsRW(stride);
+      final int tjpf = getTJPF(pf);
+
+      dm.submit(r, DecodeManager.LANE_POOL, new Runnable() {
+        public void run() {
+          try {
+            tjDecompress(getTjhandle(), jpegBuf, compressedLen, data, r.tl.x,
+                         r.tl.y, r.width(), stride[0], r.height(), tjpf, 0);
+          } catch (Exception e) {
+            throw new SystemException(e);
+          } finally {
+            BufferPool.release(jpegBuf);
+          }
+        }
+      });
+      return;
+    }
+
     // Allocate netbuf and read in data
     checkNetbuf(compressedLen);
     is.readBytes(netbuf, 0, compressedLen);
 
+    dm.waitFor(r);
+
     if (tjhandle != 0) {
 
       int[] stride = new int[1];
       Object data = handler.getRawPixelsRW(stride);
-      int tjpf = TJPF_RGB;
-      PixelFormat pf = handler.cp.pf();
 
       if (pf.is888()) {
-        int redShift, greenShift, blueShift;
-
-        if (pf.bigEndian) {
-          redShift = 24 - pf.redShift;
-          greenShift = 24 - pf.greenShift;
-          blueShift = 24 - pf.blueShift;
-        } else {
-          redShift = pf.redShift;
-          greenShift = pf.greenShift;
-          blueShift = pf.blueShift;
-        }
-
-        if (redShift == 0 && greenShift == 8 && blueShift == 16)
-          tjpf = TJPF_RGBX;
-        if (redShift == 16 && greenShift == 8 && blueShift == 0)
-          tjpf = TJPF_BGRX;
-        if (redShift == 24 && greenShift == 16 && blueShift == 8)
-          tjpf = TJPF_XBGR;
-        if (redShift == 8 && greenShift == 16 && blueShift == 24)
-          tjpf = TJPF_XRGB;
-
         try {
           tjDecompress(tjhandle, netbuf, compressedLen, (int[])data, r.tl.x,
-                       r.tl.y, r.width(), stride[0], r.height(), tjpf, 0);
+                       r.tl.y, r.width(), stride[0], r.height(), getTJPF(pf),
+                       0);
         } catch (Exception e) {
           throw new SystemException(e);
         }
       } else {
-        byte[] rgbBuf = new byte[r.width() * r.height() * 3];
+        byte[] rgbBuf = BufferPool.getBytes(r.width() * r.height() * 3);
         try {
           tjDecompress(tjhandle, netbuf, compressedLen, rgbBuf, 0, 0,
                        r.width(), 0, r.height(), TJPF_RGB, 0);
+          pf.bufferFromRGB(data, r.tl.x, r.tl.y, stride[0], rgbBuf,
+                           r.width(), r.height());
         } catch (Exception e) {
           throw new SystemException(e);
+        } finally {
+          BufferPool.release(rgbBuf);
         }
-        pf.bufferFromRGB(data, r.tl.x, r.tl.y, stride[0], rgbBuf,
-                         r.width(), r.height());
       }
       handler.releaseRawPixels(r);
       return;
@@ -491,19 +628,23 @@ public class TightDecoder extends Decoder {
   /* NOTE: we support gradient encoding only for backward compatibility with
      TightVNC 1.3.x.  It is decidedly non-optimal. */
 
-  private void filterGradient24(int[] buf, int stride, Rect r) {
+  private static void filterGradient24(int[] buf, int stride, Rect r,
+                                       byte[] decodebuf,
+                                       PixelFormat serverpf) {
 
     int x, y, c;
     int ptr = r.tl.y * stride + r.tl.x;
-    int[] prevRow = new int[TIGHT_MAX_WIDTH * 3];
-    int[] thisRow = new int[TIGHT_MAX_WIDTH * 3];
-    int[] pix = new int[3];
-    int[] est = new int[3];
 
     // Set up shortcut variables
     int rectHeight = r.height();
     int rectWidth = r.width();
 
+    int[] prevRow = BufferPool.getInts(rectWidth * 3);
+    int[] thisRow = BufferPool.getInts(rectWidth * 3);
+    int[] pix = new int[3];
+    int[] est = new int[3];
+    Arrays.fill(prevRow, 0, rectWidth * 3, 0);
+
     for (y = 0; y < rectHeight; y++) {
       /* First pixel in a row */
       for (c = 0; c < 3; c++) {
@@ -529,16 +670,21 @@ public class TightDecoder extends Decoder {
                                                           pix[2], null);
       }
 
-      System.arraycopy(thisRow, 0, prevRow, 0, prevRow.length);
+      System.arraycopy(thisRow, 0, prevRow, 0, rectWidth * 3);
     }
+
+    BufferPool.release(prevRow);
+    BufferPool.release(thisRow);
   }
 
-  private void filterGradient16(short[] buf, int stride, Rect r) {
+  private static void filterGradient16(short[] buf, int stride, Rect r,
+                                       byte[] decodebuf,
+                                       PixelFormat serverpf) {
 
     int x, y, c, p;
     int ptr = r.tl.y * stride + r.tl.x;
-    int[] prevRow = new int[TIGHT_MAX_WIDTH * 3];
-    int[] thisRow = new int[TIGHT_MAX_WIDTH * 3];
+    int[] prevRow = BufferPool.getInts(r.width() * 3);
+    int[] thisRow = BufferPool.getInts(r.width() * 3);
     int[] pix = new int[3];
     int[] est = new int[3];
     int[] max = new int[] { serverpf.redMax, serverpf.greenMax,
@@ -550,6 +696,8 @@ public class TightDecoder extends Decoder {
     int rectHeight = r.height();
     int rectWidth = r.width();
 
+    Arrays.fill(prevRow, 0, rectWidth * 3, 0);
+
     for (y = 0; y < rectHeight; y++) {
       /* First pixel in a row */
       p = getShort(decodebuf, y * rectWidth * 2);
@@ -579,20 +727,24 @@ public class TightDecoder extends Decoder {
                                             (pix[2] << shift[2]));
       }
 
-      System.arraycopy(thisRow, 0, prevRow, 0, prevRow.length);
+      System.arraycopy(thisRow, 0, prevRow, 0, rectWidth * 3);
     }
+
+    BufferPool.release(prevRow);
+    BufferPool.release(thisRow);
   }
 
   private CMsgReader reader;
   private Inflater[] inflater;
-  private PixelFormat serverpf;
   private long tjhandle;
+  private final ThreadLocal<Long> threadTjhandle = new ThreadLocal<Long>();
+  private final ArrayList<Long> tjhandles = new ArrayList<Long>();
   private Object palette;
   private byte[] tightPalette;
   private byte[] netbuf;
-  private int netbufSize;
-  private byte[] decodebuf;
-  private int decodebufSize;
+  private final byte[] fillBuf = new byte[3];
+  private final ThreadLocal<byte[]> threadDecodebuf =
+    new ThreadLocal<byte[]>();
 
   private native long tjInitDecompress() throws Exception;
   private native void tjDecompress(long handle, byte[] srcBuf, int size,
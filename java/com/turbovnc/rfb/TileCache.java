@@ -0,0 +1,96 @@
+/* Copyright (C) 2026 agent.  All Rights Reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ */
+
+//
+// TileCache - the viewer's half of the TurboVNC tile cache extension
+//
+// The server keeps track of which tile is in each slot and evicts the least
+// recently used tiles, so the viewer simply copies tiles into and out of the
+// slots that the server specifies.  Slots are allocated as they are first
+// used, so the memory footprint of the cache grows only as large as
+// necessary.
+//
+
+package com.turbovnc.rfb;
+
+import com.turbovnc.rdr.*;
+
+public class TileCache {
+
+  public static final int TILE_SIZE = 64;
+
+  // Return the cache size level (0 = 256 tiles, 1 = 512 tiles, etc.) that
+  // corresponds to the value of the turbovnc.tilecache system property (in
+  // megabytes), or -1 if the tile cache is disabled.
+  public static int getSizeLevel() {
+    int mb = Utils.getIntProperty("turbovnc.tilecache", 0);
+    if (mb <= 0)
+      return -1;
+    long tiles = (long)mb * 1024 * 1024 / (TILE_SIZE * TILE_SIZE * 4);
+    int level = 0;
+    while (level < MAX_LEVEL && (256L << (level + 1)) <= tiles)
+      level++;
+    return level;
+  }
+
+  public TileCache(int nSlots) {
+    pixels = new int[nSlots][];
+    widths = new int[nSlots];
+    heights = new int[nSlots];
+    vlog.info("Using tile cache with " + nSlots + " tiles");
+  }
+
+  // Copy the pixels in the specified rectangle of the framebuffer into a
+  // slot.
+  public void store(Rect r, int slot, CMsgHandler handler) {
+    checkSlot(r, slot);
+    if (pixels[slot] == null)
+      pixels[slot] = new int[TILE_SIZE * TILE_SIZE];
+    handler.getImageRect(r, pixels[slot]);
+    widths[slot] = r.width();
+    heights[slot] = r.height();
+  }
+
+  // Draw the contents of a slot into the specified rectangle of the
+  // framebuffer.
+  public void draw(Rect r, int slot, CMsgHandler handler) {
+    checkSlot(r, slot);
+    if (pixels[slot] == null || widths[slot] != r.width() ||
+        heights[slot] != r.height())
+      throw new ErrorException("Invalid tile cache reference to slot " +
+                               slot);
+    handler.imageRect(r, pixels[slot]);
+  }
+
+  private void checkSlot(Rect r, int slot) {
+    if (slot < 0 || slot >= pixels.length)
+      throw new ErrorException("Invalid tile cache slot " + slot);
+    if (r.width() <= 0 || r.width() > TILE_SIZE || r.height() <= 0 ||
+        r.height() > TILE_SIZE)
+      throw new ErrorException("Invalid tile cache rectangle " +
+                               r.width() + "x" + r.height());
+  }
+
+  // 0xFFFFFB00 .. 0xFFFFFB07
+  private static final int MAX_LEVEL = 7;
+
+  private int[][] pixels;
+  private int[] widths, heights;
+
+  static LogWriter vlog = new LogWriter("TileCache");
+}
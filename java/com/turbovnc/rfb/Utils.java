@@ -69,6 +69,18 @@ public final class Utils {
     return def;
   }
 
+  public static int getIntProperty(String key, int def) {
+    String prop = System.getProperty(key);
+    if (prop != null && prop.length() > 0) {
+      try {
+        return Integer.parseInt(prop.trim());
+      } catch (NumberFormatException e) {
+        vlog.error("Invalid value for " + key + ": " + prop);
+      }
+    }
+    return def;
+  }
+
   public static String getFileSeparator() {
     String separator = null;
     try {
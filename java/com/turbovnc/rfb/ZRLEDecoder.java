@@ -20,148 +20,268 @@
 package com.turbovnc.rfb;
 
 import com.turbovnc.rdr.*;
+import java.util.Arrays;
+import java.util.zip.*;
 
 public class ZRLEDecoder extends Decoder {
 
   public ZRLEDecoder(CMsgReader reader_) {
     reader = reader_;
-    zis = new ZlibInStream();
+    inflater = new Inflater();
+    palette = new int[128];
+  }
+
+  void checkNetbuf(int size) {
+    netbuf = BufferPool.checkBytes(netbuf, size);
+  }
+
+  // The server flushes the zlib stream at the end of each rectangle, so all of
+  // the data for the rectangle can be inflated at once.  This allows the tiles
+  // to be decoded directly from a byte array, rather than one pixel at a time
+  // through an InStream.
+  int inflateRect(int length, int sizeHint) {
+    decodebuf = BufferPool.checkBytes(decodebuf, sizeHint);
+    inflater.setInput(netbuf, 0, length);
+
+    int outLen = 0;
+    try {
+      while (true) {
+        if (outLen == decodebuf.length) {
+          byte[] newbuf = BufferPool.getBytes(decodebuf.length * 2);
+          System.arraycopy(decodebuf, 0, newbuf, 0, outLen);
+          BufferPool.release(decodebuf);
+          decodebuf = newbuf;
+        }
+        int n = inflater.inflate(decodebuf, outLen, decodebuf.length - outLen);
+        outLen += n;
+        if (n == 0) {
+          if (inflater.needsInput())
+            break;
+          throw new ErrorException("ZRLEDecoder: zlib stream is corrupt");
+        }
+      }
+    } catch (DataFormatException e) {
+      throw new ErrorException(e.getMessage());
+    }
+    return outLen;
   }
 
   public void readRect(Rect r, CMsgHandler handler) {
     InStream is = reader.getInStream();
-    int[] buf = reader.getImageBuf(64 * 64 * 4);
     int bpp = handler.cp.pf().bpp;
     int bytesPerPixel = (bpp > 24 ? 3 : bpp / 8);
     boolean bigEndian = handler.cp.pf().bigEndian;
 
-    if (zis == null) return;
+    if (inflater == null) return;
 
     int length = is.readU32();
-    zis.setUnderlying(is, length);
-    Rect t = new Rect();
+    checkNetbuf(length);
+    is.readBytes(netbuf, 0, length);
+    int dataLen = inflateRect(length, r.area() * bytesPerPixel + 4096);
+
+    // If the framebuffer stores 32-bit pixels, then decode directly into it.
+    // Otherwise, decode each tile into the image buffer and let the handler
+    // convert it.
+    int[] stride = new int[1];
+    Object fb = handler.getRawPixelsRW(stride);
+    boolean direct = (fb instanceof int[]);
+    int[] tileBuf = direct ? null : reader.getImageBuf(64 * 64 * 4);
 
-    for (t.tl.y = r.tl.y; t.tl.y < r.br.y; t.tl.y += 64) {
+    Rect t = new Rect();
+    int sp = 0;
 
-      t.br.y = Math.min(r.br.y, t.tl.y + 64);
+    try {
+      for (t.tl.y = r.tl.y; t.tl.y < r.br.y; t.tl.y += 64) {
 
-      for (t.tl.x = r.tl.x; t.tl.x < r.br.x; t.tl.x += 64) {
+        t.br.y = Math.min(r.br.y, t.tl.y + 64);
 
-        t.br.x = Math.min(r.br.x, t.tl.x + 64);
+        for (t.tl.x = r.tl.x; t.tl.x < r.br.x; t.tl.x += 64) {
 
-        int mode = zis.readU8();
-        boolean rle = (mode & 128) != 0;
-        int palSize = mode & 127;
-        int[] palette = new int[128];
+          t.br.x = Math.min(r.br.x, t.tl.x + 64);
 
-        zis.readPixels(palette, palSize, bytesPerPixel, bigEndian);
+          int[] dst;
+          int dstPtr, dstStride;
+          if (direct) {
+            dst = (int[])fb;
+            dstStride = stride[0];
+            dstPtr = t.tl.y * dstStride + t.tl.x;
+          } else {
+            dst = tileBuf;
+            dstStride = t.width();
+            dstPtr = 0;
+          }
 
-        if (palSize == 1) {
-          int pix = palette[0];
-          handler.fillRect(t, pix);
-          continue;
+          sp = decodeTile(sp, t, dst, dstPtr, dstStride, bytesPerPixel,
+                          bigEndian, direct ? null : handler);
         }
+      }
+    } catch (ArrayIndexOutOfBoundsException e) {
+      throw new ErrorException("ZRLEDecoder: rectangle data is truncated");
+    }
 
-        if (!rle) {
-          if (palSize == 0) {
+    if (sp > dataLen)
+      throw new ErrorException("ZRLEDecoder: rectangle data is truncated");
 
-            // raw
+    if (direct)
+      handler.releaseRawPixels(r);
+  }
 
-            zis.readPixels(buf, t.area(), bytesPerPixel, bigEndian);
+  static int getPixel(byte[] src, int sp, int bytesPerPixel,
+                      boolean bigEndian) {
+    int b0 = src[sp] & 0xff;
+    int b1 = bytesPerPixel > 1 ? src[sp + 1] & 0xff : 0;
+    int b2 = bytesPerPixel > 2 ? src[sp + 2] & 0xff : 0;
 
-          } else {
+    if (bigEndian)
+      return b0 << 24 | b1 << 16 | b2 << 8 | 0x000000ff;
+    else
+      return 0xff000000 | b2 << 16 | b1 << 8 | b0;
+  }
 
-            // packed pixels
-            int bppp = ((palSize > 16) ? 8 :
-                        ((palSize > 4) ? 4 : ((palSize > 2) ? 2 : 1)));
-
-            int ptr = 0;
-
-            for (int i = 0; i < t.height(); i++) {
-              int eol = ptr + t.width();
-              int b = 0;
-              int nbits = 0;
-
-              while (ptr < eol) {
-                if (nbits == 0) {
-                  b = zis.readU8();
-                  nbits = 8;
-                }
-                nbits -= bppp;
-                int index = (b >> nbits) & ((1 << bppp) - 1) & 127;
-                buf[ptr++] = palette[index];
-              }
-            }
-          }
+  // Decode one tile from decodebuf, starting at offset sp, and store the
+  // pixels in dst.  If handler is non-null, then the tile is passed to it
+  // rather than being stored in the framebuffer directly.  Returns the offset
+  // of the next tile.
+  private int decodeTile(int sp, Rect t, int[] dst, int dstPtr, int dstStride,
+                         int bytesPerPixel, boolean bigEndian,
+                         CMsgHandler handler) {
+    byte[] src = decodebuf;
+    int w = t.width(), h = t.height();
+    int pad = dstStride - w;
+
+    int mode = src[sp++] & 0xff;
+    boolean rle = (mode & 128) != 0;
+    int palSize = mode & 127;
+
+    for (int i = 0; i < palSize; i++) {
+      palette[i] = getPixel(src, sp, bytesPerPixel, bigEndian);
+      sp += bytesPerPixel;
+    }
 
-        } else {
+    if (palSize == 1) {
+      int pix = palette[0];
+      if (handler != null) {
+        handler.fillRect(t, pix);
+      } else {
+        for (int y = 0; y < h; y++, dstPtr += dstStride)
+          Arrays.fill(dst, dstPtr, dstPtr + w, pix);
+      }
+      return sp;
+    }
+
+    if (!rle) {
+      if (palSize == 0) {
+
+        // raw
 
-          if (palSize == 0) {
+        if (bytesPerPixel == 3 && !bigEndian) {
+          for (int y = 0; y < h; y++, dstPtr += pad) {
+            for (int eol = dstPtr + w; dstPtr < eol; sp += 3)
+              dst[dstPtr++] = 0xff000000 | (src[sp + 2] & 0xff) << 16 |
+                              (src[sp + 1] & 0xff) << 8 | (src[sp] & 0xff);
+          }
+        } else {
+          for (int y = 0; y < h; y++, dstPtr += pad) {
+            for (int eol = dstPtr + w; dstPtr < eol; sp += bytesPerPixel)
+              dst[dstPtr++] = getPixel(src, sp, bytesPerPixel, bigEndian);
+          }
+        }
 
-            // plain RLE
+      } else {
 
-            int ptr = 0;
-            int end = ptr + t.area();
-            while (ptr < end) {
-              int pix = zis.readPixel(bytesPerPixel, bigEndian);
-              int len = 1;
-              int b;
-              do {
-                b = zis.readU8();
-                len += b;
-              } while (b == 255);
+        // packed pixels
+        int bppp = ((palSize > 16) ? 8 :
+                    ((palSize > 4) ? 4 : ((palSize > 2) ? 2 : 1)));
+        int mask = ((1 << bppp) - 1) & 127;
 
-              if (!(len <= end - ptr))
-                throw new ErrorException(
-                  "ZRLEDecoder: assertion (len <= end - ptr) failed");
+        for (int y = 0; y < h; y++, dstPtr += pad) {
+          int eol = dstPtr + w;
+          int b = 0;
+          int nbits = 0;
 
-              while (len-- > 0) buf[ptr++] = pix;
+          while (dstPtr < eol) {
+            if (nbits == 0) {
+              b = src[sp++] & 0xff;
+              nbits = 8;
             }
-          } else {
+            nbits -= bppp;
+            dst[dstPtr++] = palette[(b >> nbits) & mask];
+          }
+        }
+      }
 
-            // palette RLE
+    } else {
 
-            int ptr = 0;
-            int end = ptr + t.area();
-            while (ptr < end) {
-              int index = zis.readU8();
-              int len = 1;
-              if ((index & 128) != 0) {
-                int b;
-                do {
-                  b = zis.readU8();
-                  len += b;
-                } while (b == 255);
+      // The RLE runs are laid out in tile order, so decode them into the
+      // framebuffer one row segment at a time.
+      int x = 0;
+      int remaining = w * h;
 
-                if (!(len <= end - ptr))
-                  throw new ErrorException(
-                    "ZRLEDecoder: assertion (len <= end - ptr) failed");
-              }
+      while (remaining > 0) {
+        int pix, len = 1;
 
-              index &= 127;
+        if (palSize == 0) {
 
-              int pix = palette[index];
+          // plain RLE
 
-              while (len-- > 0) buf[ptr++] = pix;
-            }
+          pix = getPixel(src, sp, bytesPerPixel, bigEndian);
+          sp += bytesPerPixel;
+          int b;
+          do {
+            b = src[sp++] & 0xff;
+            len += b;
+          } while (b == 255);
+
+        } else {
+
+          // palette RLE
+
+          int index = src[sp++] & 0xff;
+          if ((index & 128) != 0) {
+            int b;
+            do {
+              b = src[sp++] & 0xff;
+              len += b;
+            } while (b == 255);
           }
+          pix = palette[index & 127];
         }
 
-        handler.imageRect(t, buf);
+        if (!(len <= remaining))
+          throw new ErrorException(
+            "ZRLEDecoder: assertion (len <= end - ptr) failed");
+        remaining -= len;
+
+        while (len > 0) {
+          int n = Math.min(len, w - x);
+          Arrays.fill(dst, dstPtr, dstPtr + n, pix);
+          dstPtr += n;
+          x += n;
+          len -= n;
+          if (x == w) {
+            x = 0;
+            dstPtr += pad;
+          }
+        }
       }
     }
 
-    zis.reset();
+    if (handler != null)
+      handler.imageRect(t, dst);
+    return sp;
   }
 
   // NOTE: must be idempotent
   public void close() {
-    if (zis != null) {
-      zis.close();
-      zis = null;
+    if (inflater != null) {
+      inflater.end();
+      inflater = null;
     }
   }
 
-  CMsgReader reader;
-  ZlibInStream zis;
+  private CMsgReader reader;
+  private Inflater inflater;
+  private int[] palette;
+  private byte[] netbuf;
+  private byte[] decodebuf;
 }
@@ -48,9 +48,20 @@ public class BIPixelBuffer extends PlatformPixelBuffer
     if (w == width() && h == height())
       return;
 
+    Object oldData = data;
+    int oldStride = stride, oldW = width, oldH = height;
     width = w;
     height = h;
     createImage(w, h);
+
+    // Copy the overlapping area from the old image, so that the server need
+    // only send the parts of the desktop that are new or have changed.
+    if (oldData != null && data != null &&
+        oldData.getClass() == data.getClass()) {
+      int rowLen = Math.min(oldW, w), rows = Math.min(oldH, h);
+      for (int y = 0; y < rows; y++)
+        System.arraycopy(oldData, y * oldStride, data, y * stride, rowLen);
+    }
   }
 
   private void createImage(int w, int h) {
@@ -126,6 +137,20 @@ public class BIPixelBuffer extends PlatformPixelBuffer
     }
   }
 
+  public void getImageRect(int x, int y, int w, int h, int[] pix) {
+    SampleModel sm = image.getSampleModel();
+    if (sm.getTransferType() == DataBuffer.TYPE_BYTE) {
+      byte[] bytes = (byte[])sm.getDataElements(x, y, w, h, null, db);
+      for (int i = 0; i < w * h; i++)
+        pix[i] = bytes[i] & 0xff;
+    } else if (sm.getTransferType() == DataBuffer.TYPE_USHORT) {
+      short[] shorts = (short[])sm.getDataElements(x, y, w, h, null, db);
+      for (int i = 0; i < w * h; i++)
+        pix[i] = shorts[i] & 0xffff;
+    } else
+      sm.getDataElements(x, y, w, h, pix, db);
+  }
+
   public void copyRect(int x, int y, int w, int h, int srcX, int srcY) {
     Graphics2D graphics = (Graphics2D)image.getGraphics();
     graphics.copyArea(srcX, srcY, w, h, x - srcX, y - srcY);
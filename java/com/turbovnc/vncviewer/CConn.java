@@ -79,6 +79,7 @@ public class CConn extends CConnection implements UserPasswdGetter,
     options.initDialog();
     clipboardDialog = new ClipboardDialog(this);
     profileDialog = new ProfileDialog(this);
+    memStats = new MemoryStats();
     String env = System.getenv("TVNC_PROFILE");
     if (env != null && env.equals("1"))
       alwaysProfile = true;
@@ -100,6 +101,7 @@ public class CConn extends CConnection implements UserPasswdGetter,
     } else if (!benchmark) {
       String serverName = null;
       int port = -1;
+      Socket tunnelSock = null;
 
       if (opts.serverName != null &&
           !Params.alwaysShowConnectionDialog.getValue()) {
@@ -139,7 +141,7 @@ public class CConn extends CConnection implements UserPasswdGetter,
           }
         }
         try {
-          Tunnel.createTunnel(opts);
+          tunnelSock = Tunnel.createTunnel(opts);
           port = Hostname.getPort(opts.serverName);
           serverName = Hostname.getHost(opts.serverName);
         } catch (Exception e) {
@@ -164,8 +166,14 @@ public class CConn extends CConnection implements UserPasswdGetter,
         }
       }
 
-      sock = new TcpSocket(serverName, port);
-      vlog.info("connected to host " + serverName + " port " + port);
+      if (tunnelSock != null) {
+        sock = tunnelSock;
+        vlog.info("connected to host " + serverName + " port " + port +
+                  " through SSH channel");
+      } else {
+        sock = new TcpSocket(serverName, port);
+        vlog.info("connected to host " + serverName + " port " + port);
+      }
     }
 
     if (benchmark) {
@@ -173,6 +181,10 @@ public class CConn extends CConnection implements UserPasswdGetter,
       reader = new CMsgReaderV3(this, viewer.benchFile);
     } else {
       sock.inStream().setBlockCallback(this);
+      // Receive data on a separate thread, so that the socket continues to be
+      // drained while we are decoding.
+      if (Utils.getBooleanProperty("turbovnc.recvthread", true))
+        sock.inStream().startRecvThread();
       setServerName(opts.serverName);
       setStreams(sock.inStream(), sock.outStream());
       initialiseProtocol();
@@ -492,6 +504,12 @@ public class CConn extends CConnection implements UserPasswdGetter,
     tElapsed = Utils.getTime() - tStart;
 
     if (tElapsed > (double)Params.profileInt.getValue() && !benchmark) {
+      memStats.sample(tElapsed);
+      // Time spent encrypting and decrypting data (a subset of the receive
+      // and decode times), or -1 if the connection does not use TLS
+      double tTLS = -1.0;
+      if (getInStream() instanceof TLSInStream)
+        tTLS = ((TLSInStream)getInStream()).getTLSTime();
       if (profileDialog.isVisible()) {
         String str;
         str = String.format("%.3f", (double)updates / tElapsed);
@@ -535,6 +553,35 @@ public class CConn extends CConnection implements UserPasswdGetter,
 
         str = String.format("%.0f", (double)decodeRect / (double)updates);
         profileDialog.rpuDecodeVal.setText(str);
+
+        str = String.format("%.1f", sock.inStream().getReadTime() /
+                            tElapsed * 100.);
+        profileDialog.pctRecvVal.setText(str);
+        str = String.format("%.1f", tDecode / tElapsed * 100.);
+        profileDialog.pctDecodeVal.setText(str);
+        str = String.format("%.1f", tBlit / tElapsed * 100.);
+        profileDialog.pctBlitVal.setText(str);
+        str = String.format("%.1f", tUpdate / tElapsed * 100.);
+        profileDialog.pctTotalVal.setText(str);
+
+        str = String.format("%d", sock.inStream().getRecvStalls());
+        profileDialog.stallsVal.setText(str);
+
+        str = String.format("%.1f", memStats.poolAllocRate);
+        profileDialog.allocDecodeVal.setText(str);
+        str = memStats.allocRate < 0.0 ? "N/A" :
+              String.format("%.1f", memStats.allocRate);
+        profileDialog.allocTotalVal.setText(str);
+        str = String.format("%d", memStats.gcCount);
+        profileDialog.gcCountVal.setText(str);
+        str = String.format("%.1f", memStats.gcTime / tElapsed * 100.);
+        profileDialog.gcPctVal.setText(str);
+        str = tTLS < 0.0 ? "N/A" :
+              String.format("%.3f", tTLS / (double)updates * 1000.);
+        profileDialog.tlsTpuVal.setText(str);
+        str = tTLS < 0.0 ? "N/A" :
+              String.format("%.1f", tTLS / tElapsed * 100.);
+        profileDialog.tlsPctVal.setText(str);
       }
       if (profileDialog.isVisible() || alwaysProfile) {
         System.out.format("-------------------------------------------------------------------------------\n");
@@ -564,10 +611,40 @@ public class CConn extends CConnection implements UserPasswdGetter,
         System.out.format("              Total = %.3f ms  +  Overhead = %.3f ms\n",
                           tUpdate / (double)updates * 1000.,
                           (tElapsed - tUpdate) / (double)updates * 1000.);
+        System.out.format("Time (%%):     Recv = %.1f,  Decode = %.1f,  Blit = %.1f,  Total = %.1f\n",
+                          sock.inStream().getReadTime() / tElapsed * 100.,
+                          tDecode / tElapsed * 100., tBlit / tElapsed * 100.,
+                          tUpdate / tElapsed * 100.);
+        System.out.format("Recv buffer stalls:  %d\n",
+                          sock.inStream().getRecvStalls());
+        if (tTLS >= 0.0)
+          System.out.format("TLS:          %.3f ms/update,  %.1f %%\n",
+                            tTLS / (double)updates * 1000.,
+                            tTLS / tElapsed * 100.);
+        if (memStats.allocRate >= 0.0)
+          System.out.format("Memory:       Alloc = %.1f MB/sec,  Decoder buffers = %.1f MB/sec\n",
+                            memStats.allocRate, memStats.poolAllocRate);
+        else
+          System.out.format("Memory:       Decoder buffers = %.1f MB/sec\n",
+                            memStats.poolAllocRate);
+        System.out.format("GC:           %d collections,  %.3f ms,  %.1f %%\n",
+                          memStats.gcCount, memStats.gcTime * 1000.,
+                          memStats.gcTime / tElapsed * 100.);
+        synchronized (motionLock) {
+          System.out.format("Motion:       %d events,  %d merged\n",
+                            motionEventsRcvd, motionEventsMerged);
+        }
       }
       tUpdate = tDecode = tBlit = 0.0;
       sock.inStream().resetReadTime();
       sock.inStream().resetBytesRead();
+      sock.inStream().resetRecvStalls();
+      if (tTLS >= 0.0)
+        ((TLSInStream)getInStream()).resetTLSTime();
+      memStats.reset();
+      synchronized (motionLock) {
+        motionEventsRcvd = motionEventsMerged = 0;
+      }
       decodePixels = decodeRect = blitPixels = blits = updates = 0;
       tStart = Utils.getTime();
     }
@@ -710,6 +787,63 @@ public class CConn extends CConnection implements UserPasswdGetter,
       clipboardDialog.serverCutText(str, len);
   }
 
+  // RFB thread
+  public void handleClipboardCaps(int flags, int[] sizes) {
+    super.handleClipboardCaps(flags, sizes);
+    if (benchmark)
+      return;
+    vlog.info("Enabling extended clipboard");
+
+    int[] clientSizes = new int[16];
+    clientSizes[0] = Params.maxClipboard.getValue();
+    writer().writeClipboardCaps(RFB.EXTCLIP_TEXT | RFB.EXTCLIP_REQUEST |
+                                RFB.EXTCLIP_PEEK | RFB.EXTCLIP_NOTIFY |
+                                RFB.EXTCLIP_PROVIDE, clientSizes);
+  }
+
+  // RFB thread
+  public void handleClipboardRequest(int flags) {
+    String str = localClipboard;
+    if (benchmark || (flags & RFB.EXTCLIP_TEXT) == 0 || str == null ||
+        !opts.sendClipboard)
+      return;
+    writer().writeClipboardProvide(str);
+  }
+
+  // RFB thread
+  public void handleClipboardPeek(int flags) {
+    if (benchmark || (cp.clipboardFlags & RFB.EXTCLIP_NOTIFY) == 0)
+      return;
+    writer().writeClipboardNotify(localClipboard != null &&
+                                  opts.sendClipboard ? RFB.EXTCLIP_TEXT : 0);
+  }
+
+  // RFB thread: The server's clipboard has changed.  Rather than transferring
+  // the new contents every time that happens, we fetch them only when the
+  // user might paste them into another application (that is, when the viewer
+  // window loses the keyboard focus or isn't focused to begin with) or when
+  // the clipboard dialog is displayed.
+  public void handleClipboardNotify(int flags) {
+    serverClipboardPending = (flags & RFB.EXTCLIP_TEXT) != 0;
+    if (serverClipboardPending && (desktop == null || !desktop.isFocusOwner()))
+      requestServerClipboard();
+  }
+
+  // RFB thread
+  public void handleClipboardProvide(int flags, String str) {
+    serverCutText(str, str.length());
+  }
+
+  // EDT or RFB thread
+  public void requestServerClipboard() {
+    if (!serverClipboardPending || !opts.recvClipboard ||
+        (cp.clipboardFlags & RFB.EXTCLIP_REQUEST) == 0 ||
+        state() != RFBSTATE_NORMAL || shuttingDown || benchmark)
+      return;
+    serverClipboardPending = false;
+    writer().writeClipboardRequest(RFB.EXTCLIP_TEXT);
+  }
+
   public void startDecodeTimer() {
     tDecodeStart = Utils.getTime();
     if (benchmark)
@@ -755,6 +889,10 @@ public class CConn extends CConnection implements UserPasswdGetter,
     desktop.imageRect(r.tl.x, r.tl.y, r.width(), r.height(), p);
   }
 
+  public void getImageRect(Rect r, int[] p) {
+    desktop.getImageRect(r.tl.x, r.tl.y, r.width(), r.height(), p);
+  }
+
   public void copyRect(Rect r, int sx, int sy) {
     desktop.copyRect(r.tl.x, r.tl.y, r.width(), r.height(), sx, sy);
   }
@@ -789,6 +927,11 @@ public class CConn extends CConnection implements UserPasswdGetter,
       return;
     }
 
+    if (len == MOTION_FENCE_DATA.length && data[0] == MOTION_FENCE_DATA[0]) {
+      motionFenceReturned();
+      return;
+    }
+
     if (len == 0) {
       // Initial probe
       if ((flags & RFB.FENCE_FLAG_SYNC_NEXT) != 0) {
@@ -1469,8 +1612,10 @@ public class CConn extends CConnection implements UserPasswdGetter,
     if (disposeViewport && !confirmClose()) return;
     deleteWindow(disposeViewport);
     shuttingDown = true;
-    if (sock != null)
+    if (sock != null) {
       sock.shutdown();
+      sock.inStream().stopRecvThread();
+    }
     if (opts.sshSession != null) {
       opts.sshSession.disconnect();
       opts.sshSession = null;
@@ -1602,7 +1747,8 @@ public class CConn extends CConnection implements UserPasswdGetter,
     if (opts.allowJpeg != oldOpts.allowJpeg ||
         opts.quality != oldOpts.quality ||
         opts.compressLevel != oldOpts.compressLevel ||
-        opts.subsampling != oldOpts.subsampling)
+        opts.subsampling != oldOpts.subsampling ||
+        opts.serverScale != oldOpts.serverScale)
       encodingChange = true;
 
     if (opts.viewOnly != oldOpts.viewOnly && opts.showToolbar &&
@@ -1884,7 +2030,19 @@ public class CConn extends CConnection implements UserPasswdGetter,
   public void writeClientCutText(String str, int len) {
     if (state() != RFBSTATE_NORMAL || shuttingDown || benchmark)
       return;
-    writer().writeClientCutText(str, len);
+    if ((cp.clipboardFlags & RFB.EXTCLIP_NOTIFY) != 0) {
+      // The server will request the text if and when it needs it.
+      localClipboard = str;
+      writer().writeClipboardNotify(RFB.EXTCLIP_TEXT);
+    } else if ((cp.clipboardFlags & RFB.EXTCLIP_PROVIDE) != 0) {
+      if (len <= (cp.clipboardSizes[0] & 0xFFFFFFFFL))
+        writer().writeClipboardProvide(str);
+      else
+        vlog.info("Not sending " + len + "-character clipboard update " +
+                  "(server limit is " + (cp.clipboardSizes[0] & 0xFFFFFFFFL) +
+                  " bytes)");
+    } else
+      writer().writeClientCutText(str, len);
   }
 
   // EDT
@@ -1892,6 +2050,7 @@ public class CConn extends CConnection implements UserPasswdGetter,
     if (state() != RFBSTATE_NORMAL || shuttingDown || benchmark)
       return;
     try {
+      flushPendingMotion();
       writer().writeKeyEvent(keysym, down);
     } catch (Exception e) {
       if (!shuttingDown) {
@@ -2460,7 +2619,9 @@ public class CConn extends CConnection implements UserPasswdGetter,
     }
 
     try {
-      writer().writePointerEvent(new Point(ev.getX(), ev.getY()), buttonMask);
+      sendPointerEvent(new Point(ev.getX(), ev.getY()), buttonMask,
+                       ev.getID() == MouseEvent.MOUSE_MOVED ||
+                       ev.getID() == MouseEvent.MOUSE_DRAGGED);
     } catch (Exception e) {
       if (!shuttingDown) {
         vlog.error("Error writing pointer event:");
@@ -2470,6 +2631,56 @@ public class CConn extends CConnection implements UserPasswdGetter,
   }
 
 
+  // Motion events are coalesced based on the round-trip time.  Each motion
+  // event that is sent is followed by a fence, and subsequent motion events
+  // are held until the server returns that fence.  Only the most recent held
+  // event is sent when the fence returns, so no more than one round trip's
+  // worth of stale motion is ever queued on the connection.  Button and key
+  // events flush the held motion event and are never coalesced.
+  private void sendPointerEvent(Point pos, int mask, boolean motion) {
+    synchronized (motionLock) {
+      if (motion) motionEventsRcvd++;
+      if (motion && COALESCE_MOTION && cp.supportsFence) {
+        if (motionFencePending) {
+          if (pendingMotion != null) motionEventsMerged++;
+          pendingMotion = pos;
+          pendingMotionMask = mask;
+          return;
+        }
+        writer().writePointerEvent(pos, mask);
+        writer().writeFence(RFB.FENCE_FLAG_REQUEST, MOTION_FENCE_DATA.length,
+                            MOTION_FENCE_DATA);
+        motionFencePending = true;
+      } else {
+        flushPendingMotion();
+        writer().writePointerEvent(pos, mask);
+      }
+    }
+  }
+
+  private void flushPendingMotion() {
+    synchronized (motionLock) {
+      if (pendingMotion != null) {
+        writer().writePointerEvent(pendingMotion, pendingMotionMask);
+        pendingMotion = null;
+      }
+    }
+  }
+
+  // RFB thread
+  private void motionFenceReturned() {
+    synchronized (motionLock) {
+      motionFencePending = false;
+      if (pendingMotion != null) {
+        writer().writePointerEvent(pendingMotion, pendingMotionMask);
+        writer().writeFence(RFB.FENCE_FLAG_REQUEST, MOTION_FENCE_DATA.length,
+                            MOTION_FENCE_DATA);
+        motionFencePending = true;
+        pendingMotion = null;
+      }
+    }
+  }
+
   // EDT
   public void writeWheelEvent(MouseWheelEvent ev) {
     if (state() != RFBSTATE_NORMAL || shuttingDown || benchmark)
@@ -2502,6 +2713,7 @@ public class CConn extends CConnection implements UserPasswdGetter,
       x = ev.getX();
       y = ev.getY();
       try {
+        flushPendingMotion();
         writer().writePointerEvent(new Point(x, y), wheelMask);
         writer().writePointerEvent(new Point(x, y), buttonMask);
       } catch (Exception e) {
@@ -2554,9 +2766,24 @@ public class CConn extends CConnection implements UserPasswdGetter,
 
   // clipboard sync issues?
   ClipboardDialog clipboardDialog;
+  // Local clipboard contents that have been announced to the server but not
+  // necessarily sent
+  private volatile String localClipboard;
+  // The server's clipboard has changed, but its contents have not been
+  // requested.
+  private volatile boolean serverClipboardPending;
 
   int buttonMask;  // EDT only
 
+  static final boolean COALESCE_MOTION =
+    Utils.getBooleanProperty("turbovnc.coalescemotion", true);
+  static final byte[] MOTION_FENCE_DATA = { 'M' };
+  private final Object motionLock = new Object();
+  private boolean motionFencePending;
+  private Point pendingMotion;
+  private int pendingMotionMask;
+  private long motionEventsRcvd, motionEventsMerged;
+
   protected DesktopWindow desktop;
 
   PixelFormat serverPF;
@@ -2596,6 +2823,7 @@ public class CConn extends CConnection implements UserPasswdGetter,
   double tStart = -1.0, tElapsed, tUpdateStart, tUpdate;
   long updates;
   ProfileDialog profileDialog;
+  MemoryStats memStats;
   boolean alwaysProfile;
 
   static LogWriter vlog = new LogWriter("CConn");
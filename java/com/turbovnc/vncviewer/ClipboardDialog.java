@@ -66,6 +66,13 @@ class ClipboardDialog extends Dialog implements ActionListener {
     dlg.setMinimumSize(dlg.getSize());
   }
 
+  public boolean showDialog(Window w) {
+    // Fetch the server's clipboard contents, if they have changed but have
+    // not yet been transferred.  The dialog is updated when they arrive.
+    cc.requestServerClipboard();
+    return super.showDialog(w);
+  }
+
   public boolean compareContentsTo(String str) {
     return str.equals(textArea.getText());
   }
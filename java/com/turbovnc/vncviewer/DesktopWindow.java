@@ -93,6 +93,7 @@ class DesktopWindow extends JPanel implements Runnable, MouseListener,
       }
       public void focusLost(FocusEvent e) {
         cc.releasePressedKeys();
+        cc.requestServerClipboard();
       }
     });
     setFocusTraversalKeysEnabled(false);
@@ -201,6 +202,7 @@ class DesktopWindow extends JPanel implements Runnable, MouseListener,
   // RFB thread
   public void setServerPF(PixelFormat pf) {
     im.setPF(pf);
+    invalidateScaledImage();
   }
 
   public PixelFormat getPreferredPF() {
@@ -218,6 +220,7 @@ class DesktopWindow extends JPanel implements Runnable, MouseListener,
     im.setColourMapEntries(firstColour, nColours, rgbs);
     if (nColours <= 256) {
       im.updateColourMap();
+      invalidateScaledImage();
     } else {
       if (setColourMapEntriesTimerThread == null) {
         setColourMapEntriesTimerThread = new Thread(this);
@@ -234,20 +237,15 @@ class DesktopWindow extends JPanel implements Runnable, MouseListener,
     cc.blitPixels += r.width() * r.height();
     if (!r.isEmpty()) {
       if (cc.cp.width != scaledWidth || cc.cp.height != scaledHeight) {
-        int x = (int)Math.floor(r.tl.x * scaleWidthRatio);
-        int y = (int)Math.floor(r.tl.y * scaleHeightRatio);
-        // Need one extra pixel to account for rounding.
-        int width = (int)Math.ceil(r.width() * scaleWidthRatio) + 1;
-        int height = (int)Math.ceil(r.height() * scaleHeightRatio) + 1;
+        // Rescale only the damaged region, so that repainting the window
+        // doesn't require rescaling the whole framebuffer.
+        Rectangle sr = rescaleRect(r.tl.x, r.tl.y, r.width(), r.height());
+        int x = sr.x, y = sr.y, width = sr.width, height = sr.height;
         if (cc.viewport != null) {
           if (cc.viewport.dx > 0)
             x += cc.viewport.dx;
           if (cc.viewport.dy > 0)
             y += cc.viewport.dy;
-          if (x + width > scaledWidth + cc.viewport.dx)
-            width = scaledWidth + cc.viewport.dx - x;
-          if (y + height > scaledHeight + cc.viewport.dy)
-            height = scaledHeight + cc.viewport.dy - y;
         }
         // We don't actually need Java 2D to double-buffer the viewport,
         // because we're taking care of that ourselves.  This improves
@@ -299,6 +297,7 @@ class DesktopWindow extends JPanel implements Runnable, MouseListener,
     hideLocalCursor();
     setSize(w, h);
     im.resize(w, h);
+    invalidateScaledImage();
   }
 
   // RFB thread
@@ -319,6 +318,13 @@ class DesktopWindow extends JPanel implements Runnable, MouseListener,
       showLocalCursor();
   }
 
+  public final void getImageRect(int x, int y, int w, int h, int[] pix) {
+    if (overlapsCursor(x, y, w, h)) hideLocalCursor();
+    im.getImageRect(x, y, w, h, pix);
+    if (softCursor == null)
+      showLocalCursor();
+  }
+
   public final void copyRect(int x, int y, int w, int h,
                              int srcX, int srcY) {
     if (overlapsCursor(x, y, w, h) || overlapsCursor(srcX, srcY, w, h))
@@ -399,6 +405,68 @@ class DesktopWindow extends JPanel implements Runnable, MouseListener,
     }
     scaleWidthRatio = (float)scaledWidth / (float)cc.cp.width;
     scaleHeightRatio = (float)scaledHeight / (float)cc.cp.height;
+    invalidateScaledImage();
+  }
+
+  // The scaled image is a copy of the framebuffer, scaled to the size of the
+  // window, that is updated incrementally as rectangles are decoded.
+  // invalidateScaledImage() causes the whole image to be rescaled the next time
+  // it is updated or painted.
+  void invalidateScaledImage() {
+    synchronized (scaledImageLock) {
+      scaledImageValid = false;
+    }
+  }
+
+  // Rescale the given region (in framebuffer coordinates) into the scaled
+  // image, and return the corresponding region in scaled coordinates.
+  private Rectangle rescaleRect(int x, int y, int w, int h) {
+    // Bilinear interpolation samples the neighboring pixels, so expand the
+    // region by one pixel in each direction before scaling it.  Need one more
+    // pixel to account for rounding.
+    int sx = (int)Math.floor(Math.max(x - 1, 0) * scaleWidthRatio);
+    int sy = (int)Math.floor(Math.max(y - 1, 0) * scaleHeightRatio);
+    int sw = Math.min((int)Math.ceil((x + w + 1) * scaleWidthRatio) + 1,
+                      scaledWidth) - sx;
+    int sh = Math.min((int)Math.ceil((y + h + 1) * scaleHeightRatio) + 1,
+                      scaledHeight) - sy;
+    synchronized (scaledImageLock) {
+      updateScaledImage(sx, sy, sw, sh);
+    }
+    return new Rectangle(sx, sy, sw, sh);
+  }
+
+  // Rescale the given region (in scaled coordinates) of the framebuffer into
+  // the scaled image, or rescale the whole framebuffer if the scaled image is
+  // invalid.  scaledImageLock must be held.
+  private void updateScaledImage(int x, int y, int w, int h) {
+    int sw = scaledWidth, sh = scaledHeight;
+    if (sw <= 0 || sh <= 0)
+      return;
+    if (scaledImage == null || scaledImage.getWidth() != sw ||
+        scaledImage.getHeight() != sh) {
+      if (scaledImage != null)
+        scaledImage.flush();
+      GraphicsConfiguration gc = getGraphicsConfiguration();
+      if (gc != null)
+        scaledImage = gc.createCompatibleImage(sw, sh);
+      else
+        scaledImage = new BufferedImage(sw, sh, BufferedImage.TYPE_INT_RGB);
+      scaledImageValid = false;
+    }
+    if (!scaledImageValid) {
+      x = y = 0;
+      w = sw;  h = sh;
+      scaledImageValid = true;
+    }
+    if (w <= 0 || h <= 0)
+      return;
+    Graphics2D g2 = scaledImage.createGraphics();
+    g2.setRenderingHint(RenderingHints.KEY_INTERPOLATION,
+                        RenderingHints.VALUE_INTERPOLATION_BILINEAR);
+    g2.clipRect(x, y, w, h);
+    g2.drawImage(im.getImage(), 0, 0, sw, sh, null);
+    g2.dispose();
   }
 
   // EDT
@@ -412,9 +480,14 @@ class DesktopWindow extends JPanel implements Runnable, MouseListener,
     if (cc.viewport != null && (cc.viewport.dx > 0 || cc.viewport.dy > 0))
       g2.translate(cc.viewport.dx, cc.viewport.dy);
     if (cc.cp.width != scaledWidth || cc.cp.height != scaledHeight) {
-      g2.setRenderingHint(RenderingHints.KEY_INTERPOLATION,
-                          RenderingHints.VALUE_INTERPOLATION_BILINEAR);
-      g2.drawImage(im.getImage(), 0, 0, scaledWidth, scaledHeight, null);
+      Rectangle r = g.getClipBounds();
+      synchronized (scaledImageLock) {
+        // Make sure that the scaled image is current.
+        updateScaledImage(0, 0, 0, 0);
+        if (scaledImage != null)
+          g2.drawImage(scaledImage, r.x, r.y, r.x + r.width, r.y + r.height,
+                       r.x, r.y, r.x + r.width, r.y + r.height, null);
+      }
     } else {
       Rectangle r = g.getClipBounds();
       g2.drawImage(im.getImage(), r.x, r.y, r.x + r.width, r.y + r.height,
@@ -745,6 +818,8 @@ class DesktopWindow extends JPanel implements Runnable, MouseListener,
       cursorVisible = false;
       im.imageRect(cursorBackingX, cursorBackingY, cursorBacking.width(),
                    cursorBacking.height(), cursorBacking.data);
+      if (softCursor == null)
+        rescaleCursorRect();
     }
   }
 
@@ -781,9 +856,19 @@ class DesktopWindow extends JPanel implements Runnable, MouseListener,
 
       im.maskRect(cursorLeft, cursorTop, cursor.width(), cursor.height(),
                   (int[])cursor.data, cursor.mask);
+      rescaleCursorRect();
     }
   }
 
+  // Rescale only the area under the cursor, so that moving a cursor that is
+  // drawn into the framebuffer doesn't require rescaling the whole
+  // framebuffer.
+  private void rescaleCursorRect() {
+    if (cc.cp.width != scaledWidth || cc.cp.height != scaledHeight)
+      rescaleRect(cursorBackingX, cursorBackingY, cursorBacking.width(),
+                  cursorBacking.height());
+  }
+
   // RFB thread
   void damageRect(int x, int y, int w, int h) {
     if (damage.isEmpty()) {
@@ -804,6 +889,7 @@ class DesktopWindow extends JPanel implements Runnable, MouseListener,
       Thread.sleep(100);
     } catch (InterruptedException e) {}
     im.updateColourMap();
+    invalidateScaledImage();
     setColourMapEntriesTimerThread = null;
   }
 
@@ -904,6 +990,10 @@ class DesktopWindow extends JPanel implements Runnable, MouseListener,
 
   int scaledWidth = 0, scaledHeight = 0;
   float scaleWidthRatio, scaleHeightRatio;
+  // Access to the following must be synchronized on scaledImageLock:
+  private final Object scaledImageLock = new Object();
+  private BufferedImage scaledImage;
+  private boolean scaledImageValid;
 
   int lastX, lastY;  // EDT only
   Rect damage = new Rect();
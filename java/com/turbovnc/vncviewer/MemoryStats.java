@@ -0,0 +1,136 @@
+/* Copyright (C) 2026 agent.  All Rights Reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ */
+
+//
+// MemoryStats - measures the heap allocation rate and garbage collection
+// overhead of the viewer, for the profiling output
+//
+
+package com.turbovnc.vncviewer;
+
+import java.lang.management.*;
+import java.lang.reflect.Method;
+
+import com.turbovnc.rfb.*;
+
+class MemoryStats {
+
+  MemoryStats() {
+    // The per-thread allocation counters are a HotSpot extension, so they are
+    // accessed using reflection.
+    try {
+      Class<?> iface = Class.forName("com.sun.management.ThreadMXBean");
+      ThreadMXBean bean = ManagementFactory.getThreadMXBean();
+      if (iface.isInstance(bean)) {
+        Method isSupported =
+          iface.getMethod("isThreadAllocatedMemorySupported", (Class[])null);
+        if ((Boolean)isSupported.invoke(bean, (Object[])null)) {
+          Method setEnabled =
+            iface.getMethod("setThreadAllocatedMemoryEnabled", boolean.class);
+          setEnabled.invoke(bean, true);
+          getAllocatedBytes =
+            iface.getMethod("getThreadAllocatedBytes", long[].class);
+          threadBean = bean;
+        }
+      }
+    } catch (Exception e) {
+      vlog.debug("Heap allocation rate is not available:");
+      vlog.debug("  " + e.toString());
+    }
+    reset();
+  }
+
+  // Begin a new measurement interval.
+  void reset() {
+    allocStart = getAllocatedBytes();
+    gcCountStart = getGCCount();
+    gcTimeStart = getGCTime();
+    BufferPool.resetStats();
+  }
+
+  // Compute the statistics for the interval that began with the last call to
+  // reset().
+  void sample(double tElapsed) {
+    long alloc = getAllocatedBytes();
+    if (alloc >= 0 && allocStart >= 0)
+      allocRate =
+        (double)Math.max(alloc - allocStart, 0) / 1000000. / tElapsed;
+    else
+      allocRate = -1.0;
+    poolAllocRate =
+      (double)BufferPool.getBytesAllocated() / 1000000. / tElapsed;
+    gcCount = getGCCount() - gcCountStart;
+    gcTime = (double)(getGCTime() - gcTimeStart) / 1000.;
+  }
+
+  // Return the total number of bytes allocated by all live threads, or -1 if
+  // this information is not available.
+  private long getAllocatedBytes() {
+    if (threadBean == null)
+      return -1;
+    try {
+      long[] bytes = (long[])getAllocatedBytes.invoke(threadBean,
+        threadBean.getAllThreadIds());
+      long total = 0;
+      for (long b : bytes)
+        if (b > 0) total += b;
+      return total;
+    } catch (Exception e) {
+      threadBean = null;
+      return -1;
+    }
+  }
+
+  private static long getGCCount() {
+    long count = 0;
+    for (GarbageCollectorMXBean gc :
+         ManagementFactory.getGarbageCollectorMXBeans()) {
+      long c = gc.getCollectionCount();
+      if (c > 0) count += c;
+    }
+    return count;
+  }
+
+  // NOTE: For concurrent collectors, this includes time that the collector
+  // spent running alongside the application threads as well as the time that
+  // it paused them.
+  private static long getGCTime() {
+    long time = 0;
+    for (GarbageCollectorMXBean gc :
+         ManagementFactory.getGarbageCollectorMXBeans()) {
+      long t = gc.getCollectionTime();
+      if (t > 0) time += t;
+    }
+    return time;
+  }
+
+  // Heap allocation rate (MB/sec) of all threads, or -1 if unavailable
+  double allocRate;
+  // Allocation rate (MB/sec) of new decoder buffers
+  double poolAllocRate;
+  // Number of garbage collections and time (seconds) spent in garbage
+  // collection
+  long gcCount;
+  double gcTime;
+
+  private ThreadMXBean threadBean;
+  private Method getAllocatedBytes;
+  private long allocStart, gcCountStart, gcTimeStart;
+
+  static LogWriter vlog = new LogWriter("MemoryStats");
+}
@@ -42,8 +42,8 @@ class OptionsDialog extends Dialog implements ActionListener, ChangeListener,
   private JTabbedPane tabPane;
   private JPanel buttonPane, encodingPanel, connPanel, globalPanel, secPanel;
   private JCheckBox allowJpeg, interframe;
-  private JComboBox menuKey, scalingFactor, encMethodComboBox, span,
-    desktopSize, grabKeyboard;
+  private JComboBox menuKey, scalingFactor, serverScale, encMethodComboBox,
+    span, desktopSize, grabKeyboard;
   private JSlider jpegQualityLevel, subsamplingLevel, compressionLevel;
   private JCheckBox viewOnly, recvClipboard, sendClipboard, acceptBell,
     reverseScroll, fsAltEnter;
@@ -67,7 +67,7 @@ class OptionsDialog extends Dialog implements ActionListener, ChangeListener,
   private String jpegQualityLabelString, subsamplingLabelString;
   private String compressionLabelString;
   private Hashtable<Integer, String> subsamplingLabelTable;
-  private String oldScalingFactor, oldDesktopSize;
+  private String oldScalingFactor, oldServerScale, oldDesktopSize;
   private boolean enableX509 = true;
 
   OptionsDialog(OptionsDialogCallback callback_) {
@@ -270,6 +270,25 @@ class OptionsDialog extends Dialog implements ActionListener, ChangeListener,
                           GridBagConstraints.FIRST_LINE_START,
                           new Insets(4, 5, 0, 5));
 
+    JLabel serverScaleLabel = new JLabel("Server-side scaling factor:");
+    Object[] serverScales = {
+      "25%", "50%", "75%", "100%"
+    };
+    serverScale = new JComboBox(serverScales);
+    serverScale.setEditable(true);
+    serverScale.addItemListener(this);
+
+    Dialog.addGBComponent(serverScaleLabel, displayPanel,
+                          0, 1, 1, 1, 2, 2, 1, 0,
+                          GridBagConstraints.NONE,
+                          GridBagConstraints.FIRST_LINE_START,
+                          new Insets(8, 8, 0, 5));
+    Dialog.addGBComponent(serverScale, displayPanel,
+                          1, 1, 1, 1, 2, 2, 25, 0,
+                          GridBagConstraints.NONE,
+                          GridBagConstraints.FIRST_LINE_START,
+                          new Insets(4, 5, 0, 5));
+
     Object[] desktopSizeOptions = {
       "Auto", "Server", "480x320", "640x360", "640x480", "800x480", "800x600",
       "854x480", "960x540", "960x600", "960x640",
@@ -301,12 +320,12 @@ class OptionsDialog extends Dialog implements ActionListener, ChangeListener,
     desktopSize.setMaximumSize(desktopSize.getPreferredSize());
 
     Dialog.addGBComponent(desktopSizeLabel, displayPanel,
-                          0, 1, 1, 1, 2, 2, 1, 0,
+                          0, 2, 1, 1, 2, 2, 1, 0,
                           GridBagConstraints.NONE,
                           GridBagConstraints.FIRST_LINE_START,
                           new Insets(8, 8, 0, 5));
     Dialog.addGBComponent(desktopSize, displayPanel,
-                          1, 1, 1, 1, 2, 2, 25, 0,
+                          1, 2, 1, 1, 2, 2, 25, 0,
                           GridBagConstraints.NONE,
                           GridBagConstraints.FIRST_LINE_START,
                           new Insets(4, 5, 0, 5));
@@ -315,7 +334,7 @@ class OptionsDialog extends Dialog implements ActionListener, ChangeListener,
     fullScreen.addItemListener(this);
 
     Dialog.addGBComponent(fullScreen, displayPanel,
-                          0, 2, 2, 1, 2, 2, 1, 0,
+                          0, 3, 2, 1, 2, 2, 1, 0,
                           GridBagConstraints.HORIZONTAL,
                           GridBagConstraints.FIRST_LINE_START,
                           new Insets(4, 5, 0, 5));
@@ -336,12 +355,12 @@ class OptionsDialog extends Dialog implements ActionListener, ChangeListener,
     }
 
     Dialog.addGBComponent(spanLabel, displayPanel,
-                          0, 3, 1, 1, 2, 2, 1, 0,
+                          0, 4, 1, 1, 2, 2, 1, 0,
                           GridBagConstraints.NONE,
                           GridBagConstraints.FIRST_LINE_START,
                           new Insets(8, 8, 0, 5));
     Dialog.addGBComponent(span, displayPanel,
-                          1, 3, 1, 1, 2, 2, 25, 0,
+                          1, 4, 1, 1, 2, 2, 25, 0,
                           GridBagConstraints.NONE,
                           GridBagConstraints.FIRST_LINE_START,
                           new Insets(4, 5, 0, 5));
@@ -350,7 +369,7 @@ class OptionsDialog extends Dialog implements ActionListener, ChangeListener,
     acceptBell.addItemListener(this);
 
     Dialog.addGBComponent(acceptBell, displayPanel,
-                          0, 4, 2, 1, 2, 2, 1, 1,
+                          0, 5, 2, 1, 2, 2, 1, 1,
                           GridBagConstraints.HORIZONTAL,
                           GridBagConstraints.FIRST_LINE_START,
                           new Insets(4, 5, 0, 5));
@@ -360,7 +379,7 @@ class OptionsDialog extends Dialog implements ActionListener, ChangeListener,
     cursorShape.addItemListener(this);
 
     Dialog.addGBComponent(cursorShape, displayPanel,
-                          0, 5, 2, 1, 2, 2, 1, 0,
+                          0, 6, 2, 1, 2, 2, 1, 0,
                           GridBagConstraints.HORIZONTAL,
                           GridBagConstraints.FIRST_LINE_START,
                           new Insets(4, 5, 0, 5));
@@ -369,7 +388,7 @@ class OptionsDialog extends Dialog implements ActionListener, ChangeListener,
     showToolbar.addItemListener(this);
 
     Dialog.addGBComponent(showToolbar, displayPanel,
-                          0, 6, 2, 1, 2, 2, 1, 0,
+                          0, 7, 2, 1, 2, 2, 1, 0,
                           GridBagConstraints.HORIZONTAL,
                           GridBagConstraints.FIRST_LINE_START,
                           new Insets(4, 5, 0, 5));
@@ -788,6 +807,7 @@ class OptionsDialog extends Dialog implements ActionListener, ChangeListener,
   public void initDialog() {
     if (callback != null) callback.setOptions();
     oldScalingFactor = scalingFactor.getSelectedItem().toString();
+    oldServerScale = serverScale.getSelectedItem().toString();
     oldDesktopSize = desktopSize.getSelectedItem().toString();
   }
 
@@ -963,6 +983,19 @@ class OptionsDialog extends Dialog implements ActionListener, ChangeListener,
           desktopSize.setEnabled(callback.supportsSetDesktopSize());
       }
     }
+    if (s instanceof JComboBox && (JComboBox)s == serverScale) {
+      String newServerScale = serverScale.getSelectedItem().toString();
+      int sf = Options.parseServerScale(newServerScale);
+      if (sf == 0) {
+        vlog.error("Bogus server-side scaling factor");
+        serverScale.setSelectedItem(oldServerScale);
+      } else {
+        String newsf = sf + "%";
+        oldServerScale = newsf;
+        if (!newsf.equals(newServerScale))
+          serverScale.setSelectedItem(newsf);
+      }
+    }
     if (s instanceof JComboBox && (JComboBox)s == desktopSize) {
       String newDesktopSize = desktopSize.getSelectedItem().toString();
       Options.DesktopSize size = Options.parseDesktopSize(newDesktopSize);
@@ -1216,6 +1249,7 @@ class OptionsDialog extends Dialog implements ActionListener, ChangeListener,
     } else {
       scalingFactor.setSelectedItem(opts.scalingFactor + "%");
     }
+    serverScale.setSelectedItem(opts.serverScale + "%");
 
     desktopSize.setSelectedItem(opts.desktopSize.getString());
     fullScreen.setSelected(opts.fullScreen);
@@ -1319,6 +1353,7 @@ class OptionsDialog extends Dialog implements ActionListener, ChangeListener,
 
     // Connection: Display
     opts.setScalingFactor(scalingFactor.getSelectedItem().toString());
+    opts.setServerScale(serverScale.getSelectedItem().toString());
     opts.setDesktopSize(desktopSize.getSelectedItem().toString());
     opts.fullScreen = fullScreen.isSelected();
     int index = span.getSelectedIndex();
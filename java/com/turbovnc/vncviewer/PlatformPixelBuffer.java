@@ -77,6 +77,10 @@ public abstract class PlatformPixelBuffer extends PixelBuffer {
 
   public abstract void imageRect(int x, int y, int w, int h, Object pix);
 
+  // getImageRect() is the inverse of imageRect().  It copies the pixels in
+  // the specified rectangle into pix, which must hold at least w * h pixels.
+  public abstract void getImageRect(int x, int y, int w, int h, int[] pix);
+
   // setColourMapEntries() changes some of the entries in the colourmap.
   // However these settings won't take effect until updateColourMap() is
   // called.  This is because getting java to recalculate its internal
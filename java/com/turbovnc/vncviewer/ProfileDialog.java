@@ -105,6 +105,42 @@ class ProfileDialog extends Dialog {
     rpuHeading.setFont(boldFont);
     rpuDecodeVal = new JLabel("0000000");
 
+    JLabel pctHeading = new JLabel("Time (%):");
+    font = pctHeading.getFont();
+    boldFont = new Font(font.getFontName(), Font.BOLD, font.getSize());
+    pctHeading.setFont(boldFont);
+    pctRecvVal = new JLabel("000.0");
+    pctDecodeVal = new JLabel("000.0");
+    pctBlitVal = new JLabel("000.0");
+    pctTotalVal = new JLabel("000.0");
+
+    JLabel stallsHeading = new JLabel("Recv buffer stalls:");
+    font = stallsHeading.getFont();
+    boldFont = new Font(font.getFontName(), Font.BOLD, font.getSize());
+    stallsHeading.setFont(boldFont);
+    stallsVal = new JLabel("0000000");
+
+    JLabel allocHeading = new JLabel("Allocation (MB/sec):");
+    font = allocHeading.getFont();
+    boldFont = new Font(font.getFontName(), Font.BOLD, font.getSize());
+    allocHeading.setFont(boldFont);
+    allocDecodeVal = new JLabel("0000.0");
+    allocTotalVal = new JLabel("0000.0");
+
+    JLabel gcHeading = new JLabel("GC collections/time (%):");
+    font = gcHeading.getFont();
+    boldFont = new Font(font.getFontName(), Font.BOLD, font.getSize());
+    gcHeading.setFont(boldFont);
+    gcCountVal = new JLabel("0000000");
+    gcPctVal = new JLabel("000.0");
+
+    JLabel tlsHeading = new JLabel("TLS time/update (ms)/(%):");
+    font = tlsHeading.getFont();
+    boldFont = new Font(font.getFontName(), Font.BOLD, font.getSize());
+    tlsHeading.setFont(boldFont);
+    tlsTpuVal = new JLabel("000.000");
+    tlsPctVal = new JLabel("000.0");
+
     Dialog.addGBComponent(recvHeading, panel,
                           1, 0, 1, 1, 0, 0, 0, 0,
                           GridBagConstraints.NONE,
@@ -254,6 +290,91 @@ class ProfileDialog extends Dialog {
                           GridBagConstraints.LINE_START,
                           new Insets(2, 8, 2, 8));
 
+    Dialog.addGBComponent(pctHeading, panel,
+                          0, 9, 1, 1, 0, 0, 0, 0,
+                          GridBagConstraints.NONE,
+                          GridBagConstraints.LINE_START,
+                          new Insets(2, 8, 2, 8));
+    Dialog.addGBComponent(pctRecvVal, panel,
+                          1, 9, 1, 1, 0, 0, 0, 0,
+                          GridBagConstraints.NONE,
+                          GridBagConstraints.LINE_START,
+                          new Insets(2, 8, 2, 8));
+    Dialog.addGBComponent(pctDecodeVal, panel,
+                          2, 9, 1, 1, 0, 0, 0, 0,
+                          GridBagConstraints.NONE,
+                          GridBagConstraints.LINE_START,
+                          new Insets(2, 8, 2, 8));
+    Dialog.addGBComponent(pctBlitVal, panel,
+                          3, 9, 1, 1, 0, 0, 0, 0,
+                          GridBagConstraints.NONE,
+                          GridBagConstraints.LINE_START,
+                          new Insets(2, 8, 2, 8));
+    Dialog.addGBComponent(pctTotalVal, panel,
+                          4, 9, 1, 1, 0, 0, 0, 0,
+                          GridBagConstraints.NONE,
+                          GridBagConstraints.LINE_START,
+                          new Insets(2, 8, 2, 8));
+
+    Dialog.addGBComponent(stallsHeading, panel,
+                          0, 10, 1, 1, 0, 0, 0, 0,
+                          GridBagConstraints.NONE,
+                          GridBagConstraints.LINE_START,
+                          new Insets(2, 8, 2, 8));
+    Dialog.addGBComponent(stallsVal, panel,
+                          1, 10, 1, 1, 0, 0, 0, 0,
+                          GridBagConstraints.NONE,
+                          GridBagConstraints.LINE_START,
+                          new Insets(2, 8, 2, 8));
+
+    Dialog.addGBComponent(allocHeading, panel,
+                          0, 11, 1, 1, 0, 0, 0, 0,
+                          GridBagConstraints.NONE,
+                          GridBagConstraints.LINE_START,
+                          new Insets(2, 8, 2, 8));
+    Dialog.addGBComponent(allocDecodeVal, panel,
+                          2, 11, 1, 1, 0, 0, 0, 0,
+                          GridBagConstraints.NONE,
+                          GridBagConstraints.LINE_START,
+                          new Insets(2, 8, 2, 8));
+    Dialog.addGBComponent(allocTotalVal, panel,
+                          4, 11, 1, 1, 0, 0, 0, 0,
+                          GridBagConstraints.NONE,
+                          GridBagConstraints.LINE_START,
+                          new Insets(2, 8, 2, 8));
+
+    Dialog.addGBComponent(gcHeading, panel,
+                          0, 12, 1, 1, 0, 0, 0, 0,
+                          GridBagConstraints.NONE,
+                          GridBagConstraints.LINE_START,
+                          new Insets(2, 8, 2, 8));
+    Dialog.addGBComponent(gcCountVal, panel,
+                          1, 12, 1, 1, 0, 0, 0, 0,
+                          GridBagConstraints.NONE,
+                          GridBagConstraints.LINE_START,
+                          new Insets(2, 8, 2, 8));
+    Dialog.addGBComponent(gcPctVal, panel,
+                          4, 12, 1, 1, 0, 0, 0, 0,
+                          GridBagConstraints.NONE,
+                          GridBagConstraints.LINE_START,
+                          new Insets(2, 8, 2, 8));
+
+    Dialog.addGBComponent(tlsHeading, panel,
+                          0, 13, 1, 1, 0, 0, 0, 0,
+                          GridBagConstraints.NONE,
+                          GridBagConstraints.LINE_START,
+                          new Insets(2, 8, 2, 8));
+    Dialog.addGBComponent(tlsTpuVal, panel,
+                          1, 13, 1, 1, 0, 0, 0, 0,
+                          GridBagConstraints.NONE,
+                          GridBagConstraints.LINE_START,
+                          new Insets(2, 8, 2, 8));
+    Dialog.addGBComponent(tlsPctVal, panel,
+                          4, 13, 1, 1, 0, 0, 0, 0,
+                          GridBagConstraints.NONE,
+                          GridBagConstraints.LINE_START,
+                          new Insets(2, 8, 2, 8));
+
     panel.setBorder(BorderFactory.createEmptyBorder(10, 10, 10, 10));
   }
 
@@ -304,4 +425,8 @@ class ProfileDialog extends Dialog {
   JLabel mpDecodeVal, mpBlitVal, mpsDecodeVal, mpsBlitVal, mpsTotalVal;
   JLabel rectDecodeVal, rectBlitVal, pprDecodeVal, pprBlitVal;
   JLabel rpuDecodeVal;
+  JLabel pctRecvVal, pctDecodeVal, pctBlitVal, pctTotalVal;
+  JLabel stallsVal;
+  JLabel allocDecodeVal, allocTotalVal, gcCountVal, gcPctVal;
+  JLabel tlsTpuVal, tlsPctVal;
 }
@@ -40,7 +40,11 @@ import com.jcraft.jsch.*;
 
 public class Tunnel {
 
-  public static void createTunnel(Options opts) throws Exception {
+  // If the built-in SSH client is used, then this returns a socket that
+  // communicates directly with an SSH channel.  Otherwise, it returns null,
+  // and the caller should connect to opts.serverName.
+  public static Socket createTunnel(Options opts) throws Exception {
+    Socket sock = null;
     int localPort;
     int remotePort;
     String gatewayHost;
@@ -84,14 +88,36 @@ public class Tunnel {
       vlog.debug("Opening SSH tunnel through gateway " + gatewayHost);
       if (opts.sshSession == null)
         createTunnelJSch(gatewayHost, opts);
+      if (Utils.getBooleanProperty("turbovnc.sshchannel", true)) {
+        // Read from and write to the SSH channel directly rather than through
+        // a loopback TCP connection.  The local window starts at 2 MB and
+        // grows as needed (up to turbovnc.sshwindow KB) so that it does not
+        // limit throughput on high-latency links.
+        int maxWindowSize =
+          Math.max(Utils.getIntProperty("turbovnc.sshwindow", 16384), 128) *
+          1024;
+        vlog.debug("Opening SSH channel to " + remoteHost + ":" + remotePort +
+                   " (relative to gateway)");
+        sock = new SSHChannelSocket(opts.sshSession, remoteHost, remotePort,
+                                    Math.min(SSH_WINDOW_SIZE, maxWindowSize),
+                                    maxWindowSize, SSH_PACKET_SIZE);
+        opts.serverName = remoteHost + "::" + remotePort;
+        opts.sshTunnelActive = true;
+        return sock;
+      }
       vlog.debug("Forwarding local port " + localPort + " to " + remoteHost +
                  ":" + remotePort + " (relative to gateway)");
       opts.sshSession.setPortForwardingL(localPort, remoteHost, remotePort);
     }
     opts.serverName = "localhost::" + localPort;
     opts.sshTunnelActive = true;
+    return sock;
   }
 
+  private static final int SSH_WINDOW_SIZE = 2 * 1024 * 1024;
+  // OpenSSH's default maximum packet size
+  private static final int SSH_PACKET_SIZE = 32768;
+
   /* Create a tunnel using the builtin JSch SSH client */
 
   protected static void createTunnelJSch(String host, Options opts)
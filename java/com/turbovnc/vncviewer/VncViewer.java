@@ -883,6 +883,8 @@ public class VncViewer implements Runnable, OptionsDialogCallback {
         opts.desktopSize.mode = Options.SIZE_SERVER;
       }
 
+      opts.serverScale = Params.serverScale.getValue();
+
       if (Params.span.getValue().toLowerCase().startsWith("p"))
         opts.span = Options.SPAN_PRIMARY;
       else if (Params.span.getValue().toLowerCase().startsWith("al"))
@@ -42,6 +42,7 @@
 #include "scrnintstr.h"
 #include "pixmapstr.h"
 #include "gcstruct.h"
+#include "servermd.h"
 #include "os.h"
 
 #include "glxserver.h"
@@ -108,6 +109,13 @@ __glXDRIdrawableSwapBuffers(ClientPtr client, __GLXdrawable * drawable)
 
     (*core->swapBuffers) (private->driDrawable);
 
+#ifdef TURBOVNC
+    if (drawable->type == GLX_DRAWABLE_WINDOW) {
+        extern void rfbFrameComplete(WindowPtr pWin);
+        rfbFrameComplete((WindowPtr)drawable->pDraw);
+    }
+#endif
+
     return TRUE;
 }
 
@@ -294,18 +302,43 @@ swrastGetDrawableInfo(__DRIdrawable * draw,
 }
 
 static void
-swrastPutImage(__DRIdrawable * draw, int op,
-               int x, int y, int w, int h, char *data, void *loaderPrivate)
+swrastPutImage2(__DRIdrawable * draw, int op,
+                int x, int y, int w, int h, int stride,
+                char *data, void *loaderPrivate)
 {
     __GLXDRIdrawable *drawable = loaderPrivate;
     DrawablePtr pDraw = drawable->base.pDraw;
     GCPtr gc;
     __GLXcontext *cx = lastGLContext;
+    int bytesPerPixel = pDraw->bitsPerPixel / 8;
 
     if ((gc = GetScratchGC(pDraw->depth, pDraw->pScreen))) {
-        ValidateGC(pDraw, gc);
-        gc->ops->PutImage(pDraw, gc, pDraw->depth, x, y, w, h, 0, ZPixmap,
-                          data);
+        if (stride == PixmapBytePad(w, pDraw->depth)) {
+            ValidateGC(pDraw, gc);
+            gc->ops->PutImage(pDraw, gc, pDraw->depth, x, y, w, h, 0, ZPixmap,
+                              data);
+        } else if (bytesPerPixel > 0 && stride % bytesPerPixel == 0 &&
+                   PixmapBytePad(stride / bytesPerPixel, pDraw->depth) ==
+                   stride) {
+            /* The driver's back buffer is padded (or we are being asked to
+             * display only part of it.)  Rather than repacking the rows,
+             * treat the padding as part of the image and clip it away.  This
+             * also ensures that only the swapped area is damaged.
+             */
+            xRectangle rect = { x, y, w, h };
+
+            SetClipRects(gc, 0, 0, 1, &rect, YXBanded);
+            ValidateGC(pDraw, gc);
+            gc->ops->PutImage(pDraw, gc, pDraw->depth, x, y,
+                              stride / bytesPerPixel, h, 0, ZPixmap, data);
+        } else {
+            int i;
+
+            ValidateGC(pDraw, gc);
+            for (i = 0; i < h; i++)
+                gc->ops->PutImage(pDraw, gc, pDraw->depth, x, y + i, w, 1, 0,
+                                  ZPixmap, data + i * stride);
+        }
         FreeScratchGC(gc);
     }
 
@@ -316,27 +349,66 @@ swrastPutImage(__DRIdrawable * draw, int op,
 }
 
 static void
-swrastGetImage(__DRIdrawable * draw,
+swrastPutImage(__DRIdrawable * draw, int op,
                int x, int y, int w, int h, char *data, void *loaderPrivate)
 {
     __GLXDRIdrawable *drawable = loaderPrivate;
     DrawablePtr pDraw = drawable->base.pDraw;
+
+    swrastPutImage2(draw, op, x, y, w, h, PixmapBytePad(w, pDraw->depth),
+                    data, loaderPrivate);
+}
+
+static void
+swrastGetImage2(__DRIdrawable * draw,
+                int x, int y, int w, int h, int stride,
+                char *data, void *loaderPrivate)
+{
+    __GLXDRIdrawable *drawable = loaderPrivate;
+    DrawablePtr pDraw = drawable->base.pDraw;
     ScreenPtr pScreen = pDraw->pScreen;
     __GLXcontext *cx = lastGLContext;
 
     pScreen->SourceValidate(pDraw, x, y, w, h, IncludeInferiors);
-    pScreen->GetImage(pDraw, x, y, w, h, ZPixmap, ~0L, data);
+    if (stride == PixmapBytePad(w, pDraw->depth))
+        pScreen->GetImage(pDraw, x, y, w, h, ZPixmap, ~0L, data);
+    else {
+        int i;
+
+        for (i = 0; i < h; i++)
+            pScreen->GetImage(pDraw, x, y + i, w, 1, ZPixmap, ~0L,
+                              data + i * stride);
+    }
     if (cx != lastGLContext) {
         lastGLContext = cx;
         cx->makeCurrent(cx);
     }
 }
 
+static void
+swrastGetImage(__DRIdrawable * draw,
+               int x, int y, int w, int h, char *data, void *loaderPrivate)
+{
+    __GLXDRIdrawable *drawable = loaderPrivate;
+    DrawablePtr pDraw = drawable->base.pDraw;
+
+    swrastGetImage2(draw, x, y, w, h, PixmapBytePad(w, pDraw->depth), data,
+                    loaderPrivate);
+}
+
+/* Version 3 of the loader interface allows the driver to pass its back buffer
+ * with an arbitrary stride, which spares it from repacking padded rows (or,
+ * for sub-rectangle swaps, copying the sub-rectangle) before handing them to
+ * us.  The SHM interfaces in versions 4 and later are not useful here, since
+ * the driver already runs in the X server's address space.
+ */
 static const __DRIswrastLoaderExtension swrastLoaderExtension = {
-    {__DRI_SWRAST_LOADER, 1},
+    {__DRI_SWRAST_LOADER, 3},
     swrastGetDrawableInfo,
     swrastPutImage,
-    swrastGetImage
+    swrastGetImage,
+    swrastPutImage2,
+    swrastGetImage2
 };
 
 static const __DRIextension *loader_extensions[] = {
@@ -59,6 +59,26 @@ static const char Base64[] =
 	"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
 static const char Pad64 = '=';
 
+/* Reverse lookup table for the Base64 alphabet (255 = not a Base64 digit) */
+static const u_char Base64Rev[256] = {
+	255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+	255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+	255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,  62, 255, 255, 255,  63,
+	 52,  53,  54,  55,  56,  57,  58,  59,  60,  61, 255, 255, 255, 255, 255, 255,
+	255,   0,   1,   2,   3,   4,   5,   6,   7,   8,   9,  10,  11,  12,  13,  14,
+	 15,  16,  17,  18,  19,  20,  21,  22,  23,  24,  25, 255, 255, 255, 255, 255,
+	255,  26,  27,  28,  29,  30,  31,  32,  33,  34,  35,  36,  37,  38,  39,  40,
+	 41,  42,  43,  44,  45,  46,  47,  48,  49,  50,  51, 255, 255, 255, 255, 255,
+	255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+	255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+	255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+	255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+	255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+	255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+	255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+	255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+};
+
 /* (From RFC1521 and draft-ietf-dnssec-secext-03.txt)
    The following encoding technique is taken from RFC 1521 by Borenstein
    and Freed.  It is reproduced here in a slightly edited form for
@@ -134,23 +154,22 @@ __b64_ntop(src, srclength, target, targsize)
 	u_char output[4];
 	int i;
 
+	/* Check the target size once, rather than once per quantum. */
+	if ((srclength + 2) / 3 * 4 >= targsize)
+		return (-1);
+
 	while (2 < srclength) {
-		input[0] = *src++;
-		input[1] = *src++;
-		input[2] = *src++;
-		srclength -= 3;
+		u_int group = ((u_int)src[0] << 16) | ((u_int)src[1] << 8) |
+		    (u_int)src[2];
 
-		output[0] = input[0] >> 2;
-		output[1] = ((input[0] & 0x03) << 4) + (input[1] >> 4);
-		output[2] = ((input[1] & 0x0f) << 2) + (input[2] >> 6);
-		output[3] = input[2] & 0x3f;
+		src += 3;
+		srclength -= 3;
 
-		if (datalength + 4 > targsize)
-			return (-1);
-		target[datalength++] = Base64[output[0]];
-		target[datalength++] = Base64[output[1]];
-		target[datalength++] = Base64[output[2]];
-		target[datalength++] = Base64[output[3]];
+		target[datalength] = Base64[group >> 18];
+		target[datalength + 1] = Base64[(group >> 12) & 0x3f];
+		target[datalength + 2] = Base64[(group >> 6) & 0x3f];
+		target[datalength + 3] = Base64[group & 0x3f];
+		datalength += 4;
 	}
 
 	/* Now we worry about padding. */
@@ -194,11 +213,32 @@ __b64_pton(src, target, targsize)
 {
 	int tarindex, state, ch;
 	u_char nextbyte;
-	char *pos;
+	u_char digit;
 
 	state = 0;
 	tarindex = 0;
 
+	/*
+	 * Fast path: decode complete quanta that contain no whitespace or
+	 * padding.  '\0' is not a Base64 digit, so this never reads past the
+	 * end of the string.
+	 */
+	if (target) {
+		u_char d0, d1, d2, d3;
+
+		while ((d0 = Base64Rev[(u_char)src[0]]) < 64 &&
+		    (d1 = Base64Rev[(u_char)src[1]]) < 64 &&
+		    (d2 = Base64Rev[(u_char)src[2]]) < 64 &&
+		    (d3 = Base64Rev[(u_char)src[3]]) < 64 &&
+		    tarindex + 3 <= targsize) {
+			target[tarindex] = (d0 << 2) | (d1 >> 4);
+			target[tarindex + 1] = (d1 << 4) | (d2 >> 2);
+			target[tarindex + 2] = (d2 << 6) | d3;
+			tarindex += 3;
+			src += 4;
+		}
+	}
+
 	while ((ch = (unsigned char)*src++) != '\0') {
 		if (isspace(ch))	/* Skip whitespace anywhere. */
 			continue;
@@ -206,8 +246,8 @@ __b64_pton(src, target, targsize)
 		if (ch == Pad64)
 			break;
 
-		pos = strchr(Base64, ch);
-		if (pos == 0) 		/* A non-base64 character. */
+		digit = Base64Rev[ch];
+		if (digit >= 64)	/* A non-base64 character. */
 			return (-1);
 
 		switch (state) {
@@ -215,7 +255,7 @@ __b64_pton(src, target, targsize)
 			if (target) {
 				if (tarindex >= targsize)
 					return (-1);
-				target[tarindex] = (pos - Base64) << 2;
+				target[tarindex] = digit << 2;
 			}
 			state = 1;
 			break;
@@ -223,8 +263,8 @@ __b64_pton(src, target, targsize)
 			if (target) {
 				if (tarindex >= targsize)
 					return (-1);
-				target[tarindex]   |=  (pos - Base64) >> 4;
-				nextbyte = ((pos - Base64) & 0x0f) << 4;
+				target[tarindex]   |=  digit >> 4;
+				nextbyte = (digit & 0x0f) << 4;
 				if (tarindex + 1 < targsize)
 					target[tarindex+1] = nextbyte;
 				else if (nextbyte)
@@ -237,8 +277,8 @@ __b64_pton(src, target, targsize)
 			if (target) {
 				if (tarindex >= targsize)
 					return (-1);
-				target[tarindex]   |=  (pos - Base64) >> 2;
-				nextbyte = ((pos - Base64) & 0x03) << 6;
+				target[tarindex]   |=  digit >> 2;
+				nextbyte = (digit & 0x03) << 6;
 				if (tarindex + 1 < targsize)
 					target[tarindex+1] = nextbyte;
 				else if (nextbyte)
@@ -251,7 +291,7 @@ __b64_pton(src, target, targsize)
 			if (target) {
 				if (tarindex >= targsize)
 					return (-1);
-				target[tarindex] |= (pos - Base64);
+				target[tarindex] |= digit;
 			}
 			tarindex++;
 			state = 0;
@@ -296,7 +296,7 @@ Bool rfbSendCursorShape(rfbClientPtr cl, ScreenPtr pScreen)
 Bool rfbSendCursorPos(rfbClientPtr cl, ScreenPtr pScreen)
 {
   rfbFramebufferUpdateRectHeader rect;
-  int x, y;
+  int x, y, cx, cy;
 
   if (ublen + sz_rfbFramebufferUpdateRectHeader > UPDATE_BUF_SIZE) {
     if (!rfbSendUpdateBuf(cl))
@@ -304,10 +304,12 @@ Bool rfbSendCursorPos(rfbClientPtr cl, ScreenPtr pScreen)
   }
 
   rfbSpriteGetCursorPos(pScreen, &x, &y);
+  cx = x;  cy = y;
+  rfbScalePoint(cl, &cx, &cy, FALSE);
 
   rect.encoding = Swap32IfLE(rfbEncodingPointerPos);
-  rect.r.x = Swap16IfLE((CARD16)x);
-  rect.r.y = Swap16IfLE((CARD16)y);
+  rect.r.x = Swap16IfLE((CARD16)cx);
+  rect.r.y = Swap16IfLE((CARD16)cy);
   rect.r.w = 0;
   rect.r.h = 0;
 
@@ -0,0 +1,324 @@
+/*
+ * dirtytiles.c - precise framebuffer change tracking
+ */
+
+/*
+ *  Copyright (C) 2026 agent.  All Rights Reserved.
+ *
+ *  This is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This software is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this software; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ *  USA.
+ */
+
+/*
+ * The drawing wrappers in draw.c report the bounding box of each drawing
+ * operation, which is often much larger than the area that actually changed
+ * (the bounding box of a diagonal line or of a run of glyphs, for instance),
+ * and applications sometimes redraw content that has not changed at all.
+ * When precise damage tracking (-precisedamage) is enabled, the wrappers add
+ * the reported region to a single pending region rather than to each
+ * client's modified region.  Just before an update is sent, the framebuffer
+ * is divided into DIRTY_TILE_SIZE x DIRTY_TILE_SIZE tiles, the tiles that
+ * overlap the pending region are hashed, and only the parts of the pending
+ * region that lie in tiles whose hash changed are added to the clients'
+ * modified regions.
+ *
+ * Unlike interframe comparison, this requires only a small per-tile hash
+ * table, which is shared by all clients.  The hash table always describes the
+ * framebuffer as it was when the pending region was last flushed, so a tile
+ * that was modified and then restored between two flushes is correctly
+ * treated as unchanged.  Framebuffer changes that do not pass through the
+ * pending region (CopyRect operations and the software cursor) would
+ * invalidate that assumption, so CopyRect destinations are marked as unknown,
+ * and the tiles under the cursor are never hashed while it is drawn into the
+ * framebuffer.
+ */
+
+#ifdef HAVE_DIX_CONFIG_H
+#include <dix-config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "rfb.h"
+#include "sprite.h"
+
+
+Bool rfbPreciseDamage = FALSE;
+
+static unsigned long long *tileHash = NULL;
+static char *tileValid = NULL;
+static int tilesX = 0, tilesY = 0;
+static RegionRec pendingRegion;
+static Bool pendingInited = FALSE;
+
+
+#define HASH_MIX(h, v) {  \
+  (h) ^= (v);  \
+  (h) *= 0x9E3779B97F4A7C15ULL;  \
+  (h) ^= (h) >> 32;  \
+}
+
+static unsigned long long HashTile(BoxPtr box)
+{
+  int pitch = rfbFB.paddedWidthInBytes, ps = rfbFB.bitsPerPixel / 8;
+  int rowBytes = (box->x2 - box->x1) * ps, x, y;
+  char *row = &rfbFB.pfbMemory[box->y1 * pitch + box->x1 * ps];
+  unsigned long long hv = 0xCBF29CE484222325ULL, v;
+
+  for (y = box->y1; y < box->y2; y++, row += pitch) {
+    for (x = 0; x <= rowBytes - 8; x += 8) {
+      memcpy(&v, &row[x], 8);
+      HASH_MIX(hv, v);
+    }
+    if (x < rowBytes) {
+      v = 0;
+      memcpy(&v, &row[x], rowBytes - x);
+      HASH_MIX(hv, v);
+    }
+  }
+
+  return hv;
+}
+
+
+static void TileBox(int tx, int ty, BoxPtr box)
+{
+  box->x1 = tx * DIRTY_TILE_SIZE;
+  box->y1 = ty * DIRTY_TILE_SIZE;
+  box->x2 = min(box->x1 + DIRTY_TILE_SIZE, rfbFB.width);
+  box->y2 = min(box->y1 + DIRTY_TILE_SIZE, rfbFB.height);
+}
+
+
+/*
+ * Allocate the tile hash table for the current framebuffer dimensions.  This
+ * is called at startup and whenever the framebuffer is resized.  All tiles
+ * start out unknown, so the first update that touches a tile always sends
+ * it.
+ */
+
+Bool rfbDirtyTilesInit(ScreenPtr pScreen)
+{
+  if (!rfbPreciseDamage) return TRUE;
+
+  free(tileHash);  tileHash = NULL;
+  free(tileValid);  tileValid = NULL;
+
+  tilesX = (rfbFB.width + DIRTY_TILE_SIZE - 1) / DIRTY_TILE_SIZE;
+  tilesY = (rfbFB.height + DIRTY_TILE_SIZE - 1) / DIRTY_TILE_SIZE;
+  if ((tileHash = (unsigned long long *)malloc(tilesX * tilesY *
+                                               sizeof(unsigned long long)))
+      == NULL ||
+      (tileValid = (char *)calloc(tilesX * tilesY, 1)) == NULL) {
+    rfbLogPerror("rfbDirtyTilesInit: couldn't allocate tile hash table");
+    free(tileHash);  tileHash = NULL;
+    rfbPreciseDamage = FALSE;
+    return FALSE;
+  }
+
+  if (pendingInited)
+    REGION_EMPTY(pScreen, &pendingRegion);
+  else {
+    REGION_INIT(pScreen, &pendingRegion, NullBox, 0);
+    pendingInited = TRUE;
+  }
+  return TRUE;
+}
+
+
+/*
+ * Add the region modified by a drawing operation to the pending region.
+ */
+
+void rfbDirtyTilesAdd(ScreenPtr pScreen, RegionPtr reg)
+{
+  REGION_UNION(pScreen, &pendingRegion, &pendingRegion, reg);
+}
+
+
+/*
+ * Reallocate the tile hash table after the framebuffer has been resized.  The
+ * framebuffer contents are preserved across a resize, so tiles that have the
+ * same dimensions in the old and new framebuffer keep their hashes, and the
+ * pending region is clipped to the new framebuffer rather than discarded.
+ */
+
+Bool rfbDirtyTilesResize(ScreenPtr pScreen, int oldWidth, int oldHeight)
+{
+  unsigned long long *oldHash = tileHash;
+  char *oldValid = tileValid;
+  int oldTilesX = tilesX, oldTilesY = tilesY, tx, ty;
+  RegionRec savedPending, tmpRegion;
+  BoxRec box;
+
+  if (!rfbPreciseDamage) return TRUE;
+
+  REGION_INIT(pScreen, &savedPending, NullBox, 0);
+  REGION_COPY(pScreen, &savedPending, &pendingRegion);
+
+  tileHash = NULL;  tileValid = NULL;
+  if (!rfbDirtyTilesInit(pScreen)) {
+    free(oldHash);  free(oldValid);
+    REGION_UNINIT(pScreen, &savedPending);
+    return FALSE;
+  }
+
+  if (oldValid) {
+    for (ty = 0; ty < min(tilesY, oldTilesY); ty++) {
+      int y2 = (ty + 1) * DIRTY_TILE_SIZE;
+
+      if (min(y2, oldHeight) != min(y2, rfbFB.height)) continue;
+      for (tx = 0; tx < min(tilesX, oldTilesX); tx++) {
+        int x2 = (tx + 1) * DIRTY_TILE_SIZE;
+
+        if (min(x2, oldWidth) != min(x2, rfbFB.width)) continue;
+        tileHash[ty * tilesX + tx] = oldHash[ty * oldTilesX + tx];
+        tileValid[ty * tilesX + tx] = oldValid[ty * oldTilesX + tx];
+      }
+    }
+  }
+  free(oldHash);  free(oldValid);
+
+  box.x1 = box.y1 = 0;
+  box.x2 = rfbFB.width;  box.y2 = rfbFB.height;
+  REGION_INIT(pScreen, &tmpRegion, &box, 0);
+  REGION_INTERSECT(pScreen, &pendingRegion, &savedPending, &tmpRegion);
+  REGION_UNINIT(pScreen, &tmpRegion);
+  REGION_UNINIT(pScreen, &savedPending);
+  return TRUE;
+}
+
+
+Bool rfbDirtyTilesPending(void)
+{
+  return rfbPreciseDamage && REGION_NOTEMPTY(screenInfo.screens[0],
+                                             &pendingRegion);
+}
+
+
+/*
+ * Mark the tiles overlapping the given region as unknown.  This is called
+ * when the region is modified without passing through the pending region.
+ */
+
+void rfbDirtyTilesInvalidate(ScreenPtr pScreen, RegionPtr reg)
+{
+  BoxPtr pBox;
+  int n, tx, ty;
+
+  if (!tileValid) return;
+
+  pBox = REGION_RECTS(reg);
+  for (n = REGION_NUM_RECTS(reg); n > 0; n--, pBox++) {
+    if (pBox->x2 <= pBox->x1 || pBox->y2 <= pBox->y1) continue;
+    for (ty = max(pBox->y1, 0) / DIRTY_TILE_SIZE;
+         ty <= (pBox->y2 - 1) / DIRTY_TILE_SIZE && ty < tilesY; ty++)
+      for (tx = max(pBox->x1, 0) / DIRTY_TILE_SIZE;
+           tx <= (pBox->x2 - 1) / DIRTY_TILE_SIZE && tx < tilesX; tx++)
+        tileValid[ty * tilesX + tx] = FALSE;
+  }
+}
+
+
+/*
+ * Hash the tiles that overlap the pending region, and add the parts of the
+ * pending region that lie in changed tiles to the modified region of each
+ * client.
+ */
+
+void rfbDirtyTilesFlush(ScreenPtr pScreen)
+{
+  RegionRec changedRegion, tmpRegion, cursorRegion;
+  BoxPtr extents;
+  BoxRec box;
+  rfbClientPtr cl;
+  int tx, ty, tx1, tx2, ty1, ty2;
+  Bool cursorDrawn;
+
+  if (!rfbDirtyTilesPending()) return;
+
+  /* The cursor is not part of the pending region, so the hashes of the tiles
+     under it would be meaningless.  Those tiles are passed through unfiltered
+     and marked as unknown. */
+  REGION_INIT(pScreen, &cursorRegion, NullBox, 0);
+  if (rfbFB.cursorIsDrawn)
+    rfbSpriteGetCursorRegion(pScreen, &cursorRegion);
+  cursorDrawn = REGION_NOTEMPTY(pScreen, &cursorRegion);
+
+  REGION_INIT(pScreen, &changedRegion, NullBox, 0);
+
+  extents = REGION_EXTENTS(pScreen, &pendingRegion);
+  tx1 = max(extents->x1, 0) / DIRTY_TILE_SIZE;
+  ty1 = max(extents->y1, 0) / DIRTY_TILE_SIZE;
+  tx2 = min((extents->x2 - 1) / DIRTY_TILE_SIZE, tilesX - 1);
+  ty2 = min((extents->y2 - 1) / DIRTY_TILE_SIZE, tilesY - 1);
+
+  for (ty = ty1; ty <= ty2; ty++) {
+    int runStart = -1;
+
+    /* Adjacent changed tiles in the same row are combined into one box, in
+       order to reduce the number of region operations. */
+    for (tx = tx1; tx <= tx2 + 1; tx++) {
+      Bool changed = FALSE;
+
+      if (tx <= tx2) {
+        int i = ty * tilesX + tx;
+
+        TileBox(tx, ty, &box);
+        if (RECT_IN_REGION(pScreen, &pendingRegion, &box) != rgnOUT) {
+          if (cursorDrawn &&
+              RECT_IN_REGION(pScreen, &cursorRegion, &box) != rgnOUT) {
+            tileValid[i] = FALSE;
+            changed = TRUE;
+          } else {
+            unsigned long long hash = HashTile(&box);
+
+            if (!tileValid[i] || tileHash[i] != hash) {
+              tileHash[i] = hash;
+              tileValid[i] = TRUE;
+              changed = TRUE;
+            }
+          }
+        }
+      }
+
+      if (changed && runStart < 0)
+        runStart = tx;
+      else if (!changed && runStart >= 0) {
+        BoxRec runBox;
+
+        TileBox(runStart, ty, &runBox);
+        runBox.x2 = min(tx * DIRTY_TILE_SIZE, rfbFB.width);
+        REGION_INIT(pScreen, &tmpRegion, &runBox, 0);
+        REGION_UNION(pScreen, &changedRegion, &changedRegion, &tmpRegion);
+        REGION_UNINIT(pScreen, &tmpRegion);
+        runStart = -1;
+      }
+    }
+  }
+
+  REGION_INTERSECT(pScreen, &changedRegion, &changedRegion, &pendingRegion);
+  REGION_UNINIT(pScreen, &cursorRegion);
+
+  if (REGION_NOTEMPTY(pScreen, &changedRegion)) {
+    for (cl = rfbClientHead; cl; cl = cl->next)
+      REGION_UNION(pScreen, &cl->modifiedRegion, &cl->modifiedRegion,
+                   &changedRegion);
+  }
+
+  REGION_UNINIT(pScreen, &changedRegion);
+  REGION_EMPTY(pScreen, &pendingRegion);
+}
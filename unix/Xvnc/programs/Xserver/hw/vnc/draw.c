@@ -64,6 +64,7 @@ in this Software without prior written authorization from the X Consortium.
 #endif
 
 #include <stdio.h>
+#include <math.h>
 #include "scrnintstr.h"
 #include "gcstruct.h"
 #include "windowstr.h"
@@ -72,10 +73,25 @@ in this Software without prior written authorization from the X Consortium.
 #include "rfb.h"
 #include "fb.h"
 #include "misc.h"
+#ifdef PRESENT
+#include "present.h"
+#endif
 
 extern WindowPtr *WindowTable;  /* Why isn't this in a header file? */
 
 int rfbDeferUpdateTime = DEFAULT_DEFER_UPDATE_TIME;  /* ms */
+Bool rfbFrameSync = FALSE;
+
+/* Frame synchronization state */
+static double lastFrameTime = -1.0;
+static double frameInterval = MIN_FRAME_INTERVAL;  /* seconds */
+
+/* Screen area of the windows that are producing frames.  This is rebuilt
+   every FRAME_REGION_LIFETIME seconds, so that it follows windows that move
+   or stop producing frames. */
+#define FRAME_REGION_LIFETIME 1.0
+static RegionRec frameRegion;
+static double frameRegionStart = -1.0;
 
 
 static inline Bool is_visible(DrawablePtr drawable)
@@ -116,18 +132,25 @@ static inline Bool is_visible(DrawablePtr drawable)
 #define TRC(x)  /* (rfbLog x) */
 
 /* ADD_TO_MODIFIED_REGION adds the given region to the modified region for each
-   client */
+   client (or, if precise damage tracking is enabled, to the pending region,
+   which is filtered by rfbDirtyTilesFlush() before it is added to the
+   modified region for each client.)  Changes made while drawing or removing
+   the cursor are never filtered, since they don't apply to all clients. */
 
 #define ADD_TO_MODIFIED_REGION(pScreen, reg) {  \
   rfbClientPtr clTemp;  \
   BoxRec *boxTemp = REGION_EXTENTS(pScreen, reg);  \
-  if ((boxTemp->x2 - boxTemp->x1) * (boxTemp->y2 - boxTemp->y1) != 0)  \
-    for (clTemp = rfbClientHead; clTemp; clTemp = clTemp->next) {  \
-      if (!prfb->dontSendFramebufferUpdate || pointerOwner != clTemp ||  \
-          !clTemp->enableCursorShapeUpdates)  \
-        REGION_UNION((pScreen), &clTemp->modifiedRegion,  \
-                     &clTemp->modifiedRegion, reg);  \
-    }  \
+  if ((boxTemp->x2 - boxTemp->x1) * (boxTemp->y2 - boxTemp->y1) != 0) {  \
+    if (rfbPreciseDamage && !prfb->dontSendFramebufferUpdate)  \
+      rfbDirtyTilesAdd(pScreen, reg);  \
+    else  \
+      for (clTemp = rfbClientHead; clTemp; clTemp = clTemp->next) {  \
+        if (!prfb->dontSendFramebufferUpdate || pointerOwner != clTemp ||  \
+            !clTemp->enableCursorShapeUpdates)  \
+          REGION_UNION((pScreen), &clTemp->modifiedRegion,  \
+                       &clTemp->modifiedRegion, reg);  \
+      }  \
+  }  \
 }
 
 /* ADD_TO_ALR_REGION adds the given region to the ALR-eligible region for each
@@ -369,6 +392,14 @@ void rfbCopyWindow(WindowPtr pWin, DDXPointRec ptOldOrg, RegionPtr pOldRegion)
   ClipToScreen(pScreen, &dstRegion);
   REGION_INTERSECT(pScreen, &dstRegion, &dstRegion, &pWin->borderClip);
 
+  /* The pending changes must be in the modified regions before they are
+     translated by rfbCopyRegion(), and the destination is no longer described
+     by the tile hashes. */
+  if (rfbPreciseDamage) {
+    rfbDirtyTilesFlush(pScreen);
+    rfbDirtyTilesInvalidate(pScreen, &dstRegion);
+  }
+
   for (cl = rfbClientHead; cl; cl = cl->next) {
     if (cl->useCopyRect) {
       REGION_INIT(pScreen, &srcRegion, NullBox, 0);
@@ -708,6 +739,11 @@ static RegionPtr rfbCopyArea(DrawablePtr pSrc, DrawablePtr pDst, GCPtr pGC,
     box.x2 = box.x1 + w;
     box.y2 = box.y1 + h;
 
+    if (rfbPreciseDamage) {
+      rfbDirtyTilesFlush(pDst->pScreen);
+      rfbDirtyTilesInvalidate(pDst->pScreen, &dstRegion);
+    }
+
     for (cl = rfbClientHead; cl; cl = cl->next) {
       if (cl->useCopyRect) {
         SAFE_REGION_INIT(pSrc->pScreen, &srcRegion, &box, 0);
@@ -1860,8 +1896,46 @@ static CARD32 rfbDeferredUpdateCallback(OsTimerPtr timer, CARD32 now,
                                         pointer arg)
 {
   rfbClientPtr cl = (rfbClientPtr)arg;
+  ScreenPtr pScreen = screenInfo.screens[0];
   BOOL status = TRUE;
 
+  /* If an application is actively producing frames, then hold the damage to
+     its window until the application finishes its current frame, but never
+     for longer than one frame interval beyond the usual deferral time.  Any
+     other damage is sent as usual. */
+  if (rfbFrameSync && cl->deferredUpdateScheduled && lastFrameTime >= 0.0) {
+    double tNow = gettime();
+
+    if (tNow - lastFrameTime < max(2.0 * frameInterval, 0.1)) {
+      double deadline = cl->deferredUpdateStart +
+        (double)rfbDeferUpdateTime / 1000.0 + frameInterval;
+
+      if (tNow < deadline) {
+        RegionRec heldRegion;
+
+        if (rfbPreciseDamage)
+          rfbDirtyTilesFlush(pScreen);
+
+        REGION_NULL(pScreen, &heldRegion);
+        REGION_INTERSECT(pScreen, &heldRegion, &cl->modifiedRegion,
+                         &frameRegion);
+        if (REGION_NOTEMPTY(pScreen, &heldRegion)) {
+          REGION_SUBTRACT(pScreen, &cl->modifiedRegion, &cl->modifiedRegion,
+                          &heldRegion);
+          if (FB_UPDATE_PENDING(cl) && !rfbSendFramebufferUpdate(cl)) {
+            REGION_UNINIT(pScreen, &heldRegion);
+            return 0;
+          }
+          REGION_UNION(pScreen, &cl->modifiedRegion, &cl->modifiedRegion,
+                       &heldRegion);
+          REGION_UNINIT(pScreen, &heldRegion);
+          return max((CARD32)((deadline - tNow) * 1000.0), 1);
+        }
+        REGION_UNINIT(pScreen, &heldRegion);
+      }
+    }
+  }
+
   if (cl->deferredUpdateScheduled && FB_UPDATE_PENDING(cl))
     status = rfbSendFramebufferUpdate(cl);
 
@@ -1889,6 +1963,83 @@ static void rfbScheduleDeferredUpdate(rfbClientPtr cl)
 }
 
 
+/*
+ * rfbFrameComplete() is called by the GLX and Present extensions whenever an
+ * application finishes a frame in the specified window.  If frame
+ * synchronization is enabled, then any pending deferred updates are sent
+ * immediately, so that each update contains a complete frame.
+ */
+
+void rfbFrameComplete(WindowPtr pWin)
+{
+  ScreenPtr pScreen = pWin->drawable.pScreen;
+  rfbClientPtr cl, nextCl;
+  double tNow;
+
+  if (!rfbFrameSync)
+    return;
+
+  tNow = gettime();
+
+  if (frameRegionStart < 0.0)
+    REGION_NULL(pScreen, &frameRegion);
+  if (tNow - frameRegionStart >= FRAME_REGION_LIFETIME) {
+    REGION_EMPTY(pScreen, &frameRegion);
+    frameRegionStart = tNow;
+  }
+  REGION_UNION(pScreen, &frameRegion, &frameRegion, &pWin->borderClip);
+
+  lastFrameTime = tNow;
+
+  if (rfbFB.dontSendFramebufferUpdate || rfbFB.blockUpdates)
+    return;
+
+  for (cl = rfbClientHead; cl; cl = nextCl) {
+    nextCl = cl->next;
+    if (cl->deferredUpdateScheduled) {
+      TimerCancel(cl->deferredUpdateTimer);
+      if (FB_UPDATE_PENDING(cl) && !rfbSendFramebufferUpdate(cl))
+        continue;
+      cl->deferredUpdateScheduled = FALSE;
+    }
+  }
+}
+
+
+/*
+ * rfbUpdateFrameClock() derives the frame interval from the rate at which the
+ * slowest viewer can currently receive updates and, if the Present
+ * extension's fake vblank clock is in use, slows the clock down accordingly.
+ * This throttles applications that use Present or glXSwapInterval() to a
+ * frame rate that the viewers can actually absorb.
+ */
+
+void rfbUpdateFrameClock(ScreenPtr pScreen)
+{
+  rfbClientPtr cl;
+  double interval = MIN_FRAME_INTERVAL;
+
+  if (!rfbFrameSync)
+    return;
+
+  for (cl = rfbClientHead; cl; cl = cl->next) {
+    if (cl->frameInterval > interval)
+      interval = cl->frameInterval;
+  }
+  if (interval > MAX_FRAME_INTERVAL)
+    interval = MAX_FRAME_INTERVAL;
+
+  /* Ignore insignificant changes, to avoid needlessly rebasing the clock. */
+  if (fabs(interval - frameInterval) < frameInterval * 0.05)
+    return;
+
+  frameInterval = interval;
+#ifdef PRESENT
+  present_fake_set_interval(pScreen, (uint32_t)(interval * 1000000.0));
+#endif
+}
+
+
 /*
  * PrintRegion is useful for debugging.
  */
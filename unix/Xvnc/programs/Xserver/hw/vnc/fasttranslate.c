@@ -0,0 +1,201 @@
+/*
+ * fasttranslate.c - direct (table-free) pixel format translation
+ *
+ * When the TurboVNC Server's framebuffer has 8-bit colour components (which
+ * is always the case at depth 24), translating a pixel to the client's format
+ * requires only shifting, masking, and scaling each component.  The functions
+ * in this file do that arithmetically rather than looking up each component
+ * in a table, so the inner loops have no data-dependent memory accesses and
+ * can be vectorized by the compiler.  The scaling uses the same rounding as
+ * the table-driven functions, so the output is identical.
+ */
+
+/*
+ *  Copyright (C) 2026 agent.  All Rights Reserved.
+ *
+ *  This is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This software is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this software; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ *  USA.
+ */
+
+#include <stddef.h>
+#include <X11/Xmd.h>
+#include <rfbproto.h>
+#include "fasttranslate.h"
+
+
+/*
+ * Scale an 8-bit colour component to [0, max] with rounding.  This is
+ * equivalent to (c * max + 127) / 255, which is what the table-driven
+ * functions use, but division by 255 is replaced with shifts.  (The
+ * replacement is exact for all dividends less than 65535.)  Since max <= 255,
+ * all of the intermediate values fit in 16 bits, which allows the compiler to
+ * process more pixels per vector instruction.
+ */
+
+#define DIV255(x)  (CARD16)((CARD16)((x) + 1 + ((x) >> 8)) >> 8)
+#define SCALE(c, max)  DIV255((CARD16)((c) * (max) + 127))
+
+#define SWAP8(x)  (x)
+#define SWAP16(x)  ((CARD16)(((x) << 8) | ((x) >> 8)))
+#define SWAP32(x)  ((((x) & 0xff000000) >> 24) | (((x) & 0x00ff0000) >> 8) |  \
+                    (((x) & 0x0000ff00) << 8) | (((x) & 0x000000ff) << 24))
+
+
+/*
+ * The inner loops are only faster than the table-driven functions if they are
+ * vectorized.  Clang vectorizes them at -O2, but GCC versions prior to 12 do
+ * not vectorize at -O2, and GCC 12 and later use a cost model at -O2 that
+ * rejects these loops.  Thus, vectorization is requested explicitly for these
+ * functions, so that the speedup does not depend on the build type.
+ */
+
+#if defined(__GNUC__) && !defined(__clang__)
+#define VECTORIZE  \
+  __attribute__((optimize("tree-vectorize", "vect-cost-model=dynamic")))
+#else
+#define VECTORIZE
+#endif
+
+
+#define DEFINE_FAST_TRANSLATE(OUT)                                            \
+                                                                              \
+VECTORIZE                                                                     \
+static void rfbTranslateFast32to##OUT(char *table, rfbPixelFormat *in,        \
+                                      rfbPixelFormat *out,                    \
+                                      char *iptr, char *optr,                 \
+                                      int bytesBetweenInputLines,             \
+                                      int width, int height)                  \
+{                                                                             \
+  CARD32 *ip = (CARD32 *)iptr;                                                \
+  CARD##OUT *op = (CARD##OUT *)optr;                                          \
+  int ipstride = bytesBetweenInputLines / sizeof(CARD32);                     \
+  int inRS = in->redShift, inGS = in->greenShift, inBS = in->blueShift;       \
+  int outRS = out->redShift, outGS = out->greenShift;                         \
+  int outBS = out->blueShift;                                                 \
+  CARD16 rMax = out->redMax, gMax = out->greenMax, bMax = out->blueMax;       \
+  int scale = (rMax != 255 || gMax != 255 || bMax != 255);                    \
+  int swap = (OUT != 8 && out->bigEndian != in->bigEndian);                   \
+  int x;                                                                      \
+                                                                              \
+  (void)table;                                                                \
+                                                                              \
+  while (height > 0) {                                                        \
+    if (scale) {                                                              \
+      for (x = 0; x < width; x++) {                                           \
+        CARD32 p = ip[x];                                                     \
+        CARD16 r = SCALE((CARD16)((p >> inRS) & 0xff), rMax);                 \
+        CARD16 g = SCALE((CARD16)((p >> inGS) & 0xff), gMax);                 \
+        CARD16 b = SCALE((CARD16)((p >> inBS) & 0xff), bMax);                 \
+                                                                              \
+        op[x] = (CARD##OUT)(((CARD32)r << outRS) | ((CARD32)g << outGS) |     \
+                            ((CARD32)b << outBS));                            \
+      }                                                                       \
+    } else {                                                                  \
+      for (x = 0; x < width; x++) {                                           \
+        CARD32 p = ip[x];                                                     \
+                                                                              \
+        op[x] = (CARD##OUT)((((p >> inRS) & 0xff) << outRS) |                 \
+                            (((p >> inGS) & 0xff) << outGS) |                 \
+                            (((p >> inBS) & 0xff) << outBS));                 \
+      }                                                                       \
+    }                                                                         \
+    if (swap) {                                                               \
+      for (x = 0; x < width; x++)                                             \
+        op[x] = SWAP##OUT(op[x]);                                             \
+    }                                                                         \
+    ip += ipstride;                                                           \
+    op += width;                                                              \
+    height--;                                                                 \
+  }                                                                           \
+}
+
+DEFINE_FAST_TRANSLATE(8)
+DEFINE_FAST_TRANSLATE(16)
+DEFINE_FAST_TRANSLATE(32)
+
+
+static int ComponentBits(int max)
+{
+  int bits = 0;
+
+  while (max >> bits) bits++;
+  return bits;
+}
+
+
+rfbFastTranslateFnType rfbGetFastTranslateFn(rfbPixelFormat *in,
+                                             rfbPixelFormat *out)
+{
+  int bpp = out->bitsPerPixel;
+
+  if (in->bitsPerPixel != 32 || !in->trueColour || !out->trueColour)
+    return NULL;
+
+  if (in->redMax != 255 || in->greenMax != 255 || in->blueMax != 255 ||
+      in->redShift > 24 || in->greenShift > 24 || in->blueShift > 24)
+    return NULL;
+
+  if (out->redMax < 1 || out->redMax > 255 ||
+      out->greenMax < 1 || out->greenMax > 255 ||
+      out->blueMax < 1 || out->blueMax > 255 ||
+      out->redShift + ComponentBits(out->redMax) > bpp ||
+      out->greenShift + ComponentBits(out->greenMax) > bpp ||
+      out->blueShift + ComponentBits(out->blueMax) > bpp)
+    return NULL;
+
+  switch (bpp) {
+    case 8:
+      return rfbTranslateFast32to8;
+    case 16:
+      return rfbTranslateFast32to16;
+    case 32:
+      return rfbTranslateFast32to32;
+  }
+  return NULL;
+}
+
+
+/*
+ * rfbPack24() is used by the Tight encoder to pack 32-bit pixels into 24-bit
+ * RGB triplets in place.  (Assembling the triplets into 32-bit words and
+ * storing whole words was measured to be slower than storing individual bytes,
+ * since this loop cannot be vectorized without byte shuffle instructions.)
+ */
+
+void rfbPack24(char *buf, rfbPixelFormat *fmt, int serverBigEndian, int count)
+{
+  CARD32 *buf32;
+  CARD32 pix;
+  int r_shift, g_shift, b_shift;
+
+  buf32 = (CARD32 *)buf;
+
+  if (!serverBigEndian == !fmt->bigEndian) {
+    r_shift = fmt->redShift;
+    g_shift = fmt->greenShift;
+    b_shift = fmt->blueShift;
+  } else {
+    r_shift = 24 - fmt->redShift;
+    g_shift = 24 - fmt->greenShift;
+    b_shift = 24 - fmt->blueShift;
+  }
+
+  while (count--) {
+    pix = *buf32++;
+    *buf++ = (char)(pix >> r_shift);
+    *buf++ = (char)(pix >> g_shift);
+    *buf++ = (char)(pix >> b_shift);
+  }
+}
@@ -0,0 +1,60 @@
+/*
+ * fasttranslate.h - direct (table-free) pixel format translation
+ */
+
+/*
+ *  Copyright (C) 2026 agent.  All Rights Reserved.
+ *
+ *  This is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This software is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this software; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ *  USA.
+ */
+
+#ifndef __FASTTRANSLATE_H__
+#define __FASTTRANSLATE_H__
+
+/*
+ * This module has no dependencies on the X server, so that it can also be
+ * built into the translation microbenchmark (unix/tvncbench/translatebench.c.)
+ * rfbproto.h must be included before this header.  The function signature
+ * is the same as that of rfbTranslateFnType.  The table argument is ignored.
+ */
+
+typedef void (*rfbFastTranslateFnType) (char *table, rfbPixelFormat *in,
+                                        rfbPixelFormat *out,
+                                        char *iptr, char *optr,
+                                        int bytesBetweenInputLines,
+                                        int width, int height);
+
+/*
+ * Returns a direct translation function for the given formats, or NULL if
+ * the formats are not supported (in which case, the table-driven translation
+ * functions in translate.c must be used.)  The output of the direct
+ * translation functions is bit-for-bit identical to that of the table-driven
+ * functions.
+ */
+
+extern rfbFastTranslateFnType rfbGetFastTranslateFn(rfbPixelFormat *in,
+                                                    rfbPixelFormat *out);
+
+/*
+ * Pack count 32-bit pixels in the given client pixel format into 24-bit RGB
+ * triplets in place.  serverBigEndian is the byte order of the server's
+ * framebuffer, which is also the byte order of the host.
+ */
+
+extern void rfbPack24(char *buf, rfbPixelFormat *fmt, int serverBigEndian,
+                      int count);
+
+#endif
@@ -308,6 +308,45 @@ Bool rfbIsCongested(rfbClientPtr cl)
 }
 
 
+/*
+ * rfbGetSpareWindow() returns the number of bytes that can be sent before the
+ * transport becomes congested.  If the client does not support fences, then
+ * there is no way to measure congestion, so the maximum window is returned.
+ */
+
+unsigned rfbGetSpareWindow(rfbClientPtr cl)
+{
+  unsigned inFlight;
+
+  if (!cl->enableFence)
+    return MAXIMUM_WINDOW;
+
+  rfbUpdatePosition(cl, cl->sockOffset);
+  inFlight = GetInFlight(cl);
+  if (inFlight >= cl->congWindow)
+    return 0;
+
+  return cl->congWindow - inFlight;
+}
+
+
+/*
+ * rfbGetBandwidth() estimates the available network bandwidth, in megabits
+ * per second, from the congestion window and the base round-trip time.  It
+ * returns -1.0 if the bandwidth is unknown.
+ */
+
+double rfbGetBandwidth(rfbClientPtr cl)
+{
+  if (!rfbCongestionControl || !cl->enableFence ||
+      cl->baseRTT == (unsigned)-1)
+    return -1.0;
+
+  return (double)cl->congWindow * 8.0 / (double)max(cl->baseRTT, 1) /
+         1000.0;
+}
+
+
 /*
  * GetUncongestedETA() estimates the number of milliseconds until the transport
  * will no longer be congested.  It returns 0 if there is no congestion and -1
@@ -25,11 +25,61 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "rfb.h"
 
-static Bool sendHextiles8(rfbClientPtr cl, int x, int y, int w, int h);
-static Bool sendHextiles16(rfbClientPtr cl, int x, int y, int w, int h);
-static Bool sendHextiles32(rfbClientPtr cl, int x, int y, int w, int h);
+
+/* Rectangles smaller than this (in pixels) per thread are not split */
+#define MIN_PIXELS_PER_THREAD  65536
+
+/* Size of the blocks compared by the branchless solid-tile test */
+#define SOLID_BLOCK  16
+
+/*
+ * Per-band encoder state.  Band 0 is always encoded on the calling thread and
+ * writes directly into the global update buffer, flushing it as necessary.
+ * The other bands are encoded on the Tight encoding threads into private
+ * buffers, which are written to the client in band order once all of the
+ * bands have been encoded.  Each band starts with no valid background or
+ * foreground colour, so the concatenated output is a valid Hextile stream for
+ * the whole rectangle.
+ */
+
+typedef struct {
+  rfbClientPtr cl;
+  int x, y, w, h, id, _ublen, *ublen;
+  char *updateBuf;
+  int updateBufSize;
+  int bytessent;
+  Bool status;
+} hextileparam;
+
+static hextileparam hparam[MAX_ENCODING_THREADS];
+
+static void sendHextilesJob(void *param);
+static Bool sendHextiles8(hextileparam *t, int x, int y, int w, int h);
+static Bool sendHextiles16(hextileparam *t, int x, int y, int w, int h);
+static Bool sendHextiles32(hextileparam *t, int x, int y, int w, int h);
+
+
+static Bool CheckUpdateBuf(hextileparam *t, int bytes)
+{
+  rfbClientPtr cl = t->cl;
+
+  if (t->id == 0) {
+    if (ublen + bytes > UPDATE_BUF_SIZE) {
+      if (!rfbSendUpdateBuf(cl))
+        return FALSE;
+    }
+  } else {
+    while ((*t->ublen) + bytes > t->updateBufSize) {
+      t->updateBufSize += UPDATE_BUF_SIZE;
+      t->updateBuf = (char *)rfbRealloc(t->updateBuf, t->updateBufSize);
+    }
+  }
+  return TRUE;
+}
 
 
 /*
@@ -39,6 +89,15 @@ static Bool sendHextiles32(rfbClientPtr cl, int x, int y, int w, int h);
 Bool rfbSendRectEncodingHextile(rfbClientPtr cl, int x, int y, int w, int h)
 {
   rfbFramebufferUpdateRectHeader rect;
+  void *args[MAX_ENCODING_THREADS];
+  Bool status = TRUE;
+  int i, nt, tileRows, bandHeight;
+
+  if (cl->format.bitsPerPixel != 8 && cl->format.bitsPerPixel != 16 &&
+      cl->format.bitsPerPixel != 32) {
+    rfbLog("rfbSendRectEncodingHextile: bpp %d?\n", cl->format.bitsPerPixel);
+    return FALSE;
+  }
 
   if (ublen + sz_rfbFramebufferUpdateRectHeader > UPDATE_BUF_SIZE) {
     if (!rfbSendUpdateBuf(cl))
@@ -57,36 +116,119 @@ Bool rfbSendRectEncodingHextile(rfbClientPtr cl, int x, int y, int w, int h)
   cl->rfbRectanglesSent[rfbEncodingHextile]++;
   cl->rfbBytesSent[rfbEncodingHextile] += sz_rfbFramebufferUpdateRectHeader;
 
-  switch (cl->format.bitsPerPixel) {
+  /* Split the rectangle into bands of whole tile rows, one per thread. */
+  tileRows = (h + 15) / 16;
+  nt = min(rfbNumThreads, w * h / MIN_PIXELS_PER_THREAD);
+  nt = min(nt, tileRows);
+  if (nt < 1) nt = 1;
+  bandHeight = (tileRows + nt - 1) / nt * 16;
+  nt = (h + bandHeight - 1) / bandHeight;
+
+  for (i = 0; i < nt; i++) {
+    hparam[i].cl = cl;
+    hparam[i].id = i;
+    hparam[i].x = x;
+    hparam[i].y = y + bandHeight * i;
+    hparam[i].w = w;
+    hparam[i].h = (i == nt - 1) ? h - bandHeight * i : bandHeight;
+    hparam[i].bytessent = 0;
+    hparam[i].status = TRUE;
+    if (i == 0) {
+      hparam[i].ublen = &ublen;
+      hparam[i].updateBuf = updateBuf;
+      hparam[i].updateBufSize = UPDATE_BUF_SIZE;
+    } else {
+      hparam[i].ublen = &hparam[i]._ublen;
+      hparam[i]._ublen = 0;
+      if (!hparam[i].updateBuf) {
+        hparam[i].updateBufSize = UPDATE_BUF_SIZE;
+        hparam[i].updateBuf = (char *)rfbAlloc(hparam[i].updateBufSize);
+      }
+    }
+    args[i] = &hparam[i];
+  }
+
+  if (nt > 1)
+    rfbRunEncodingJobs(nt, sendHextilesJob, args);
+  else
+    sendHextilesJob(&hparam[0]);
+
+  for (i = 0; i < nt; i++) status &= hparam[i].status;
+  if (!status) return FALSE;
+  cl->rfbBytesSent[rfbEncodingHextile] += hparam[0].bytessent;
+
+  if (nt > 1) {
+    if (ublen > 0) {
+      if (!rfbSendUpdateBuf(cl))
+        return FALSE;
+    }
+    for (i = 1; i < nt; i++) {
+      if ((*hparam[i].ublen) > 0 &&
+          WriteExact(cl, hparam[i].updateBuf, *hparam[i].ublen) < 0) {
+        rfbLogPerror("rfbSendRectEncodingHextile: write");
+        rfbCloseClient(cl);
+        return FALSE;
+      }
+      (*hparam[i].ublen) = 0;
+      cl->rfbBytesSent[rfbEncodingHextile] += hparam[i].bytessent;
+    }
+  }
+
+  return TRUE;
+}
+
+
+/*
+ * Free the private update buffers of the bands that were encoded on the Tight
+ * encoding threads.
+ */
+
+void ShutdownHextile(void)
+{
+  int i;
+
+  for (i = 1; i < MAX_ENCODING_THREADS; i++) {
+    free(hparam[i].updateBuf);
+    hparam[i].updateBuf = NULL;
+    hparam[i].updateBufSize = 0;
+  }
+}
+
+
+static void sendHextilesJob(void *param)
+{
+  hextileparam *t = (hextileparam *)param;
+
+  switch (t->cl->format.bitsPerPixel) {
     case 8:
-      return sendHextiles8(cl, x, y, w, h);
+      t->status = sendHextiles8(t, t->x, t->y, t->w, t->h);
+      break;
     case 16:
-      return sendHextiles16(cl, x, y, w, h);
+      t->status = sendHextiles16(t, t->x, t->y, t->w, t->h);
+      break;
     case 32:
-      return sendHextiles32(cl, x, y, w, h);
+      t->status = sendHextiles32(t, t->x, t->y, t->w, t->h);
+      break;
   }
-
-  rfbLog("rfbSendRectEncodingHextile: bpp %d?\n", cl->format.bitsPerPixel);
-  return FALSE;
 }
 
 
-#define PUT_PIXEL8(pix) (updateBuf[ublen++] = (pix))
+#define PUT_PIXEL8(pix) (t->updateBuf[(*t->ublen)++] = (pix))
 
-#define PUT_PIXEL16(pix) (updateBuf[ublen++] = ((char *)&(pix))[0],  \
-                          updateBuf[ublen++] = ((char *)&(pix))[1])
+#define PUT_PIXEL16(pix) (t->updateBuf[(*t->ublen)++] = ((char *)&(pix))[0],  \
+                          t->updateBuf[(*t->ublen)++] = ((char *)&(pix))[1])
 
-#define PUT_PIXEL32(pix) (updateBuf[ublen++] = ((char *)&(pix))[0],  \
-                          updateBuf[ublen++] = ((char *)&(pix))[1],  \
-                          updateBuf[ublen++] = ((char *)&(pix))[2],  \
-                          updateBuf[ublen++] = ((char *)&(pix))[3])
+#define PUT_PIXEL32(pix) (t->updateBuf[(*t->ublen)++] = ((char *)&(pix))[0],  \
+                          t->updateBuf[(*t->ublen)++] = ((char *)&(pix))[1],  \
+                          t->updateBuf[(*t->ublen)++] = ((char *)&(pix))[2],  \
+                          t->updateBuf[(*t->ublen)++] = ((char *)&(pix))[3])
 
 
 #define DEFINE_SEND_HEXTILES(bpp)                                             \
                                                                               \
                                                                               \
-static Bool subrectEncode##bpp(CARD##bpp *data, int w, int h, CARD##bpp bg,   \
-                               CARD##bpp fg, Bool mono);                      \
+static Bool subrectEncode##bpp(hextileparam *t, CARD##bpp *data, int w, int h,\
+                               CARD##bpp bg, CARD##bpp fg, Bool mono);        \
 static void testColours##bpp(CARD##bpp *data, int size, Bool *mono,           \
                              Bool *solid, CARD##bpp *bg, CARD##bpp *fg);      \
                                                                               \
@@ -95,9 +237,9 @@ static void testColours##bpp(CARD##bpp *data, int size, Bool *mono,           \
  * rfbSendHextiles                                                            \
  */                                                                           \
                                                                               \
-static Bool sendHextiles##bpp(rfbClientPtr cl, int rx, int ry,                \
-                              int rw, int rh)                                 \
+static Bool sendHextiles##bpp(hextileparam *t, int rx, int ry, int rw, int rh)\
 {                                                                             \
+  rfbClientPtr cl = t->cl;                                                    \
   int x, y, w, h;                                                             \
   int startUblen;                                                             \
   char *fbptr;                                                                \
@@ -115,10 +257,8 @@ static Bool sendHextiles##bpp(rfbClientPtr cl, int rx, int ry,                \
       if (ry + rh - y < 16)                                                   \
         h = ry + rh - y;                                                      \
                                                                               \
-      if ((ublen + 1 + (2 + 16 * 16) * (bpp / 8)) > UPDATE_BUF_SIZE) {        \
-        if (!rfbSendUpdateBuf(cl))                                            \
-          return FALSE;                                                       \
-      }                                                                       \
+      if (!CheckUpdateBuf(t, 1 + (2 + 16 * 16) * (bpp / 8)))                  \
+        return FALSE;                                                         \
                                                                               \
       fbptr = (cl->fb + (rfbFB.paddedWidthInBytes * y) +                      \
                (x * (rfbFB.bitsPerPixel / 8)));                               \
@@ -127,9 +267,9 @@ static Bool sendHextiles##bpp(rfbClientPtr cl, int rx, int ry,                \
                           &cl->format, fbptr, (char *)clientPixelData,        \
                           rfbFB.paddedWidthInBytes, w, h);                    \
                                                                               \
-      startUblen = ublen;                                                     \
-      updateBuf[startUblen] = 0;                                              \
-      ublen++;                                                                \
+      startUblen = *t->ublen;                                                 \
+      t->updateBuf[startUblen] = 0;                                           \
+      (*t->ublen)++;                                                          \
                                                                               \
       testColours##bpp(clientPixelData, w * h, &mono, &solid,                 \
                        &newBg, &newFg);                                       \
@@ -137,46 +277,46 @@ static Bool sendHextiles##bpp(rfbClientPtr cl, int rx, int ry,                \
       if (!validBg || (newBg != bg)) {                                        \
         validBg = TRUE;                                                       \
         bg = newBg;                                                           \
-        updateBuf[startUblen] |= rfbHextileBackgroundSpecified;               \
+        t->updateBuf[startUblen] |= rfbHextileBackgroundSpecified;            \
         PUT_PIXEL##bpp(bg);                                                   \
       }                                                                       \
                                                                               \
       if (solid) {                                                            \
-        cl->rfbBytesSent[rfbEncodingHextile] += ublen - startUblen;           \
+        t->bytessent += *t->ublen - startUblen;                               \
         continue;                                                             \
       }                                                                       \
                                                                               \
-      updateBuf[startUblen] |= rfbHextileAnySubrects;                         \
+      t->updateBuf[startUblen] |= rfbHextileAnySubrects;                      \
                                                                               \
       if (mono) {                                                             \
         if (!validFg || (newFg != fg)) {                                      \
           validFg = TRUE;                                                     \
           fg = newFg;                                                         \
-          updateBuf[startUblen] |= rfbHextileForegroundSpecified;             \
+          t->updateBuf[startUblen] |= rfbHextileForegroundSpecified;          \
           PUT_PIXEL##bpp(fg);                                                 \
         }                                                                     \
       } else {                                                                \
         validFg = FALSE;                                                      \
-        updateBuf[startUblen] |= rfbHextileSubrectsColoured;                  \
+        t->updateBuf[startUblen] |= rfbHextileSubrectsColoured;               \
       }                                                                       \
                                                                               \
-      if (!subrectEncode##bpp(clientPixelData, w, h, bg, fg, mono)) {         \
+      if (!subrectEncode##bpp(t, clientPixelData, w, h, bg, fg, mono)) {      \
         /* encoding was too large, use raw */                                 \
         validBg = FALSE;                                                      \
         validFg = FALSE;                                                      \
-        ublen = startUblen;                                                   \
-        updateBuf[ublen++] = rfbHextileRaw;                                   \
+        *t->ublen = startUblen;                                               \
+        t->updateBuf[(*t->ublen)++] = rfbHextileRaw;                          \
         (*cl->translateFn) (cl->translateLookupTable, &rfbServerFormat,       \
                             &cl->format, fbptr, (char *)clientPixelData,      \
                             rfbFB.paddedWidthInBytes, w, h);                  \
                                                                               \
-        memcpy(&updateBuf[ublen], (char *)clientPixelData,                    \
+        memcpy(&t->updateBuf[*t->ublen], (char *)clientPixelData,             \
                w * h * (bpp / 8));                                            \
                                                                               \
-        ublen += w * h * (bpp / 8);                                           \
+        *t->ublen += w * h * (bpp / 8);                                       \
       }                                                                       \
                                                                               \
-      cl->rfbBytesSent[rfbEncodingHextile] += ublen - startUblen;             \
+      t->bytessent += *t->ublen - startUblen;                                 \
     }                                                                         \
   }                                                                           \
                                                                               \
@@ -184,8 +324,8 @@ static Bool sendHextiles##bpp(rfbClientPtr cl, int rx, int ry,                \
 }                                                                             \
                                                                               \
                                                                               \
-static Bool subrectEncode##bpp(CARD##bpp *data, int w, int h, CARD##bpp bg,   \
-                               CARD##bpp fg, Bool mono)                       \
+static Bool subrectEncode##bpp(hextileparam *t, CARD##bpp *data, int w, int h,\
+                               CARD##bpp bg, CARD##bpp fg, Bool mono)         \
 {                                                                             \
   CARD##bpp cl;                                                               \
   int x, y;                                                                   \
@@ -200,8 +340,8 @@ static Bool subrectEncode##bpp(CARD##bpp *data, int w, int h, CARD##bpp bg,   \
   int newLen;                                                                 \
   int nSubrectsUblen;                                                         \
                                                                               \
-  nSubrectsUblen = ublen;                                                     \
-  ublen++;                                                                    \
+  nSubrectsUblen = *t->ublen;                                                 \
+  (*t->ublen)++;                                                              \
                                                                               \
   for (y = 0; y < h; y++) {                                                   \
     line = data + (y * w);                                                    \
@@ -214,7 +354,7 @@ static Bool subrectEncode##bpp(CARD##bpp *data, int w, int h, CARD##bpp bg,   \
           seg = data + (j * w);                                               \
           if (seg[x] != cl) break;                                            \
           i = x;                                                              \
-          while ((seg[i] == cl) && (i < w)) i += 1;                           \
+          while ((i < w) && (seg[i] == cl)) i += 1;                           \
           i -= 1;                                                             \
           if (j == y) vx = hx = i;                                            \
           if (i < vx) vx = i;                                                 \
@@ -245,9 +385,9 @@ static Bool subrectEncode##bpp(CARD##bpp *data, int w, int h, CARD##bpp bg,   \
         }                                                                     \
                                                                               \
         if (mono)                                                             \
-          newLen = ublen - nSubrectsUblen + 2;                                \
+          newLen = *t->ublen - nSubrectsUblen + 2;                            \
         else                                                                  \
-          newLen = ublen - nSubrectsUblen + bpp / 8 + 2;                      \
+          newLen = *t->ublen - nSubrectsUblen + bpp / 8 + 2;                  \
                                                                               \
         if (newLen > (w * h * (bpp / 8)))                                     \
           return FALSE;                                                       \
@@ -256,8 +396,8 @@ static Bool subrectEncode##bpp(CARD##bpp *data, int w, int h, CARD##bpp bg,   \
                                                                               \
         if (!mono) PUT_PIXEL##bpp(cl);                                        \
                                                                               \
-        updateBuf[ublen++] = rfbHextilePackXY(thex, they);                    \
-        updateBuf[ublen++] = rfbHextilePackWH(thew, theh);                    \
+        t->updateBuf[(*t->ublen)++] = rfbHextilePackXY(thex, they);           \
+        t->updateBuf[(*t->ublen)++] = rfbHextilePackWH(thew, theh);           \
                                                                               \
         /*                                                                    \
          * Now mark the subrect as done.                                      \
@@ -269,7 +409,7 @@ static Bool subrectEncode##bpp(CARD##bpp *data, int w, int h, CARD##bpp bg,   \
     }                                                                         \
   }                                                                           \
                                                                               \
-  updateBuf[nSubrectsUblen] = numsubs;                                        \
+  t->updateBuf[nSubrectsUblen] = numsubs;                                     \
                                                                               \
   return TRUE;                                                                \
 }                                                                             \
@@ -278,21 +418,40 @@ static Bool subrectEncode##bpp(CARD##bpp *data, int w, int h, CARD##bpp bg,   \
 /*                                                                            \
  * testColours() tests if there are one (solid), two (mono) or more           \
  * colours in a tile and gets a reasonable guess at the best background       \
- * pixel, and the foreground pixel for mono.                                  \
+ * pixel, and the foreground pixel for mono.  Solid tiles are by far the most \
+ * common case, so they are detected first by comparing whole blocks of pixels\
+ * against the first pixel without branching, which the compiler can          \
+ * vectorize.                                                                 \
  */                                                                           \
                                                                               \
 static void testColours##bpp(CARD##bpp *data, int size, Bool *mono,           \
                              Bool *solid, CARD##bpp *bg, CARD##bpp *fg)       \
 {                                                                             \
-  CARD##bpp colour1 = 0, colour2 = 0;                                         \
-  int n1 = 0, n2 = 0;                                                         \
+  CARD##bpp colour1 = data[0], colour2 = 0, diff = 0;                         \
+  int n1 = 0, n2 = 0, i;                                                      \
   *mono = TRUE;                                                               \
   *solid = TRUE;                                                              \
                                                                               \
-  for (; size > 0; size--, data++) {                                          \
+  for (; n1 + SOLID_BLOCK <= size; n1 += SOLID_BLOCK) {                       \
+    for (i = 0; i < SOLID_BLOCK; i++)                                         \
+      diff |= data[n1 + i] ^ colour1;                                         \
+    if (diff) break;                                                          \
+  }                                                                           \
+  if (!diff) {                                                                \
+    for (i = n1; i < size; i++)                                               \
+      diff |= data[i] ^ colour1;                                              \
+    if (!diff) {                                                              \
+      *bg = colour1;                                                          \
+      *fg = 0;                                                                \
+      return;                                                                 \
+    }                                                                         \
+  }                                                                           \
                                                                               \
-    if (n1 == 0)                                                              \
-      colour1 = *data;                                                        \
+  /* The first n1 pixels are known to be colour1. */                          \
+  data += n1;                                                                 \
+  size -= n1;                                                                 \
+                                                                              \
+  for (; size > 0; size--, data++) {                                          \
                                                                               \
     if (*data == colour1) {                                                   \
       n1++;                                                                   \
@@ -240,6 +240,11 @@ int ddxProcessArgument(int argc, char *argv[], int i)
     return 1;
   }
 
+  if (strcasecmp(argv[i], "-framesync") == 0) {
+    rfbFrameSync = TRUE;
+    return 1;
+  }
+
   if (strcasecmp(argv[i], "-idletimeout") == 0) {  /* -idletimeout sec */
     REQUIRE_ARG();
     rfbIdleTimeout = atoi(argv[i + 1]);
@@ -358,6 +363,11 @@ int ddxProcessArgument(int argc, char *argv[], int i)
     return 1;
   }
 
+  if (strcasecmp(argv[i], "-precisedamage") == 0) {
+    rfbPreciseDamage = TRUE;
+    return 1;
+  }
+
   if (strcasecmp(argv[i], "-rfbport") == 0) {  /* -rfbport port */
     REQUIRE_ARG();
     rfbPort = atoi(argv[i + 1]);
@@ -377,6 +387,11 @@ int ddxProcessArgument(int argc, char *argv[], int i)
     return 1;
   }
 
+  if (strcasecmp(argv[i], "-nocoalesce") == 0) {
+    rfbCoalesceMotion = FALSE;
+    return 1;
+  }
+
   if (strcasecmp(argv[i], "-nocursor") == 0) {
     noCursor = TRUE;
     return 1;
@@ -537,6 +552,16 @@ int ddxProcessArgument(int argc, char *argv[], int i)
     return 2;
   }
 
+  if (strcasecmp(argv[i], "-alrprelimqual") == 0) {
+    REQUIRE_ARG();
+    rfbALRPrelimQualityLevel = atoi(argv[i + 1]);
+    if (rfbALRPrelimQualityLevel < 1 || rfbALRPrelimQualityLevel > 100) {
+      UseMsg();
+      exit(1);
+    }
+    return 2;
+  }
+
   if (strcasecmp(argv[i], "-alrsamp") == 0) {
     int s;
     REQUIRE_ARG();
@@ -563,6 +588,16 @@ int ddxProcessArgument(int argc, char *argv[], int i)
     return 1;
   }
 
+  if (strcasecmp(argv[i], "-lz4bw") == 0) {
+    REQUIRE_ARG();
+    rfbLZ4Bandwidth = atoi(argv[i + 1]);
+    if (rfbLZ4Bandwidth < 0) {
+      UseMsg();
+      exit(1);
+    }
+    return 2;
+  }
+
 #if !defined(__FreeBSD__) && !defined(__NetBSD__) && !defined(__OpenBSD__) && !defined(__DragonFly__)
   if (strcasecmp(argv[i], "-nomt") == 0) {
     rfbMT = FALSE;
@@ -575,6 +610,11 @@ int ddxProcessArgument(int argc, char *argv[], int i)
     return 1;
   }
 
+  if (strcasecmp(argv[i], "-nolz4") == 0) {
+    rfbLZ4Bandwidth = -1;
+    return 1;
+  }
+
 #if !defined(__FreeBSD__) && !defined(__NetBSD__) && !defined(__OpenBSD__) && !defined(__DragonFly__)
   if (strcasecmp(argv[i], "-nthreads") == 0) {
     REQUIRE_ARG();
@@ -779,6 +819,7 @@ static Bool rfbScreenInit(ScreenPtr pScreen, int argc, char **argv)
   prfb->bitsPerPixel = rfbBitsPerPixel(prfb->depth);
   pbits = rfbAllocateFramebufferMemory(prfb);
   if (!pbits) return FALSE;
+  rfbDirtyTilesInit(pScreen);
 
   switch (prfb->depth) {
     case 8:
@@ -1545,6 +1586,7 @@ void ddxGiveUp(enum ExitCode error)
     rfbPAMEnd(cl);
 #endif
   ShutdownTightThreads();
+  ShutdownHextile();
   free(rfbFB.pfbMemory);
   if (initOutputCalled) {
     char unixSocketName[32];
@@ -1622,6 +1664,7 @@ void ddxUseMsg(void)
   ErrorF("-disconnect            disconnect existing viewers when a new non-shared\n"
          "                       connection comes in, rather than refusing the new\n"
          "                       connection\n");
+  ErrorF("-framesync             synchronize updates with OpenGL and Present frames\n");
   ErrorF("-idletimeout S         exit if S seconds elapse with no VNC viewer connections\n");
   ErrorF("-inetd                 Xvnc is launched by inetd\n");
   ErrorF("-interface ipaddr      only bind to specified interface address\n");
@@ -1644,6 +1687,10 @@ void ddxUseMsg(void)
   ErrorF("                       selection (typically used when pasting with the middle\n");
   ErrorF("                       mouse button)\n");
   ErrorF("-noreverse             disable reverse connections\n");
+  ErrorF("-precisedamage         hash the framebuffer in %dx%d tiles in order to avoid\n",
+         DIRTY_TILE_SIZE, DIRTY_TILE_SIZE);
+  ErrorF("                       sending areas that the drawing operations did not\n");
+  ErrorF("                       actually change\n");
   ErrorF("-rfbport port          TCP port for RFB protocol\n");
   ErrorF("-rfbwait time          max time in ms to wait for a send/receive operation\n");
   ErrorF("                       to/from a connected viewer to complete [default: %d]\n",
@@ -1652,6 +1699,8 @@ void ddxUseMsg(void)
   ErrorF("\nTurboVNC input options\n");
   ErrorF("======================\n");
   ErrorF("-compatiblekbd         set META key = ALT key as in the original VNC\n");
+  ErrorF("-nocoalesce            pass every pointer motion event to the X server, even\n");
+  ErrorF("                       if a newer one from the same viewer is already queued\n");
   ErrorF("-nocursor              don't display a cursor\n");
   ErrorF("-viewonly              only let viewers view, not control, the remote desktop\n");
   ErrorF("-virtualtablet         set up virtual stylus and eraser devices for this\n");
@@ -1689,17 +1738,24 @@ void ddxUseMsg(void)
   ErrorF("-alrqual Q             send automatic lossless refresh as a JPEG image with\n");
   ErrorF("                       quality Q, rather than as a mathematically lossless\n");
   ErrorF("                       image\n");
+  ErrorF("-alrprelimqual Q       before sending automatic lossless refresh, send a\n");
+  ErrorF("                       preliminary refresh as a JPEG image with quality Q\n");
   ErrorF("-alrsamp S             specify chroma subsampling factor for automatic lossless\n");
   ErrorF("                       refresh JPEG images (S = 1x, 2x, 4x, or gray)\n");
   ErrorF("-economictranslate     use less memory-hungry pixel format translation if\n");
   ErrorF("                       depth=16\n");
   ErrorF("-interframe            always use interframe comparison\n");
   ErrorF("-nointerframe          never use interframe comparison\n");
+  ErrorF("-lz4bw B               use LZ4 rather than zlib to compress Tight-encoded\n");
+  ErrorF("                       rectangles when the estimated network bandwidth is at\n");
+  ErrorF("                       least B Mbps (0 = always) and the viewer supports it\n");
+  ErrorF("                       [default: 1000]\n");
+  ErrorF("-nolz4                 never use LZ4 compression with Tight encoding\n");
 #if !defined(__FreeBSD__) && !defined(__NetBSD__) && !defined(__OpenBSD__) && !defined(__DragonFly__)
-  ErrorF("-nomt                  disable multithreaded Tight encoding\n");
+  ErrorF("-nomt                  disable multithreaded Tight and Hextile encoding\n");
   ErrorF("-nthreads N            specify number of threads (1 <= N <= %d) to use with\n",
          MAX_ENCODING_THREADS);
-  ErrorF("                       multithreaded Tight encoding [default: 1 per CPU core,\n");
+  ErrorF("                       multithreaded encoding [default: 1 per CPU core,\n");
   ErrorF("                       max. 4]\n");
 #endif
 
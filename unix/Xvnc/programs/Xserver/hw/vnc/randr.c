@@ -283,6 +283,74 @@ static RRModePtr vncSetModes(rfbScreenInfo *screen)
 }
 
 
+/*
+ * Move the rows of a framebuffer-sized buffer from a layout with a stride of
+ * srcPitch bytes to a layout with a stride of dstPitch bytes, keeping the
+ * pixels in the area that the old and new framebuffers have in common and
+ * clearing the rest.  dst and src may point to the same buffer.
+ */
+
+static void CopyFBRows(char *dst, int dstPitch, char *src, int srcPitch,
+                       int oldWidth, int oldHeight, int newWidth,
+                       int newHeight)
+{
+  int ps = rfbFB.bitsPerPixel / 8, y;
+  int rowBytes = min(oldWidth, newWidth) * ps;
+  int rows = min(oldHeight, newHeight);
+
+  /* When resizing in place, the rows must be moved in an order that never
+     overwrites a row that has not yet been moved. */
+  if (dst != src || dstPitch < srcPitch) {
+    for (y = 0; y < rows; y++)
+      memmove(&dst[y * dstPitch], &src[y * srcPitch], rowBytes);
+  } else if (dstPitch > srcPitch) {
+    for (y = rows - 1; y >= 0; y--)
+      memmove(&dst[y * dstPitch], &src[y * srcPitch], rowBytes);
+  }
+
+  if (newWidth > oldWidth) {
+    for (y = 0; y < rows; y++)
+      memset(&dst[y * dstPitch + rowBytes], 0, (newWidth - oldWidth) * ps);
+  }
+  if (newHeight > oldHeight)
+    memset(&dst[rows * dstPitch], 0, (newHeight - rows) * dstPitch);
+}
+
+
+/*
+ * Resize a client's interframe comparison buffer to match the new framebuffer
+ * dimensions, keeping its contents.
+ */
+
+static Bool ResizeCompareFB(rfbClientPtr cl, int oldWidth, int oldHeight,
+                            int oldPitch)
+{
+  int oldSize = oldPitch * oldHeight;
+  int newSize = rfbFB.paddedWidthInBytes * rfbFB.height;
+  char *buf = cl->compareFB;
+
+  if (newSize > oldSize) {
+    if (!(buf = (char *)realloc(cl->compareFB, newSize))) {
+      rfbLogPerror("ResizeCompareFB: couldn't reallocate comparison buffer");
+      return FALSE;
+    }
+    cl->compareFB = buf;
+  } else if (newSize < oldSize / 2) {
+    /* Don't hold onto more than twice as much memory as is needed. */
+    if (!(buf = (char *)malloc(newSize)))
+      buf = cl->compareFB;
+  }
+
+  CopyFBRows(buf, rfbFB.paddedWidthInBytes, cl->compareFB, oldPitch, oldWidth,
+             oldHeight, rfbFB.width, rfbFB.height);
+  if (buf != cl->compareFB) {
+    free(cl->compareFB);
+    cl->compareFB = buf;
+  }
+  return TRUE;
+}
+
+
 static int vncScreenSetSize(ScreenPtr pScreen, CARD16 width, CARD16 height,
                             CARD32 mmWidth, CARD32 mmHeight)
 {
@@ -290,7 +358,11 @@ static int vncScreenSetSize(ScreenPtr pScreen, CARD16 width, CARD16 height,
   rfbClientPtr cl, nextCl;
   rfbFBInfo newFB = rfbFB;
   PixmapPtr rootPixmap = pScreen->GetScreenPixmap(pScreen);
-  int ret = rfbEDSResultSuccess, i;
+  int ret = rfbEDSResultSuccess, i, newSize;
+  int oldWidth = rfbFB.width, oldHeight = rfbFB.height;
+  int oldPitch = rfbFB.paddedWidthInBytes;
+  RegionRec newRegion, screenRegion;
+  BoxRec box;
 
   if (width > rfbMaxWidth || height > rfbMaxHeight) {
     width = min(width, rfbMaxWidth);
@@ -302,33 +374,78 @@ static int vncScreenSetSize(ScreenPtr pScreen, CARD16 width, CARD16 height,
   newFB.width = width;
   newFB.height = height;
   newFB.paddedWidthInBytes = PixmapBytePad(newFB.width, newFB.depth);
-  newFB.pfbMemory = NULL;
-  if (!rfbAllocateFramebufferMemory(&newFB)) {
-    rfbLog("ERROR: Could not allocate framebuffer memory\n");
-    return rfbEDSResultNoResources;
+  newSize = newFB.paddedWidthInBytes * newFB.height;
+
+  /* The framebuffer contents are preserved across the resize.  The
+     framebuffer is resized in place if the existing allocation is large
+     enough (and not wastefully large) or if it can be grown with realloc(),
+     which also keeps the old pixels.  Otherwise, the overlapping pixels are
+     copied into a new allocation. */
+  if (newSize > rfbFB.sizeInBytes) {
+    if (!(newFB.pfbMemory = (char *)realloc(rfbFB.pfbMemory, newSize))) {
+      rfbLog("ERROR: Could not allocate framebuffer memory\n");
+      return rfbEDSResultNoResources;
+    }
+    rfbFB.pfbMemory = newFB.pfbMemory;
+    rfbFB.sizeInBytes = newFB.sizeInBytes = newSize;
+  } else if (newSize < rfbFB.sizeInBytes / 2) {
+    newFB.pfbMemory = NULL;
+    if (!rfbAllocateFramebufferMemory(&newFB)) {
+      newFB.pfbMemory = rfbFB.pfbMemory;
+      newFB.sizeInBytes = rfbFB.sizeInBytes;
+    }
   }
 
   rfbFB.blockUpdates = newFB.blockUpdates = TRUE;
-  SetRootClip(pScreen, ROOT_CLIP_NONE);
 
   if (!pScreen->ModifyPixmapHeader(rootPixmap, newFB.width, newFB.height,
                                    newFB.depth, newFB.bitsPerPixel,
                                    newFB.paddedWidthInBytes,
                                    newFB.pfbMemory)) {
     rfbLog("ERROR: Could not modify root pixmap size\n");
-    free(newFB.pfbMemory);
-    SetRootClip(pScreen, ROOT_CLIP_FULL);
+    if (newFB.pfbMemory != rfbFB.pfbMemory)
+      free(newFB.pfbMemory);
+    /* realloc() may have moved the framebuffer. */
+    pScreen->ModifyPixmapHeader(rootPixmap, rfbFB.width, rfbFB.height,
+                                rfbFB.depth, rfbFB.bitsPerPixel,
+                                rfbFB.paddedWidthInBytes, rfbFB.pfbMemory);
     rfbFB.blockUpdates = FALSE;
     return rfbEDSResultInvalid;
   }
-  free(rfbFB.pfbMemory);
+  CopyFBRows(newFB.pfbMemory, newFB.paddedWidthInBytes, rfbFB.pfbMemory,
+             oldPitch, oldWidth, oldHeight, newFB.width, newFB.height);
+  if (newFB.pfbMemory != rfbFB.pfbMemory)
+    free(rfbFB.pfbMemory);
   rfbFB = newFB;
+  rfbDirtyTilesResize(pScreen, oldWidth, oldHeight);
   pScreen->width = width;
   pScreen->height = height;
   pScreen->mmWidth = mmWidth;
   pScreen->mmHeight = mmHeight;
 
+  /* Compute the newly-added area of the screen. */
+  box.x1 = box.y1 = 0;
+  box.x2 = width;  box.y2 = height;
+  SAFE_REGION_INIT(pScreen, &screenRegion, &box, 0);
+  box.x2 = oldWidth;  box.y2 = oldHeight;
+  SAFE_REGION_INIT(pScreen, &newRegion, &box, 0);
+  REGION_SUBTRACT(pScreen, &newRegion, &screenRegion, &newRegion);
+
+  /* Since the existing windows are still intact in the framebuffer, the root
+     clip is not disabled during the resize (which would cause every window to
+     be exposed and redrawn.)  Instead, the root clip is updated to the new
+     screen dimensions, and only the newly-added area of the root window is
+     exposed.  Windows that extend into that area are exposed by
+     SetRootClip(). */
   SetRootClip(pScreen, ROOT_CLIP_FULL);
+  if (REGION_NOTEMPTY(pScreen, &newRegion)) {
+    RegionRec exposed;
+
+    REGION_INIT(pScreen, &exposed, NullBox, 0);
+    REGION_INTERSECT(pScreen, &exposed, &newRegion, &pScreen->root->clipList);
+    (*pScreen->WindowExposures)(pScreen->root, &exposed);
+    REGION_UNINIT(pScreen, &exposed);
+  }
 
   RRScreenSizeNotify(pScreen);
   update_desktop_dimensions();
@@ -375,6 +492,8 @@ static int vncScreenSetSize(ScreenPtr pScreen, CARD16 width, CARD16 height,
                             crtc->numOutputs, crtc->outputs)) {
       rfbLog("ERROR: Could not crop CRTC to new screen dimensions\n");
       rfbFB.blockUpdates = FALSE;
+      REGION_UNINIT(pScreen, &newRegion);
+      REGION_UNINIT(pScreen, &screenRegion);
       return rfbEDSResultInvalid;
     }
   }
@@ -382,46 +501,90 @@ static int vncScreenSetSize(ScreenPtr pScreen, CARD16 width, CARD16 height,
   rfbFB.blockUpdates = FALSE;
 
   for (cl = rfbClientHead; cl; cl = nextCl) {
-    RegionRec tmpRegion;  BoxRec box;
-    Bool reEnableInterframe = (cl->compareFB != NULL);
+    Bool keepContent;
+
     nextCl = cl->next;
-    InterframeOff(cl);
-    if (reEnableInterframe) {
-      if (!InterframeOn(cl)) {
+    if (!rfbScaleResize(cl)) {
+      rfbCloseClient(cl);
+      ret = rfbEDSResultInvalid;
+      continue;
+    }
+    /* A client that keeps its framebuffer contents across a resize needs only
+       the newly-added area and whatever has been redrawn.  Server-side
+       scaling changes the scaled coordinates of every pixel, so scaled
+       clients always receive the whole screen. */
+    keepContent = cl->resizeKeepContent && !cl->scaledFB;
+    if (cl->compareFB) {
+      if (!ResizeCompareFB(cl, oldWidth, oldHeight, oldPitch)) {
         rfbCloseClient(cl);
         ret = rfbEDSResultInvalid;
         continue;
       }
-    }
+      cl->fb = cl->compareFB;
+      if (!keepContent) cl->firstCompare = TRUE;
+    } else
+      cl->fb = cl->scaledFB ? cl->scaledFB : rfbFB.pfbMemory;
     cl->deferredUpdateScheduled = FALSE;
-    /* Reset all of the regions, so the next FBU will behave as if it
-       was the first. */
-    box.x1 = box.y1 = 0;
-    box.x2 = pScreen->width;  box.y2 = pScreen->height;
-    SAFE_REGION_INIT(pScreen, &tmpRegion, &box, 0);
-    REGION_EMPTY(pScreen, &cl->modifiedRegion);
-    REGION_UNION(pScreen, &cl->modifiedRegion, &cl->modifiedRegion,
-                 &tmpRegion);
-    REGION_EMPTY(pScreen, &cl->copyRegion);
-    REGION_EMPTY(pScreen, &cl->ifRegion);
-    REGION_UNION(pScreen, &cl->ifRegion, &cl->ifRegion, &tmpRegion);
-    if (rfbAutoLosslessRefresh > 0.0) {
-      REGION_EMPTY(pScreen, &cl->alrRegion);
-      REGION_EMPTY(pScreen, &cl->alrEligibleRegion);
-      REGION_EMPTY(pScreen, &cl->lossyRegion);
-      cl->firstUpdate = TRUE;
+
+    if (keepContent) {
+      /* Pending CopyRect operations may have sources outside of the new
+         screen, so send their destinations as ordinary updates. */
+      REGION_UNION(pScreen, &cl->modifiedRegion, &cl->modifiedRegion,
+                   &cl->copyRegion);
+      REGION_EMPTY(pScreen, &cl->copyRegion);
+      REGION_INTERSECT(pScreen, &cl->modifiedRegion, &cl->modifiedRegion,
+                       &screenRegion);
+      REGION_UNION(pScreen, &cl->modifiedRegion, &cl->modifiedRegion,
+                   &newRegion);
+      if (cl->compareFB) {
+        REGION_INTERSECT(pScreen, &cl->ifRegion, &cl->ifRegion,
+                         &screenRegion);
+        REGION_UNION(pScreen, &cl->ifRegion, &cl->ifRegion, &newRegion);
+      }
+      if (rfbAutoLosslessRefresh > 0.0) {
+        REGION_INTERSECT(pScreen, &cl->alrRegion, &cl->alrRegion,
+                         &screenRegion);
+        REGION_INTERSECT(pScreen, &cl->alrEligibleRegion,
+                         &cl->alrEligibleRegion, &screenRegion);
+        REGION_INTERSECT(pScreen, &cl->lossyRegion, &cl->lossyRegion,
+                         &screenRegion);
+        REGION_INTERSECT(pScreen, &cl->alrPassRegion, &cl->alrPassRegion,
+                         &screenRegion);
+        REGION_INTERSECT(pScreen, &cl->alrPrelimRegion, &cl->alrPrelimRegion,
+                         &screenRegion);
+      }
+    } else {
+      /* Reset all of the regions, so the next FBU will behave as if it
+         was the first. */
+      REGION_EMPTY(pScreen, &cl->modifiedRegion);
+      REGION_UNION(pScreen, &cl->modifiedRegion, &cl->modifiedRegion,
+                   &screenRegion);
+      REGION_EMPTY(pScreen, &cl->copyRegion);
+      if (cl->compareFB) {
+        REGION_EMPTY(pScreen, &cl->ifRegion);
+        REGION_UNION(pScreen, &cl->ifRegion, &cl->ifRegion, &screenRegion);
+      }
+      if (rfbAutoLosslessRefresh > 0.0) {
+        REGION_EMPTY(pScreen, &cl->alrRegion);
+        REGION_EMPTY(pScreen, &cl->alrEligibleRegion);
+        REGION_EMPTY(pScreen, &cl->lossyRegion);
+        REGION_EMPTY(pScreen, &cl->alrPassRegion);
+        REGION_EMPTY(pScreen, &cl->alrPrelimRegion);
+        cl->firstUpdate = TRUE;
+      }
     }
     if (cl->continuousUpdates) {
       REGION_EMPTY(pScreen, &cl->cuRegion);
-      REGION_UNION(pScreen, &cl->cuRegion, &cl->cuRegion, &tmpRegion);
+      REGION_UNION(pScreen, &cl->cuRegion, &cl->cuRegion, &screenRegion);
     } else {
       REGION_EMPTY(pScreen, &cl->requestedRegion);
       REGION_UNION(pScreen, &cl->requestedRegion, &cl->requestedRegion,
-                   &tmpRegion);
+                   &screenRegion);
     }
-    REGION_UNINIT(pScreen, &tmpRegion);
   }
 
+  REGION_UNINIT(pScreen, &newRegion);
+  REGION_UNINIT(pScreen, &screenRegion);
   return ret;
 }
 
@@ -86,6 +86,12 @@
 
 #define DEFAULT_DEFER_UPDATE_TIME 40
 
+/* Bounds (in seconds) for the frame interval used with frame synchronization.
+   The lower bound corresponds to the 60 Hz refresh rate that the Present
+   extension's fake vblank clock normally emulates. */
+#define MIN_FRAME_INTERVAL (1.0 / 60.0)
+#define MAX_FRAME_INTERVAL 0.5
+
 /* Maximum number of threads to use for multithreaded encoding, regardless of
    the CPU count */
 #define MAX_ENCODING_THREADS 8
@@ -353,6 +359,11 @@ typedef struct rfbClientRec {
   OsTimerPtr deferredUpdateTimer;
   double deferredUpdateStart;
 
+  /* Estimated time (in seconds) required to encode and deliver one update to
+     this client, used to pace frame-synchronized applications */
+
+  double frameInterval;
+
   /* translateFn points to the translation function which is used to copy
      and translate a rectangle from the framebuffer to an output buffer. */
 
@@ -372,10 +383,16 @@ typedef struct rfbClientRec {
   int rfbCursorShapeUpdatesSent;
   long long rfbCursorPosBytesSent;
   int rfbCursorPosUpdatesSent;
+  int rfbTileCacheStoresSent;
+  int rfbTileCacheHits;
+  long long rfbTileCacheBytesSent;
   int rfbFramebufferUpdateMessagesSent;
   long long rfbRawBytesEquivalent;
   int rfbKeyEventsRcvd;
   int rfbPointerEventsRcvd;
+  int rfbPointerEventsMerged;
+  int rfbGIIValuatorEventsRcvd;
+  int rfbGIIValuatorEventsMerged;
 
   /* zlib encoding -- necessary compression state info per client */
 
@@ -421,17 +438,44 @@ typedef struct rfbClientRec {
   Bool firstUpdate, inALR;
   OsTimerPtr alrTimer;
   RegionRec lossyRegion, alrRegion, alrEligibleRegion;
+  RegionRec alrPassRegion;          /* remainder of the current ALR pass */
+  RegionRec alrPrelimRegion;        /* sent at the preliminary ALR quality */
+  Bool alrPrelimPass;               /* current ALR pass is preliminary */
+  double alrBytesPerPixel[2];       /* measured ALR cost (prelim, final) */
 
   /* Interframe comparison */
   char *compareFB, *fb;
   Bool firstCompare;
   RegionRec ifRegion;
 
+  /* Server-side scaling */
+  int scale;                        /* scaling factor (percent) */
+  int scaledWidth, scaledHeight;
+  char *scaledFB;                   /* downscaled copy of the framebuffer */
+  int *scaleMap;                    /* framebuffer column/row at which each
+                                       scaled column/row starts */
+
+  /* Tile cache */
+  struct _rfbTileCache *tileCache;
+
+  /* client keeps its framebuffer contents across desktop resizes */
+  Bool resizeKeepContent;
+
+  /* LZ4 compression for Tight encoding */
+  Bool enableTightLZ4;              /* client supports LZ4 for Tight */
+  Bool tightLZ4;                    /* LZ4 is currently in use */
+
   struct rfbClientRec *prev, *next;
 
   char *cutText;
   int cutTextLen;
 
+  /* extended clipboard */
+  Bool enableExtClipboard;          /* client supports extended clipboard */
+  CARD32 clipFlags;                 /* client's clipboard capabilities */
+  CARD32 clipSizes[16];             /* client's maximum unsolicited size for
+                                       each clipboard format */
+
   /* flow control extensions */
 
   Bool continuousUpdates;
@@ -460,9 +504,20 @@ typedef struct rfbClientRec {
 
 #if USETLS
   rfbSslCtx *sslctx;
+  char *tlsBuf;                     /* plaintext pending TLS record
+                                       coalescing */
+  int tlsBufLen;
+  Bool tlsCorked;                   /* TLS writes are being coalesced */
 #endif
   wsCtx     *wsctx;
 
+  int lastButtonMask;               /* button mask of the last pointer event
+                                       passed to the X server */
+
+  char *inBuf;                      /* data read from the client but not yet
+                                       processed (see rfbFillInBuf()) */
+  int inBufStart, inBufEnd;
+
   /* Extended input device support */
   rfbDevInfo devices[MAXDEVICES];
   int numDevices;
@@ -479,12 +534,19 @@ typedef struct rfbClientRec {
  * be sent to the client.
  */
 
+/* Framebuffer dimensions, as seen by the client */
+#define rfbClientWidth(cl)  \
+  ((cl)->scaledFB ? (cl)->scaledWidth : rfbFB.width)
+#define rfbClientHeight(cl)  \
+  ((cl)->scaledFB ? (cl)->scaledHeight : rfbFB.height)
+
 #define FB_UPDATE_PENDING(cl)  \
   ((!(cl)->enableCursorShapeUpdates && !rfbFB.cursorIsDrawn) ||  \
    ((cl)->enableCursorShapeUpdates && (cl)->cursorWasChanged) ||  \
    ((cl)->enableCursorPosUpdates && (cl)->cursorWasMoved) ||  \
    REGION_NOTEMPTY((pScreen), &(cl)->copyRegion) ||  \
-   REGION_NOTEMPTY((pScreen), &(cl)->modifiedRegion))
+   REGION_NOTEMPTY((pScreen), &(cl)->modifiedRegion) ||  \
+   rfbDirtyTilesPending())
 
 /*
  * This macro creates an empty region (ie. a region with no areas) if it is
@@ -705,6 +767,21 @@ extern void vncHandleSelection(Atom selection, Atom target, Atom property,
 extern void vncSelectionInit(void);
 
 
+/* dirtytiles.c */
+
+#define DIRTY_TILE_SIZE  32
+
+extern Bool rfbPreciseDamage;
+
+extern Bool rfbDirtyTilesInit(ScreenPtr pScreen);
+extern Bool rfbDirtyTilesResize(ScreenPtr pScreen, int oldWidth,
+                                int oldHeight);
+extern void rfbDirtyTilesAdd(ScreenPtr pScreen, RegionPtr reg);
+extern Bool rfbDirtyTilesPending(void);
+extern void rfbDirtyTilesInvalidate(ScreenPtr pScreen, RegionPtr reg);
+extern void rfbDirtyTilesFlush(ScreenPtr pScreen);
+
+
 /* dispcur.c */
 
 extern Bool rfbDCInitialize(ScreenPtr, miPointerScreenFuncPtr);
@@ -713,8 +790,11 @@ extern Bool rfbDCInitialize(ScreenPtr, miPointerScreenFuncPtr);
 /* draw.c */
 
 extern int rfbDeferUpdateTime;
+extern Bool rfbFrameSync;
 
 extern void ClipToScreen(ScreenPtr pScreen, RegionPtr pRegion);
+extern void rfbFrameComplete(WindowPtr pWin);
+extern void rfbUpdateFrameClock(ScreenPtr pScreen);
 void PrintRegion(ScreenPtr pScreen, RegionPtr reg, const char *msg);
 
 #ifdef RENDER
@@ -744,6 +824,8 @@ extern void rfbInitFlowControl(rfbClientPtr cl);
 extern void rfbUpdatePosition(rfbClientPtr cl, unsigned pos);
 extern Bool rfbSendRTTPing(rfbClientPtr cl);
 extern Bool rfbIsCongested(rfbClientPtr cl);
+extern unsigned rfbGetSpareWindow(rfbClientPtr cl);
+extern double rfbGetBandwidth(rfbClientPtr cl);
 extern Bool rfbSendFence(rfbClientPtr cl, CARD32 flags, unsigned len,
                          const char *data);
 extern void HandleFence(rfbClientPtr cl, CARD32 flags, unsigned len,
@@ -755,6 +837,7 @@ extern Bool rfbSendEndOfCU(rfbClientPtr cl);
 
 extern Bool rfbSendRectEncodingHextile(rfbClientPtr cl, int x, int y, int w,
                                        int h);
+extern void ShutdownHextile(void);
 
 
 /* init.c */
@@ -874,14 +957,20 @@ extern double rfbAutoLosslessRefresh;
 extern Bool rfbALRAll;
 extern int rfbALRQualityLevel;
 extern int rfbALRSubsampLevel;
+extern int rfbALRPrelimQualityLevel;
 extern int rfbInterframe;
 extern int rfbMaxClipboard;
 extern Bool rfbVirtualTablet;
+extern Bool rfbCoalesceMotion;
 
 /* Multithreading params specified on the command line or in the environment */
 extern Bool rfbMT;
 extern int rfbNumThreads;
 
+/* Bandwidth (Mbps) above which LZ4 is used instead of zlib for Tight
+   encoding, 0 = always, -1 = never */
+extern int rfbLZ4Bandwidth;
+
 extern char *captureFile;
 
 #define debugregion(r, m)  \
@@ -914,6 +1003,7 @@ int rfbssl_pending(rfbClientPtr cl);
 int rfbssl_peek(rfbClientPtr cl, char *buf, int bufsize);
 int rfbssl_read(rfbClientPtr cl, char *buf, int bufsize);
 int rfbssl_write(rfbClientPtr cl, const char *buf, int bufsize);
+Bool rfbssl_write_wants_read(rfbClientPtr cl);
 void rfbssl_destroy(rfbClientPtr cl);
 char *rfbssl_geterr(void);
 
@@ -926,11 +1016,25 @@ extern Bool rfbSendRectEncodingRRE(rfbClientPtr cl, int x, int y, int w,
                                    int h);
 
 
+/* scale.c */
+
+extern Bool rfbSetClientScale(rfbClientPtr cl, int scale);
+extern Bool rfbScaleResize(rfbClientPtr cl);
+extern void rfbScaleOff(rfbClientPtr cl);
+extern void rfbScaleBox(rfbClientPtr cl, BoxPtr box, Bool up);
+extern void rfbScaleRegion(rfbClientPtr cl, RegionPtr region, Bool up);
+extern void rfbScalePoint(rfbClientPtr cl, int *x, int *y, Bool up);
+extern int rfbScaleDimUp(rfbClientPtr cl, int dim);
+extern void rfbScaleUpdateRegion(rfbClientPtr cl, RegionPtr region);
+
+
 /* sockets.c */
 
 extern int rfbMaxClientConnections;
 extern int rfbMaxClientWait;
 
+#define CLIENT_INBUF_SIZE 65536
+
 extern int rfbPort;
 extern int rfbListenSock;
 
@@ -940,10 +1044,13 @@ extern void rfbCloseClient(rfbClientPtr cl);
 extern int rfbConnect(char *host, int port);
 extern void rfbCorkSock(int sock);
 extern void rfbUncorkSock(int sock);
+extern void rfbCorkClient(rfbClientPtr cl);
+extern Bool rfbUncorkClient(rfbClientPtr cl);
 
 extern int PeekExactTimeout(rfbClientPtr cl, char *buf, int len, int timeout);
 extern int ReadExact(rfbClientPtr cl, char *buf, int len);
 extern int ReadExactTimeout(rfbClientPtr cl, char *buf, int len, int timeout);
+extern int rfbFillInBuf(rfbClientPtr cl);
 extern int SkipExact(rfbClientPtr cl, int len);
 extern int WriteExact(rfbClientPtr cl, char *buf, int len);
 extern int ListenOnTCPPort(int port);
@@ -977,9 +1084,19 @@ extern int rfbNumCodedRectsTight(rfbClientPtr cl, int x, int y, int w, int h);
 extern Bool rfbSendRectEncodingTight(rfbClientPtr cl, int x, int y, int w,
                                      int h);
 extern int rfbTightCompressLevel(rfbClientPtr cl);
+extern void rfbRunEncodingJobs(int n, void (*func)(void *), void **args);
 extern void ShutdownTightThreads(void);
 
 
+/* tilecache.c */
+
+extern Bool rfbTileCacheInit(rfbClientPtr cl, int nSlots);
+extern void rfbTileCacheFree(rfbClientPtr cl);
+extern void rfbTileCacheReset(rfbClientPtr cl);
+extern int rfbTileCacheProcessRegion(rfbClientPtr cl, RegionPtr updateRegion);
+extern Bool rfbTileCacheSendOps(rfbClientPtr cl);
+
+
 /* translate.c */
 
 extern Bool rfbEconomicTranslate;
@@ -999,6 +1116,7 @@ extern Bool rfbSetClientColourMap(rfbClientPtr cl, int firstColour,
 /* websockets.c */
 
 extern Bool webSocketsCheck(rfbClientPtr cl);
+extern int webSocketsEncodeHeader(rfbClientPtr cl, int len, char *header);
 extern int webSocketsEncode(rfbClientPtr cl, const char *src, int len,
                             char **dst);
 extern int webSocketsDecode(rfbClientPtr cl, char *dst, int len);
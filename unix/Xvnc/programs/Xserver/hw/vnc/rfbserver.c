@@ -80,6 +80,7 @@ Bool rfbInterframeDebug = FALSE;
 int rfbMaxWidth = MAXSHORT, rfbMaxHeight = MAXSHORT;
 int rfbMaxClipboard = MAX_CUTTEXT_LEN;
 Bool rfbVirtualTablet = FALSE;
+Bool rfbCoalesceMotion = TRUE;
 #if !defined(__FreeBSD__) && !defined(__NetBSD__) && !defined(__OpenBSD__) && !defined(__DragonFly__)
 Bool rfbMT = TRUE;
 #else
@@ -87,6 +88,7 @@ Bool rfbMT = TRUE;
 Bool rfbMT = FALSE;
 #endif
 int rfbNumThreads = 0;
+int rfbLZ4Bandwidth = 1000;
 
 static rfbClientPtr rfbNewClient(int sock);
 static void rfbProcessClientProtocolVersion(rfbClientPtr cl);
@@ -97,6 +99,10 @@ static Bool rfbSendCopyRegion(rfbClientPtr cl, RegionPtr reg, int dx, int dy);
 static Bool rfbSendLastRectMarker(rfbClientPtr cl);
 Bool rfbSendDesktopSize(rfbClientPtr cl);
 Bool rfbSendExtDesktopSize(rfbClientPtr cl);
+static Bool rfbSendClipboardMsg(rfbClientPtr cl, CARD32 flags, char *data,
+                                int len);
+static Bool rfbSendClipboardCaps(rfbClientPtr cl);
+static Bool rfbSendClipboardProvide(rfbClientPtr cl, char *str, int len);
 
 
 /*
@@ -159,9 +165,82 @@ double gettime(void)
 
 /*
  * Auto Lossless Refresh
+ *
+ * Refreshing the whole lossy region in one update can occupy a slow link for
+ * seconds, delaying any interactive updates that follow it.  Thus, the lossy
+ * region is refreshed in slices, the size of which is bounded by the spare
+ * capacity of the congestion window.  The largest rectangles are refreshed
+ * first, and the rectangles that were queued for the current refresh pass are
+ * completed before newer lossy rectangles are considered.  If a preliminary
+ * ALR quality is specified, then each region is first refreshed using that
+ * JPEG quality and then refreshed again using the final ALR quality.
  */
 
 static Bool alrCopyRect = TRUE;
+int rfbALRPrelimQualityLevel = -1;
+
+/* Delay (in ms) between successive ALR slices, or before retrying an ALR
+   slice if the transport is congested */
+#define ALR_SLICE_DELAY 10
+
+/* Lower bounds for the size of an ALR slice, so that progress is always made
+   even when the congestion window is small */
+#define ALR_MIN_SLICE_PIXELS 65536
+#define ALR_MIN_SLICE_ROWS 16
+
+static int alrBoxCompare(const void *arg1, const void *arg2)
+{
+  const BoxRec *box1 = (const BoxRec *)arg1, *box2 = (const BoxRec *)arg2;
+  long area1 = (long)(box1->x2 - box1->x1) * (long)(box1->y2 - box1->y1);
+  long area2 = (long)(box2->x2 - box2->x1) * (long)(box2->y2 - box2->y1);
+
+  /* Sort in descending order of area */
+  if (area1 > area2) return -1;
+  if (area1 < area2) return 1;
+  return 0;
+}
+
+/* Select up to maxPixels pixels from the current ALR pass, largest rectangles
+   first.  Rectangles that exceed the remaining budget are split into
+   horizontal bands.  Returns the number of pixels selected. */
+
+static long alrSelectSlice(rfbClientPtr cl, RegionPtr slice, long maxPixels)
+{
+  int nBoxes = REGION_NUM_RECTS(&cl->alrPassRegion), i;
+  BoxPtr boxes;
+  long pixels = 0;
+
+  if (nBoxes < 1) return 0;
+  boxes = (BoxPtr)rfbAlloc(nBoxes * sizeof(BoxRec));
+  memcpy(boxes, REGION_RECTS(&cl->alrPassRegion), nBoxes * sizeof(BoxRec));
+  qsort(boxes, nBoxes, sizeof(BoxRec), alrBoxCompare);
+
+  for (i = 0; i < nBoxes && pixels < maxPixels; i++) {
+    BoxRec box = boxes[i];
+    int w = box.x2 - box.x1, h = box.y2 - box.y1;
+    RegionRec tmpRegion;
+
+    if ((long)w * h > maxPixels - pixels) {
+      int rows = (int)((maxPixels - pixels) / w);
+
+      if (rows < ALR_MIN_SLICE_ROWS) {
+        /* Don't exceed the budget by more than necessary.  A smaller
+           rectangle may still fit. */
+        if (pixels > 0) continue;
+        rows = ALR_MIN_SLICE_ROWS;
+      }
+      h = min(h, rows);
+      box.y2 = box.y1 + h;
+    }
+    SAFE_REGION_INIT(pScreen, &tmpRegion, &box, 0);
+    REGION_UNION(pScreen, slice, slice, &tmpRegion);
+    REGION_UNINIT(pScreen, &tmpRegion);
+    pixels += (long)w * h;
+  }
+
+  free(boxes);
+  return pixels;
+}
 
 static CARD32 alrCallback(OsTimerPtr timer, CARD32 time, pointer arg)
 {
@@ -171,13 +250,54 @@ static CARD32 alrCallback(OsTimerPtr timer, CARD32 time, pointer arg)
   int tightCompressLevelSave, tightQualityLevelSave, copyDXSave, copyDYSave,
     tightSubsampLevelSave;
   RegionRec tmpRegion;
+  unsigned spare;
+  int stage, startOffset;
+  long pixels, maxPixels;
+  double maxPixelsD;
+  CARD32 retval = 0;
+
+  /* Discard any part of the current pass that has since been refreshed by a
+     lossless update. */
+  REGION_INTERSECT(pScreen, &cl->alrPassRegion, &cl->alrPassRegion,
+                   &cl->lossyRegion);
+
+  if (!REGION_NOTEMPTY(pScreen, &cl->alrPassRegion)) {
+    /* Start a new pass */
+    if (rfbALRAll || cl->firstUpdate)
+      REGION_COPY(pScreen, &cl->alrRegion, &cl->lossyRegion);
+    if (cl->firstUpdate) cl->firstUpdate = FALSE;
+    REGION_INIT(pScreen, &tmpRegion, NullBox, 0);
+    REGION_INTERSECT(pScreen, &tmpRegion, &cl->alrRegion, &cl->lossyRegion);
+
+    cl->alrPrelimPass = FALSE;
+    if (rfbALRPrelimQualityLevel >= 0) {
+      REGION_SUBTRACT(pScreen, &cl->alrPassRegion, &tmpRegion,
+                      &cl->alrPrelimRegion);
+      if (REGION_NOTEMPTY(pScreen, &cl->alrPassRegion))
+        cl->alrPrelimPass = TRUE;
+    }
+    if (!cl->alrPrelimPass)
+      REGION_COPY(pScreen, &cl->alrPassRegion, &tmpRegion);
+    REGION_UNINIT(pScreen, &tmpRegion);
+
+    if (!REGION_NOTEMPTY(pScreen, &cl->alrPassRegion)) {
+      REGION_EMPTY(pScreen, &cl->alrRegion);
+      REGION_EMPTY(pScreen, &cl->alrPrelimRegion);
+      return 0;
+    }
+  }
+
+  /* Yield to interactive updates if the transport is congested. */
+  spare = rfbCongestionControl ? rfbGetSpareWindow(cl) : (unsigned)-1;
+  if (spare == 0) return ALR_SLICE_DELAY;
+
+  stage = cl->alrPrelimPass ? 0 : 1;
+  maxPixelsD = (double)spare / cl->alrBytesPerPixel[stage];
+  maxPixels = maxPixelsD > (double)INT_MAX ? INT_MAX : (long)maxPixelsD;
+  maxPixels = max(maxPixels, ALR_MIN_SLICE_PIXELS);
 
   REGION_INIT(pScreen, &tmpRegion, NullBox, 0);
-  if (!rfbALRAll && !cl->firstUpdate)
-    REGION_INTERSECT(pScreen, &tmpRegion, &cl->alrRegion, &cl->lossyRegion);
-  else
-    REGION_COPY(pScreen, &tmpRegion, &cl->lossyRegion);
-  if (cl->firstUpdate) cl->firstUpdate = FALSE;
+  pixels = alrSelectSlice(cl, &tmpRegion, maxPixels);
 
   if (REGION_NOTEMPTY(pScreen, &tmpRegion)) {
 
@@ -196,7 +316,8 @@ static CARD32 alrCallback(OsTimerPtr timer, CARD32 time, pointer arg)
     REGION_COPY(pScreen, &ifRegionSave, &cl->ifRegion);
 
     cl->tightCompressLevel = 1;
-    cl->tightQualityLevel = rfbALRQualityLevel;
+    cl->tightQualityLevel = cl->alrPrelimPass ? rfbALRPrelimQualityLevel :
+                                                rfbALRQualityLevel;
     cl->tightSubsampLevel = rfbALRSubsampLevel;
     cl->copyDX = cl->copyDY = 0;
     REGION_EMPTY(pScreen, &cl->copyRegion);
@@ -212,11 +333,31 @@ static CARD32 alrCallback(OsTimerPtr timer, CARD32 time, pointer arg)
     }
 
     cl->inALR = TRUE;
+    startOffset = cl->sockOffset;
     if (!rfbSendFramebufferUpdate(cl)) return 0;
     cl->inALR = FALSE;
 
-    REGION_EMPTY(pScreen, &cl->lossyRegion);
-    REGION_EMPTY(pScreen, &cl->alrRegion);
+    /* Track the cost of ALR updates, so the next slice can be sized to fit
+       the congestion window. */
+    if (pixels > 0) {
+      double bpp = (double)(cl->sockOffset - startOffset) / (double)pixels;
+
+      cl->alrBytesPerPixel[stage] =
+        max(0.5 * cl->alrBytesPerPixel[stage] + 0.5 * bpp, 0.01);
+    }
+
+    REGION_SUBTRACT(pScreen, &cl->alrPassRegion, &cl->alrPassRegion,
+                    &tmpRegion);
+    if (cl->alrPrelimPass)
+      REGION_UNION(pScreen, &cl->alrPrelimRegion, &cl->alrPrelimRegion,
+                   &tmpRegion);
+    else {
+      REGION_SUBTRACT(pScreen, &cl->lossyRegion, &cl->lossyRegion,
+                      &tmpRegion);
+      REGION_SUBTRACT(pScreen, &cl->alrRegion, &cl->alrRegion, &tmpRegion);
+      REGION_SUBTRACT(pScreen, &cl->alrPrelimRegion, &cl->alrPrelimRegion,
+                      &tmpRegion);
+    }
     cl->tightCompressLevel = tightCompressLevelSave;
     cl->tightQualityLevel = tightQualityLevelSave;
     cl->tightSubsampLevel = tightSubsampLevelSave;
@@ -232,10 +373,15 @@ static CARD32 alrCallback(OsTimerPtr timer, CARD32 time, pointer arg)
       REGION_COPY(pScreen, &cl->ifRegion, &ifRegionSave);
       REGION_UNINIT(pScreen, &ifRegionSave);
     }
+
+    /* Keep refreshing until the pass is complete.  If a preliminary pass was
+       just completed, then the final pass follows it. */
+    if (REGION_NOTEMPTY(pScreen, &cl->alrPassRegion) || cl->alrPrelimPass)
+      retval = ALR_SLICE_DELAY;
   }
 
   REGION_UNINIT(pScreen, &tmpRegion);
-  return 0;
+  return retval;
 }
 
 
@@ -270,7 +416,7 @@ void InterframeOff(rfbClientPtr cl)
     rfbLog("Interframe comparison disabled\n");
   }
   cl->compareFB = NULL;
-  cl->fb = rfbFB.pfbMemory;
+  cl->fb = cl->scaledFB ? cl->scaledFB : rfbFB.pfbMemory;
 }
 
 
@@ -401,6 +547,7 @@ static rfbClientPtr rfbNewClient(int sock)
   cl->tightSubsampLevel = TIGHT_DEFAULT_SUBSAMP;
   cl->tightQualityLevel = -1;
   cl->imageQualityLevel = -1;
+  cl->scale = 100;
 
   cl->next = rfbClientHead;
   cl->prev = NULL;
@@ -463,6 +610,10 @@ static rfbClientPtr rfbNewClient(int sock)
       alrCopyRect = FALSE;
     REGION_INIT(pScreen, &cl->alrRegion, NullBox, 0);
     REGION_INIT(pScreen, &cl->alrEligibleRegion, NullBox, 0);
+    REGION_INIT(pScreen, &cl->alrPassRegion, NullBox, 0);
+    REGION_INIT(pScreen, &cl->alrPrelimRegion, NullBox, 0);
+    cl->alrBytesPerPixel[0] = 0.25;
+    cl->alrBytesPerPixel[1] = 1.0;
   }
 
   if ((env = getenv("TVNC_MT")) != NULL && !strcmp(env, "0"))
@@ -538,11 +689,14 @@ void rfbClientConnectionGone(rfbClientPtr cl)
   free(cl->host);
 
   ShutdownTightThreads();
+  ShutdownHextile();
 
   if (rfbAutoLosslessRefresh > 0.0) {
     REGION_UNINIT(pScreen, &cl->lossyRegion);
     REGION_UNINIT(pScreen, &cl->alrRegion);
     REGION_UNINIT(pScreen, &cl->alrEligibleRegion);
+    REGION_UNINIT(pScreen, &cl->alrPassRegion);
+    REGION_UNINIT(pScreen, &cl->alrPrelimRegion);
   }
 
   /* Release the compression state structures if any. */
@@ -576,6 +730,8 @@ void rfbClientConnectionGone(rfbClientPtr cl)
     free(rttInfo);
   }
 
+  rfbScaleOff(cl);
+  rfbTileCacheFree(cl);
   InterframeOff(cl);
 
   i = cl->numDevices;
@@ -587,61 +743,237 @@ void rfbClientConnectionGone(rfbClientPtr cl)
 
   free(cl);
 
+  rfbUpdateFrameClock(screenInfo.screens[0]);
+
   if (rfbClientHead == NULL && rfbIdleTimeout > 0)
     IdleTimerSet();
 }
 
 
 /*
- * rfbProcessClientMessage is called when there is data to read from a client.
+ * ClientMessageReady returns TRUE if the client's input buffer contains a
+ * complete normal protocol message.  A message that is too large to fit in
+ * the input buffer is considered to be ready as soon as its fixed-length
+ * header has arrived, and the remainder of it is read (blocking, as before) by
+ * rfbProcessClientNormalMessage().
  */
 
-void rfbProcessClientMessage(rfbClientPtr cl)
+static Bool ClientMessageReady(rfbClientPtr cl)
 {
-  rfbCorkSock(cl->sock);
+  const unsigned char *buf = (unsigned char *)&cl->inBuf[cl->inBufStart];
+  int avail = cl->inBufEnd - cl->inBufStart, hdrLen;
+  unsigned long long len;
 
-  if (cl->pendingSyncFence) {
-    cl->syncFence = TRUE;
-    cl->pendingSyncFence = FALSE;
+  if (avail < 1) return FALSE;
+
+  switch (buf[0]) {
+    case rfbSetPixelFormat:
+      hdrLen = sz_rfbSetPixelFormatMsg;  break;
+    case rfbFixColourMapEntries:
+      hdrLen = sz_rfbFixColourMapEntriesMsg;  break;
+    case rfbSetEncodings:
+      hdrLen = sz_rfbSetEncodingsMsg;  break;
+    case rfbFramebufferUpdateRequest:
+      hdrLen = sz_rfbFramebufferUpdateRequestMsg;  break;
+    case rfbKeyEvent:
+      hdrLen = sz_rfbKeyEventMsg;  break;
+    case rfbPointerEvent:
+      hdrLen = sz_rfbPointerEventMsg;  break;
+    case rfbClientCutText:
+      hdrLen = sz_rfbClientCutTextMsg;  break;
+    case rfbEnableContinuousUpdates:
+      hdrLen = sz_rfbEnableContinuousUpdatesMsg;  break;
+    case rfbFence:
+      hdrLen = sz_rfbFenceMsg;  break;
+    case rfbSetDesktopSize:
+      hdrLen = sz_rfbSetDesktopSizeMsg;  break;
+    case rfbGIIClient:
+      hdrLen = 4;  break;
+    default:
+      /* rfbProcessClientNormalMessage() will reject the message. */
+      return TRUE;
   }
+  if (avail < hdrLen) return FALSE;
 
-  switch (cl->state) {
-    case RFB_PROTOCOL_VERSION:
-      rfbProcessClientProtocolVersion(cl);
-      break;
-    case RFB_SECURITY_TYPE:     /* protocol versions 3.7 and above */
-      rfbProcessClientSecurityType(cl);
-      break;
-    case RFB_TUNNELING_TYPE:    /* protocol versions 3.7t, 3.8t */
-      rfbProcessClientTunnelingType(cl);
+  /* Add the length of the variable-length data, if any */
+  len = hdrLen;
+  switch (buf[0]) {
+    case rfbSetEncodings:
+      len += 4ULL * ((buf[2] << 8) | buf[3]);
       break;
-    case RFB_AUTH_TYPE:         /* protocol versions 3.7t, 3.8t */
-      rfbProcessClientAuthType(cl);
+    case rfbClientCutText:
+    {
+      CARD32 cutLen = ((CARD32)buf[4] << 24) | (buf[5] << 16) |
+                      (buf[6] << 8) | buf[7];
+
+      /* A negative length indicates an extended clipboard message. */
+      if (cl->enableExtClipboard && (cutLen & 0x80000000))
+        cutLen = -cutLen;
+      len += cutLen;
       break;
-#if USETLS
-    case RFB_TLS_HANDSHAKE:
-      rfbAuthTLSHandshake(cl);
+    }
+    case rfbFence:
+      len += buf[8];
       break;
-#endif
-    case RFB_AUTHENTICATION:
-      rfbAuthProcessResponse(cl);
+    case rfbSetDesktopSize:
+      len += (unsigned long long)buf[6] * sz_rfbScreenDesc;
       break;
-    case RFB_INITIALISATION:
-      rfbInitFlowControl(cl);
-      rfbProcessClientInitMessage(cl);
+    case rfbGIIClient:
+      if (buf[1] & rfbGIIBE)
+        len += (buf[2] << 8) | buf[3];
+      else
+        len += (buf[3] << 8) | buf[2];
       break;
-    default:
-      rfbProcessClientNormalMessage(cl);
   }
 
-  CHECK_CLIENT_PTR(cl, return)
+  return len <= (unsigned long long)avail || len > CLIENT_INBUF_SIZE;
+}
+
 
-  if (cl->syncFence) {
-    if (!rfbSendFence(cl, cl->fenceFlags, cl->fenceDataLen, cl->fenceData))
+/*
+ * Motion event coalescing
+ *
+ * When a client's input backs up (for instance, on a high-latency network),
+ * the input buffer may contain many pointer events that were generated before
+ * the client received the most recent framebuffer update.  Passing all of
+ * them to the X server would replay the pointer's path long after the user
+ * stopped moving it, so a motion event is dropped if the next message in the
+ * input buffer is a motion event that supersedes it.  Since this only
+ * considers data that has already arrived, the amount of coalescing adapts to
+ * the round-trip time, and nothing is coalesced on a fast network.
+ */
+
+static Bool NextPointerEventSupersedes(rfbClientPtr cl, CARD8 buttonMask)
+{
+  const unsigned char *buf = (unsigned char *)&cl->inBuf[cl->inBufStart];
+
+  return rfbCoalesceMotion && buttonMask == cl->lastButtonMask &&
+         cl->inBufEnd - cl->inBufStart >= sz_rfbPointerEventMsg &&
+         buf[0] == rfbPointerEvent && buf[1] == buttonMask;
+}
+
+
+static CARD32 GIIGet32(const unsigned char *buf, Bool bigEndian)
+{
+  if (bigEndian)
+    return ((CARD32)buf[0] << 24) | (buf[1] << 16) | (buf[2] << 8) | buf[3];
+  else
+    return ((CARD32)buf[3] << 24) | (buf[2] << 16) | (buf[1] << 8) | buf[0];
+}
+
+
+/*
+ * A GII absolute valuator event is superseded only if the next message is a
+ * GII event message containing a single absolute valuator event for the same
+ * device and the same valuators, and only the first two valuators (the X and
+ * Y position) differ.  Thus, pen pressure and tilt samples are never lost.
+ */
+
+static Bool NextGIIEventSupersedes(rfbClientPtr cl, rfbGIIValuatorEvent *v,
+                                   int *values)
+{
+  const unsigned char *buf = (unsigned char *)&cl->inBuf[cl->inBufStart];
+  int avail = cl->inBufEnd - cl->inBufStart, eventSize, i;
+  Bool bigEndian;
+
+  if (!rfbCoalesceMotion || avail < sz_rfbGIIEventMsg ||
+      buf[0] != rfbGIIClient || (buf[1] & ~rfbGIIBE) != rfbGIIEvent)
+    return FALSE;
+  bigEndian = (buf[1] & rfbGIIBE) != 0;
+
+  eventSize = sz_rfbGIIValuatorEvent + v->count * 4;
+  if (eventSize > 255 || avail < sz_rfbGIIEventMsg + eventSize ||
+      (bigEndian ? (buf[2] << 8) | buf[3] : (buf[3] << 8) | buf[2]) !=
+      eventSize)
+    return FALSE;
+
+  buf += sz_rfbGIIEventMsg;
+  if (buf[0] != eventSize || buf[1] != rfbGIIValuatorAbsolute ||
+      GIIGet32(&buf[4], bigEndian) != v->deviceOrigin ||
+      GIIGet32(&buf[8], bigEndian) != v->first ||
+      GIIGet32(&buf[12], bigEndian) != v->count)
+    return FALSE;
+
+  buf += sz_rfbGIIValuatorEvent;
+  for (i = v->first; i < v->first + v->count; i++, buf += 4) {
+    if (i >= 2 && (int)GIIGet32(buf, bigEndian) != values[i])
+      return FALSE;
+  }
+  return TRUE;
+}
+
+
+/*
+ * rfbProcessClientMessage is called when there is data to read from a client.
+ *
+ * Once the client has entered the normal protocol state, all of the data that
+ * is available from the client is read into its input buffer without
+ * blocking, and all of the complete messages in the buffer are processed in
+ * one pass.  A partial message is left in the buffer until more data arrives,
+ * so a slow client cannot stall the X server in the middle of a message.
+ */
+
+void rfbProcessClientMessage(rfbClientPtr cl)
+{
+  int n;
+
+  if (cl->state == RFB_NORMAL) {
+    if ((n = rfbFillInBuf(cl)) <= 0) {
+      if (n != 0)
+        rfbLogPerror("rfbProcessClientMessage: read");
+      rfbCloseClient(cl);
+      return;
+    }
+    if (!ClientMessageReady(cl))
       return;
-    cl->syncFence = FALSE;
   }
 
+  rfbCorkSock(cl->sock);
+
+  do {
+    if (cl->pendingSyncFence) {
+      cl->syncFence = TRUE;
+      cl->pendingSyncFence = FALSE;
+    }
+
+    switch (cl->state) {
+      case RFB_PROTOCOL_VERSION:
+        rfbProcessClientProtocolVersion(cl);
+        break;
+      case RFB_SECURITY_TYPE:     /* protocol versions 3.7 and above */
+        rfbProcessClientSecurityType(cl);
+        break;
+      case RFB_TUNNELING_TYPE:    /* protocol versions 3.7t, 3.8t */
+        rfbProcessClientTunnelingType(cl);
+        break;
+      case RFB_AUTH_TYPE:         /* protocol versions 3.7t, 3.8t */
+        rfbProcessClientAuthType(cl);
+        break;
+#if USETLS
+      case RFB_TLS_HANDSHAKE:
+        rfbAuthTLSHandshake(cl);
+        break;
+#endif
+      case RFB_AUTHENTICATION:
+        rfbAuthProcessResponse(cl);
+        break;
+      case RFB_INITIALISATION:
+        rfbInitFlowControl(cl);
+        rfbProcessClientInitMessage(cl);
+        break;
+      default:
+        rfbProcessClientNormalMessage(cl);
+    }
+
+    CHECK_CLIENT_PTR(cl, return)
+
+    if (cl->syncFence) {
+      if (!rfbSendFence(cl, cl->fenceFlags, cl->fenceDataLen, cl->fenceData))
+        return;
+      cl->syncFence = FALSE;
+    }
+  } while (cl->state == RFB_NORMAL && ClientMessageReady(cl));
+
   rfbUncorkSock(cl->sock);
 }
 
@@ -785,7 +1117,7 @@ static void rfbProcessClientInitMessage(rfbClientPtr cl)
 /* Update these constants on changing capability lists below! */
 #define N_SMSG_CAPS  0
 #define N_CMSG_CAPS  0
-#define N_ENC_CAPS  17
+#define N_ENC_CAPS  21
 
 void rfbSendInteractionCaps(rfbClientPtr cl)
 {
@@ -843,6 +1175,10 @@ void rfbSendInteractionCaps(rfbClientPtr cl)
   SetCapInfo(&enc_list[i++],  rfbEncodingQualityLevel0,  rfbTightVncVendor);
   SetCapInfo(&enc_list[i++],  rfbEncodingFineQualityLevel0, rfbTurboVncVendor);
   SetCapInfo(&enc_list[i++],  rfbEncodingSubsamp1X,         rfbTurboVncVendor);
+  SetCapInfo(&enc_list[i++],  rfbEncodingServerScale1,      rfbTurboVncVendor);
+  SetCapInfo(&enc_list[i++],  rfbEncodingTileCache256,      rfbTurboVncVendor);
+  SetCapInfo(&enc_list[i++],  rfbEncodingTightLZ4,          rfbTurboVncVendor);
+  SetCapInfo(&enc_list[i++],  rfbEncodingResizeKeepContent, rfbTurboVncVendor);
   SetCapInfo(&enc_list[i++],  rfbEncodingXCursor,        rfbTightVncVendor);
   SetCapInfo(&enc_list[i++],  rfbEncodingRichCursor,     rfbTightVncVendor);
   SetCapInfo(&enc_list[i++],  rfbEncodingPointerPos,     rfbTightVncVendor);
@@ -890,6 +1226,202 @@ void rfbSendInteractionCaps(rfbClientPtr cl)
     return;  \
   }
 
+/*
+ * Convert UTF-8 text with CRLF line endings, as used by the extended clipboard
+ * extension, into Latin-1 text with LF line endings.  Characters that cannot
+ * be represented in Latin-1 are replaced with '?'.  Returns the length of the
+ * converted text, which is never longer than maxLen bytes.
+ */
+
+static int Utf8ToLatin1(char *dst, int maxLen, const unsigned char *src,
+                        int len)
+{
+  int i = 0, j, n, dstLen = 0;
+  CARD32 ucs;
+
+  while (i < len && dstLen < maxLen && src[i] != 0) {
+    if (src[i] < 0x80) {
+      ucs = src[i];  n = 1;
+    } else if ((src[i] & 0xE0) == 0xC0) {
+      ucs = src[i] & 0x1F;  n = 2;
+    } else if ((src[i] & 0xF0) == 0xE0) {
+      ucs = src[i] & 0x0F;  n = 3;
+    } else if ((src[i] & 0xF8) == 0xF0) {
+      ucs = src[i] & 0x07;  n = 4;
+    } else {
+      ucs = '?';  n = 1;
+    }
+    for (j = 1; j < n; j++) {
+      if (i + j >= len || (src[i + j] & 0xC0) != 0x80) {
+        ucs = '?';  n = 1;
+        break;
+      }
+      ucs = (ucs << 6) | (src[i + j] & 0x3F);
+    }
+    i += n;
+    if (ucs == '\r' && i < len && src[i] == '\n')
+      continue;
+    dst[dstLen++] = ucs > 0xFF ? '?' : (char)ucs;
+  }
+
+  return dstLen;
+}
+
+
+/*
+ * Decompress and apply an extended clipboard Provide message from a client.
+ * Only the text format is used.
+ */
+
+static void rfbProcessClipboardProvide(rfbClientPtr cl, char *data, int len)
+{
+  z_stream zs;
+  unsigned char lenBuf[4], *utf8 = NULL;
+  CARD32 textLen;
+  char *str;
+  int maxUtf8Len, strLen, err;
+
+  memset(&zs, 0, sizeof(zs));
+  if (inflateInit(&zs) != Z_OK) {
+    rfbLog("Could not initialize zlib stream for clipboard data\n");
+    return;
+  }
+  zs.next_in = (Bytef *)data;
+  zs.avail_in = len;
+
+  zs.next_out = lenBuf;
+  zs.avail_out = 4;
+  err = inflate(&zs, Z_SYNC_FLUSH);
+  if ((err != Z_OK && err != Z_STREAM_END) || zs.avail_out != 0) {
+    rfbLog("Invalid clipboard data from client %s\n", cl->host);
+    goto bailout;
+  }
+  textLen = ((CARD32)lenBuf[0] << 24) | (lenBuf[1] << 16) | (lenBuf[2] << 8) |
+            lenBuf[3];
+
+  /* Each Latin-1 character occupies at most two bytes in UTF-8, and each LF
+     may be preceded by a CR, so there is no point in decompressing more than
+     twice the maximum clipboard size. */
+  maxUtf8Len = rfbMaxClipboard * 2;
+  if (textLen > (CARD32)maxUtf8Len) {
+    rfbLog("Truncating %u-byte clipboard update to %d bytes.\n", textLen,
+           maxUtf8Len);
+    textLen = maxUtf8Len;
+  }
+  if (textLen == 0) goto bailout;
+
+  utf8 = (unsigned char *)rfbAlloc(textLen);
+  zs.next_out = utf8;
+  zs.avail_out = textLen;
+  err = inflate(&zs, Z_SYNC_FLUSH);
+  if (err != Z_OK && err != Z_STREAM_END && err != Z_BUF_ERROR) {
+    rfbLog("Invalid clipboard data from client %s\n", cl->host);
+    goto bailout;
+  }
+
+  str = (char *)rfbAlloc(rfbMaxClipboard);
+  strLen = Utf8ToLatin1(str, rfbMaxClipboard, utf8, textLen - zs.avail_out);
+  if (strLen > 0) {
+    vncClientCutText(str, strLen);
+    if (rfbSyncCutBuffer) rfbSetXCutText(str, strLen);
+  }
+  free(str);
+
+  bailout:
+  free(utf8);
+  inflateEnd(&zs);
+}
+
+
+/*
+ * rfbProcessClientExtClipboard reads and processes an extended clipboard
+ * message (a ClientCutText message with a negative length) from a client.
+ */
+
+static void rfbProcessClientExtClipboard(rfbClientPtr cl, CARD32 len)
+{
+  int n, i;
+  CARD32 flags, size;
+  char *data;
+
+  if (len < 4 || len > 0x7FFFFFFF) {
+    rfbLog("Invalid extended clipboard message length %u from client %s\n",
+           len, cl->host);
+    rfbCloseClient(cl);
+    return;
+  }
+  READ((char *)&flags, 4)
+  flags = Swap32IfLE(flags);
+  len -= 4;
+
+  if (flags & rfbExtClipCaps) {
+    cl->clipFlags = flags;
+    memset(cl->clipSizes, 0, sizeof(cl->clipSizes));
+    for (i = 0; i < 16; i++) {
+      if (!(flags & (1 << i))) continue;
+      if (len < 4) break;
+      READ((char *)&size, 4)
+      cl->clipSizes[i] = Swap32IfLE(size);
+      len -= 4;
+    }
+    if (len > 0) {
+      SKIP(len)
+    }
+    return;
+  }
+
+  if (!(flags & rfbExtClipProvide)) {
+    if (len > 0) {
+      SKIP(len)
+    }
+
+    if (rfbViewOnly || cl->viewOnly)
+      return;
+
+    if (flags & rfbExtClipRequest) {
+      if ((flags & rfbExtClipText) && cl->cutText && !rfbAuthDisableCBSend)
+        rfbSendClipboardProvide(cl, cl->cutText, cl->cutTextLen);
+    } else if (flags & rfbExtClipPeek) {
+      if (!rfbAuthDisableCBSend)
+        rfbSendClipboardMsg(cl, rfbExtClipNotify |
+                            (cl->cutText ? rfbExtClipText : 0), NULL, 0);
+    } else if (flags & rfbExtClipNotify) {
+      /* The X server has no way of deferring a paste operation while the
+         clipboard contents are fetched from the client, so fetch them as soon
+         as they are announced. */
+      if ((flags & rfbExtClipText) && (cl->clipFlags & rfbExtClipRequest) &&
+          !rfbAuthDisableCBRecv)
+        rfbSendClipboardMsg(cl, rfbExtClipRequest | rfbExtClipText, NULL, 0);
+    }
+    return;
+  }
+
+  if (len > (CARD32)rfbMaxClipboard) {
+    rfbLog("Ignoring %u-byte compressed clipboard update from client %s\n",
+           len, cl->host);
+    SKIP(len)
+    return;
+  }
+  if (len == 0) return;
+
+  data = (char *)rfbAlloc(len);
+  if ((n = ReadExact(cl, data, len)) <= 0) {
+    if (n != 0)
+      rfbLogPerror("rfbProcessClientNormalMessage: read");
+    free(data);
+    rfbCloseClient(cl);
+    return;
+  }
+
+  /* NOTE: We do not accept cut text from a view-only client */
+  if ((flags & rfbExtClipText) && !rfbViewOnly && !cl->viewOnly &&
+      !rfbAuthDisableCBRecv)
+    rfbProcessClipboardProvide(cl, data, len);
+
+  free(data);
+}
+
+
 static void rfbProcessClientNormalMessage(rfbClientPtr cl)
 {
   int n;
@@ -918,6 +1450,7 @@ static void rfbProcessClientNormalMessage(rfbClientPtr cl)
       cl->readyForSetColourMapEntries = TRUE;
 
       rfbSetTranslateFunction(cl);
+      rfbTileCacheReset(cl);
       return;
 
     case rfbFixColourMapEntries:
@@ -933,7 +1466,9 @@ static void rfbProcessClientNormalMessage(rfbClientPtr cl)
       Bool firstFence = !cl->enableFence;
       Bool firstCU = !cl->enableCU;
       Bool firstGII = !cl->enableGII;
+      Bool firstExtClipboard = !cl->enableExtClipboard;
       Bool logTightCompressLevel = FALSE;
+      int scale = 100, tileCacheSlots = 0;
 
       READ(((char *)&msg) + 1, sz_rfbSetEncodingsMsg - 1)
 
@@ -944,6 +1479,8 @@ static void rfbProcessClientNormalMessage(rfbClientPtr cl)
       cl->enableCursorShapeUpdates = FALSE;
       cl->enableCursorPosUpdates = FALSE;
       cl->enableLastRectEncoding = FALSE;
+      cl->enableTightLZ4 = FALSE;
+      cl->resizeKeepContent = FALSE;
       cl->tightCompressLevel = TIGHT_DEFAULT_COMPRESSION;
       cl->tightSubsampLevel = TIGHT_DEFAULT_SUBSAMP;
       cl->tightQualityLevel = -1;
@@ -1075,12 +1612,29 @@ static void rfbProcessClientNormalMessage(rfbClientPtr cl)
                 rfbLog("WARNING: Remote desktop resizing disabled per system policy.\n");
             }
             break;
+          case rfbEncodingTightLZ4:
+            if (!cl->enableTightLZ4) {
+              rfbLog("Enabling LZ4 compression for Tight encoding for client %s\n",
+                     cl->host);
+              cl->enableTightLZ4 = TRUE;
+            }
+            break;
+          case rfbEncodingResizeKeepContent:
+            cl->resizeKeepContent = TRUE;
+            break;
           case rfbEncodingGII:
             if (!cl->enableGII) {
               rfbLog("Enabling GII protocol extension for client %s\n", cl->host);
               cl->enableGII = TRUE;
             }
             break;
+          case rfbEncodingExtendedClipboard:
+            if (!cl->enableExtClipboard) {
+              rfbLog("Enabling Extended Clipboard protocol extension for client %s\n",
+                     cl->host);
+              cl->enableExtClipboard = TRUE;
+            }
+            break;
           default:
             if (enc >= (CARD32)rfbEncodingCompressLevel0 &&
                 enc <= (CARD32)rfbEncodingCompressLevel9) {
@@ -1121,6 +1675,12 @@ static void rfbProcessClientNormalMessage(rfbClientPtr cl)
               cl->tightQualityLevel = enc & 0xFF;
               rfbLog("Using JPEG quality %d for client %s\n",
                      cl->tightQualityLevel, cl->host);
+            } else if (enc >= (CARD32)rfbEncodingServerScale1 &&
+                       enc <= (CARD32)rfbEncodingServerScale100) {
+              scale = enc & 0xFF;
+            } else if (enc >= (CARD32)rfbEncodingTileCache256 &&
+                       enc <= (CARD32)rfbEncodingTileCache32768) {
+              tileCacheSlots = 256 << (enc & 0x0F);
             } else {
               rfbLog("rfbProcessClientNormalMessage: ignoring unknown encoding %d (%x)\n",
                      (int)enc, (int)enc);
@@ -1140,6 +1700,30 @@ static void rfbProcessClientNormalMessage(rfbClientPtr cl)
         cl->enableCursorPosUpdates = FALSE;
       }
 
+      /* The client can only be informed of its scaled framebuffer dimensions
+         via a desktop size message. */
+      if (scale != 100 && !cl->enableDesktopSize &&
+          !cl->enableExtDesktopSize) {
+        rfbLog("WARNING: Ignoring server-side scaling request from client %s,\n",
+               cl->host);
+        rfbLog("    which does not support desktop resizing\n");
+        scale = 100;
+      }
+      if (!rfbSetClientScale(cl, scale)) {
+        rfbCloseClient(cl);
+        return;
+      }
+
+      if (tileCacheSlots) {
+        if (!rfbTileCacheInit(cl, tileCacheSlots)) {
+          rfbCloseClient(cl);
+          return;
+        }
+      } else if (cl->tileCache) {
+        rfbLog("Disabling tile cache for client %s\n", cl->host);
+        rfbTileCacheFree(cl);
+      }
+
       if (cl->enableFence && firstFence) {
         char type = 0;
         if (!rfbSendFence(cl, rfbFenceFlagRequest, sizeof(type), &type))
@@ -1151,6 +1735,11 @@ static void rfbProcessClientNormalMessage(rfbClientPtr cl)
           return;
       }
 
+      if (cl->enableExtClipboard && firstExtClipboard) {
+        if (!rfbSendClipboardCaps(cl))
+          return;
+      }
+
       if (cl->enableGII && firstGII) {
         /* Send GII server version message to all clients */
         rfbGIIServerVersionMsg svmsg;
@@ -1183,6 +1772,7 @@ static void rfbProcessClientNormalMessage(rfbClientPtr cl)
       box.y1 = Swap16IfLE(msg.fur.y);
       box.x2 = box.x1 + Swap16IfLE(msg.fur.w);
       box.y2 = box.y1 + Swap16IfLE(msg.fur.h);
+      rfbScaleBox(cl, &box, TRUE);
       SAFE_REGION_INIT(pScreen, &tmpRegion, &box, 0);
 
       if (!msg.fur.incremental || !cl->continuousUpdates)
@@ -1246,8 +1836,14 @@ static void rfbProcessClientNormalMessage(rfbClientPtr cl)
         pointerDragClient = cl;
 
       if (!rfbViewOnly && !cl->viewOnly) {
+        if (NextPointerEventSupersedes(cl, msg.pe.buttonMask)) {
+          cl->rfbPointerEventsMerged++;
+          return;
+        }
+
         cl->cursorX = (int)Swap16IfLE(msg.pe.x);
         cl->cursorY = (int)Swap16IfLE(msg.pe.y);
+        rfbScalePoint(cl, &cl->cursorX, &cl->cursorY, TRUE);
 
         /* If the pointer was most recently moved by another client, we set
            pointerOwner to NULL here so that the client that is currently
@@ -1258,6 +1854,7 @@ static void rfbProcessClientNormalMessage(rfbClientPtr cl)
           pointerOwner = NULL;
 
         PtrAddEvent(msg.pe.buttonMask, cl->cursorX, cl->cursorY, cl);
+        cl->lastButtonMask = msg.pe.buttonMask;
 
         pointerOwner = cl;
       }
@@ -1270,6 +1867,10 @@ static void rfbProcessClientNormalMessage(rfbClientPtr cl)
       READ(((char *)&msg) + 1, sz_rfbClientCutTextMsg - 1)
 
       msg.cct.length = Swap32IfLE(msg.cct.length);
+      if (cl->enableExtClipboard && (msg.cct.length & 0x80000000)) {
+        rfbProcessClientExtClipboard(cl, -msg.cct.length);
+        return;
+      }
       if (msg.cct.length > rfbMaxClipboard) {
         rfbLog("Truncating %d-byte clipboard update to %d bytes.\n",
                msg.cct.length, rfbMaxClipboard);
@@ -1329,6 +1930,7 @@ static void rfbProcessClientNormalMessage(rfbClientPtr cl)
       box.y1 = Swap16IfLE(msg.ecu.y);
       box.x2 = box.x1 + Swap16IfLE(msg.ecu.w);
       box.y2 = box.y1 + Swap16IfLE(msg.ecu.h);
+      rfbScaleBox(cl, &box, TRUE);
       SAFE_REGION_INIT(pScreen, &cl->cuRegion, &box, 0);
 
       cl->continuousUpdates = msg.ecu.enable;
@@ -1393,6 +1995,10 @@ static void rfbProcessClientNormalMessage(rfbClientPtr cl)
       if (msg.sds.w < 1 || msg.sds.h < 1)
         EDSERROR("Requested framebuffer dimensions %dx%d are invalid",
                  msg.sds.w, msg.sds.h);
+      if (cl->scaledFB) {
+        msg.sds.w = rfbScaleDimUp(cl, msg.sds.w);
+        msg.sds.h = rfbScaleDimUp(cl, msg.sds.h);
+      }
 
       xorg_list_init(&newScreens);
       for (i = 0; i < msg.sds.numScreens; i++) {
@@ -1405,6 +2011,15 @@ static void rfbProcessClientNormalMessage(rfbClientPtr cl)
         screen->s.w = Swap16IfLE(screen->s.w);
         screen->s.h = Swap16IfLE(screen->s.h);
         screen->s.flags = Swap32IfLE(screen->s.flags);
+        if (cl->scaledFB) {
+          int x = rfbScaleDimUp(cl, screen->s.x);
+          int y = rfbScaleDimUp(cl, screen->s.y);
+
+          screen->s.w = rfbScaleDimUp(cl, screen->s.x + screen->s.w) - x;
+          screen->s.h = rfbScaleDimUp(cl, screen->s.y + screen->s.h) - y;
+          screen->s.x = x;
+          screen->s.y = y;
+        }
         if (screen->s.w < 1 || screen->s.h < 1)
           EDSERROR("Screen 0x%.8x requested dimensions %dx%d are invalid",
                    (unsigned int)screen->s.id, screen->s.w, screen->s.h);
@@ -1754,12 +2369,19 @@ static void rfbProcessClientNormalMessage(rfbClientPtr cl)
 #ifdef GII_DEBUG
                 fprintf(stderr, "\n");
 #endif
+                cl->rfbGIIValuatorEventsRcvd++;
                 if (v.count > 0) {
                   dev->valFirst = v.first;
                   dev->valCount = v.count;
                   dev->mode = eventType == rfbGIIValuatorAbsolute ?
                               Absolute : Relative;
-                  ExtInputAddEvent(dev, MotionNotify, 0);
+                  /* Only the last event in a message can be superseded by
+                     the next message. */
+                  if (eventType == rfbGIIValuatorAbsolute && length == 0 &&
+                      NextGIIEventSupersedes(cl, &v, dev->values))
+                    cl->rfbGIIValuatorEventsMerged++;
+                  else
+                    ExtInputAddEvent(dev, MotionNotify, 0);
                 }
                 break;
               }
@@ -1792,6 +2414,26 @@ static void rfbProcessClientNormalMessage(rfbClientPtr cl)
 }
 
 
+/*
+ * If an update is aborted part-way, then the client may or may not have been
+ * closed (and freed.)  If it is still connected, then send any data that was
+ * held for coalescing and end the coalescing, so that subsequent messages are
+ * not held.
+ */
+
+static void UncorkIfConnected(rfbClientPtr cl)
+{
+  rfbClientPtr cl2;
+
+  for (cl2 = rfbClientHead; cl2; cl2 = cl2->next) {
+    if (cl2 == cl) {
+      rfbUncorkClient(cl);
+      return;
+    }
+  }
+}
+
+
 /*
  * rfbSendFramebufferUpdate - send the currently pending framebuffer update to
  * the RFB client.
@@ -1801,7 +2443,7 @@ Bool rfbSendFramebufferUpdate(rfbClientPtr cl)
 {
   ScreenPtr pScreen = screenInfo.screens[0];
   int i;
-  int nUpdateRegionRects;
+  int nUpdateRegionRects, nTileCacheRects = 0;
   rfbFramebufferUpdateMsg *fu = (rfbFramebufferUpdateMsg *)updateBuf;
   RegionRec _updateRegion, *updateRegion = &_updateRegion, updateCopyRegion,
     idRegion;
@@ -1811,7 +2453,8 @@ Bool rfbSendFramebufferUpdate(rfbClientPtr cl)
   Bool sendCursorShape = FALSE;
   Bool sendCursorPos = FALSE;
   Bool redundantUpdate = FALSE;
-  double tUpdateStart = 0.0;
+  double tUpdateStart = 0.0, tFrameStart = 0.0;
+  int startOffset;
 
   rfbUpdatePosition(cl, cl->sockOffset);
 
@@ -1836,26 +2479,36 @@ Bool rfbSendFramebufferUpdate(rfbClientPtr cl)
   if (rfbCongestionControl && rfbIsCongested(cl) && !cl->inALR)
     return TRUE;
 
+  if (rfbFrameSync) tFrameStart = gettime();
+  startOffset = cl->sockOffset;
+
   /* In continuous mode, we will be outputting at least three distinct
      messages.  We need to aggregate these in order to not clog up TCP's
      congestion window. */
 
-  rfbCorkSock(cl->sock);
+  rfbCorkClient(cl);
 
   if (cl->pendingExtDesktopResize) {
-    if (!rfbSendExtDesktopSize(cl)) return FALSE;
+    if (!rfbSendExtDesktopSize(cl)) {
+      UncorkIfConnected(cl);
+      return FALSE;
+    }
     cl->pendingExtDesktopResize = FALSE;
   }
 
   if (cl->pendingDesktopResize) {
-    if (!rfbSendDesktopSize(cl)) return FALSE;
+    if (!rfbSendDesktopSize(cl)) {
+      UncorkIfConnected(cl);
+      return FALSE;
+    }
     cl->pendingDesktopResize = FALSE;
   }
 
-  if (rfbFB.blockUpdates) {
-    rfbUncorkSock(cl->sock);
-    return TRUE;
-  }
+  if (rfbFB.blockUpdates)
+    return rfbUncorkClient(cl);
+
+  if (rfbPreciseDamage)
+    rfbDirtyTilesFlush(pScreen);
 
   /*
    * If this client understands cursor shape updates and owns the pointer or is
@@ -1908,7 +2561,7 @@ Bool rfbSendFramebufferUpdate(rfbClientPtr cl)
   if (!REGION_NOTEMPTY(pScreen, updateRegion) && !sendCursorShape &&
       !sendCursorPos) {
     REGION_UNINIT(pScreen, updateRegion);
-    return TRUE;
+    return rfbUncorkClient(cl);
   }
 
   /*
@@ -1980,6 +2633,11 @@ Bool rfbSendFramebufferUpdate(rfbClientPtr cl)
     ClipToScreen(pScreen, updateRegion);
   }
 
+  /* Convert the update region to scaled coordinates, and bring the
+     corresponding area of the scaled framebuffer up to date. */
+  if (cl->scaledFB)
+    rfbScaleUpdateRegion(cl, updateRegion);
+
   if (cl->compareFB && !cl->inALR) {
     if ((cl->ifRegion.extents.x2 > pScreen->width ||
          cl->ifRegion.extents.y2 > pScreen->height) &&
@@ -2078,6 +2736,10 @@ Bool rfbSendFramebufferUpdate(rfbClientPtr cl)
     }
   }
 
+  /* Remove any tiles that the client has cached from the update region. */
+  if (cl->tileCache && !redundantUpdate)
+    nTileCacheRects = rfbTileCacheProcessRegion(cl, updateRegion);
+
   if (!rfbSendRTTPing(cl))
     goto abort;
 
@@ -2126,7 +2788,7 @@ Bool rfbSendFramebufferUpdate(rfbClientPtr cl)
   fu->type = rfbFramebufferUpdate;
   if (nUpdateRegionRects != 0xFFFF) {
     fu->nRects = Swap16IfLE(REGION_NUM_RECTS(&updateCopyRegion) +
-                            nUpdateRegionRects +
+                            nUpdateRegionRects + nTileCacheRects +
                             !!sendCursorShape + !!sendCursorPos);
   } else {
     fu->nRects = 0xFFFF;
@@ -2226,6 +2888,9 @@ Bool rfbSendFramebufferUpdate(rfbClientPtr cl)
     REGION_NULL(pScreen, updateRegion);
   }
 
+  if (nTileCacheRects && !rfbTileCacheSendOps(cl))
+    goto abort;
+
   if (nUpdateRegionRects == 0xFFFF && !rfbSendLastRectMarker(cl))
     goto abort;
 
@@ -2280,8 +2945,28 @@ Bool rfbSendFramebufferUpdate(rfbClientPtr cl)
     cl->alrTimer = TimerSet(cl->alrTimer, 0, timeout, alrCallback, cl);
   }
 
-  rfbUncorkSock(cl->sock);
+  if (!rfbUncorkClient(cl)) return FALSE;
   rfbUpdatePosition(cl, cl->sockOffset);
+
+  if (rfbFrameSync && !cl->inALR && !redundantUpdate) {
+    double interval = gettime() - tFrameStart;
+
+    /* Estimate how long it will take for the update to drain from the
+       network, based on the congestion window and the round-trip time. */
+    if (rfbCongestionControl && cl->baseRTT != (unsigned)-1 &&
+        cl->congWindow > 0) {
+      double tTransmit = (double)(cl->sockOffset - startOffset) *
+        (double)cl->baseRTT / (double)cl->congWindow / 1000.0;
+
+      if (tTransmit > interval) interval = tTransmit;
+    }
+    if (cl->frameInterval > 0.0)
+      cl->frameInterval = cl->frameInterval * 0.75 + interval * 0.25;
+    else
+      cl->frameInterval = interval;
+    rfbUpdateFrameClock(pScreen);
+  }
+
   return TRUE;
 
   abort:
@@ -2300,6 +2985,7 @@ Bool rfbSendFramebufferUpdate(rfbClientPtr cl)
   } else if (!REGION_NIL(&_updateRegion)) {
     REGION_UNINIT(pScreen, &_updateRegion);
   }
+  UncorkIfConnected(cl);
   return FALSE;
 }
 
@@ -2659,6 +3345,22 @@ void rfbSendServerCutText(char *str, int len)
     cl->cutText = rfbAlloc(len);
     memcpy(cl->cutText, str, len);
     cl->cutTextLen = len;
+    if (cl->clipFlags & rfbExtClipCaps) {
+      /* Clients that support the extended clipboard extension are notified
+         that the clipboard has changed, and they request the text only if
+         and when they need it. */
+      if (cl->clipFlags & rfbExtClipNotify)
+        rfbSendClipboardMsg(cl, rfbExtClipNotify | rfbExtClipText, NULL, 0);
+      else if ((cl->clipFlags & rfbExtClipProvide) &&
+               (cl->clipFlags & rfbExtClipText)) {
+        if ((CARD32)len <= cl->clipSizes[0])
+          rfbSendClipboardProvide(cl, str, len);
+        else
+          rfbLog("Not sending %d-byte clipboard update to client %s (limit is %u bytes)\n",
+                 len, cl->host, cl->clipSizes[0]);
+      }
+      continue;
+    }
     memset(&sct, 0, sz_rfbServerCutTextMsg);
     sct.type = rfbServerCutText;
     sct.length = Swap32IfLE(len);
@@ -2680,6 +3382,101 @@ void rfbSendServerCutText(char *str, int len)
 }
 
 
+/*
+ * rfbSendClipboardMsg sends an extended clipboard message (a ServerCutText
+ * message with a negative length) to a specific client.
+ */
+
+static Bool rfbSendClipboardMsg(rfbClientPtr cl, CARD32 flags, char *data,
+                                int len)
+{
+  rfbServerCutTextMsg sct;
+  CARD32 flagsBE = Swap32IfLE(flags);
+
+  memset(&sct, 0, sz_rfbServerCutTextMsg);
+  sct.type = rfbServerCutText;
+  sct.length = Swap32IfLE(-(CARD32)(len + 4));
+  if (WriteExact(cl, (char *)&sct, sz_rfbServerCutTextMsg) < 0 ||
+      WriteExact(cl, (char *)&flagsBE, 4) < 0 ||
+      (len > 0 && WriteExact(cl, data, len) < 0)) {
+    rfbLogPerror("rfbSendClipboardMsg: write");
+    rfbCloseClient(cl);
+    return FALSE;
+  }
+  if (cl->captureFD >= 0) {
+    WriteCapture(cl->captureFD, (char *)&sct, sz_rfbServerCutTextMsg);
+    WriteCapture(cl->captureFD, (char *)&flagsBE, 4);
+    if (len > 0) WriteCapture(cl->captureFD, data, len);
+  }
+  return TRUE;
+}
+
+
+/*
+ * rfbSendClipboardCaps tells a client which extended clipboard actions and
+ * formats the server supports.
+ */
+
+static Bool rfbSendClipboardCaps(rfbClientPtr cl)
+{
+  CARD32 textSize = Swap32IfLE(rfbMaxClipboard);
+
+  return rfbSendClipboardMsg(cl, rfbExtClipCaps | rfbExtClipRequest |
+                             rfbExtClipPeek | rfbExtClipNotify |
+                             rfbExtClipProvide | rfbExtClipText,
+                             (char *)&textSize, 4);
+}
+
+
+/*
+ * rfbSendClipboardProvide sends Latin-1 text to a specific client using an
+ * extended clipboard Provide message.  The text is converted to UTF-8 with
+ * CRLF line endings and compressed using zlib.
+ */
+
+static Bool rfbSendClipboardProvide(rfbClientPtr cl, char *str, int len)
+{
+  unsigned char *buf, *ptr;
+  Bytef *zbuf;
+  uLongf zlen;
+  CARD32 textLen;
+  Bool status;
+  int i;
+
+  /* Each Latin-1 character, including LF (which becomes CRLF), occupies at
+     most two bytes in UTF-8. */
+  buf = (unsigned char *)rfbAlloc(4 + len * 2 + 1);
+  ptr = buf + 4;
+  for (i = 0; i < len && str[i] != 0; i++) {
+    unsigned char c = (unsigned char)str[i];
+
+    if (c == '\n' && (i == 0 || str[i - 1] != '\r'))
+      *ptr++ = '\r';
+    if (c >= 0x80) {
+      *ptr++ = 0xC0 | (c >> 6);
+      *ptr++ = 0x80 | (c & 0x3F);
+    } else
+      *ptr++ = c;
+  }
+  *ptr++ = 0;
+  textLen = ptr - buf - 4;
+  buf[0] = textLen >> 24;  buf[1] = textLen >> 16;
+  buf[2] = textLen >> 8;  buf[3] = textLen;
+
+  zlen = compressBound(ptr - buf);
+  zbuf = (Bytef *)rfbAlloc(zlen);
+  if (compress2(zbuf, &zlen, buf, ptr - buf, Z_BEST_SPEED) != Z_OK) {
+    rfbLog("Could not compress clipboard data for client %s\n", cl->host);
+    free(buf);  free(zbuf);
+    return TRUE;
+  }
+  status = rfbSendClipboardMsg(cl, rfbExtClipProvide | rfbExtClipText,
+                               (char *)zbuf, zlen);
+  free(buf);  free(zbuf);
+  return status;
+}
+
+
 /*
  * rfbSendDesktopSize sends a DesktopSize message to a specific client.
  */
@@ -2703,8 +3500,8 @@ Bool rfbSendDesktopSize(rfbClientPtr cl)
 
   rh.encoding = Swap32IfLE(rfbEncodingNewFBSize);
   rh.r.x = rh.r.y = 0;
-  rh.r.w = Swap16IfLE(rfbFB.width);
-  rh.r.h = Swap16IfLE(rfbFB.height);
+  rh.r.w = Swap16IfLE(rfbClientWidth(cl));
+  rh.r.h = Swap16IfLE(rfbClientHeight(cl));
   if (WriteExact(cl, (char *)&rh, sz_rfbFramebufferUpdateRectHeader) < 0) {
     rfbLogPerror("rfbSendDesktopSize: write");
     rfbCloseClient(cl);
@@ -2746,8 +3543,8 @@ Bool rfbSendExtDesktopSize(rfbClientPtr cl)
   rh.encoding = Swap32IfLE(rfbEncodingExtendedDesktopSize);
   rh.r.x = Swap16IfLE(cl->reason);
   rh.r.y = Swap16IfLE(cl->result);
-  rh.r.w = Swap16IfLE(rfbFB.width);
-  rh.r.h = Swap16IfLE(rfbFB.height);
+  rh.r.w = Swap16IfLE(rfbClientWidth(cl));
+  rh.r.h = Swap16IfLE(rfbClientHeight(cl));
   if (WriteExact(cl, (char *)&rh, sz_rfbFramebufferUpdateRectHeader) < 0) {
     rfbLogPerror("rfbSendExtDesktopSize: write");
     rfbCloseClient(cl);
@@ -2774,8 +3571,8 @@ Bool rfbSendExtDesktopSize(rfbClientPtr cl)
                                                   entry);
     screen.s.id = Swap32IfLE(screen.s.id);
     screen.s.x = screen.s.y = 0;
-    screen.s.w = Swap16IfLE(rfbFB.width);
-    screen.s.h = Swap16IfLE(rfbFB.height);
+    screen.s.w = Swap16IfLE(rfbClientWidth(cl));
+    screen.s.h = Swap16IfLE(rfbClientHeight(cl));
     screen.s.flags = Swap32IfLE(screen.s.flags);
     if (WriteExact(cl, (char *)&screen.s, sz_rfbScreenDesc) < 0) {
       rfbLogPerror("rfbSendExtDesktopSize: write");
@@ -2787,6 +3584,16 @@ Bool rfbSendExtDesktopSize(rfbClientPtr cl)
       rfbScreenInfo screen = *iter;
 
       if (screen.output->crtc && screen.output->crtc->mode) {
+        if (cl->scaledFB) {
+          BoxRec box;
+
+          box.x1 = screen.s.x;  box.y1 = screen.s.y;
+          box.x2 = screen.s.x + screen.s.w;  box.y2 = screen.s.y + screen.s.h;
+          rfbScaleBox(cl, &box, FALSE);
+          screen.s.x = box.x1;  screen.s.y = box.y1;
+          screen.s.w = max(box.x2 - box.x1, 1);
+          screen.s.h = max(box.y2 - box.y1, 1);
+        }
         screen.s.id = Swap32IfLE(screen.s.id);
         screen.s.x = Swap16IfLE(screen.s.x);
         screen.s.y = Swap16IfLE(screen.s.y);
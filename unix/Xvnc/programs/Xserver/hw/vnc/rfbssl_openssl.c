@@ -45,6 +45,23 @@ CARD32 rfbTLSKeyLength = 2048;
 #ifndef SSL_CTRL_SET_ECDH_AUTO
 #define SSL_CTRL_SET_ECDH_AUTO 94
 #endif
+#ifndef SSL_CTRL_MODE
+#define SSL_CTRL_MODE 33
+#endif
+#ifndef SSL_MODE_ENABLE_PARTIAL_WRITE
+#define SSL_MODE_ENABLE_PARTIAL_WRITE 0x00000001U
+#endif
+#ifndef SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER
+#define SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER 0x00000002U
+#endif
+/* These values are specific to OpenSSL 3.x, so kernel TLS offload is only
+   enabled if the OpenSSL library in use at run time is 3.x or later. */
+#ifndef SSL_OP_ENABLE_KTLS
+#define SSL_OP_ENABLE_KTLS ((uint64_t)1 << 3)
+#endif
+#ifndef BIO_CTRL_GET_KTLS_SEND
+#define BIO_CTRL_GET_KTLS_SEND 73
+#endif
 #ifndef OPENSSL_INIT_LOAD_CRYPTO_STRINGS
 #define OPENSSL_INIT_LOAD_CRYPTO_STRINGS 0x00000002L
 #endif
@@ -73,6 +90,8 @@ typedef int (*DSA_generate_parameters_ex_type) (DSA *, int,
 typedef DSA *(*DSA_new_type) (void);
 typedef unsigned long (*ERR_get_error_type) (void);
 typedef char *(*ERR_error_string_type) (unsigned long, char *);
+typedef long (*BIO_ctrl_type) (BIO *, int, long, void *);
+typedef unsigned long (*OpenSSL_version_num_type) (void);
 
 struct rfbcrypto_functions {
   DH_free_type DH_free;
@@ -84,6 +103,8 @@ struct rfbcrypto_functions {
   DSA_new_type DSA_new;
   ERR_get_error_type ERR_get_error;
   ERR_error_string_type ERR_error_string;
+  BIO_ctrl_type BIO_ctrl;
+  OpenSSL_version_num_type OpenSSL_version_num;
 };
 
 static struct rfbcrypto_functions crypto = {
@@ -91,7 +112,13 @@ static struct rfbcrypto_functions crypto = {
   NULL
 #else
   DH_free, DH_generate_key, DH_size, DSA_dup_DH, DSA_free,
-  DSA_generate_parameters_ex, DSA_new, ERR_get_error, ERR_error_string
+  DSA_generate_parameters_ex, DSA_new, ERR_get_error, ERR_error_string,
+  BIO_ctrl,
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+  OpenSSL_version_num
+#else
+  NULL
+#endif
 #endif
 };
 
@@ -101,6 +128,7 @@ typedef int (*SSL_library_init_type) (void);
 typedef void (*SSL_load_error_strings_type) (void);
 typedef void (*SSL_free_type) (SSL *);
 typedef const char *(*SSL_get_cipher_list_type) (const SSL *, int);
+typedef BIO *(*SSL_get_wbio_type) (const SSL *);
 typedef CONST SSL_CIPHER *(*SSL_get_current_cipher_type) (const SSL *);
 typedef int (*SSL_get_error_type) (const SSL *, int);
 typedef SSL *(*SSL_new_type) (SSL_CTX *);
@@ -113,6 +141,7 @@ typedef int (*SSL_write_type) (SSL *, const void *, int);
 typedef const char *(*SSL_CIPHER_get_name_type) (const SSL_CIPHER *);
 typedef long (*SSL_CTX_ctrl_type) (SSL_CTX *, int, long, void *);
 typedef void (*SSL_CTX_free_type) (SSL_CTX *);
+typedef uint64_t (*SSL_CTX_set_options_type) (SSL_CTX *, uint64_t);
 typedef SSL_CTX *(*SSL_CTX_new_type) (CONST SSL_METHOD *);
 typedef int (*SSL_CTX_set_cipher_list_type) (SSL_CTX *, const char *);
 typedef void (*SSL_CTX_set_security_level_type) (SSL_CTX *, int);
@@ -128,6 +157,7 @@ struct rfbssl_functions {
   SSL_load_error_strings_type SSL_load_error_strings;
   SSL_free_type SSL_free;
   SSL_get_cipher_list_type SSL_get_cipher_list;
+  SSL_get_wbio_type SSL_get_wbio;
   SSL_get_current_cipher_type SSL_get_current_cipher;
   SSL_get_error_type SSL_get_error;
   SSL_new_type SSL_new;
@@ -140,6 +170,7 @@ struct rfbssl_functions {
   SSL_CIPHER_get_name_type SSL_CIPHER_get_name;
   SSL_CTX_ctrl_type SSL_CTX_ctrl;
   SSL_CTX_free_type SSL_CTX_free;
+  SSL_CTX_set_options_type SSL_CTX_set_options;
   SSL_CTX_new_type SSL_CTX_new;
   SSL_CTX_set_cipher_list_type SSL_CTX_set_cipher_list;
   SSL_CTX_set_security_level_type SSL_CTX_set_security_level;
@@ -158,10 +189,15 @@ static struct rfbssl_functions ssl = {
 #else
   NULL, SSL_library_init, SSL_load_error_strings,
 #endif
-  SSL_free, SSL_get_cipher_list, SSL_get_current_cipher, SSL_get_error,
-  SSL_new, SSL_peek, SSL_pending, SSL_read, SSL_set_fd, SSL_shutdown,
-  SSL_write, SSL_CIPHER_get_name, SSL_CTX_ctrl, SSL_CTX_free, SSL_CTX_new,
-  SSL_CTX_set_cipher_list,
+  SSL_free, SSL_get_cipher_list, SSL_get_wbio, SSL_get_current_cipher,
+  SSL_get_error, SSL_new, SSL_peek, SSL_pending, SSL_read, SSL_set_fd,
+  SSL_shutdown, SSL_write, SSL_CIPHER_get_name, SSL_CTX_ctrl, SSL_CTX_free,
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+  SSL_CTX_set_options,
+#else
+  NULL,
+#endif
+  SSL_CTX_new, SSL_CTX_set_cipher_list,
 #if OPENSSL_VERSION_NUMBER >= 0x10100000L
   SSL_CTX_set_security_level,
 #else
@@ -243,6 +279,7 @@ static int loadFunctions(void)
     }
     LOADSYM(ssl, SSL_free);
     LOADSYM(ssl, SSL_get_cipher_list);
+    LOADSYM(ssl, SSL_get_wbio);
     LOADSYM(ssl, SSL_get_current_cipher);
     LOADSYM(ssl, SSL_get_error);
     LOADSYM(ssl, SSL_new);
@@ -255,6 +292,7 @@ static int loadFunctions(void)
     LOADSYM(ssl, SSL_CIPHER_get_name);
     LOADSYM(ssl, SSL_CTX_ctrl);
     LOADSYM(ssl, SSL_CTX_free);
+    LOADSYMOPT(ssl, SSL_CTX_set_options, "SSL_CTX_set_options");
     LOADSYM(ssl, SSL_CTX_new);
     LOADSYM(ssl, SSL_CTX_set_cipher_list);
     LOADSYMOPT(ssl, SSL_CTX_set_security_level, "SSL_CTX_set_security_level");
@@ -305,6 +343,8 @@ static int loadFunctions(void)
     LOADSYM(crypto, DH_generate_key);
     LOADSYM(crypto, ERR_get_error);
     LOADSYM(crypto, ERR_error_string);
+    LOADSYM(crypto, BIO_ctrl);
+    LOADSYMOPT(crypto, OpenSSL_version_num, "OpenSSL_version_num");
     rfbLog("Successfully loaded symbols from %s\n", libName);
   }
 
@@ -319,8 +359,12 @@ static char errStr[BUFSIZE] = "No error";
 struct rfbssl_ctx {
   SSL_CTX *ssl_ctx;
   SSL     *ssl;
+  Bool    writeWantsRead;
 };
 
+/* Use kernel TLS offload, if the kernel and the OpenSSL library support it */
+static Bool rfbKTLS = TRUE;
+
 
 static void rfbErr(const char *format, ...)
 {
@@ -355,6 +399,7 @@ rfbSslCtx *rfbssl_init(rfbClientPtr cl, Bool anon)
   DSA *dsa = NULL;
   int flags = SSL_OP_NO_SSLv2 | SSL_OP_NO_SSLv3, priority = 0;
   const char *list = NULL;
+  char *env;
 
 #ifdef DLOPENSSL
   if (loadFunctions() == -1)
@@ -381,6 +426,21 @@ rfbSslCtx *rfbssl_init(rfbClientPtr cl, Bool anon)
     goto bailout;
   }
   ssl.SSL_CTX_ctrl(ctx->ssl_ctx, SSL_CTRL_OPTIONS, flags, NULL);
+  /* Allow SSL_write() to return after writing part of a buffer, so that
+     WriteExact() can wait for the socket to become writable rather than
+     SSL_write() spinning, and allow the buffer to move between retries. */
+  ssl.SSL_CTX_ctrl(ctx->ssl_ctx, SSL_CTRL_MODE,
+                   SSL_MODE_ENABLE_PARTIAL_WRITE |
+                   SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER, NULL);
+  if ((env = getenv("TVNC_KTLS")) != NULL && !strcmp(env, "0"))
+    rfbKTLS = FALSE;
+  /* OpenSSL 1.1.x also exports SSL_CTX_set_options(), but the option and
+     control values used for kernel TLS offload mean something else there. */
+  if (!ssl.SSL_CTX_set_options || !crypto.OpenSSL_version_num ||
+      crypto.OpenSSL_version_num() < 0x30000000L)
+    rfbKTLS = FALSE;
+  if (rfbKTLS)
+    ssl.SSL_CTX_set_options(ctx->ssl_ctx, SSL_OP_ENABLE_KTLS);
   if (anon) {
     if ((dsa = crypto.DSA_new()) == NULL) {
       rfbssl_error("DSA_new()");
@@ -493,6 +553,10 @@ int rfbssl_accept(rfbClientPtr cl)
   }
   rfbLog("Negotiated cipher suite: %s\n",
          ssl.SSL_CIPHER_get_name(ssl.SSL_get_current_cipher(ctx->ssl)));
+  if (rfbKTLS &&
+      crypto.BIO_ctrl(ssl.SSL_get_wbio(ctx->ssl), BIO_CTRL_GET_KTLS_SEND, 0,
+                      NULL))
+    rfbLog("Using kernel TLS offload for sending\n");
 
   return 0;
 }
@@ -508,15 +572,34 @@ int rfbssl_write(rfbClientPtr cl, const char *buf, int bufsize)
     return -1;
 #endif
 
-  while ((ret = ssl.SSL_write(ctx->ssl, buf, bufsize)) <= 0) {
-    if (ssl.SSL_get_error(ctx->ssl, ret) != SSL_ERROR_WANT_WRITE)
-      break;
+  /* If the socket isn't writable, or if OpenSSL must read from the socket
+     before it can write (during renegotiation, for instance), then let the
+     caller wait for the socket to become writable or readable (as reported
+     by rfbssl_write_wants_read()), rather than spinning.  The caller must
+     retry the write with the same data. */
+  ctx->writeWantsRead = FALSE;
+  if ((ret = ssl.SSL_write(ctx->ssl, buf, bufsize)) <= 0) {
+    int err = ssl.SSL_get_error(ctx->ssl, ret);
+
+    if (err == SSL_ERROR_WANT_WRITE || err == SSL_ERROR_WANT_READ) {
+      ctx->writeWantsRead = (err == SSL_ERROR_WANT_READ);
+      errno = EAGAIN;
+      return -1;
+    }
   }
 
   return ret;
 }
 
 
+Bool rfbssl_write_wants_read(rfbClientPtr cl)
+{
+  struct rfbssl_ctx *ctx = (struct rfbssl_ctx *)cl->sslctx;
+
+  return ctx->writeWantsRead;
+}
+
+
 int rfbssl_peek(rfbClientPtr cl, char *buf, int bufsize)
 {
   int ret;
@@ -527,9 +610,13 @@ int rfbssl_peek(rfbClientPtr cl, char *buf, int bufsize)
     return -1;
 #endif
 
-  while ((ret = ssl.SSL_peek(ctx->ssl, buf, bufsize)) <= 0) {
-    if (ssl.SSL_get_error(ctx->ssl, ret) != SSL_ERROR_WANT_READ)
-      break;
+  if ((ret = ssl.SSL_peek(ctx->ssl, buf, bufsize)) <= 0 &&
+      ssl.SSL_get_error(ctx->ssl, ret) == SSL_ERROR_WANT_READ) {
+    /* Only part of a TLS record has arrived.  Rather than spinning until the
+       rest of it arrives, let the caller wait for the socket to become
+       readable again. */
+    errno = EAGAIN;
+    return -1;
   }
 
   return ret;
@@ -546,9 +633,13 @@ int rfbssl_read(rfbClientPtr cl, char *buf, int bufsize)
     return -1;
 #endif
 
-  while ((ret = ssl.SSL_read(ctx->ssl, buf, bufsize)) <= 0) {
-    if (ssl.SSL_get_error(ctx->ssl, ret) != SSL_ERROR_WANT_READ)
-      break;
+  if ((ret = ssl.SSL_read(ctx->ssl, buf, bufsize)) <= 0 &&
+      ssl.SSL_get_error(ctx->ssl, ret) == SSL_ERROR_WANT_READ) {
+    /* Only part of a TLS record has arrived.  Rather than spinning until the
+       rest of it arrives, let the caller wait for the socket to become
+       readable again. */
+    errno = EAGAIN;
+    return -1;
   }
 
   return ret;
@@ -0,0 +1,328 @@
+/*
+ * scale.c - per-client server-side scaling
+ */
+
+/*
+ *  Copyright (C) 2026 agent.  All Rights Reserved.
+ *
+ *  This is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This software is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this software; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ *  USA.
+ */
+
+/*
+ * A client can request that the server downscale the remote desktop before
+ * encoding it, by sending one of the rfbEncodingServerScale* pseudo-encodings.
+ * This reduces both the encoding time on the server and the bandwidth usage,
+ * which is useful when the client is displaying a large remote desktop on a
+ * small screen.
+ *
+ * Each scaled client has a private downscaled copy of the framebuffer
+ * (cl->scaledFB), which becomes the source of pixels for the encoders.  All
+ * of the client's regions (modifiedRegion, requestedRegion, etc.) remain in
+ * framebuffer coordinates.  rfbSendFramebufferUpdate() maps the update region
+ * into scaled coordinates and refreshes the corresponding area of the scaled
+ * copy just before encoding it, and the coordinates in client messages are
+ * mapped back into framebuffer coordinates as they are received.
+ *
+ * Each scaled pixel is the average of the block of framebuffer pixels that
+ * maps to it (box filtering.)  The block boundaries are stored in
+ * cl->scaleMap, so the blocks tile the framebuffer exactly, and a scaled
+ * region can be mapped back to the framebuffer without overlapping any of its
+ * neighbors.
+ */
+
+#ifdef HAVE_DIX_CONFIG_H
+#include <dix-config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "rfb.h"
+
+
+static int ScaleDim(int dim, int scale)
+{
+  return max(dim * scale / 100, 1);
+}
+
+
+static Bool ScaleAlloc(rfbClientPtr cl)
+{
+  int sw = ScaleDim(rfbFB.width, cl->scale);
+  int sh = ScaleDim(rfbFB.height, cl->scale), i;
+
+  free(cl->scaledFB);
+  free(cl->scaleMap);
+  cl->scaledFB = NULL;
+  cl->scaleMap = NULL;
+
+  if (!(cl->scaledFB = (char *)malloc(rfbFB.paddedWidthInBytes * sh)) ||
+      !(cl->scaleMap = (int *)malloc((sw + sh + 2) * sizeof(int)))) {
+    rfbLogPerror("ScaleAlloc: couldn't allocate scaled framebuffer");
+    free(cl->scaledFB);
+    cl->scaledFB = NULL;
+    return FALSE;
+  }
+  memset(cl->scaledFB, 0, rfbFB.paddedWidthInBytes * sh);
+
+  for (i = 0; i <= sw; i++)
+    cl->scaleMap[i] = i * rfbFB.width / sw;
+  for (i = 0; i <= sh; i++)
+    cl->scaleMap[sw + 1 + i] = i * rfbFB.height / sh;
+  cl->scaledWidth = sw;
+  cl->scaledHeight = sh;
+
+  return TRUE;
+}
+
+
+static void ScaleFree(rfbClientPtr cl)
+{
+  free(cl->scaledFB);
+  free(cl->scaleMap);
+  cl->scaledFB = NULL;
+  cl->scaleMap = NULL;
+}
+
+
+/*
+ * Enable, disable, or change the scaling factor for a client.  This is called
+ * after every SetEncodings message, since the interframe comparison engine
+ * may have been re-enabled while processing the message.
+ */
+
+Bool rfbSetClientScale(rfbClientPtr cl, int scale)
+{
+  ScreenPtr pScreen = screenInfo.screens[0];
+
+  if (scale < 1 || scale >= 100) scale = 100;
+
+  if (scale != cl->scale) {
+    RegionRec tmpRegion;
+    BoxRec box;
+
+    cl->scale = scale;
+    if (scale == 100) {
+      ScaleFree(cl);
+      rfbLog("Disabling server-side scaling for client %s\n", cl->host);
+    } else {
+      if (!ScaleAlloc(cl))
+        return FALSE;
+      rfbLog("Using server-side scaling factor %d%% (%dx%d) for client %s\n",
+             scale, cl->scaledWidth, cl->scaledHeight, cl->host);
+    }
+
+    /* The client must be told about its new framebuffer dimensions, and
+       everything it has must be redrawn. */
+    cl->pendingDesktopResize = cl->pendingExtDesktopResize = TRUE;
+    cl->reason = rfbEDSReasonServer;
+    cl->result = rfbEDSResultSuccess;
+    box.x1 = box.y1 = 0;
+    box.x2 = rfbFB.width;  box.y2 = rfbFB.height;
+    REGION_INIT(pScreen, &tmpRegion, &box, 0);
+    REGION_UNION(pScreen, &cl->modifiedRegion, &cl->modifiedRegion,
+                 &tmpRegion);
+    REGION_UNINIT(pScreen, &tmpRegion);
+    REGION_EMPTY(pScreen, &cl->copyRegion);
+    if (rfbAutoLosslessRefresh > 0.0) {
+      REGION_EMPTY(pScreen, &cl->lossyRegion);
+      REGION_EMPTY(pScreen, &cl->alrRegion);
+      REGION_EMPTY(pScreen, &cl->alrEligibleRegion);
+      REGION_EMPTY(pScreen, &cl->alrPassRegion);
+      REGION_EMPTY(pScreen, &cl->alrPrelimRegion);
+    }
+  }
+
+  /* The interframe comparison engine works in framebuffer coordinates, and
+     CopyRect can't be reproduced exactly in scaled coordinates, so both are
+     disabled while scaling. */
+  if (cl->scaledFB) {
+    InterframeOff(cl);
+    cl->useCopyRect = FALSE;
+  } else if (rfbInterframe == 1 || cl->compareFB) {
+    if (!InterframeOn(cl))
+      return FALSE;
+  } else
+    InterframeOff(cl);
+
+  return TRUE;
+}
+
+
+/*
+ * Reallocate the scaled framebuffer after the framebuffer has been resized.
+ */
+
+Bool rfbScaleResize(rfbClientPtr cl)
+{
+  if (!cl->scaledFB) return TRUE;
+  if (!ScaleAlloc(cl)) return FALSE;
+  cl->fb = cl->scaledFB;
+  return TRUE;
+}
+
+
+void rfbScaleOff(rfbClientPtr cl)
+{
+  ScaleFree(cl);
+  cl->scale = 100;
+}
+
+
+/*
+ * Map a box from framebuffer coordinates to scaled coordinates (up == FALSE)
+ * or from scaled coordinates to framebuffer coordinates (up == TRUE.)  When
+ * scaling down, the result includes every scaled pixel that is affected by
+ * the box.
+ */
+
+void rfbScaleBox(rfbClientPtr cl, BoxPtr box, Bool up)
+{
+  int sw = cl->scaledWidth, sh = cl->scaledHeight;
+  int *xMap = cl->scaleMap, *yMap = &cl->scaleMap[sw + 1];
+
+  if (!cl->scaledFB) return;
+
+  if (up) {
+    box->x1 = xMap[min(max(box->x1, 0), sw)];
+    box->y1 = yMap[min(max(box->y1, 0), sh)];
+    box->x2 = xMap[min(max(box->x2, 0), sw)];
+    box->y2 = yMap[min(max(box->y2, 0), sh)];
+  } else {
+    box->x1 = min(max(box->x1, 0) * sw / rfbFB.width, sw);
+    box->y1 = min(max(box->y1, 0) * sh / rfbFB.height, sh);
+    box->x2 = min((max(box->x2, 0) * sw + rfbFB.width - 1) / rfbFB.width, sw);
+    box->y2 = min((max(box->y2, 0) * sh + rfbFB.height - 1) / rfbFB.height,
+                  sh);
+  }
+}
+
+
+void rfbScaleRegion(rfbClientPtr cl, RegionPtr region, Bool up)
+{
+  ScreenPtr pScreen = screenInfo.screens[0];
+  RegionRec scaledRegion;
+  int i;
+
+  if (!cl->scaledFB || !REGION_NOTEMPTY(pScreen, region)) return;
+
+  REGION_INIT(pScreen, &scaledRegion, NullBox, 0);
+  for (i = 0; i < REGION_NUM_RECTS(region); i++) {
+    BoxRec box = REGION_RECTS(region)[i];
+
+    rfbScaleBox(cl, &box, up);
+    if (box.x2 > box.x1 && box.y2 > box.y1) {
+      RegionRec tmpRegion;
+
+      REGION_INIT(pScreen, &tmpRegion, &box, 1);
+      REGION_UNION(pScreen, &scaledRegion, &scaledRegion, &tmpRegion);
+      REGION_UNINIT(pScreen, &tmpRegion);
+    }
+  }
+  REGION_COPY(pScreen, region, &scaledRegion);
+  REGION_UNINIT(pScreen, &scaledRegion);
+}
+
+
+void rfbScalePoint(rfbClientPtr cl, int *x, int *y, Bool up)
+{
+  if (!cl->scaledFB) return;
+
+  if (up) {
+    *x = *x * rfbFB.width / cl->scaledWidth;
+    *y = *y * rfbFB.height / cl->scaledHeight;
+  } else {
+    *x = *x * cl->scaledWidth / rfbFB.width;
+    *y = *y * cl->scaledHeight / rfbFB.height;
+  }
+}
+
+
+/*
+ * Return the framebuffer dimension that scales down to the given client
+ * dimension.  This is used to map remote desktop resize requests.
+ */
+
+int rfbScaleDimUp(rfbClientPtr cl, int dim)
+{
+  if (!cl->scaledFB) return dim;
+  return (dim * 100 + cl->scale - 1) / cl->scale;
+}
+
+
+/*
+ * Refresh the given area (in scaled coordinates) of the scaled framebuffer.
+ */
+
+static void ScaleRect(rfbClientPtr cl, int x1, int y1, int x2, int y2)
+{
+  int pitch = rfbFB.paddedWidthInBytes, ps = rfbFB.bitsPerPixel / 8;
+  int *xMap = cl->scaleMap, *yMap = &cl->scaleMap[cl->scaledWidth + 1];
+  /* Averaging pixels byte-wise is only valid if each component occupies
+     exactly one byte.  Other pixel formats are point-sampled. */
+  Bool average = (ps == 4 && rfbServerFormat.redMax == 255 &&
+                  rfbServerFormat.greenMax == 255 &&
+                  rfbServerFormat.blueMax == 255);
+  int x, y;
+
+  for (y = y1; y < y2; y++) {
+    int sy0 = yMap[y], sy1 = yMap[y + 1];
+    unsigned char *dst = (unsigned char *)&cl->scaledFB[y * pitch + x1 * ps];
+
+    if (average) {
+      for (x = x1; x < x2; x++, dst += 4) {
+        int sx0 = xMap[x], sx1 = xMap[x + 1], sx, sy;
+        unsigned int n = (sx1 - sx0) * (sy1 - sy0);
+        unsigned int s0 = n / 2, s1 = n / 2, s2 = n / 2, s3 = n / 2;
+
+        for (sy = sy0; sy < sy1; sy++) {
+          unsigned char *src =
+            (unsigned char *)&rfbFB.pfbMemory[sy * pitch + sx0 * 4];
+
+          for (sx = sx0; sx < sx1; sx++, src += 4) {
+            s0 += src[0];  s1 += src[1];  s2 += src[2];  s3 += src[3];
+          }
+        }
+        dst[0] = s0 / n;  dst[1] = s1 / n;  dst[2] = s2 / n;  dst[3] = s3 / n;
+      }
+    } else {
+      char *srcRow = &rfbFB.pfbMemory[((sy0 + sy1) / 2) * pitch];
+
+      for (x = x1; x < x2; x++, dst += ps)
+        memcpy(dst, &srcRow[((xMap[x] + xMap[x + 1]) / 2) * ps], ps);
+    }
+  }
+}
+
+
+/*
+ * Map the update region from framebuffer coordinates to scaled coordinates,
+ * and refresh the corresponding area of the scaled framebuffer.
+ */
+
+void rfbScaleUpdateRegion(rfbClientPtr cl, RegionPtr region)
+{
+  int i;
+
+  if (!cl->scaledFB) return;
+
+  rfbScaleRegion(cl, region, FALSE);
+  for (i = 0; i < REGION_NUM_RECTS(region); i++) {
+    BoxPtr box = &REGION_RECTS(region)[i];
+
+    ScaleRect(cl, box->x1, box->y1, box->x2, box->y2);
+  }
+}
@@ -48,6 +48,7 @@
 #include <stdlib.h>
 #include <sys/types.h>
 #include <sys/time.h>
+#include <sys/uio.h>
 #include <arpa/inet.h>
 #include <netinet/tcp.h>
 #include <netdb.h>
@@ -66,6 +67,7 @@ int deny_severity = LOG_WARNING;
 #endif
 
 #include "rfb.h"
+#include "ws_decode.h"
 
 
 /* Maximum time (in ms) to wait before deciding that the client has gone away -
@@ -79,6 +81,13 @@ int rfbMaxClientConnections = DEFAULT_MAX_CONNECTIONS;
 extern unsigned long long sendBytes;
 
 static void rfbSockNotify(int fd, int ready, void *data);
+static int WriteRaw(rfbClientPtr cl, char *hdr, int hdrLen, char *buf,
+                    int len);
+
+#if USETLS
+/* Maximum plaintext size of a TLS record */
+#define TLS_RECORD_SIZE 16384
+#endif
 
 
 /*
@@ -288,6 +297,47 @@ void rfbUncorkSock(int sock)
 }
 
 
+
+/*
+ * rfbCorkClient and rfbUncorkClient work like rfbCorkSock and rfbUncorkSock,
+ * but with TLS clients, they also cause the messages sent in between to be
+ * coalesced into full-size TLS records.  rfbUncorkClient returns FALSE (and
+ * closes the client) if the pending data could not be sent.
+ */
+
+void rfbCorkClient(rfbClientPtr cl)
+{
+  rfbCorkSock(cl->sock);
+#if USETLS
+  if (cl->sslctx) {
+    if (!cl->tlsBuf)
+      cl->tlsBuf = (char *)rfbAlloc(TLS_RECORD_SIZE);
+    cl->tlsCorked = TRUE;
+  }
+#endif
+}
+
+
+Bool rfbUncorkClient(rfbClientPtr cl)
+{
+#if USETLS
+  if (cl->tlsCorked) {
+    int len = cl->tlsBufLen;
+
+    cl->tlsCorked = FALSE;
+    cl->tlsBufLen = 0;
+    if (len > 0 && WriteRaw(cl, NULL, 0, cl->tlsBuf, len) < 0) {
+      rfbLogPerror("rfbUncorkClient: write");
+      rfbCloseClient(cl);
+      return FALSE;
+    }
+  }
+#endif
+  rfbUncorkSock(cl->sock);
+  return TRUE;
+}
+
+
 void rfbCloseSock(int sock)
 {
   close(sock);
@@ -306,9 +356,14 @@ void rfbCloseClient(rfbClientPtr cl)
     shutdown(sock, SHUT_RDWR);
     rfbssl_destroy(cl);
   }
+  free(cl->tlsBuf);
+  cl->tlsBuf = NULL;
 #endif
   if (cl->wsctx)
     webSocketsFree(cl);
+  free(cl->inBuf);
+  cl->inBuf = NULL;
+  cl->inBufStart = cl->inBufEnd = 0;
   close(sock);
   RemoveNotifyFd(sock);
   rfbClientConnectionGone(cl);
@@ -366,6 +421,16 @@ int ReadExactTimeout(rfbClientPtr cl, char *buf, int len, int timeout)
   struct timeval tv;
   int sock = cl->sock;
 
+  /* Data that rfbFillInBuf() has already read from the socket is returned
+     first. */
+  if (cl->inBufEnd > cl->inBufStart) {
+    n = min(len, cl->inBufEnd - cl->inBufStart);
+    memcpy(buf, &cl->inBuf[cl->inBufStart], n);
+    cl->inBufStart += n;
+    buf += n;
+    len -= n;
+  }
+
   while (len > 0) {
     do {
       if (cl->wsctx)
@@ -426,6 +491,68 @@ int ReadExact(rfbClientPtr cl, char *buf, int len)
 }
 
 
+/*
+ * rfbFillInBuf reads as much data as is available from a client, without
+ * blocking, into the client's input buffer.  This allows all of the messages
+ * that arrived in a single TCP segment (or TLS record or WebSocket frame) to
+ * be read with one system call rather than two or more per message.  Returns
+ * 1 on success (even if no data was available), 0 if the other end has
+ * closed, or -1 if an error occurred.
+ */
+
+int rfbFillInBuf(rfbClientPtr cl)
+{
+  int n, avail;
+  Bool framed = (cl->wsctx != NULL);
+
+#if USETLS
+  if (cl->sslctx) framed = TRUE;
+#endif
+
+  if (!cl->inBuf)
+    cl->inBuf = (char *)rfbAlloc(CLIENT_INBUF_SIZE);
+
+  if (cl->inBufStart > 0) {
+    memmove(cl->inBuf, &cl->inBuf[cl->inBufStart],
+            cl->inBufEnd - cl->inBufStart);
+    cl->inBufEnd -= cl->inBufStart;
+    cl->inBufStart = 0;
+  }
+
+  while ((avail = CLIENT_INBUF_SIZE - cl->inBufEnd) > 0) {
+    do {
+      if (cl->wsctx)
+        n = webSocketsDecode(cl, &cl->inBuf[cl->inBufEnd], avail);
+#if USETLS
+      else if (cl->sslctx)
+        n = rfbssl_read(cl, &cl->inBuf[cl->inBufEnd], avail);
+#endif
+      else
+        n = read(cl->sock, &cl->inBuf[cl->inBufEnd], avail);
+    } while (n < 0 && errno == EINTR);
+
+    if (n == 0)
+      return 0;
+    if (n < 0) {
+      if (errno != EWOULDBLOCK && errno != EAGAIN)
+        return -1;
+      break;
+    }
+
+    cl->inBufEnd += n;
+
+    /* A short read from a plain TCP socket means that the socket has been
+       drained, so another read would only return EAGAIN.  TLS and WebSocket
+       reads return at most one record or frame at a time, so keep reading
+       until they report that no more data is available.  (They return EAGAIN
+       rather than blocking if only part of a record or frame has arrived.) */
+    if (n < avail && !framed)
+      break;
+  }
+  return 1;
+}
+
+
 /*
  * SkipExact reads an exact number of bytes on a TCP socket into a temporary
  * buffer and then discards them.  Returns 1 on success, 0 if the other end has
@@ -515,44 +642,51 @@ int PeekExactTimeout(rfbClientPtr cl, char *buf, int len, int timeout)
 
 
 /*
- * WriteExact writes an exact number of bytes on a TCP socket.  Returns 1 if
- * those bytes have been written, or -1 if an error occurred (errno is set to
- * ETIMEDOUT if it timed out).
+ * WriteRaw writes an exact number of bytes, optionally preceded by a WebSocket
+ * frame header, on a TCP socket.  The caller is responsible for updating
+ * cl->sockOffset.
  */
 
-int WriteExact(rfbClientPtr cl, char *buf, int len)
+static int WriteRaw(rfbClientPtr cl, char *hdr, int hdrLen, char *buf,
+                    int len)
 {
-  int n, bytesWritten = 0;
+  int n;
   fd_set fds;
   struct timeval tv;
   int totalTimeWaited = 0;
   int sock = cl->sock;
 
-  if (cl->wsctx) {
-    char *tmp = NULL;
-    if ((len = webSocketsEncode(cl, buf, len, &tmp)) < 0) {
-      rfbLog("WriteExact: WebSockets encode error\n");
-      return -1;
-    }
-    buf = tmp;
-  }
-
-  while (len > 0) {
+  while (hdrLen > 0 || len > 0) {
     do {
 #if USETLS
       if (cl->sslctx)
         n = rfbssl_write(cl, buf, len);
       else
 #endif
-      n = write(sock, buf, len);
+      if (hdrLen > 0) {
+        struct iovec iov[2];
+
+        iov[0].iov_base = hdr;
+        iov[0].iov_len = hdrLen;
+        iov[1].iov_base = buf;
+        iov[1].iov_len = len;
+        n = writev(sock, iov, 2);
+      } else
+        n = write(sock, buf, len);
     } while (n < 0 && errno == EINTR);
 
     if (n > 0) {
 
+      sendBytes += n;
+      if (hdrLen > 0) {
+        int hdrWritten = min(n, hdrLen);
+
+        hdr += hdrWritten;
+        hdrLen -= hdrWritten;
+        n -= hdrWritten;
+      }
       buf += n;
       len -= n;
-      bytesWritten += n;
-      sendBytes += n;
 
     } else if (n == 0) {
 
@@ -572,6 +706,12 @@ int WriteExact(rfbClientPtr cl, char *buf, int len)
       tv.tv_sec = 5;
       tv.tv_usec = 0;
       do {
+#if USETLS
+        /* OpenSSL may need to read from the socket before it can write. */
+        if (cl->sslctx && rfbssl_write_wants_read(cl))
+          n = select(sock + 1, &fds, NULL, NULL, &tv);
+        else
+#endif
         n = select(sock + 1, NULL, &fds, NULL, &tv);
       } while (n < 0 && errno == EINTR);
       if (n < 0) {
@@ -590,11 +730,86 @@ int WriteExact(rfbClientPtr cl, char *buf, int len)
     }
   }
 
-  cl->sockOffset += bytesWritten;
+  return 1;
+}
+
+
+#if USETLS
+
+/*
+ * WriteCoalesced accumulates small writes into full-size TLS records.
+ * Encrypting each small message separately would produce a separate TLS
+ * record (with its own header, MAC, and padding) for each one.
+ */
+
+static int WriteCoalesced(rfbClientPtr cl, char *buf, int len)
+{
+  while (len > 0) {
+    int n;
+
+    /* Large buffers are written directly, since the TLS implementation will
+       split them into full-size records anyway. */
+    if (cl->tlsBufLen == 0 && len >= TLS_RECORD_SIZE)
+      return WriteRaw(cl, NULL, 0, buf, len);
+
+    n = min(len, TLS_RECORD_SIZE - cl->tlsBufLen);
+    memcpy(&cl->tlsBuf[cl->tlsBufLen], buf, n);
+    cl->tlsBufLen += n;
+    buf += n;
+    len -= n;
+
+    if (cl->tlsBufLen == TLS_RECORD_SIZE) {
+      cl->tlsBufLen = 0;
+      if (WriteRaw(cl, NULL, 0, cl->tlsBuf, TLS_RECORD_SIZE) < 0)
+        return -1;
+    }
+  }
 
   return 1;
 }
 
+#endif
+
+
+/*
+ * WriteExact writes an exact number of bytes on a TCP socket.  Returns 1 if
+ * those bytes have been written, or -1 if an error occurred (errno is set to
+ * ETIMEDOUT if it timed out).
+ */
+
+int WriteExact(rfbClientPtr cl, char *buf, int len)
+{
+  char wsHeader[WSHLENMAX];
+  int hdrLen = 0, ret;
+
+  if (cl->wsctx) {
+    /* If possible, frame the original buffer rather than copying it. */
+    hdrLen = webSocketsEncodeHeader(cl, len, wsHeader);
+    if (hdrLen == 0) {
+      char *tmp = NULL;
+      if ((len = webSocketsEncode(cl, buf, len, &tmp)) < 0) {
+        rfbLog("WriteExact: WebSockets encode error\n");
+        return -1;
+      }
+      buf = tmp;
+    }
+  }
+
+#if USETLS
+  /* Data that is held for coalescing is counted as written, since the
+     flow control code must see it as preceding any subsequent fence. */
+  if (cl->tlsCorked)
+    ret = WriteCoalesced(cl, buf, len);
+  else
+#endif
+  ret = WriteRaw(cl, wsHeader, hdrLen, buf, len);
+
+  if (ret > 0)
+    cl->sockOffset += hdrLen + len;
+
+  return ret;
+}
+
 
 int ListenOnTCPPort(int port)
 {
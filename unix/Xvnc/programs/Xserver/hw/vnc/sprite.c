@@ -1122,3 +1122,23 @@ rfbSpriteRestoreCursorAllDev(ScreenPtr pScreen)
         }
     }
 }
+
+void
+rfbSpriteGetCursorRegion(ScreenPtr pScreen, RegionPtr pRegion)
+{
+    DeviceIntPtr pDev;
+    rfbCursorInfoPtr pCursorInfo;
+    RegionRec tmpRegion;
+
+    RegionEmpty(pRegion);
+    for (pDev = inputInfo.devices; pDev; pDev = pDev->next) {
+        if (!DevHasCursor(pDev) || IsFloating(pDev))
+            continue;
+        pCursorInfo = RFBSPRITE(pDev);
+        if (!pCursorInfo->isUp)
+            continue;
+        RegionInit(&tmpRegion, &pCursorInfo->saved, 0);
+        RegionUnion(pRegion, pRegion, &tmpRegion);
+        RegionUninit(&tmpRegion);
+    }
+}
@@ -53,6 +53,7 @@ extern void rfbSpriteGetCursorPos(ScreenPtr, int *, int *);
 extern CursorPtr rfbSpriteGetCursorPtr(ScreenPtr);
 extern void rfbSpriteRemoveCursorAllDev(ScreenPtr pScreen);
 extern void rfbSpriteRestoreCursorAllDev(ScreenPtr pScreen);
+extern void rfbSpriteGetCursorRegion(ScreenPtr pScreen, RegionPtr pRegion);
 
 extern Bool rfbDCRealizeCursor(ScreenPtr pScreen, CursorPtr pCursor);
 extern Bool rfbDCUnrealizeCursor(ScreenPtr pScreen, CursorPtr pCursor);
@@ -49,10 +49,16 @@ void rfbResetStats(rfbClientPtr cl)
   cl->rfbCursorShapeUpdatesSent = 0;
   cl->rfbCursorPosBytesSent = 0;
   cl->rfbCursorPosUpdatesSent = 0;
+  cl->rfbTileCacheStoresSent = 0;
+  cl->rfbTileCacheHits = 0;
+  cl->rfbTileCacheBytesSent = 0;
   cl->rfbFramebufferUpdateMessagesSent = 0;
   cl->rfbRawBytesEquivalent = 0;
   cl->rfbKeyEventsRcvd = 0;
   cl->rfbPointerEventsRcvd = 0;
+  cl->rfbPointerEventsMerged = 0;
+  cl->rfbGIIValuatorEventsRcvd = 0;
+  cl->rfbGIIValuatorEventsMerged = 0;
 }
 
 
@@ -65,8 +71,12 @@ void rfbPrintStats(rfbClientPtr cl)
   rfbLog("Statistics:\n");
 
   if ((cl->rfbKeyEventsRcvd != 0) || (cl->rfbPointerEventsRcvd != 0))
-    rfbLog("  key events received %d, pointer events %d\n",
-           cl->rfbKeyEventsRcvd, cl->rfbPointerEventsRcvd);
+    rfbLog("  key events received %d, pointer events %d (%d merged)\n",
+           cl->rfbKeyEventsRcvd, cl->rfbPointerEventsRcvd,
+           cl->rfbPointerEventsMerged);
+  if (cl->rfbGIIValuatorEventsRcvd != 0)
+    rfbLog("  GII valuator events received %d (%d merged)\n",
+           cl->rfbGIIValuatorEventsRcvd, cl->rfbGIIValuatorEventsMerged);
 
   for (i = 0; i < MAX_ENCODINGS; i++) {
     totalRectanglesSent += cl->rfbRectanglesSent[i];
@@ -74,10 +84,12 @@ void rfbPrintStats(rfbClientPtr cl)
   }
   totalRectanglesSent += (cl->rfbCursorShapeUpdatesSent +
                           cl->rfbCursorPosUpdatesSent +
-                          cl->rfbLastRectMarkersSent);
+                          cl->rfbLastRectMarkersSent +
+                          cl->rfbTileCacheStoresSent + cl->rfbTileCacheHits);
   totalBytesSent += (cl->rfbCursorShapeBytesSent +
                      cl->rfbCursorPosBytesSent +
-                     cl->rfbLastRectBytesSent);
+                     cl->rfbLastRectBytesSent +
+                     cl->rfbTileCacheBytesSent);
 
   rfbLog("  framebuffer updates %d, rectangles %d, bytes %d\n",
          cl->rfbFramebufferUpdateMessagesSent, totalRectanglesSent,
@@ -95,6 +107,11 @@ void rfbPrintStats(rfbClientPtr cl)
     rfbLog("    cursor position updates %d, bytes %d\n",
            cl->rfbCursorPosUpdatesSent, cl->rfbCursorPosBytesSent);
 
+  if (cl->rfbTileCacheStoresSent != 0 || cl->rfbTileCacheHits != 0)
+    rfbLog("    tile cache stores %d, hits %d, bytes %d\n",
+           cl->rfbTileCacheStoresSent, cl->rfbTileCacheHits,
+           cl->rfbTileCacheBytesSent);
+
   for (i = 0; i < MAX_ENCODINGS; i++) {
     if (cl->rfbRectanglesSent[i] != 0)
       rfbLog("    %s rectangles %d, bytes %d\n", encNames[i],
@@ -35,7 +35,9 @@
 #include <errno.h>
 #include <unistd.h>
 #include "rfb.h"
+#include "fasttranslate.h"
 #include "turbojpeg.h"
+#include "lz4.h"
 
 
 /* Note: The following constant should not be changed. */
@@ -46,8 +48,19 @@
 #define MIN_SOLID_SUBRECT_SIZE  2048
 #define MAX_SPLIT_TILE_SIZE       16
 
-/* This variable is set on every rfbSendRectEncodingTight() call. */
+/* End (exclusive) of the solid-tile map tile that contains coordinate c */
+#define TILE_END(c, origin)  \
+  ((origin) + ((c) - (origin)) / MAX_SPLIT_TILE_SIZE * MAX_SPLIT_TILE_SIZE +  \
+   MAX_SPLIT_TILE_SIZE)
+
+/* These variables are set on every rfbSendRectEncodingTight() call. */
 static Bool usePixelFormat24;
+static Bool useLZ4;
+
+/* When LZ4 is in use, it is not disabled until the bandwidth drops below this
+   fraction of the threshold, so that small fluctuations in the bandwidth
+   estimate do not cause the server to switch back and forth. */
+#define LZ4_HYSTERESIS  0.75
 
 
 /* ALR stuff */
@@ -141,6 +154,12 @@ typedef struct _threadparam {
   tjhandle j;
   int bytessent, rectsent;
   int streamId, baseStreamId, nStreams;
+  /* Solid-tile map (see BuildSolidTileMap()) */
+  CARD32 *tileColor, *tileSolid;
+  int tileMapSize, mapX, mapY, mapW, mapH, mapTilesX, mapTilesY;
+  /* Job dispatched by another encoder (see rfbRunEncodingJobs()) */
+  void (*job)(void *);
+  void *jobArg;
   pthread_mutex_t ready, done;
   Bool status, deadyet;
   RegionRec lossyRegion, losslessRegion;
@@ -151,11 +170,21 @@ static threadparam tparam[MAX_ENCODING_THREADS];
 
 /* Prototypes for static functions. */
 
-static void FindBestSolidArea(rfbClientPtr cl, int x, int y, int w, int h,
+static void BuildSolidTileMap(threadparam *t);
+static void BuildSolidTileMap8(threadparam *t);
+static void BuildSolidTileMap16(threadparam *t);
+static void BuildSolidTileMap32(threadparam *t);
+static Bool CheckSolidArea(threadparam *t, int x, int y, int w, int h,
+                           CARD32 *colorPtr, Bool needSameColor);
+static void FindBestSolidArea(threadparam *t, int x, int y, int w, int h,
                               CARD32 colorValue, int *w_ptr, int *h_ptr);
-static void ExtendSolidArea(rfbClientPtr cl, int x, int y, int w, int h,
+static void ExtendSolidArea(threadparam *t, int x, int y, int w, int h,
                             CARD32 colorValue, int *x_ptr, int *y_ptr,
                             int *w_ptr, int *h_ptr);
+static int SolidRunLeft(rfbClientPtr cl, int x, int y, int xmin,
+                        CARD32 colorValue);
+static int SolidRunRight(rfbClientPtr cl, int x, int y, int xmax,
+                         CARD32 colorValue);
 static Bool CheckSolidTile(rfbClientPtr cl, int x, int y, int w, int h,
                            CARD32 *colorPtr, Bool needSameColor);
 static Bool CheckSolidTile8(rfbClientPtr cl, int x, int y, int w, int h,
@@ -188,6 +217,7 @@ static void FastFillPalette32(threadparam *t, CARD32 *data, int w, int pitch,
 
 static void PaletteReset(threadparam *t);
 static int PaletteInsert(threadparam *t, CARD32 rgb, int numPixels, int bpp);
+static void PaletteFinish(threadparam *t, int bpp, Bool rehash);
 
 static void Pack24(char *buf, rfbPixelFormat *fmt, int count);
 
@@ -202,6 +232,7 @@ static Bool SendJpegRect(threadparam *t, int x, int y, int w, int h,
                          int quality);
 
 static Bool SendRectEncodingTight(threadparam *t, int x, int y, int w, int h);
+static Bool UseLZ4(rfbClientPtr cl);
 
 static void *TightThreadFunc(void *param);
 static Bool CheckUpdateBuf(threadparam *t, int bytes);
@@ -337,6 +368,8 @@ void ShutdownTightThreads(void)
   for (i = 0; i < rfbNumThreads; i++) {
     free(tparam[i].tightAfterBuf);
     free(tparam[i].tightBeforeBuf);
+    free(tparam[i].tileColor);
+    free(tparam[i].tileSolid);
     if (i != 0) free(tparam[i].updateBuf);
     if (tparam[i].j) tjDestroy(tparam[i].j);
     if (!REGION_NAR(&tparam[i].losslessRegion))
@@ -355,13 +388,53 @@ static void *TightThreadFunc(void *param)
   while (!t->deadyet) {
     pthread_mutex_lock(&t->ready);
     if (t->deadyet) break;
-    t->status = SendRectEncodingTight(t, t->x, t->y, t->w, t->h);
+    if (t->job)
+      t->job(t->jobArg);
+    else {
+      BuildSolidTileMap(t);
+      t->status = SendRectEncodingTight(t, t->x, t->y, t->w, t->h);
+    }
     pthread_mutex_unlock(&t->done);
   }
   return NULL;
 }
 
 
+/*
+ * Run a job from another encoder on the Tight encoding threads.  The jobs are
+ * run in batches of rfbNumThreads.  Within each batch, the first job runs on
+ * the calling thread, and the others run on the encoding threads.  This
+ * function returns once all of the jobs have finished.  The jobs run serially
+ * if the encoding threads could not be started.
+ */
+
+void rfbRunEncodingJobs(int n, void (*func)(void *), void **args)
+{
+  int i, j, nt;
+
+  if (n > 1 && rfbNumThreads > 1 && !threadInit) InitThreads();
+  if (rfbNumThreads < 2 || !threadInit) {
+    for (i = 0; i < n; i++) func(args[i]);
+    return;
+  }
+
+  for (j = 0; j < n; j += nt) {
+    nt = min(n - j, rfbNumThreads);
+    for (i = 1; i < nt; i++) {
+      tparam[i].job = func;
+      tparam[i].jobArg = args[j + i];
+      pthread_mutex_unlock(&tparam[i].ready);
+    }
+    func(args[j]);
+    for (i = 1; i < nt; i++) {
+      pthread_mutex_lock(&tparam[i].done);
+      tparam[i].job = NULL;
+      tparam[i].jobArg = NULL;
+    }
+  }
+}
+
+
 static Bool CheckUpdateBuf(threadparam *t, int bytes)
 {
   rfbClientPtr cl = t->cl;
@@ -401,6 +474,8 @@ Bool rfbSendRectEncodingTight(rfbClientPtr cl, int x, int y, int w, int h)
   else
     usePixelFormat24 = FALSE;
 
+  useLZ4 = UseLZ4(cl);
+
   nt = min(rfbNumThreads, w * h / tightConf[compressLevel].maxRectSize);
   if (nt < 1) nt = 1;
 
@@ -428,6 +503,7 @@ Bool rfbSendRectEncodingTight(rfbClientPtr cl, int x, int y, int w, int h)
     for (i = 1; i < nt; i++) pthread_mutex_unlock(&tparam[i].ready);
   }
 
+  BuildSolidTileMap(&tparam[0]);
   status &= SendRectEncodingTight(&tparam[0], tparam[0].x, tparam[0].y,
                                   tparam[0].w, tparam[0].h);
   if (!status) return FALSE;
@@ -459,6 +535,9 @@ Bool rfbSendRectEncodingTight(rfbClientPtr cl, int x, int y, int w, int h)
 
   if (rfbAutoLosslessRefresh > 0.0) {
     for (i = 0; i < nt; i++) {
+      /* The ALR regions are tracked in framebuffer coordinates. */
+      rfbScaleRegion(cl, &tparam[i].lossyRegion, TRUE);
+      rfbScaleRegion(cl, &tparam[i].losslessRegion, TRUE);
       REGION_UNION(pScreen, &cl->lossyRegion, &cl->lossyRegion,
                    &tparam[i].lossyRegion);
       REGION_UNINIT(pScreen, &tparam[i].lossyRegion);
@@ -474,6 +553,40 @@ Bool rfbSendRectEncodingTight(rfbClientPtr cl, int x, int y, int w, int h)
 }
 
 
+/*
+ * LZ4 compresses several times faster than zlib but produces larger output,
+ * so it improves the frame rate only when the network has bandwidth to spare
+ * and the CPU is the bottleneck.  UseLZ4() decides, based on the bandwidth
+ * estimate from the congestion control algorithm, whether to use LZ4 for the
+ * current framebuffer update.
+ */
+
+static Bool UseLZ4(rfbClientPtr cl)
+{
+  Bool lz4 = FALSE;
+
+  if (cl->enableTightLZ4 && rfbLZ4Bandwidth >= 0) {
+    if (rfbLZ4Bandwidth == 0)
+      lz4 = TRUE;
+    else {
+      double bandwidth = rfbGetBandwidth(cl);
+
+      if (cl->tightLZ4)
+        lz4 = bandwidth >= (double)rfbLZ4Bandwidth * LZ4_HYSTERESIS;
+      else
+        lz4 = bandwidth >= (double)rfbLZ4Bandwidth;
+    }
+  }
+
+  if (lz4 != cl->tightLZ4) {
+    rfbLog("Using %s compression for Tight encoding for client %s\n",
+           lz4 ? "LZ4" : "zlib", cl->host);
+    cl->tightLZ4 = lz4;
+  }
+  return lz4;
+}
+
+
 static Bool SendRectEncodingTight(threadparam *t, int x, int y, int w, int h)
 {
   int nMaxRows;
@@ -510,7 +623,7 @@ static Bool SendRectEncodingTight(threadparam *t, int x, int y, int w, int h)
 
   /* Try to find large solid-color areas and send them separately. */
 
-  for (dy = y; dy < y + h; dy += MAX_SPLIT_TILE_SIZE) {
+  for (dy = y; dy < y + h; dy += dh) {
 
     /* If a rectangle becomes too large, send its upper part now. */
 
@@ -521,15 +634,13 @@ static Bool SendRectEncodingTight(threadparam *t, int x, int y, int w, int h)
       h -= nMaxRows;
     }
 
-    dh =
-      (dy + MAX_SPLIT_TILE_SIZE <= y + h) ? MAX_SPLIT_TILE_SIZE : (y + h - dy);
+    dh = min(TILE_END(dy, t->mapY), y + h) - dy;
 
-    for (dx = x; dx < x + w; dx += MAX_SPLIT_TILE_SIZE) {
+    for (dx = x; dx < x + w; dx += dw) {
 
-      dw = (dx + MAX_SPLIT_TILE_SIZE <= x + w) ?
-           MAX_SPLIT_TILE_SIZE : (x + w - dx);
+      dw = min(TILE_END(dx, t->mapX), x + w) - dx;
 
-      if (CheckSolidTile(cl, dx, dy, dw, dh, &colorValue, FALSE)) {
+      if (CheckSolidArea(t, dx, dy, dw, dh, &colorValue, FALSE)) {
 
         if (subsampLevel == TJ_GRAYSCALE && qualityLevel != -1) {
           CARD32 r = (colorValue >> 16) & 0xFF;
@@ -542,7 +653,7 @@ static Bool SendRectEncodingTight(threadparam *t, int x, int y, int w, int h)
 
         /* Get dimensions of solid-color area. */
 
-        FindBestSolidArea(cl, dx, dy, w - (dx - x), h - (dy - y), colorValue,
+        FindBestSolidArea(t, dx, dy, w - (dx - x), h - (dy - y), colorValue,
                           &w_best, &h_best);
 
         /* Make sure a solid rectangle is large enough
@@ -555,7 +666,7 @@ static Bool SendRectEncodingTight(threadparam *t, int x, int y, int w, int h)
         /* Try to extend solid rectangle to maximum size. */
 
         x_best = dx;  y_best = dy;
-        ExtendSolidArea(cl, x, y, w, h, colorValue, &x_best, &y_best,
+        ExtendSolidArea(t, x, y, w, h, colorValue, &x_best, &y_best,
                         &w_best, &h_best);
 
         /* Send rectangles at top and left to solid-color area. */
@@ -608,7 +719,156 @@ static Bool SendRectEncodingTight(threadparam *t, int x, int y, int w, int h)
 }
 
 
-static void FindBestSolidArea(rfbClientPtr cl, int x, int y, int w, int h,
+/*
+ * The solid-tile map records, for each MAX_SPLIT_TILE_SIZE x
+ * MAX_SPLIT_TILE_SIZE tile of the rectangle that a thread is encoding, whether
+ * the tile is a single color and, if so, which color.  It is built with one
+ * pass over the framebuffer, and the solid-area search consults it rather than
+ * re-reading the framebuffer for every tile that it (and its recursive calls)
+ * examine.  Only the parts of non-solid tiles that are partly covered by the
+ * area being checked still have to be examined pixel by pixel.
+ *
+ * The tiles are aligned to the origin of the thread's rectangle, so the
+ * solid-area search steps from one tile boundary to the next rather than by
+ * MAX_SPLIT_TILE_SIZE pixels from the origin of each subrectangle.
+ */
+
+static void BuildSolidTileMap(threadparam *t)
+{
+  rfbClientPtr cl = t->cl;
+  int nTiles;
+
+  t->mapX = t->x;  t->mapY = t->y;
+  t->mapW = t->w;  t->mapH = t->h;
+  t->mapTilesX = (t->w + MAX_SPLIT_TILE_SIZE - 1) / MAX_SPLIT_TILE_SIZE;
+  t->mapTilesY = (t->h + MAX_SPLIT_TILE_SIZE - 1) / MAX_SPLIT_TILE_SIZE;
+
+  /* The map is used only if the rectangle may be split. */
+  if (!cl->enableLastRectEncoding || t->w * t->h < MIN_SPLIT_RECT_SIZE)
+    return;
+
+  nTiles = t->mapTilesX * t->mapTilesY;
+  if (t->tileMapSize < nTiles) {
+    t->tileMapSize = nTiles;
+    free(t->tileColor);
+    free(t->tileSolid);
+    t->tileColor = (CARD32 *)rfbAlloc(nTiles * sizeof(CARD32));
+    t->tileSolid = (CARD32 *)rfbAlloc(nTiles * sizeof(CARD32));
+  }
+
+  switch (rfbServerFormat.bitsPerPixel) {
+    case 32:
+      BuildSolidTileMap32(t);  break;
+    case 16:
+      BuildSolidTileMap16(t);  break;
+    default:
+      BuildSolidTileMap8(t);
+  }
+}
+
+
+/*
+ * The framebuffer is read one row of tiles at a time, in raster order.  The
+ * pixels of each tile are XORed with the first pixel of the tile and ORed
+ * together without branching, so the compiler can vectorize the inner loop.
+ * A tile is skipped on subsequent rows once it is known not to be solid.
+ */
+
+#define DEFINE_BUILD_SOLID_TILE_MAP_FUNCTION(bpp)                             \
+                                                                              \
+static void BuildSolidTileMap##bpp(threadparam *t)                            \
+{                                                                             \
+  int tx, ty, dx, dy, tw, th;                                                 \
+  int pitch = rfbFB.paddedWidthInBytes;                                       \
+                                                                              \
+  for (ty = 0; ty < t->mapTilesY; ty++) {                                     \
+    int y0 = t->mapY + ty * MAX_SPLIT_TILE_SIZE;                              \
+    CARD32 *color = &t->tileColor[ty * t->mapTilesX];                         \
+    CARD32 *diff = &t->tileSolid[ty * t->mapTilesX];                          \
+    CARD##bpp *row =                                                          \
+      (CARD##bpp *)&t->cl->fb[y0 * pitch + t->mapX * (bpp / 8)];              \
+                                                                              \
+    th = min(MAX_SPLIT_TILE_SIZE, t->mapY + t->mapH - y0);                    \
+                                                                              \
+    for (tx = 0; tx < t->mapTilesX; tx++) {                                   \
+      color[tx] = (CARD32)row[tx * MAX_SPLIT_TILE_SIZE];                      \
+      diff[tx] = 0;                                                           \
+    }                                                                         \
+                                                                              \
+    for (dy = 0; dy < th; dy++) {                                             \
+      for (tx = 0; tx < t->mapTilesX; tx++) {                                 \
+        CARD##bpp *p = &row[tx * MAX_SPLIT_TILE_SIZE];                        \
+        CARD##bpp c = (CARD##bpp)color[tx], d = 0;                            \
+                                                                              \
+        if (diff[tx]) continue;                                               \
+        tw = min(MAX_SPLIT_TILE_SIZE, t->mapW - tx * MAX_SPLIT_TILE_SIZE);    \
+        for (dx = 0; dx < tw; dx++)                                           \
+          d |= p[dx] ^ c;                                                     \
+        diff[tx] = d;                                                         \
+      }                                                                       \
+      row = (CARD##bpp *)((CARD8 *)row + pitch);                              \
+    }                                                                         \
+                                                                              \
+    for (tx = 0; tx < t->mapTilesX; tx++)                                     \
+      diff[tx] = (diff[tx] == 0);                                             \
+  }                                                                           \
+}
+
+DEFINE_BUILD_SOLID_TILE_MAP_FUNCTION(8)
+DEFINE_BUILD_SOLID_TILE_MAP_FUNCTION(16)
+DEFINE_BUILD_SOLID_TILE_MAP_FUNCTION(32)
+
+
+/*
+ * Same as CheckSolidTile(), but uses the solid-tile map.  The area must lie
+ * within the thread's rectangle.
+ */
+
+static Bool CheckSolidArea(threadparam *t, int x, int y, int w, int h,
+                           CARD32 *colorPtr, Bool needSameColor)
+{
+  int tx, ty, tx1, ty1, tx2, ty2;
+  CARD32 colorValue = *colorPtr;
+  Bool haveColor = needSameColor;
+
+  tx1 = (x - t->mapX) / MAX_SPLIT_TILE_SIZE;
+  ty1 = (y - t->mapY) / MAX_SPLIT_TILE_SIZE;
+  tx2 = (x + w - 1 - t->mapX) / MAX_SPLIT_TILE_SIZE;
+  ty2 = (y + h - 1 - t->mapY) / MAX_SPLIT_TILE_SIZE;
+
+  for (ty = ty1; ty <= ty2; ty++) {
+    int tileY = t->mapY + ty * MAX_SPLIT_TILE_SIZE;
+    int tileH = min(MAX_SPLIT_TILE_SIZE, t->mapY + t->mapH - tileY);
+    int iy = max(y, tileY), ih = min(y + h, tileY + tileH) - iy;
+
+    for (tx = tx1; tx <= tx2; tx++) {
+      int i = ty * t->mapTilesX + tx;
+      int tileX = t->mapX + tx * MAX_SPLIT_TILE_SIZE;
+      int tileW = min(MAX_SPLIT_TILE_SIZE, t->mapX + t->mapW - tileX);
+      int ix = max(x, tileX), iw = min(x + w, tileX + tileW) - ix;
+
+      if (t->tileSolid[i]) {
+        if (!haveColor) {
+          colorValue = t->tileColor[i];
+          haveColor = TRUE;
+        } else if (t->tileColor[i] != colorValue)
+          return FALSE;
+      } else if (iw == tileW && ih == tileH)
+        return FALSE;
+      else {
+        if (!CheckSolidTile(t->cl, ix, iy, iw, ih, &colorValue, haveColor))
+          return FALSE;
+        haveColor = TRUE;
+      }
+    }
+  }
+
+  *colorPtr = colorValue;
+  return TRUE;
+}
+
+
+static void FindBestSolidArea(threadparam *t, int x, int y, int w, int h,
                               CARD32 colorValue, int *w_ptr, int *h_ptr)
 {
   int dx, dy, dw, dh;
@@ -617,20 +877,17 @@ static void FindBestSolidArea(rfbClientPtr cl, int x, int y, int w, int h,
 
   w_prev = w;
 
-  for (dy = y; dy < y + h; dy += MAX_SPLIT_TILE_SIZE) {
+  for (dy = y; dy < y + h; dy += dh) {
 
-    dh = (dy + MAX_SPLIT_TILE_SIZE <= y + h) ?
-         MAX_SPLIT_TILE_SIZE : (y + h - dy);
-    dw = (w_prev > MAX_SPLIT_TILE_SIZE) ?
-         MAX_SPLIT_TILE_SIZE : w_prev;
+    dh = min(TILE_END(dy, t->mapY), y + h) - dy;
+    dw = min(TILE_END(x, t->mapX), x + w_prev) - x;
 
-    if (!CheckSolidTile(cl, x, dy, dw, dh, &colorValue, TRUE))
+    if (!CheckSolidArea(t, x, dy, dw, dh, &colorValue, TRUE))
       break;
 
     for (dx = x + dw; dx < x + w_prev;) {
-      dw = (dx + MAX_SPLIT_TILE_SIZE <= x + w_prev) ?
-           MAX_SPLIT_TILE_SIZE : (x + w_prev - dx);
-      if (!CheckSolidTile(cl, dx, dy, dw, dh, &colorValue, TRUE))
+      dw = min(TILE_END(dx, t->mapX), x + w_prev) - dx;
+      if (!CheckSolidArea(t, dx, dy, dw, dh, &colorValue, TRUE))
         break;
       dx += dw;
     }
@@ -647,15 +904,15 @@ static void FindBestSolidArea(rfbClientPtr cl, int x, int y, int w, int h,
 }
 
 
-static void ExtendSolidArea(rfbClientPtr cl, int x, int y, int w, int h,
+static void ExtendSolidArea(threadparam *t, int x, int y, int w, int h,
                             CARD32 colorValue, int *x_ptr, int *y_ptr,
                             int *w_ptr, int *h_ptr)
 {
-  int cx, cy;
+  int cx, cy, xmin, xmax;
 
   /* Try to extend the area upwards. */
   for (cy = *y_ptr - 1;
-       cy >= y && CheckSolidTile(cl, *x_ptr, cy, *w_ptr, 1, &colorValue, TRUE);
+       cy >= y && CheckSolidArea(t, *x_ptr, cy, *w_ptr, 1, &colorValue, TRUE);
        cy--);
   *h_ptr += *y_ptr - (cy + 1);
   *y_ptr = cy + 1;
@@ -663,23 +920,84 @@ static void ExtendSolidArea(rfbClientPtr cl, int x, int y, int w, int h,
   /* ... downwards. */
   for (cy = *y_ptr + *h_ptr;
        cy < y + h &&
-       CheckSolidTile(cl, *x_ptr, cy, *w_ptr, 1, &colorValue, TRUE);
+       CheckSolidArea(t, *x_ptr, cy, *w_ptr, 1, &colorValue, TRUE);
        cy++);
   *h_ptr += cy - (*y_ptr + *h_ptr);
 
-  /* ... to the left. */
-  for (cx = *x_ptr - 1;
-       cx >= x && CheckSolidTile(cl, cx, *y_ptr, 1, *h_ptr, &colorValue, TRUE);
-       cx--);
-  *w_ptr += *x_ptr - (cx + 1);
-  *x_ptr = cx + 1;
+  /* ... to the left.  Rather than checking one column at a time, which reads
+     the framebuffer in a cache-unfriendly order, find the solid run to the
+     left of the area in each row, and use the shortest one. */
+  xmin = x;
+  for (cy = *y_ptr; cy < *y_ptr + *h_ptr && xmin < *x_ptr; cy++)
+    xmin = SolidRunLeft(t->cl, *x_ptr, cy, xmin, colorValue);
+  *w_ptr += *x_ptr - xmin;
+  *x_ptr = xmin;
 
   /* ... to the right. */
-  for (cx = *x_ptr + *w_ptr;
-       cx < x + w &&
-       CheckSolidTile(cl, cx, *y_ptr, 1, *h_ptr, &colorValue, TRUE);
-       cx++);
-  *w_ptr += cx - (*x_ptr + *w_ptr);
+  xmax = x + w;
+  for (cy = *y_ptr; cy < *y_ptr + *h_ptr && xmax > *x_ptr + *w_ptr; cy++)
+    xmax = SolidRunRight(t->cl, *x_ptr + *w_ptr, cy, xmax, colorValue);
+  *w_ptr = xmax - *x_ptr;
+}
+
+
+/*
+ * SolidRunLeft() returns the leftmost coordinate, no less than xmin, such that
+ * all pixels from that coordinate to x - 1 in row y are of the given color.
+ * SolidRunRight() returns the rightmost coordinate, no greater than xmax, such
+ * that all pixels from x to that coordinate - 1 are of the given color.
+ */
+
+#define DEFINE_SOLID_RUN_FUNCTIONS(bpp)                                       \
+                                                                              \
+static int SolidRunLeft##bpp(rfbClientPtr cl, int x, int y, int xmin,         \
+                             CARD32 colorValue)                               \
+{                                                                             \
+  CARD##bpp *row = (CARD##bpp *)&cl->fb[y * rfbFB.paddedWidthInBytes];        \
+                                                                              \
+  while (x > xmin && (CARD32)row[x - 1] == colorValue) x--;                   \
+  return x;                                                                   \
+}                                                                             \
+                                                                              \
+static int SolidRunRight##bpp(rfbClientPtr cl, int x, int y, int xmax,        \
+                              CARD32 colorValue)                              \
+{                                                                             \
+  CARD##bpp *row = (CARD##bpp *)&cl->fb[y * rfbFB.paddedWidthInBytes];        \
+                                                                              \
+  while (x < xmax && (CARD32)row[x] == colorValue) x++;                       \
+  return x;                                                                   \
+}
+
+DEFINE_SOLID_RUN_FUNCTIONS(8)
+DEFINE_SOLID_RUN_FUNCTIONS(16)
+DEFINE_SOLID_RUN_FUNCTIONS(32)
+
+
+static int SolidRunLeft(rfbClientPtr cl, int x, int y, int xmin,
+                        CARD32 colorValue)
+{
+  switch (rfbServerFormat.bitsPerPixel) {
+    case 32:
+      return SolidRunLeft32(cl, x, y, xmin, colorValue);
+    case 16:
+      return SolidRunLeft16(cl, x, y, xmin, colorValue);
+    default:
+      return SolidRunLeft8(cl, x, y, xmin, colorValue);
+  }
+}
+
+
+static int SolidRunRight(rfbClientPtr cl, int x, int y, int xmax,
+                         CARD32 colorValue)
+{
+  switch (rfbServerFormat.bitsPerPixel) {
+    case 32:
+      return SolidRunRight32(cl, x, y, xmax, colorValue);
+    case 16:
+      return SolidRunRight16(cl, x, y, xmax, colorValue);
+    default:
+      return SolidRunRight8(cl, x, y, xmax, colorValue);
+  }
 }
 
 
@@ -964,7 +1282,9 @@ static Bool SendMonoRect(threadparam *t, int w, int h)
   dataLen = (w + 7) / 8;
   dataLen *= h;
 
-  if (tightConf[compressLevel].monoZlibLevel == 0 || t->id > 3)
+  if (useLZ4 && tightConf[compressLevel].monoZlibLevel != 0)
+    t->updateBuf[(*t->ublen)++] = (char)(rfbTightLZ4 << 4);
+  else if (tightConf[compressLevel].monoZlibLevel == 0 || t->id > 3)
     t->updateBuf[(*t->ublen)++] =
       (char)((rfbTightNoZlib | rfbTightExplicitFilter) << 4);
   else
@@ -1032,7 +1352,9 @@ static Bool SendIndexedRect(threadparam *t, int w, int h)
   }
 
   /* Prepare tight encoding header. */
-  if (tightConf[compressLevel].idxZlibLevel == 0 || t->id > 3)
+  if (useLZ4 && tightConf[compressLevel].idxZlibLevel != 0)
+    t->updateBuf[(*t->ublen)++] = (char)(rfbTightLZ4 << 4);
+  else if (tightConf[compressLevel].idxZlibLevel == 0 || t->id > 3)
     t->updateBuf[(*t->ublen)++] =
       (char)((rfbTightNoZlib | rfbTightExplicitFilter) << 4);
   else
@@ -1089,7 +1411,7 @@ static Bool SendFullColorRect(threadparam *t, int w, int h)
   int len;
   rfbClientPtr cl = t->cl;
 
-  if (!CheckUpdateBuf(t, TIGHT_MIN_TO_COMPRESS + 1))
+  if (!CheckUpdateBuf(t, TIGHT_MIN_TO_COMPRESS + 2))
     return FALSE;
 
   if (t->nStreams > 0) {
@@ -1098,7 +1420,12 @@ static Bool SendFullColorRect(threadparam *t, int w, int h)
       t->streamId = t->baseStreamId;
   }
 
-  if (tightConf[compressLevel].rawZlibLevel == 0 || t->id > 3)
+  if (useLZ4 && tightConf[compressLevel].rawZlibLevel != 0) {
+    /* The LZ4 compression type always implies an explicit filter. */
+    t->updateBuf[(*t->ublen)++] = (char)(rfbTightLZ4 << 4);
+    t->updateBuf[(*t->ublen)++] = rfbTightFilterCopy;
+    t->bytessent++;
+  } else if (tightConf[compressLevel].rawZlibLevel == 0 || t->id > 3)
     t->updateBuf[(*t->ublen)++] = (char)(rfbTightNoZlib << 4);
   else
     t->updateBuf[(*t->ublen)++] = streamId << 4;
@@ -1130,6 +1457,16 @@ static Bool CompressData(threadparam *t, int streamId, int dataLen,
     return TRUE;
   }
 
+  /* LZ4 blocks are independent of each other, so any thread can use LZ4. */
+  if (useLZ4 && zlibLevel != 0) {
+    int compressedLen = LZ4_compress_default(t->tightBeforeBuf,
+                                             t->tightAfterBuf, dataLen,
+                                             t->tightAfterBufSize);
+    if (compressedLen <= 0)
+      return FALSE;
+    return SendCompressedData(t, t->tightAfterBuf, compressedLen);
+  }
+
   /* Tight encoding has only a limited number of Zlib streams (4).  The
      streams must all be left open as long as the client is connected, or
      performance suffers.  Thus, multiple threads can't use the same Zlib
@@ -1214,8 +1551,47 @@ static Bool SendCompressedData(threadparam *t, char *buf, int compressedLen)
 
 /*
  * Code to determine how many different colors used in rectangle.
+ *
+ * The pixels are processed as runs of identical pixels.  The end of a run is
+ * found by comparing blocks of RUN_BLOCK pixels at a time using a branchless
+ * XOR/OR reduction, which the compiler can vectorize, so long runs (which are
+ * typical of text and UI content) cost much less than one comparison and
+ * branch per pixel.  The first block is compared one pixel at a time, so short
+ * runs (such as those within antialiased glyphs) end without a block
+ * comparison.  Each run is added to the palette with a single hash lookup,
+ * and the palette is sorted by pixel count only once, after the whole
+ * rectangle has been analyzed.
  */
 
+#define RUN_BLOCK  16
+
+#define DEFINE_RUN_END_FUNCTION(bpp)                                          \
+                                                                              \
+static int RunEnd##bpp(const CARD##bpp *data, int i, int count,               \
+                       CARD##bpp mask, CARD##bpp c)                           \
+{                                                                             \
+  int end = min(i + RUN_BLOCK, count);                                        \
+                                                                              \
+  while (i < end && (data[i] & mask) == c) i++;                               \
+  if (i < end) return i;                                                      \
+  while (i + RUN_BLOCK <= count) {                                            \
+    CARD##bpp d = 0;                                                          \
+    int k;                                                                    \
+                                                                              \
+    for (k = 0; k < RUN_BLOCK; k++)                                           \
+      d |= (data[i + k] & mask) ^ c;                                          \
+    if (d) break;                                                             \
+    i += RUN_BLOCK;                                                           \
+  }                                                                           \
+  while (i < count && (data[i] & mask) == c) i++;                             \
+  return i;                                                                   \
+}
+
+DEFINE_RUN_END_FUNCTION(8)
+DEFINE_RUN_END_FUNCTION(16)
+DEFINE_RUN_END_FUNCTION(32)
+
+
 static void FillPalette8(threadparam *t, int count)
 {
   CARD8 *data = (CARD8 *)t->tightBeforeBuf;
@@ -1225,7 +1601,7 @@ static void FillPalette8(threadparam *t, int count)
   t->paletteNumColors = 0;
 
   c0 = data[0];
-  for (i = 1; i < count && data[i] == c0; i++);
+  i = RunEnd8(data, 1, count, 0xFF, c0);
   if (i == count) {
     t->paletteNumColors = 1;
     return;                     /* Solid rectangle */
@@ -1264,10 +1640,10 @@ static void FillPalette##bpp(threadparam *t, int count)                       \
 {                                                                             \
   CARD##bpp *data = (CARD##bpp *)t->tightBeforeBuf;                           \
   CARD##bpp c0, c1, ci;                                                       \
-  int i, n0, n1, ni;                                                          \
+  int i, j, n0, n1;                                                           \
                                                                               \
   c0 = data[0];                                                               \
-  for (i = 1; i < count && data[i] == c0; i++);                               \
+  i = RunEnd##bpp(data, 1, count, (CARD##bpp)~0, c0);                         \
   if (i >= count) {                                                           \
     t->paletteNumColors = 1;    /* Solid rectangle */                         \
     return;                                                                   \
@@ -1306,31 +1682,35 @@ static void FillPalette##bpp(threadparam *t, int count)                       \
   PaletteInsert(t, c0, (CARD32)n0, bpp);                                      \
   PaletteInsert(t, c1, (CARD32)n1, bpp);                                      \
                                                                               \
-  ni = 1;                                                                     \
-  for (i++; i < count; i++) {                                                 \
-    if (data[i] == ci) {                                                      \
-      ni++;                                                                   \
-    } else {                                                                  \
-      if (!PaletteInsert(t, ci, (CARD32)ni, bpp))                             \
-        return;                                                               \
-      ci = data[i];                                                           \
-      ni = 1;                                                                 \
-    }                                                                         \
+  while (i < count) {                                                         \
+    ci = data[i];                                                             \
+    j = RunEnd##bpp(data, i + 1, count, (CARD##bpp)~0, ci);                   \
+    if (!PaletteInsert(t, ci, (CARD32)(j - i), bpp))                          \
+      return;                                                                 \
+    i = j;                                                                    \
   }                                                                           \
-  PaletteInsert(t, ci, (CARD32)ni, bpp);                                      \
+  PaletteFinish(t, bpp, FALSE);                                               \
 }
 
 DEFINE_FILL_PALETTE_FUNCTION(16)
 DEFINE_FILL_PALETTE_FUNCTION(32)
 
 
+/*
+ * FastFillPalette*() analyze the framebuffer directly, without translating
+ * it first.  The pixel format of the client has the same depth and color
+ * component ranges as the server's, so translation is a one-to-one mapping of
+ * the (masked) pixel values, and the palette entries are translated once,
+ * after all of the pixels have been counted.
+ */
+
 #define DEFINE_FAST_FILL_PALETTE_FUNCTION(bpp)                                \
                                                                               \
 static void FastFillPalette##bpp(threadparam *t, CARD##bpp *data,             \
                                  int w, int pitch, int h)                     \
 {                                                                             \
   CARD##bpp c0, c1, ci, mask, c0t, c1t, cit;                                  \
-  int i, j, i2 = 0, j2, n0, n1, ni;                                           \
+  int i, j, i2 = 0, j2, n0, n1;                                               \
   rfbClientPtr cl = t->cl;                                                    \
                                                                               \
   if (cl->translateFn != rfbTranslateNone) {                                  \
@@ -1341,12 +1721,9 @@ static void FastFillPalette##bpp(threadparam *t, CARD##bpp *data,             \
                                                                               \
   c0 = data[0] & mask;                                                        \
   for (j = 0; j < h; j++) {                                                   \
-    for (i = 0; i < w; i++) {                                                 \
-      if ((data[j * pitch + i] & mask) != c0)                                 \
-        goto done;                                                            \
-    }                                                                         \
+    i = RunEnd##bpp(&data[j * pitch], 0, w, mask, c0);                        \
+    if (i < w) break;                                                         \
   }                                                                           \
-  done:                                                                       \
   if (j >= h) {                                                               \
     t->paletteNumColors = 1;    /* Solid rectangle */                         \
     return;                                                                   \
@@ -1392,32 +1769,31 @@ static void FastFillPalette##bpp(threadparam *t, CARD##bpp *data,             \
   }                                                                           \
                                                                               \
   PaletteReset(t);                                                            \
-  PaletteInsert(t, c0t, (CARD32)n0, bpp);                                     \
-  PaletteInsert(t, c1t, (CARD32)n1, bpp);                                     \
+  PaletteInsert(t, c0, (CARD32)n0, bpp);                                      \
+  PaletteInsert(t, c1, (CARD32)n1, bpp);                                      \
                                                                               \
-  ni = 1;                                                                     \
-  i2++;  if (i2 >= w) { i2 = 0;  j2++; }                                      \
-  for (j = j2; j < h; j++) {                                                  \
-    for (i = i2; i < w; i++) {                                                \
-      if ((data[j * pitch + i] & mask) == ci) {                               \
-        ni++;                                                                 \
-      } else {                                                                \
-        (*cl->translateFn) (cl->translateLookupTable, &rfbServerFormat,       \
-                            &cl->format, (char *)&ci, (char *)&cit, bpp / 8,  \
-                            1, 1);                                            \
-        if (!PaletteInsert(t, cit, (CARD32)ni, bpp))                          \
-          return;                                                             \
-        ci = data[j * pitch + i] & mask;                                      \
-        ni = 1;                                                               \
-      }                                                                       \
+  for (j = j2, i = i2; j < h; j++, i = 0) {                                   \
+    CARD##bpp *row = &data[j * pitch];                                        \
+                                                                              \
+    while (i < w) {                                                           \
+      int end;                                                                \
+                                                                              \
+      ci = row[i] & mask;                                                     \
+      end = RunEnd##bpp(row, i + 1, w, mask, ci);                             \
+      if (!PaletteInsert(t, ci, (CARD32)(end - i), bpp))                      \
+        return;                                                               \
+      i = end;                                                                \
     }                                                                         \
-    i2 = 0;                                                                   \
   }                                                                           \
                                                                               \
-  (*cl->translateFn) (cl->translateLookupTable, &rfbServerFormat,             \
-                      &cl->format, (char *)&ci, (char *)&cit, bpp / 8,        \
-                      1, 1);                                                  \
-  PaletteInsert(t, cit, (CARD32)ni, bpp);                                     \
+  for (i = 0; i < t->paletteNumColors; i++) {                                 \
+    ci = (CARD##bpp)t->palette.list[i].rgb;                                   \
+    (*cl->translateFn) (cl->translateLookupTable, &rfbServerFormat,           \
+                        &cl->format, (char *)&ci, (char *)&cit, bpp / 8,      \
+                        1, 1);                                                \
+    t->palette.list[i].rgb = (CARD32)cit;                                     \
+  }                                                                           \
+  PaletteFinish(t, bpp, TRUE);                                                \
 }
 
 DEFINE_FAST_FILL_PALETTE_FUNCTION(16)
@@ -1439,11 +1815,18 @@ static void PaletteReset(threadparam *t)
 }
 
 
+/*
+ * Add numPixels pixels of the given color to the palette.  Returns the number
+ * of colors in the palette, or 0 if the palette overflowed.  The palette
+ * entries are not kept in order, so PaletteFinish() must be called once all
+ * of the pixels have been added.
+ */
+
 static int PaletteInsert(threadparam *t, CARD32 rgb, int numPixels, int bpp)
 {
   COLOR_LIST *pnode;
   COLOR_LIST *prev_pnode = NULL;
-  int hash_key, idx, new_idx, count;
+  int hash_key, idx;
 
   hash_key = (bpp == 16) ? HASH_FUNC16(rgb) : HASH_FUNC32(rgb);
 
@@ -1452,18 +1835,7 @@ static int PaletteInsert(threadparam *t, CARD32 rgb, int numPixels, int bpp)
   while (pnode != NULL) {
     if (pnode->rgb == rgb) {
       /* Such palette entry already exists. */
-      new_idx = idx = pnode->idx;
-      count = t->palette.entry[idx].numPixels + numPixels;
-      if (new_idx && t->palette.entry[new_idx - 1].numPixels < count) {
-        do {
-          t->palette.entry[new_idx] = t->palette.entry[new_idx - 1];
-          t->palette.entry[new_idx].listNode->idx = new_idx;
-          new_idx--;
-        } while (new_idx && t->palette.entry[new_idx - 1].numPixels < count);
-        t->palette.entry[new_idx].listNode = pnode;
-        pnode->idx = new_idx;
-      }
-      t->palette.entry[new_idx].numPixels = count;
+      t->palette.entry[pnode->idx].numPixels += numPixels;
       return t->paletteNumColors;
     }
     prev_pnode = pnode;
@@ -1477,16 +1849,9 @@ static int PaletteInsert(threadparam *t, CARD32 rgb, int numPixels, int bpp)
     return 0;
   }
 
-  /* Move palette entries with lesser pixel counts. */
-  for (idx = t->paletteNumColors;
-       idx > 0 && t->palette.entry[idx - 1].numPixels < numPixels;
-       idx--) {
-    t->palette.entry[idx] = t->palette.entry[idx - 1];
-    t->palette.entry[idx].listNode->idx = idx;
-  }
-
-  /* Add new palette entry into the freed slot. */
-  pnode = &t->palette.list[t->paletteNumColors];
+  /* Add new palette entry. */
+  idx = t->paletteNumColors;
+  pnode = &t->palette.list[idx];
   if (prev_pnode != NULL)
     prev_pnode->next = pnode;
   else
@@ -1502,38 +1867,55 @@ static int PaletteInsert(threadparam *t, CARD32 rgb, int numPixels, int bpp)
 
 
 /*
- * Converting 32-bit color samples into 24-bit colors.
- * Should be called only when redMax, greenMax and blueMax are 255.
- * Color components assumed to be byte-aligned.
+ * Sort the palette entries by decreasing pixel count (so the most common
+ * colors get the smallest indices).  If rehash is TRUE, then also rebuild the
+ * hash table from the colors in the list nodes, which the caller has changed
+ * since they were inserted.
  */
 
-static void Pack24(char *buf, rfbPixelFormat *fmt, int count)
+static void PaletteFinish(threadparam *t, int bpp, Bool rehash)
 {
-  CARD32 *buf32;
-  CARD32 pix;
-  int r_shift, g_shift, b_shift;
+  int i, j, hash_key;
 
-  buf32 = (CARD32 *)buf;
+  for (i = 1; i < t->paletteNumColors; i++) {
+    PALETTE_ENTRY e = t->palette.entry[i];
 
-  if (!rfbServerFormat.bigEndian == !fmt->bigEndian) {
-    r_shift = fmt->redShift;
-    g_shift = fmt->greenShift;
-    b_shift = fmt->blueShift;
-  } else {
-    r_shift = 24 - fmt->redShift;
-    g_shift = 24 - fmt->greenShift;
-    b_shift = 24 - fmt->blueShift;
+    for (j = i; j > 0 && t->palette.entry[j - 1].numPixels < e.numPixels;
+         j--)
+      t->palette.entry[j] = t->palette.entry[j - 1];
+    t->palette.entry[j] = e;
   }
 
-  while (count--) {
-    pix = *buf32++;
-    *buf++ = (char)(pix >> r_shift);
-    *buf++ = (char)(pix >> g_shift);
-    *buf++ = (char)(pix >> b_shift);
+  if (!rehash) {
+    for (i = 0; i < t->paletteNumColors; i++)
+      t->palette.entry[i].listNode->idx = i;
+    return;
+  }
+
+  memset(t->palette.hash, 0, 256 * sizeof(COLOR_LIST *));
+  for (i = t->paletteNumColors - 1; i >= 0; i--) {
+    COLOR_LIST *pnode = t->palette.entry[i].listNode;
+
+    pnode->idx = i;
+    hash_key = (bpp == 16) ? HASH_FUNC16(pnode->rgb) : HASH_FUNC32(pnode->rgb);
+    pnode->next = t->palette.hash[hash_key];
+    t->palette.hash[hash_key] = pnode;
   }
 }
 
 
+/*
+ * Converting 32-bit color samples into 24-bit colors.
+ * Should be called only when redMax, greenMax and blueMax are 255.
+ * Color components assumed to be byte-aligned.
+ */
+
+static void Pack24(char *buf, rfbPixelFormat *fmt, int count)
+{
+  rfbPack24(buf, fmt, rfbServerFormat.bigEndian, count);
+}
+
+
 /*
  * Converting truecolor samples into palette indices.
  */
@@ -0,0 +1,452 @@
+/*
+ * tilecache.c - content-addressed tile cache
+ */
+
+/*
+ *  Copyright (C) 2026 agent.  All Rights Reserved.
+ *
+ *  This is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This software is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this software; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ *  USA.
+ */
+
+/*
+ * A client that sends one of the rfbEncodingTileCache* pseudo-encodings keeps
+ * a cache of recently-sent tiles, so content that reappears (for instance,
+ * when switching between windows or scrolling back through a document) can
+ * be redrawn without re-encoding it.
+ *
+ * The server divides the client's framebuffer into a grid of
+ * rfbTileCacheTileSize x rfbTileCacheTileSize tiles.  Before encoding an
+ * update, it computes a 64-bit hash of each tile that lies completely within
+ * the update region.  If a tile with the same hash and dimensions is already
+ * in the client's cache, then the tile is removed from the update region, and
+ * a TileCacheRef rectangle is sent instead of the pixels.  Otherwise, the
+ * least recently used slot is reassigned to the tile, and a TileCacheStore
+ * rectangle is sent after the pixels, so the client copies the decoded tile
+ * into the slot.  The server only keeps the hash of each slot, not its
+ * pixels, so the memory usage of the server is small even if the client's
+ * cache is large.
+ *
+ * Solid tiles are not cached, since the Tight encoder already sends them very
+ * efficiently.
+ *
+ * If automatic lossless refresh is enabled, then the server also remembers
+ * whether each slot contains lossy pixels.  Drawing a lossy slot adds the
+ * tile to the client's lossy region, and the next lossless refresh encodes
+ * the tile again and stores the lossless version in the same slot.
+ */
+
+#ifdef HAVE_DIX_CONFIG_H
+#include <dix-config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "rfb.h"
+
+
+typedef struct {
+  unsigned long long hash;
+  int prev, next;                   /* LRU list (most recently used first) */
+  int hashNext;                     /* next slot in the same hash bucket */
+  Bool used;
+  Bool lossy;                       /* slot contains lossy pixels */
+} TileCacheSlot;
+
+typedef struct {
+  BoxRec box;
+  int slot;
+  Bool store;
+} TileCacheOp;
+
+typedef struct _rfbTileCache {
+  int nSlots;
+  TileCacheSlot *slots;
+  int *buckets, bucketMask;
+  int lruHead, lruTail;
+  TileCacheOp *ops;                 /* operations for the current update */
+  int nOps, maxOps;
+} rfbTileCache;
+
+
+static void LRUUnlink(rfbTileCache *tc, int i)
+{
+  TileCacheSlot *s = &tc->slots[i];
+
+  if (s->prev >= 0) tc->slots[s->prev].next = s->next;
+  else tc->lruHead = s->next;
+  if (s->next >= 0) tc->slots[s->next].prev = s->prev;
+  else tc->lruTail = s->prev;
+}
+
+
+static void LRUPushFront(rfbTileCache *tc, int i)
+{
+  TileCacheSlot *s = &tc->slots[i];
+
+  s->prev = -1;
+  s->next = tc->lruHead;
+  if (tc->lruHead >= 0) tc->slots[tc->lruHead].prev = i;
+  else tc->lruTail = i;
+  tc->lruHead = i;
+}
+
+
+static void LRUTouch(rfbTileCache *tc, int i)
+{
+  if (tc->lruHead == i) return;
+  LRUUnlink(tc, i);
+  LRUPushFront(tc, i);
+}
+
+
+static void HashInsert(rfbTileCache *tc, int i)
+{
+  int *bucket = &tc->buckets[tc->slots[i].hash & tc->bucketMask];
+
+  tc->slots[i].hashNext = *bucket;
+  *bucket = i;
+}
+
+
+static void HashRemove(rfbTileCache *tc, int i)
+{
+  int *link = &tc->buckets[tc->slots[i].hash & tc->bucketMask];
+
+  while (*link >= 0) {
+    if (*link == i) {
+      *link = tc->slots[i].hashNext;
+      return;
+    }
+    link = &tc->slots[*link].hashNext;
+  }
+}
+
+
+static int HashLookup(rfbTileCache *tc, unsigned long long hash)
+{
+  int i = tc->buckets[hash & tc->bucketMask];
+
+  while (i >= 0 && tc->slots[i].hash != hash)
+    i = tc->slots[i].hashNext;
+  return i;
+}
+
+
+/*
+ * Compute the hash of a tile in the client's framebuffer.  Returns FALSE if
+ * the tile is a solid color.  The dimensions of the tile are part of the
+ * hash, so a partial tile at the edge of the framebuffer can never match a
+ * full tile.
+ */
+
+#define HASH_MIX(h, v) {  \
+  (h) ^= (v);  \
+  (h) *= 0x9E3779B97F4A7C15ULL;  \
+  (h) ^= (h) >> 32;  \
+}
+
+static Bool HashTile(rfbClientPtr cl, BoxPtr box, unsigned long long *hash)
+{
+  int pitch = rfbFB.paddedWidthInBytes, ps = rfbFB.bitsPerPixel / 8;
+  int w = box->x2 - box->x1, h = box->y2 - box->y1, rowBytes = w * ps;
+  char *row = &cl->fb[box->y1 * pitch + box->x1 * ps], *firstRow = row;
+  unsigned long long hv = 0xCBF29CE484222325ULL;
+  Bool solid = TRUE;
+  int x, y;
+
+  HASH_MIX(hv, ((unsigned long long)w << 32) | h);
+
+  for (x = ps; x < rowBytes; x += ps) {
+    if (memcmp(&row[x], row, ps)) {
+      solid = FALSE;
+      break;
+    }
+  }
+
+  for (y = 0; y < h; y++, row += pitch) {
+    unsigned long long v;
+
+    if (solid && y > 0 && memcmp(row, firstRow, rowBytes))
+      solid = FALSE;
+    for (x = 0; x <= rowBytes - 8; x += 8) {
+      memcpy(&v, &row[x], 8);
+      HASH_MIX(hv, v);
+    }
+    if (x < rowBytes) {
+      v = 0;
+      memcpy(&v, &row[x], rowBytes - x);
+      HASH_MIX(hv, v);
+    }
+  }
+
+  *hash = hv;
+  return !solid;
+}
+
+
+/*
+ * Enable the tile cache for a client, or change its size.  The cache starts
+ * out empty, since the server has no way of knowing what the client's cache
+ * contains.
+ */
+
+Bool rfbTileCacheInit(rfbClientPtr cl, int nSlots)
+{
+  rfbTileCache *tc;
+  int nBuckets = 1;
+
+  if (cl->tileCache && cl->tileCache->nSlots == nSlots) return TRUE;
+  rfbTileCacheFree(cl);
+
+  while (nBuckets < nSlots * 2) nBuckets <<= 1;
+
+  if ((tc = (rfbTileCache *)calloc(1, sizeof(rfbTileCache))) == NULL ||
+      (tc->slots =
+       (TileCacheSlot *)malloc(nSlots * sizeof(TileCacheSlot))) == NULL ||
+      (tc->buckets = (int *)malloc(nBuckets * sizeof(int))) == NULL) {
+    rfbLogPerror("rfbTileCacheInit: couldn't allocate tile cache");
+    if (tc) {
+      free(tc->slots);
+      free(tc);
+    }
+    return FALSE;
+  }
+  tc->nSlots = nSlots;
+  tc->bucketMask = nBuckets - 1;
+  cl->tileCache = tc;
+  rfbTileCacheReset(cl);
+
+  rfbLog("Enabling tile cache (%d tiles) for client %s\n", nSlots, cl->host);
+  return TRUE;
+}
+
+
+void rfbTileCacheFree(rfbClientPtr cl)
+{
+  rfbTileCache *tc = cl->tileCache;
+
+  if (!tc) return;
+  free(tc->slots);
+  free(tc->buckets);
+  free(tc->ops);
+  free(tc);
+  cl->tileCache = NULL;
+}
+
+
+/*
+ * Forget the contents of all slots.  This is called when the client's pixel
+ * format changes, since the client's copies of the tiles may no longer match
+ * what it would receive in the new pixel format.
+ */
+
+void rfbTileCacheReset(rfbClientPtr cl)
+{
+  rfbTileCache *tc = cl->tileCache;
+  int i;
+
+  if (!tc) return;
+  for (i = 0; i <= tc->bucketMask; i++)
+    tc->buckets[i] = -1;
+  for (i = 0; i < tc->nSlots; i++) {
+    tc->slots[i].prev = i - 1;
+    tc->slots[i].next = i < tc->nSlots - 1 ? i + 1 : -1;
+    tc->slots[i].hashNext = -1;
+    tc->slots[i].used = tc->slots[i].lossy = FALSE;
+  }
+  tc->lruHead = 0;
+  tc->lruTail = tc->nSlots - 1;
+  tc->nOps = 0;
+}
+
+
+static Bool GrowOps(rfbTileCache *tc)
+{
+  int maxOps = max(tc->maxOps * 2, 256);
+  TileCacheOp *ops =
+    (TileCacheOp *)realloc(tc->ops, maxOps * sizeof(TileCacheOp));
+
+  if (!ops) return FALSE;
+  tc->ops = ops;
+  tc->maxOps = maxOps;
+  return TRUE;
+}
+
+
+static void AddOp(rfbTileCache *tc, BoxPtr box, int slot, Bool store)
+{
+  tc->ops[tc->nOps].box = *box;
+  tc->ops[tc->nOps].slot = slot;
+  tc->ops[tc->nOps].store = store;
+  tc->nOps++;
+}
+
+
+/*
+ * Look up each complete tile in the update region (which is in client
+ * coordinates.)  Tiles that the client already has are removed from the
+ * update region.  Returns the number of TileCacheStore and TileCacheRef
+ * rectangles that rfbTileCacheSendOps() will send.
+ */
+
+int rfbTileCacheProcessRegion(rfbClientPtr cl, RegionPtr updateRegion)
+{
+  ScreenPtr pScreen = screenInfo.screens[0];
+  rfbTileCache *tc = cl->tileCache;
+  const int ts = rfbTileCacheTileSize;
+  int cw = rfbClientWidth(cl), ch = rfbClientHeight(cl), tx, ty;
+  /* During the final pass of a lossless refresh, a lossy slot must not be
+     used, since the purpose of the refresh is to replace lossy pixels. */
+  Bool lossless = cl->inALR && !cl->alrPrelimPass;
+  RegionRec hitRegion;
+  BoxRec extents;
+
+  if (!tc) return 0;
+  tc->nOps = 0;
+  if (!REGION_NOTEMPTY(pScreen, updateRegion)) return 0;
+
+  extents = *REGION_EXTENTS(pScreen, updateRegion);
+  REGION_INIT(pScreen, &hitRegion, NullBox, 0);
+
+  for (ty = extents.y1 / ts * ts; ty < extents.y2; ty += ts) {
+    for (tx = extents.x1 / ts * ts; tx < extents.x2; tx += ts) {
+      BoxRec box;
+      unsigned long long hash;
+      int slot;
+
+      box.x1 = tx;  box.y1 = ty;
+      box.x2 = min(tx + ts, cw);  box.y2 = min(ty + ts, ch);
+      if (box.x2 <= box.x1 || box.y2 <= box.y1 ||
+          RECT_IN_REGION(pScreen, updateRegion, &box) != rgnIN)
+        continue;
+      if (!HashTile(cl, &box, &hash))
+        continue;
+      if (tc->nOps >= tc->maxOps && !GrowOps(tc))
+        goto done;
+
+      slot = HashLookup(tc, hash);
+      if (slot >= 0 && !(lossless && tc->slots[slot].lossy)) {
+        RegionRec tmpRegion;
+
+        AddOp(tc, &box, slot, FALSE);
+        LRUTouch(tc, slot);
+        REGION_INIT(pScreen, &tmpRegion, &box, 1);
+        REGION_UNION(pScreen, &hitRegion, &hitRegion, &tmpRegion);
+        REGION_UNINIT(pScreen, &tmpRegion);
+      } else {
+        if (slot < 0) {
+          slot = tc->lruTail;
+          if (tc->slots[slot].used)
+            HashRemove(tc, slot);
+          tc->slots[slot].hash = hash;
+          tc->slots[slot].used = TRUE;
+          HashInsert(tc, slot);
+        }
+        AddOp(tc, &box, slot, TRUE);
+        LRUTouch(tc, slot);
+      }
+    }
+  }
+
+done:
+  REGION_SUBTRACT(pScreen, updateRegion, updateRegion, &hitRegion);
+  REGION_UNINIT(pScreen, &hitRegion);
+
+  return tc->nOps;
+}
+
+
+/*
+ * Send the TileCacheStore and TileCacheRef rectangles for the current update.
+ * This must be called after all of the pixel data in the update has been
+ * sent, so the client has the tiles that it is being asked to store.
+ */
+
+Bool rfbTileCacheSendOps(rfbClientPtr cl)
+{
+  ScreenPtr pScreen = screenInfo.screens[0];
+  rfbTileCache *tc = cl->tileCache;
+  int i;
+
+  if (!tc) return TRUE;
+
+  for (i = 0; i < tc->nOps; i++) {
+    TileCacheOp *op = &tc->ops[i];
+    TileCacheSlot *s = &tc->slots[op->slot];
+    rfbFramebufferUpdateRectHeader rect;
+    rfbTileCacheRect tcr;
+    int w = op->box.x2 - op->box.x1, h = op->box.y2 - op->box.y1;
+
+    if (ublen + sz_rfbFramebufferUpdateRectHeader + sz_rfbTileCacheRect >
+        UPDATE_BUF_SIZE) {
+      if (!rfbSendUpdateBuf(cl))
+        return FALSE;
+    }
+
+    rect.r.x = Swap16IfLE(op->box.x1);
+    rect.r.y = Swap16IfLE(op->box.y1);
+    rect.r.w = Swap16IfLE(w);
+    rect.r.h = Swap16IfLE(h);
+    rect.encoding = Swap32IfLE(op->store ? rfbEncodingTileCacheStore :
+                               rfbEncodingTileCacheRef);
+    tcr.slot = Swap32IfLE(op->slot);
+
+    memcpy(&updateBuf[ublen], (char *)&rect,
+           sz_rfbFramebufferUpdateRectHeader);
+    ublen += sz_rfbFramebufferUpdateRectHeader;
+    memcpy(&updateBuf[ublen], (char *)&tcr, sz_rfbTileCacheRect);
+    ublen += sz_rfbTileCacheRect;
+
+    if (op->store) {
+      cl->rfbTileCacheStoresSent++;
+    } else {
+      cl->rfbTileCacheHits++;
+      cl->rfbRawBytesEquivalent += (sz_rfbFramebufferUpdateRectHeader +
+                                    w * (cl->format.bitsPerPixel / 8) * h);
+    }
+    cl->rfbTileCacheBytesSent +=
+      sz_rfbFramebufferUpdateRectHeader + sz_rfbTileCacheRect;
+
+    if (rfbAutoLosslessRefresh > 0.0) {
+      /* The lossy region is in framebuffer coordinates. */
+      BoxRec fbBox = op->box;
+      RegionRec tmpRegion;
+
+      rfbScaleBox(cl, &fbBox, TRUE);
+      if (op->store) {
+        /* The encoder has already updated the lossy region to reflect the
+           pixels that were just sent. */
+        s->lossy = RECT_IN_REGION(pScreen, &cl->lossyRegion, &fbBox) !=
+                   rgnOUT;
+      } else {
+        REGION_INIT(pScreen, &tmpRegion, &fbBox, 1);
+        if (s->lossy) {
+          REGION_UNION(pScreen, &cl->lossyRegion, &cl->lossyRegion,
+                       &tmpRegion);
+          REGION_UNION(pScreen, &cl->alrEligibleRegion,
+                       &cl->alrEligibleRegion, &tmpRegion);
+        } else
+          REGION_SUBTRACT(pScreen, &cl->lossyRegion, &cl->lossyRegion,
+                          &tmpRegion);
+        REGION_UNINIT(pScreen, &tmpRegion);
+      }
+    }
+  }
+
+  tc->nOps = 0;
+  return TRUE;
+}
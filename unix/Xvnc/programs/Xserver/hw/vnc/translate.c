@@ -25,6 +25,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include "rfb.h"
+#include "fasttranslate.h"
 
 static void PrintPixelFormat(rfbPixelFormat *pf);
 static Bool rfbSetClientColourMapBGR233(rfbClientPtr cl);
@@ -288,6 +289,13 @@ Bool rfbSetTranslateFunction(rfbClientPtr cl)
     (*rfbInitTrueColourSingleTableFns[cl->format.bitsPerPixel / 16])
       (&cl->translateLookupTable, &rfbServerFormat, &cl->format);
 
+  } else if ((cl->translateFn =
+              rfbGetFastTranslateFn(&rfbServerFormat, &cl->format)) != NULL) {
+
+    /* 8-bit components can be translated without using lookup tables */
+
+    rfbLog("  using direct translation\n");
+
   } else {
 
     /* otherwise we use three separate tables for red, green and blue */
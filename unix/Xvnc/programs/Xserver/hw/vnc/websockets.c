@@ -332,6 +332,28 @@ static int ws_read(void *ctxPtr, char *buf, size_t len)
 }
 
 
+/* Write a frame header for a payload of blen bytes, and return the length of
+   the header */
+
+static int webSocketsFrameHeader(ws_header_t *header, unsigned char opcode,
+                                 int blen)
+{
+  header->b0 = 0x80 | (opcode & 0x0f);
+  if (blen <= 125) {
+    header->b1 = (uint8_t)blen;
+    return 2;
+  } else if (blen <= 65535) {
+    header->b1 = 0x7e;
+    header->u.s16.l16 = WS_HTON16((uint16_t)blen);
+    return 4;
+  } else {
+    header->b1 = 0x7f;
+    header->u.s64.l64 = WS_HTON64(blen);
+    return 10;
+  }
+}
+
+
 static int webSocketsEncodeHybi(rfbClientPtr cl, const char *src, int len,
                                 char **dst)
 {
@@ -374,19 +396,7 @@ static int webSocketsEncodeHybi(rfbClientPtr cl, const char *src, int len,
     blen = len;
   }
 
-  header->b0 = 0x80 | (opcode & 0x0f);
-  if (blen <= 125) {
-    header->b1 = (uint8_t)blen;
-    sz = 2;
-  } else if (blen <= 65536) {
-    header->b1 = 0x7e;
-    header->u.s16.l16 = WS_HTON16((uint16_t)blen);
-    sz = 4;
-  } else {
-    header->b1 = 0x7f;
-    header->u.s64.l64 = WS_HTON64(blen);
-    sz = 10;
-  }
+  sz = webSocketsFrameHeader(header, opcode, blen);
 
   if (wsctx->base64) {
     if (-1 == (ret = rfbBase64NtoP((unsigned char *)src, len,
@@ -409,6 +419,33 @@ static int webSocketsEncodeHybi(rfbClientPtr cl, const char *src, int len,
 }
 
 
+/*
+ * webSocketsEncodeHeader() writes the header of a binary frame containing len
+ * bytes of payload and returns the length of the header.  This allows the
+ * caller to send the header and the original payload buffer using a single
+ * gathered write, rather than copying the payload into the encode buffer.  If
+ * the payload must be base64-encoded, or if the connection is encrypted (in
+ * which case the header and the payload should be passed to the TLS
+ * implementation as one record), then 0 is returned, and the caller must use
+ * webSocketsEncode() instead.
+ */
+
+int webSocketsEncodeHeader(rfbClientPtr cl, int len, char *header)
+{
+  ws_ctx_t *wsctx = (ws_ctx_t *)cl->wsctx;
+
+  if (wsctx->base64 || len <= 0)
+    return 0;
+#ifdef USETLS
+  if (cl->sslctx)
+    return 0;
+#endif
+
+  return webSocketsFrameHeader((ws_header_t *)header, WS_OPCODE_BINARY_FRAME,
+                               len);
+}
+
+
 int webSocketsEncode(rfbClientPtr cl, const char *src, int len, char **dst)
 {
   return webSocketsEncodeHybi(cl, src, len, dst);
@@ -29,6 +29,9 @@
 
 #include <string.h>
 #include <errno.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #define WS_HYBI_MASK_LEN 4
 #define WS_HYBI_HEADER_LEN_SHORT 2 + WS_HYBI_MASK_LEN
@@ -164,23 +167,30 @@ hybiReadHeader(ws_ctx_t *wsctx, int *sockRet, int *nPayload)
   int i;
 
 
-  ws_dbg("header_read to %p with len=%d\n", headerDst, n);
-  ret = wsctx->ctxInfo.readFunc(wsctx->ctxInfo.ctxPtr, headerDst, n);
-  ws_dbg("read %d bytes from socket\n", ret);
-  if (ret <= 0) {
-    if (-1 == ret) {
-      /* save errno because rfbLog() will tamper it */
-      int olderrno = errno;
-      rfbLog("%s: read; %s\n", __func__, strerror(errno));
-      errno = olderrno;
-      goto err_cleanup_state;
-    } else {
-      *sockRet = 0;
-      goto err_cleanup_state_sock_closed;
+  /* The header may already be partially read if a previous call ran out of
+     data (in which case the remainder is read below.) */
+  ret = 0;
+  if (n > 0) {
+    ws_dbg("header_read to %p with len=%d\n", headerDst, n);
+    ret = wsctx->ctxInfo.readFunc(wsctx->ctxInfo.ctxPtr, headerDst, n);
+    ws_dbg("read %d bytes from socket\n", ret);
+    if (ret <= 0) {
+      if (-1 == ret) {
+        /* save errno because rfbLog() will tamper it */
+        int olderrno = errno;
+        if (olderrno == EAGAIN || olderrno == EWOULDBLOCK)
+          goto ret_header_pending;
+        rfbLog("%s: read; %s\n", __func__, strerror(errno));
+        errno = olderrno;
+        goto err_cleanup_state;
+      } else {
+        *sockRet = 0;
+        goto err_cleanup_state_sock_closed;
+      }
     }
-  }
 
-  wsctx->header.nRead += ret;
+    wsctx->header.nRead += ret;
+  }
   if (wsctx->header.nRead < 2) {
     /* cannot decode header with less than two bytes */
     goto ret_header_pending;
@@ -253,8 +263,11 @@ hybiReadHeader(ws_ctx_t *wsctx, int *sockRet, int *nPayload)
     } else if (wsctx->header.payloadLen == 127) {
       n = ((uint64_t)WS_HYBI_HEADER_LEN_LONG) - wsctx->header.nRead;
     }
-    ret = wsctx->ctxInfo.readFunc(wsctx->ctxInfo.ctxPtr, headerDst, n);
-    if (ret <= 0) {
+    ret = n > 0 ?
+      wsctx->ctxInfo.readFunc(wsctx->ctxInfo.ctxPtr, headerDst, n) : 0;
+    if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+      goto ret_header_pending;
+    if (ret <= 0 && n > 0) {
       if (-1 == ret) {
         /* save errno because rfbLog() will tamper it */
         int olderrno = errno;
@@ -344,6 +357,39 @@ hybiPayloadStart(ws_ctx_t *wsctx)
 }
 
 
+/**
+ * Unmask payload data in place.  The data must start on a masking key
+ * boundary, i.e. at a payload offset that is a multiple of 4.
+ *
+ * @param[in,out] data payload data
+ * @param[in]     len  number of bytes to unmask
+ * @param[in]     mask masking key
+ */
+static void
+hybiUnmask(unsigned char *data, int len, ws_mask_t mask)
+{
+  uint64_t mask64 = ((uint64_t)mask.u << 32) | mask.u;
+  int i = 0;
+
+#ifdef __SSE2__
+  __m128i mask128 = _mm_set1_epi32((int)mask.u);
+
+  for (; i + 16 <= len; i += 16) {
+    __m128i tmp = _mm_loadu_si128((__m128i *)(data + i));
+    _mm_storeu_si128((__m128i *)(data + i), _mm_xor_si128(tmp, mask128));
+  }
+#endif
+  for (; i + 8 <= len; i += 8) {
+    uint64_t tmp;
+    memcpy(&tmp, data + i, sizeof(tmp));
+    tmp ^= mask64;
+    memcpy(data + i, &tmp, sizeof(tmp));
+  }
+  for (; i < len; i++)
+    data[i] ^= mask.c[i & 3];
+}
+
+
 /**
  * Read the remaining payload bytes from associated raw socket.
  *
@@ -400,10 +446,16 @@ hybiReadAndDecode(ws_ctx_t *wsctx, char *dst, int len, int *sockRet, int nInBuf)
     /* decode more data */
     if (-1 == (n = wsctx->ctxInfo.readFunc(wsctx->ctxInfo.ctxPtr, wsctx->writePos, nextRead))) {
       int olderrno = errno;
-      rfbLog("%s: read; %s", __func__, strerror(errno));
-      errno = olderrno;
-      *sockRet = -1;
-      return WS_HYBI_STATE_ERR;
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        rfbLog("%s: read; %s", __func__, strerror(errno));
+        errno = olderrno;
+        *sockRet = -1;
+        return WS_HYBI_STATE_ERR;
+      }
+      /* The rest of the frame has not arrived yet.  Decode whatever was
+       * carried over or read along with the header, and keep the decoding
+       * state so that the next call can resume the frame. */
+      n = 0;
     } else if (n == 0) {
       *sockRet = 0;
       return WS_HYBI_STATE_ERR;
@@ -436,20 +488,14 @@ hybiReadAndDecode(ws_ctx_t *wsctx, char *dst, int len, int *sockRet, int nInBuf)
    * the whole frame is received and carry over any remaining bytes in the carry buf*/
   data = (unsigned char *)(wsctx->writePos - toDecode);
 
-  for (i = 0; i < (toDecode >> 2); i++) {
-    uint32_t tmp;
-    memcpy(&tmp, data + i * sizeof(tmp), sizeof(tmp));
-    tmp ^= wsctx->header.mask.u;
-    memcpy(data + i * sizeof(tmp), &tmp, sizeof(tmp));
-  }
+  i = toDecode >> 2;
+  if (wsctx->hybiDecodeState == WS_HYBI_STATE_FRAME_COMPLETE)
+    hybiUnmask(data, toDecode, wsctx->header.mask);
+  else
+    hybiUnmask(data, i * 4, wsctx->header.mask);
   ws_dbg("mask decoding; i=%d toDecode=%d\n", i, toDecode);
 
   if (wsctx->hybiDecodeState == WS_HYBI_STATE_FRAME_COMPLETE) {
-    /* process the remaining bytes (if any) */
-    for (i*=4; i < toDecode; i++) {
-      data[i] ^= wsctx->header.mask.c[i % 4];
-    }
-
     /* all data is here, no carrying */
     wsctx->carrylen = 0;
   } else {
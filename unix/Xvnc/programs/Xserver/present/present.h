@@ -190,4 +190,10 @@ present_register_complete_notify(present_complete_notify_proc proc);
 extern _X_EXPORT Bool
 present_can_window_flip(WindowPtr window);
 
+/* Change the interval (in microseconds) of the fake vblank clock that is used
+ * for screens without hardware vblank support.
+ */
+extern _X_EXPORT void
+present_fake_set_interval(ScreenPtr screen, uint32_t interval);
+
 #endif /* _PRESENT_H_ */
@@ -177,6 +177,13 @@ present_send_complete_notify(WindowPtr window, CARD8 kind, CARD8 mode, CARD32 se
     }
     if (complete_notify)
         (*complete_notify)(window, kind, mode, serial, ust, msc);
+#ifdef TURBOVNC
+    if (kind == PresentCompleteKindPixmap &&
+        mode != PresentCompleteModeSkip) {
+        extern void rfbFrameComplete(WindowPtr pWin);
+        rfbFrameComplete(window);
+    }
+#endif
 }
 
 void
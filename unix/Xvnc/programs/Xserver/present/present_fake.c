@@ -42,7 +42,9 @@ present_fake_get_ust_msc(ScreenPtr screen, uint64_t *ust, uint64_t *msc)
     present_screen_priv_ptr screen_priv = present_screen_priv(screen);
 
     *ust = GetTimeInMicros();
-    *msc = (*ust + screen_priv->fake_interval / 2) / screen_priv->fake_interval;
+    *msc = screen_priv->fake_base_msc +
+        (*ust - screen_priv->fake_base_ust + screen_priv->fake_interval / 2) /
+        screen_priv->fake_interval;
     return Success;
 }
 
@@ -90,11 +92,17 @@ present_fake_queue_vblank(ScreenPtr     screen,
                           uint64_t      msc)
 {
     present_screen_priv_ptr     screen_priv = present_screen_priv(screen);
-    uint64_t                    ust = msc * screen_priv->fake_interval;
+    uint64_t                    ust;
     uint64_t                    now = GetTimeInMicros();
-    INT32                       delay = ((int64_t) (ust - now)) / 1000;
+    INT32                       delay;
     present_fake_vblank_ptr     fake_vblank;
 
+    if (msc < screen_priv->fake_base_msc)
+        msc = screen_priv->fake_base_msc;
+    ust = screen_priv->fake_base_ust +
+        (msc - screen_priv->fake_base_msc) * screen_priv->fake_interval;
+    delay = ((int64_t) (ust - now)) / 1000;
+
     if (delay <= 0) {
         present_fake_notify(screen, event_id);
         return Success;
@@ -134,6 +142,30 @@ present_fake_screen_init(ScreenPtr screen)
         screen_priv->fake_interval = 16667;
 }
 
+/*
+ * Change the rate of the fake vblank clock.  The clock is rebased at the
+ * current time, so the MSC never jumps backward.
+ */
+void
+present_fake_set_interval(ScreenPtr screen, uint32_t interval)
+{
+    present_screen_priv_ptr screen_priv;
+    uint64_t ust, msc;
+
+    if (!dixPrivateKeyRegistered(&present_screen_private_key) ||
+        interval == 0)
+        return;
+
+    screen_priv = present_screen_priv(screen);
+    if (!screen_priv || screen_priv->fake_interval == interval)
+        return;
+
+    present_fake_get_ust_msc(screen, &ust, &msc);
+    screen_priv->fake_base_ust = ust;
+    screen_priv->fake_base_msc = msc;
+    screen_priv->fake_interval = interval;
+}
+
 void
 present_fake_queue_init(void)
 {
@@ -153,6 +153,8 @@ struct present_screen_priv {
     uint64_t                    unflip_event_id;
 
     uint32_t                    fake_interval;
+    uint64_t                    fake_base_ust;
+    uint64_t                    fake_base_msc;
 
     /* Currently active flipped pixmap and fence */
     RRCrtcPtr                   flip_crtc;
@@ -0,0 +1,267 @@
+/* Copyright (C) 2026 agent.  All Rights Reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ */
+
+/*
+ * translatebench - microbenchmark for the TurboVNC Server's pixel format
+ * translation routines
+ *
+ * For each of the common client pixel formats, translatebench translates a
+ * 32-bit depth-24 framebuffer using both the table-driven method that the
+ * TurboVNC Server uses as a fallback (reimplemented here, since translate.c
+ * depends on the X server) and the direct method in fasttranslate.c.  It
+ * verifies that both methods produce identical output and reports the
+ * throughput of each.  It similarly compares rfbPack24(), which the Tight
+ * encoder uses to send 24-bit pixels, with the original implementation of that
+ * function.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <X11/Xmd.h>
+#include "rfbproto.h"
+#include "fasttranslate.h"
+
+
+/* The byte order of each client pixel format is set at run time, relative
+   to the byte order of the host. */
+
+typedef struct {
+  const char *name;
+  rfbPixelFormat pf;
+  int swapped, pack24;
+} Test;
+
+#define RGB888  { 32, 24, 0, 1, 255, 255, 255, 16, 8, 0, 0, 0 }
+
+static Test tests[] = {
+  { "32 -> 16 (RGB565)", { 16, 16, 0, 1, 31, 63, 31, 11, 5, 0, 0, 0 }, 0, 0 },
+  { "32 -> 16 (RGB555)", { 16, 15, 0, 1, 31, 31, 31, 10, 5, 0, 0, 0 }, 0, 0 },
+  { "32 -> 8 (BGR233)", { 8, 8, 0, 1, 7, 7, 3, 0, 3, 6, 0, 0 }, 0, 0 },
+  { "32 -> 24 (packed RGB)", RGB888, 0, 1 },
+  { "32 -> 32 (byte-swapped)", RGB888, 1, 0 },
+  { "32 -> 32 (BGR)", { 32, 24, 0, 1, 255, 255, 255, 0, 8, 16, 0, 0 }, 0, 0 },
+  { NULL }
+};
+
+static int bigEndian;
+
+
+static double gettime(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1000000000.;
+}
+
+
+/*
+ * These replicate rfbInitTrueColourRGBTables*() and
+ * rfbTranslateWithRGBTables32to*() in translate.c.
+ */
+
+static CARD32 swap(CARD32 x, int bpp)
+{
+  if (bpp == 16)
+    return ((x & 0xff) << 8) | ((x >> 8) & 0xff);
+  else if (bpp == 32)
+    return ((x & 0xff000000) >> 24) | ((x & 0x00ff0000) >> 8) |
+           ((x & 0x0000ff00) << 8) | ((x & 0x000000ff) << 24);
+  return x;
+}
+
+
+static void initTables(CARD32 *table, rfbPixelFormat *in, rfbPixelFormat *out)
+{
+  int i, doSwap = (out->bigEndian != in->bigEndian);
+  int outMax[3] = { out->redMax, out->greenMax, out->blueMax };
+  int outShift[3] = { out->redShift, out->greenShift, out->blueShift };
+  int c;
+
+  for (c = 0; c < 3; c++) {
+    for (i = 0; i < 256; i++) {
+      table[c * 256 + i] = ((i * outMax[c] + 127) / 255) << outShift[c];
+      if (doSwap) table[c * 256 + i] = swap(table[c * 256 + i],
+                                            out->bitsPerPixel);
+    }
+  }
+}
+
+
+static void translateWithTables(CARD32 *table, rfbPixelFormat *in,
+                                rfbPixelFormat *out, CARD32 *ip, char *optr,
+                                int width, int height)
+{
+  CARD32 *redTable = table, *greenTable = table + 256,
+    *blueTable = table + 512, pix;
+  int i, n = width * height;
+
+  for (i = 0; i < n; i++) {
+    pix = redTable[(ip[i] >> in->redShift) & 255] |
+          greenTable[(ip[i] >> in->greenShift) & 255] |
+          blueTable[(ip[i] >> in->blueShift) & 255];
+    switch (out->bitsPerPixel) {
+      case 8:
+        ((CARD8 *)optr)[i] = (CARD8)pix;  break;
+      case 16:
+        ((CARD16 *)optr)[i] = (CARD16)pix;  break;
+      case 32:
+        ((CARD32 *)optr)[i] = pix;  break;
+    }
+  }
+}
+
+
+/* This is the Pack24() function from tight.c prior to TurboVNC 3.0. */
+
+static void pack24Bytes(char *buf, rfbPixelFormat *fmt, int count)
+{
+  CARD32 *buf32 = (CARD32 *)buf;
+  CARD32 pix;
+  int r_shift, g_shift, b_shift;
+
+  if (!bigEndian == !fmt->bigEndian) {
+    r_shift = fmt->redShift;
+    g_shift = fmt->greenShift;
+    b_shift = fmt->blueShift;
+  } else {
+    r_shift = 24 - fmt->redShift;
+    g_shift = 24 - fmt->greenShift;
+    b_shift = 24 - fmt->blueShift;
+  }
+
+  while (count--) {
+    pix = *buf32++;
+    *buf++ = (char)(pix >> r_shift);
+    *buf++ = (char)(pix >> g_shift);
+    *buf++ = (char)(pix >> b_shift);
+  }
+}
+
+
+static void usage(char *programName)
+{
+  fprintf(stderr, "\nUSAGE: %s [options]\n\n", programName);
+  fprintf(stderr, "Options:\n");
+  fprintf(stderr, "-size <w>x<h> = size of the source image (default: 1920x1080)\n");
+  fprintf(stderr, "-time <t> = run each test for at least <t> seconds (default: 1.0)\n\n");
+  exit(1);
+}
+
+
+int main(int argc, char **argv)
+{
+  int width = 1920, height = 1080, i, n, iter, retval = 0;
+  double benchTime = 1.0, start, elapsed, mpixels[2];
+  rfbPixelFormat serverFormat = RGB888;
+  CARD32 *src, *table, one = 1;
+  char *dst[2];
+  rfbFastTranslateFnType fastFn = NULL;
+  Test *test;
+
+  for (i = 1; i < argc; i++) {
+    if (!strcasecmp(argv[i], "-size") && i < argc - 1) {
+      if (sscanf(argv[++i], "%dx%d", &width, &height) != 2 || width < 1 ||
+          height < 1)
+        usage(argv[0]);
+    } else if (!strcasecmp(argv[i], "-time") && i < argc - 1) {
+      if ((benchTime = atof(argv[++i])) <= 0.0) usage(argv[0]);
+    } else
+      usage(argv[0]);
+  }
+
+  bigEndian = !*(char *)&one;
+  serverFormat.bigEndian = bigEndian;
+  for (test = tests; test->name; test++)
+    test->pf.bigEndian = test->swapped ? !bigEndian : bigEndian;
+
+  n = width * height;
+  if ((src = (CARD32 *)malloc(n * 4)) == NULL ||
+      (dst[0] = (char *)malloc(n * 4)) == NULL ||
+      (dst[1] = (char *)malloc(n * 4)) == NULL ||
+      (table = (CARD32 *)malloc(256 * 3 * 4)) == NULL) {
+    fprintf(stderr, "Memory allocation failure\n");
+    return 1;
+  }
+
+  /* Use a mixture of random pixels and runs, approximating a desktop image */
+  srand(0);
+  for (i = 0; i < n; i++) {
+    if (i % 64 < 48 && i > 0)
+      src[i] = src[i - 1];
+    else
+      src[i] = ((rand() & 0xff) << 16) | ((rand() & 0xff) << 8) |
+               (rand() & 0xff);
+  }
+
+  printf("Source image: %d x %d, %s endian\n\n", width, height,
+         bigEndian ? "big" : "little");
+  printf("%-26s %14s %14s %8s\n", "Client format", "Table (Mpix/s)",
+         "Direct (Mpix/s)", "Speedup");
+
+  for (test = tests; test->name; test++) {
+    int bytes = n * (test->pack24 ? 3 : test->pf.bitsPerPixel / 8), method;
+
+    if (!test->pack24) {
+      fastFn = rfbGetFastTranslateFn(&serverFormat, &test->pf);
+      if (!fastFn) {
+        printf("%-26s  direct translation not supported\n", test->name);
+        retval = 1;
+        continue;
+      }
+      initTables(table, &serverFormat, &test->pf);
+    }
+
+    for (method = 0; method < 2; method++) {
+      iter = 0;
+      start = gettime();
+      do {
+        if (test->pack24) {
+          memcpy(dst[method], src, n * 4);
+          if (method == 0)
+            pack24Bytes(dst[method], &test->pf, n);
+          else
+            rfbPack24(dst[method], &test->pf, bigEndian, n);
+        } else {
+          if (method == 0)
+            translateWithTables(table, &serverFormat, &test->pf, src,
+                                dst[method], width, height);
+          else
+            fastFn(NULL, &serverFormat, &test->pf, (char *)src, dst[method],
+                   width * 4, width, height);
+        }
+        iter++;
+      } while ((elapsed = gettime() - start) < benchTime);
+      mpixels[method] = (double)n * iter / elapsed / 1000000.;
+    }
+
+    printf("%-26s %14.1f %14.1f %7.2fx%s\n", test->name, mpixels[0],
+           mpixels[1], mpixels[1] / mpixels[0],
+           memcmp(dst[0], dst[1], bytes) ? "  OUTPUT MISMATCH" : "");
+    if (memcmp(dst[0], dst[1], bytes)) retval = 1;
+  }
+
+  printf("\nThe 24-bit test includes the time required to copy the source "
+         "image.\n");
+
+  free(src);  free(dst[0]);  free(dst[1]);  free(table);
+  return retval;
+}
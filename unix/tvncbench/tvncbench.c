@@ -0,0 +1,1350 @@
+/* Copyright (C) 2026 agent.  All Rights Reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ */
+
+/*
+ * tvncbench - measure the end-to-end latency and frame rate of the TurboVNC
+ * Server
+ *
+ * tvncbench starts a private Xvnc instance, connects a headless RFB client to
+ * it, and draws a series of frames using one of several scripted workloads.
+ * Along with each frame, the frame number is drawn as a strip of black and
+ * white blocks (the "marker") in the upper left corner of the screen.  The
+ * headless client decodes every framebuffer update that it receives and reads
+ * back the marker, so the latency of each frame is the time between issuing
+ * the X requests that drew it and decoding the framebuffer update that made it
+ * visible.  Since the drawing and the decoding happen in the same process,
+ * both timestamps come from the same clock.
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/Xmd.h>
+#include <zlib.h>
+#include <turbojpeg.h>
+#include "rfbproto.h"
+
+
+#define MARKER_BITS  16
+#define MARKER_BLOCK  16
+#define MARKER_W  (MARKER_BITS * MARKER_BLOCK)
+#define MARKER_H  MARKER_BLOCK
+/* Bit 0 of the marker is always set, so that the initial (black) screen
+   contents are never mistaken for a frame. */
+#define MAX_FRAMES  ((1 << (MARKER_BITS - 1)) - 1)
+
+#define NUM_IMAGES  8
+#define RECV_BUF_SIZE  65536
+#define TIGHT_MIN_TO_COMPRESS  12
+
+
+typedef struct {
+  const char *name;
+  CARD32 encoding;
+  int quality, subsamp, compressLevel;
+} EncConfig;
+
+/* These correspond to the encoding method presets in the TurboVNC Viewer. */
+static const EncConfig encConfigs[] = {
+  { "tight-jpeg-lan", rfbEncodingTight, 95, rfbEncodingSubsamp1X, 1 },
+  { "tight-jpeg-med", rfbEncodingTight, 80, rfbEncodingSubsamp2X, 6 },
+  { "tight-jpeg-wan", rfbEncodingTight, 30, rfbEncodingSubsamp4X, 7 },
+  { "tight-lossless", rfbEncodingTight, -1, -1, 0 },
+  { "tight-lossless-zlib", rfbEncodingTight, -1, -1, 6 },
+  { "raw", rfbEncodingRaw, -1, -1, -1 },
+  { NULL, 0, 0, 0, 0 }
+};
+
+enum { WL_RECTS, WL_LINES, WL_TEXT, WL_IMAGE, WL_GL };
+
+static const char *workloadNames[] = {
+  "rects", "lines", "text", "image", "gl", NULL
+};
+
+
+typedef struct {
+  int fd;
+  unsigned char *buf;
+  int bufLen, bufPos;
+  unsigned long long bytes;
+
+  int width, height;
+  CARD32 *fb;
+
+  z_stream zs[4];
+  int zsActive[4];
+  unsigned char *zbuf, *dbuf;
+  int zbufSize, dbufSize;
+  tjhandle tjhnd;
+  int tjpf;
+
+  pthread_t thread;
+  volatile int stop;
+  char errorMsg[256];
+} Client;
+
+typedef struct {
+  pthread_mutex_t mutex;
+  double *issueTime;
+  int framesDrawn;
+  double *latency;
+  int framesShown, lastShown;
+  unsigned long long updates, updateBytes;
+  double decodeTime;
+} Stats;
+
+
+static char *programName;
+static pid_t xvncPid = -1, cmdPid = -1;
+static int displayNum = -1, rfbPort = -1;
+static char logFileName[256];
+static Stats stats;
+static int bigEndian;
+
+
+static void usage(void)
+{
+  int i;
+
+  fprintf(stderr, "\nUSAGE: %s [options]\n\n", programName);
+  fprintf(stderr, "Options:\n");
+  fprintf(stderr, "-xvnc <path> = path to the Xvnc binary to test (default: the Xvnc binary in\n"
+                  "               the same directory as %s, or Xvnc in the PATH)\n",
+          programName);
+  fprintf(stderr, "-display <n> = display number to use for Xvnc (default: the first free\n"
+                  "               display number, starting at 50)\n");
+  fprintf(stderr, "-geometry <w>x<h> = size of the remote desktop (default: 1240x900)\n");
+  fprintf(stderr, "-serverargs <args> = additional arguments to pass to Xvnc (for instance,\n"
+                  "                     \"-deferupdate 1\")\n");
+  fprintf(stderr, "-enc <e1,e2,...> = encoding configurations to test (default: all)\n");
+  fprintf(stderr, "-workload <w1,w2,...> = workloads to run (default: rects,lines,text,image)\n");
+  fprintf(stderr, "-glcmd <command> = command that runs an OpenGL application for the \"gl\"\n"
+                  "                   workload (default: glxspheres64)\n");
+  fprintf(stderr, "-time <t> = run each test for <t> seconds (default: 10)\n");
+  fprintf(stderr, "-fps <f> = draw at most <f> frames/second (default: 60, 0 = unlimited)\n");
+  fprintf(stderr, "-csv = print the results in comma-separated format\n\n");
+  fprintf(stderr, "Encoding configurations:\n");
+  for (i = 0; encConfigs[i].name; i++)
+    fprintf(stderr, "  %s\n", encConfigs[i].name);
+  fprintf(stderr, "\nWorkloads:\n");
+  fprintf(stderr, "  rects = random filled rectangles (x11perf -rect100)\n");
+  fprintf(stderr, "  lines = random lines (x11perf -line100)\n");
+  fprintf(stderr, "  text = scrolling text (XCopyArea + XDrawString)\n");
+  fprintf(stderr, "  image = playback of photographic images (XPutImage)\n");
+  fprintf(stderr, "  gl = the OpenGL application specified with -glcmd, running behind the\n"
+                  "       marker\n\n");
+  exit(1);
+}
+
+
+static void cleanup(void)
+{
+  if (cmdPid > 0) {
+    kill(-cmdPid, SIGTERM);
+    waitpid(cmdPid, NULL, 0);
+    cmdPid = -1;
+  }
+  if (xvncPid > 0) {
+    kill(xvncPid, SIGTERM);
+    waitpid(xvncPid, NULL, 0);
+    xvncPid = -1;
+  }
+}
+
+
+static void handler(int sig)
+{
+  cleanup();
+  _exit(1);
+}
+
+
+static void fatal(const char *format, const char *arg)
+{
+  fprintf(stderr, "%s: ", programName);
+  fprintf(stderr, format, arg);
+  fprintf(stderr, "\n");
+  exit(1);
+}
+
+
+static double getTime(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1000000000.;
+}
+
+
+static void sleepUntil(double t)
+{
+  double now = getTime();
+  struct timespec ts;
+
+  if (t <= now) return;
+  ts.tv_sec = (time_t)(t - now);
+  ts.tv_nsec = (long)((t - now - (double)ts.tv_sec) * 1000000000.);
+  nanosleep(&ts, NULL);
+}
+
+
+/*
+ * Xvnc management
+ */
+
+static int isPortFree(int port)
+{
+  struct sockaddr_in addr;
+  int fd, one = 1, ret;
+
+  if ((fd = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+    return 0;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  ret = bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0;
+  close(fd);
+  return ret;
+}
+
+
+static int isDisplayFree(int n)
+{
+  char path[256];
+  struct stat sb;
+
+  snprintf(path, 256, "/tmp/.X%d-lock", n);
+  if (stat(path, &sb) == 0) return 0;
+  snprintf(path, 256, "/tmp/.X11-unix/X%d", n);
+  if (stat(path, &sb) == 0) return 0;
+  return isPortFree(5900 + n) && isPortFree(6000 + n);
+}
+
+
+static Display *startXvnc(const char *xvnc, int width, int height,
+                          char *serverArgs)
+{
+  char displayName[16], portStr[16], geometry[32], *args[256], *arg;
+  int nArgs = 0, status, fd;
+  Display *dpy = NULL;
+  double start;
+
+  if (displayNum < 0) {
+    for (displayNum = 50; displayNum < 1000; displayNum++)
+      if (isDisplayFree(displayNum)) break;
+    if (displayNum >= 1000)
+      fatal("Could not find a free display number%s", "");
+  }
+  rfbPort = 5900 + displayNum;
+  snprintf(displayName, 16, ":%d", displayNum);
+  snprintf(portStr, 16, "%d", rfbPort);
+  snprintf(geometry, 32, "%dx%d", width, height);
+  snprintf(logFileName, 256, "/tmp/tvncbench-%d.log", (int)getpid());
+
+  args[nArgs++] = (char *)xvnc;
+  args[nArgs++] = displayName;
+  args[nArgs++] = "-rfbport";  args[nArgs++] = portStr;
+  args[nArgs++] = "-localhost";
+  args[nArgs++] = "-securitytypes";  args[nArgs++] = "none";
+  args[nArgs++] = "-geometry";  args[nArgs++] = geometry;
+  args[nArgs++] = "-depth";  args[nArgs++] = "24";
+  if (serverArgs) {
+    for (arg = strtok(serverArgs, " \t"); arg && nArgs < 255;
+         arg = strtok(NULL, " \t"))
+      args[nArgs++] = arg;
+  }
+  args[nArgs] = NULL;
+
+  if ((xvncPid = fork()) < 0)
+    fatal("Could not fork: %s", strerror(errno));
+  if (xvncPid == 0) {
+    if ((fd = open(logFileName, O_WRONLY | O_CREAT | O_TRUNC, 0600)) >= 0) {
+      dup2(fd, 1);  dup2(fd, 2);
+      close(fd);
+    }
+    execvp(xvnc, args);
+    fprintf(stderr, "Could not execute %s: %s\n", xvnc, strerror(errno));
+    _exit(1);
+  }
+
+  start = getTime();
+  while (getTime() - start < 10.) {
+    if (waitpid(xvncPid, &status, WNOHANG) == xvncPid) {
+      xvncPid = -1;
+      fatal("Xvnc exited prematurely.  See %s for more information.",
+            logFileName);
+    }
+    if ((dpy = XOpenDisplay(displayName)) != NULL)
+      break;
+    usleep(100000);
+  }
+  if (!dpy)
+    fatal("Could not connect to Xvnc.  See %s for more information.",
+          logFileName);
+
+  return dpy;
+}
+
+
+static void startCommand(const char *cmd)
+{
+  char displayName[16];
+
+  snprintf(displayName, 16, ":%d", displayNum);
+  if ((cmdPid = fork()) < 0)
+    fatal("Could not fork: %s", strerror(errno));
+  if (cmdPid == 0) {
+    int fd;
+
+    setpgid(0, 0);
+    setenv("DISPLAY", displayName, 1);
+    if ((fd = open("/dev/null", O_WRONLY)) >= 0) {
+      dup2(fd, 1);  dup2(fd, 2);
+      close(fd);
+    }
+    execl("/bin/sh", "sh", "-c", cmd, NULL);
+    _exit(1);
+  }
+}
+
+
+static void stopCommand(void)
+{
+  if (cmdPid > 0) {
+    kill(-cmdPid, SIGTERM);
+    waitpid(cmdPid, NULL, 0);
+    cmdPid = -1;
+  }
+}
+
+
+/*
+ * RFB client
+ */
+
+static int clientFill(Client *c)
+{
+  int n;
+
+  do {
+    n = recv(c->fd, c->buf, RECV_BUF_SIZE, 0);
+  } while (n < 0 && errno == EINTR);
+  if (n <= 0) {
+    if (!c->stop)
+      snprintf(c->errorMsg, 256, n == 0 ? "Connection closed by server" :
+               "recv() failed: %s", strerror(errno));
+    return -1;
+  }
+  c->bufLen = n;
+  c->bufPos = 0;
+  c->bytes += n;
+  return 0;
+}
+
+
+static int clientRead(Client *c, void *dst, int len)
+{
+  unsigned char *ptr = (unsigned char *)dst;
+
+  while (len > 0) {
+    int n;
+
+    if (c->bufPos >= c->bufLen && clientFill(c) < 0)
+      return -1;
+    n = c->bufLen - c->bufPos;
+    if (n > len) n = len;
+    if (ptr) {
+      memcpy(ptr, &c->buf[c->bufPos], n);
+      ptr += n;
+    }
+    c->bufPos += n;
+    len -= n;
+  }
+  return 0;
+}
+
+#define READ(dst, len) {  \
+  if (clientRead(c, dst, len) < 0) return -1;  \
+}
+
+#define SKIP(len) {  \
+  if (clientRead(c, NULL, len) < 0) return -1;  \
+}
+
+#define READ8(var) {  \
+  unsigned char _b;  \
+  READ(&_b, 1);  var = _b;  \
+}
+
+#define READ16(var) {  \
+  unsigned char _b[2];  \
+  READ(_b, 2);  var = (_b[0] << 8) | _b[1];  \
+}
+
+#define READ32(var) {  \
+  unsigned char _b[4];  \
+  READ(_b, 4);  \
+  var = ((CARD32)_b[0] << 24) | ((CARD32)_b[1] << 16) | ((CARD32)_b[2] << 8) |  \
+        (CARD32)_b[3];  \
+}
+
+#define ERROR(...) {  \
+  snprintf(c->errorMsg, 256, __VA_ARGS__);  \
+  return -1;  \
+}
+
+
+static int clientWrite(Client *c, const void *buf, int len)
+{
+  const char *ptr = (const char *)buf;
+
+  while (len > 0) {
+    int n = send(c->fd, ptr, len, 0);
+
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      ERROR("send() failed: %s", strerror(errno));
+    }
+    ptr += n;
+    len -= n;
+  }
+  return 0;
+}
+
+
+static void put16(unsigned char *buf, int val)
+{
+  buf[0] = (val >> 8) & 0xFF;
+  buf[1] = val & 0xFF;
+}
+
+
+static void put32(unsigned char *buf, CARD32 val)
+{
+  buf[0] = (val >> 24) & 0xFF;
+  buf[1] = (val >> 16) & 0xFF;
+  buf[2] = (val >> 8) & 0xFF;
+  buf[3] = val & 0xFF;
+}
+
+
+static int clientConnect(Client *c, const EncConfig *ec)
+{
+  struct sockaddr_in addr;
+  char version[sz_rfbProtocolVersionMsg + 1];
+  unsigned char msg[64], secTypes[256];
+  int nSecTypes, i, one = 1, nEncodings = 0;
+  CARD32 reasonLen, result;
+  double start = getTime();
+
+  memset(c, 0, sizeof(Client));
+  c->fd = -1;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(rfbPort);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  while (1) {
+    if ((c->fd = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+      ERROR("Could not create socket: %s", strerror(errno));
+    if (connect(c->fd, (struct sockaddr *)&addr, sizeof(addr)) == 0)
+      break;
+    close(c->fd);
+    c->fd = -1;
+    if (getTime() - start > 10.)
+      ERROR("Could not connect to port %d: %s", rfbPort, strerror(errno));
+    usleep(100000);
+  }
+  setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+  if (!(c->buf = (unsigned char *)malloc(RECV_BUF_SIZE)))
+    ERROR("Memory allocation failure");
+
+  /* Protocol version and security handshake */
+  READ(version, sz_rfbProtocolVersionMsg);
+  version[sz_rfbProtocolVersionMsg] = 0;
+  if (strncmp(version, "RFB 003.", 8))
+    ERROR("Not a VNC server");
+  if (clientWrite(c, "RFB 003.008\n", sz_rfbProtocolVersionMsg) < 0)
+    return -1;
+  READ8(nSecTypes);
+  if (nSecTypes == 0) {
+    READ32(reasonLen);
+    if (reasonLen > 255) reasonLen = 255;
+    READ(c->errorMsg, reasonLen);
+    c->errorMsg[reasonLen] = 0;
+    return -1;
+  }
+  READ(secTypes, nSecTypes);
+  for (i = 0; i < nSecTypes; i++)
+    if (secTypes[i] == rfbSecTypeNone) break;
+  if (i >= nSecTypes)
+    ERROR("Server does not permit security type None");
+  msg[0] = rfbSecTypeNone;
+  if (clientWrite(c, msg, 1) < 0)
+    return -1;
+  READ32(result);
+  if (result != rfbAuthOK)
+    ERROR("Authentication failed");
+
+  /* Initialization */
+  msg[0] = 1;  /* shared */
+  if (clientWrite(c, msg, 1) < 0)
+    return -1;
+  READ(msg, sz_rfbServerInitMsg);
+  c->width = (msg[0] << 8) | msg[1];
+  c->height = (msg[2] << 8) | msg[3];
+  READ32(reasonLen);
+  SKIP(reasonLen);
+  if (!(c->fb = (CARD32 *)calloc(c->width * c->height, 4)))
+    ERROR("Memory allocation failure");
+
+  /* Request 32-bit true color pixels in host byte order, with the same
+     layout that TurboJPEG produces when decompressing to TJPF_BGRX
+     (little endian) or TJPF_XRGB (big endian). */
+  memset(msg, 0, 20);
+  msg[0] = rfbSetPixelFormat;
+  msg[4] = 32;  msg[5] = 24;  msg[6] = bigEndian;  msg[7] = 1;
+  put16(&msg[8], 255);  put16(&msg[10], 255);  put16(&msg[12], 255);
+  msg[14] = 16;  msg[15] = 8;  msg[16] = 0;
+  if (clientWrite(c, msg, 20) < 0)
+    return -1;
+  c->tjpf = bigEndian ? TJPF_XRGB : TJPF_BGRX;
+
+  msg[0] = rfbSetEncodings;
+  msg[1] = 0;
+  put32(&msg[4 + 4 * nEncodings++], ec->encoding);
+  put32(&msg[4 + 4 * nEncodings++], rfbEncodingCopyRect);
+  put32(&msg[4 + 4 * nEncodings++], rfbEncodingLastRect);
+  if (ec->compressLevel >= 0)
+    put32(&msg[4 + 4 * nEncodings++],
+          rfbEncodingCompressLevel0 + ec->compressLevel);
+  if (ec->quality >= 0) {
+    put32(&msg[4 + 4 * nEncodings++],
+          rfbEncodingFineQualityLevel0 + ec->quality);
+    put32(&msg[4 + 4 * nEncodings++], ec->subsamp);
+  }
+  put16(&msg[2], nEncodings);
+  if (clientWrite(c, msg, 4 + 4 * nEncodings) < 0)
+    return -1;
+
+  for (i = 0; i < 4; i++) {
+    if (inflateInit(&c->zs[i]) != Z_OK)
+      ERROR("Could not initialize zlib stream");
+    c->zsActive[i] = 1;
+  }
+  if (!(c->tjhnd = tjInitDecompress()))
+    ERROR("Could not initialize TurboJPEG decompressor: %s", tjGetErrorStr());
+
+  return 0;
+}
+
+
+static void clientClose(Client *c)
+{
+  int i;
+
+  if (c->fd >= 0) {
+    close(c->fd);
+    c->fd = -1;
+  }
+  for (i = 0; i < 4; i++)
+    if (c->zsActive[i]) inflateEnd(&c->zs[i]);
+  if (c->tjhnd) tjDestroy(c->tjhnd);
+  free(c->buf);  free(c->fb);  free(c->zbuf);  free(c->dbuf);
+  memset(c, 0, sizeof(Client));
+  c->fd = -1;
+}
+
+
+static int requestUpdate(Client *c, int incremental)
+{
+  unsigned char msg[sz_rfbFramebufferUpdateRequestMsg];
+
+  msg[0] = rfbFramebufferUpdateRequest;
+  msg[1] = incremental;
+  put16(&msg[2], 0);  put16(&msg[4], 0);
+  put16(&msg[6], c->width);  put16(&msg[8], c->height);
+  return clientWrite(c, msg, sz_rfbFramebufferUpdateRequestMsg);
+}
+
+
+static unsigned char *checkBuf(unsigned char **buf, int *size, int newSize)
+{
+  if (newSize > *size) {
+    unsigned char *newBuf = (unsigned char *)realloc(*buf, newSize);
+
+    if (!newBuf) return NULL;
+    *buf = newBuf;
+    *size = newSize;
+  }
+  return *buf;
+}
+
+
+static int readCompactLength(Client *c)
+{
+  int b, len;
+
+  READ8(b);
+  len = b & 0x7F;
+  if (b & 0x80) {
+    READ8(b);
+    len |= (b & 0x7F) << 7;
+    if (b & 0x80) {
+      READ8(b);
+      len |= (b & 0xFF) << 14;
+    }
+  }
+  return len;
+}
+
+
+#define RGB24(p)  (((CARD32)(p)[0] << 16) | ((CARD32)(p)[1] << 8) | (p)[2])
+
+static int decodeTight(Client *c, int rx, int ry, int rw, int rh)
+{
+  int compCtl, filter = rfbTightFilterCopy, numColors = 0, rowSize,
+    dataSize, readUncompressed = 0, i, x, y;
+  unsigned char rgb[3], palBuf[256 * 3], *data;
+  CARD32 palette[256], *dst;
+
+  READ8(compCtl);
+  for (i = 0; i < 4; i++) {
+    if (compCtl & (1 << i))
+      inflateReset(&c->zs[i]);
+  }
+  compCtl >>= 4;
+  if ((compCtl & rfbTightNoZlib) == rfbTightNoZlib) {
+    compCtl &= ~rfbTightNoZlib;
+    readUncompressed = 1;
+  }
+
+  if (compCtl == rfbTightFill) {
+    CARD32 pix;
+
+    READ(rgb, 3);
+    pix = RGB24(rgb);
+    for (y = ry; y < ry + rh; y++) {
+      dst = &c->fb[y * c->width + rx];
+      for (x = 0; x < rw; x++) dst[x] = pix;
+    }
+    return 0;
+  }
+
+  if (compCtl == rfbTightJpeg) {
+    int len = readCompactLength(c);
+
+    if (len < 0) return -1;
+    if (!checkBuf(&c->zbuf, &c->zbufSize, len))
+      ERROR("Memory allocation failure");
+    READ(c->zbuf, len);
+    if (tjDecompress2(c->tjhnd, c->zbuf, len,
+                      (unsigned char *)&c->fb[ry * c->width + rx], rw,
+                      c->width * 4, rh, c->tjpf, 0) < 0)
+      ERROR("JPEG decompression error: %s", tjGetErrorStr());
+    return 0;
+  }
+
+  if (compCtl > rfbTightMaxSubencoding)
+    ERROR("Bad Tight subencoding %d", compCtl);
+
+  if (compCtl & rfbTightExplicitFilter) {
+    READ8(filter);
+  }
+  if (filter == rfbTightFilterPalette) {
+    READ8(numColors);
+    numColors++;
+    READ(palBuf, numColors * 3);
+    for (i = 0; i < numColors; i++)
+      palette[i] = RGB24(&palBuf[i * 3]);
+    rowSize = numColors <= 2 ? (rw + 7) / 8 : rw;
+  } else if (filter == rfbTightFilterCopy || filter == rfbTightFilterGradient)
+    rowSize = rw * 3;
+  else
+    ERROR("Bad Tight filter %d", filter);
+  dataSize = rh * rowSize;
+
+  if (!checkBuf(&c->dbuf, &c->dbufSize, dataSize))
+    ERROR("Memory allocation failure");
+  data = c->dbuf;
+  if (dataSize < TIGHT_MIN_TO_COMPRESS || readUncompressed) {
+    if (dataSize >= TIGHT_MIN_TO_COMPRESS) {
+      int len = readCompactLength(c);
+
+      if (len != dataSize)
+        ERROR("Bad length for uncompressed Tight data");
+    }
+    READ(data, dataSize);
+  } else {
+    z_stream *zs = &c->zs[compCtl & 3];
+    int len = readCompactLength(c), err;
+
+    if (len < 0) return -1;
+    if (!checkBuf(&c->zbuf, &c->zbufSize, len))
+      ERROR("Memory allocation failure");
+    READ(c->zbuf, len);
+    zs->next_in = c->zbuf;
+    zs->avail_in = len;
+    zs->next_out = data;
+    zs->avail_out = dataSize;
+    err = inflate(zs, Z_SYNC_FLUSH);
+    if ((err != Z_OK && err != Z_STREAM_END) || zs->avail_out != 0)
+      ERROR("zlib inflate error");
+  }
+
+  for (y = 0; y < rh; y++) {
+    unsigned char *src = &data[y * rowSize];
+
+    dst = &c->fb[(ry + y) * c->width + rx];
+    if (filter == rfbTightFilterPalette) {
+      if (numColors <= 2) {
+        for (x = 0; x < rw; x++)
+          dst[x] = palette[(src[x >> 3] >> (7 - (x & 7))) & 1];
+      } else {
+        for (x = 0; x < rw; x++)
+          dst[x] = palette[src[x]];
+      }
+    } else if (filter == rfbTightFilterGradient) {
+      /* Reconstruct each component from the left, upper, and upper left
+         neighbors, which have already been written to the framebuffer. */
+      for (x = 0; x < rw; x++) {
+        int comp[3], shift;
+
+        for (i = 0, shift = 16; i < 3; i++, shift -= 8) {
+          int left = x > 0 ? (dst[x - 1] >> shift) & 0xFF : 0;
+          int up = y > 0 ? (dst[x - c->width] >> shift) & 0xFF : 0;
+          int upLeft = x > 0 && y > 0 ?
+                       (dst[x - 1 - c->width] >> shift) & 0xFF : 0;
+          int est = left + up - upLeft;
+
+          if (est < 0) est = 0;
+          else if (est > 255) est = 255;
+          comp[i] = (est + src[x * 3 + i]) & 0xFF;
+        }
+        dst[x] = ((CARD32)comp[0] << 16) | ((CARD32)comp[1] << 8) | comp[2];
+      }
+    } else {
+      for (x = 0; x < rw; x++)
+        dst[x] = RGB24(&src[x * 3]);
+    }
+  }
+
+  return 0;
+}
+
+
+static int decodeRect(Client *c, int x, int y, int w, int h, CARD32 enc)
+{
+  int row;
+
+  if (enc != rfbEncodingLastRect &&
+      (x + w > c->width || y + h > c->height))
+    ERROR("Rectangle %dx%d at %d,%d is outside of the framebuffer", w, h, x,
+          y);
+
+  switch (enc) {
+    case rfbEncodingRaw:
+      for (row = y; row < y + h; row++)
+        READ(&c->fb[row * c->width + x], w * 4);
+      return 0;
+    case rfbEncodingCopyRect:
+    {
+      int srcX, srcY;
+
+      READ16(srcX);
+      READ16(srcY);
+      if (srcX + w > c->width || srcY + h > c->height)
+        ERROR("CopyRect source is outside of the framebuffer");
+      if (srcY < y) {
+        for (row = h - 1; row >= 0; row--)
+          memmove(&c->fb[(y + row) * c->width + x],
+                  &c->fb[(srcY + row) * c->width + srcX], w * 4);
+      } else {
+        for (row = 0; row < h; row++)
+          memmove(&c->fb[(y + row) * c->width + x],
+                  &c->fb[(srcY + row) * c->width + srcX], w * 4);
+      }
+      return 0;
+    }
+    case rfbEncodingTight:
+      return decodeTight(c, x, y, w, h);
+    default:
+      ERROR("Unexpected encoding %d", (int)enc);
+  }
+}
+
+
+/* Return the frame number in the marker, or 0 if the marker is not valid */
+static int readMarker(Client *c)
+{
+  int i, frame = 0;
+
+  for (i = 0; i < MARKER_BITS; i++) {
+    CARD32 pix = c->fb[(MARKER_BLOCK / 2) * c->width + i * MARKER_BLOCK +
+                       MARKER_BLOCK / 2];
+    int g = (pix >> 8) & 0xFF;
+
+    /* Reject the marker if it has been only partially updated or if lossy
+       compression has made it ambiguous. */
+    if (g > 192)
+      frame |= 1 << i;
+    else if (g >= 64)
+      return 0;
+  }
+  return (frame & 1) ? frame >> 1 : 0;
+}
+
+
+static int readUpdate(Client *c)
+{
+  int nRects, i, x, y, w, h, frame;
+  CARD32 enc;
+  unsigned long long startBytes = c->bytes - (c->bufLen - c->bufPos);
+  double start = -1.;
+
+  SKIP(1);
+  READ16(nRects);
+  for (i = 0; nRects == 0xFFFF || i < nRects; i++) {
+    READ16(x);  READ16(y);  READ16(w);  READ16(h);
+    READ32(enc);
+    if (enc == rfbEncodingLastRect) break;
+    /* The update time is the time spent receiving and decoding the
+       rectangles, not including the time spent waiting for the server to
+       start sending the update. */
+    if (start < 0.) start = getTime();
+    if (decodeRect(c, x, y, w, h, enc) < 0) return -1;
+  }
+
+  pthread_mutex_lock(&stats.mutex);
+  stats.updates++;
+  stats.updateBytes += c->bytes - (c->bufLen - c->bufPos) - startBytes + 1;
+  if (start >= 0.) stats.decodeTime += getTime() - start;
+  frame = readMarker(c);
+  if (frame > stats.lastShown && frame <= stats.framesDrawn) {
+    stats.latency[stats.framesShown++] =
+      (getTime() - stats.issueTime[frame]) * 1000.;
+    stats.lastShown = frame;
+  }
+  pthread_mutex_unlock(&stats.mutex);
+
+  return 0;
+}
+
+
+static int readMessage(Client *c, int *gotUpdate)
+{
+  int type, len;
+
+  *gotUpdate = 0;
+  READ8(type);
+  switch (type) {
+    case rfbFramebufferUpdate:
+      if (readUpdate(c) < 0) return -1;
+      *gotUpdate = 1;
+      return 0;
+    case rfbSetColourMapEntries:
+      SKIP(3);
+      READ16(len);
+      SKIP(len * 6);
+      return 0;
+    case rfbBell:
+      return 0;
+    case rfbServerCutText:
+      SKIP(3);
+      READ32(len);
+      SKIP(len);
+      return 0;
+    default:
+      ERROR("Unexpected message type %d", type);
+  }
+}
+
+
+static void *clientThread(void *param)
+{
+  Client *c = (Client *)param;
+  int gotUpdate;
+
+  while (!c->stop) {
+    if (requestUpdate(c, 1) < 0) break;
+    do {
+      if (readMessage(c, &gotUpdate) < 0) return NULL;
+    } while (!gotUpdate);
+  }
+  return NULL;
+}
+
+
+/*
+ * Workloads
+ */
+
+static unsigned int rngState = 1;
+
+static unsigned int rng(void)
+{
+  rngState = rngState * 1103515245 + 12345;
+  return (rngState >> 8) & 0xFFFFFF;
+}
+
+
+static XImage **createImages(Display *dpy, Visual *visual, int w, int h)
+{
+  XImage **images = (XImage **)calloc(NUM_IMAGES, sizeof(XImage *));
+  int i, x, y;
+
+  if (!images) fatal("Memory allocation failure%s", "");
+  for (i = 0; i < NUM_IMAGES; i++) {
+    char *data = (char *)malloc(w * h * 4);
+    double phase = (double)i * 2. * M_PI / NUM_IMAGES;
+
+    if (!data) fatal("Memory allocation failure%s", "");
+    images[i] = XCreateImage(dpy, visual, 24, ZPixmap, 0, data, w, h, 32, 0);
+    if (!images[i]) fatal("Could not create image%s", "");
+    /* Smooth gradients with a bit of noise compress similarly to
+       photographic content. */
+    for (y = 0; y < h; y++) {
+      for (x = 0; x < w; x++) {
+        int r = 128 + (int)(100. * sin((double)x / 97. + phase)) +
+                (int)(rng() % 24) - 12;
+        int g = 128 + (int)(100. * sin((double)y / 61. - phase)) +
+                (int)(rng() % 24) - 12;
+        int b = 128 + (int)(100. * sin((double)(x + y) / 143. + 2. * phase)) +
+                (int)(rng() % 24) - 12;
+
+        XPutPixel(images[i], x, y,
+                  ((unsigned long)(r & 0xFF) << 16) |
+                  ((unsigned long)(g & 0xFF) << 8) | (unsigned long)(b & 0xFF));
+      }
+    }
+  }
+  return images;
+}
+
+
+static void drawWorkload(Display *dpy, Window win, GC gc, XFontStruct *font,
+                         XImage **images, int workload, int frame, int w,
+                         int h)
+{
+  int i;
+
+  switch (workload) {
+    case WL_RECTS:
+      for (i = 0; i < 50; i++) {
+        XSetForeground(dpy, gc, rng());
+        XFillRectangle(dpy, win, gc, rng() % (w - 100), rng() % (h - 100),
+                       100, 100);
+      }
+      break;
+    case WL_LINES:
+      for (i = 0; i < 100; i++) {
+        int x = rng() % (w - 100), y = rng() % (h - 100);
+
+        XSetForeground(dpy, gc, rng());
+        XDrawLine(dpy, win, gc, x, y, x + rng() % 100, y + rng() % 100);
+      }
+      break;
+    case WL_TEXT:
+    {
+      static const char *words[] = {
+        "the", "quick", "brown", "fox", "jumps", "over", "lazy", "dog",
+        "Xvnc", "TurboVNC", "framebuffer", "update", "latency", "0x7f3a",
+        "{", "}", "return", "int", "static", "void"
+      };
+      int lineH = font->ascent + font->descent, x = 4;
+
+      XCopyArea(dpy, win, win, gc, 0, lineH, w, h - lineH, 0, 0);
+      XSetForeground(dpy, gc, BlackPixel(dpy, DefaultScreen(dpy)));
+      XFillRectangle(dpy, win, gc, 0, h - lineH, w, lineH);
+      XSetForeground(dpy, gc, (frame & 1) ? 0xC0C0C0 : 0x80FF80);
+      while (x < w - 100) {
+        const char *word = words[rng() % (sizeof(words) / sizeof(char *))];
+        int len = strlen(word);
+
+        XDrawString(dpy, win, gc, x, h - font->descent, word, len);
+        x += XTextWidth(font, word, len) + XTextWidth(font, " ", 1);
+      }
+      break;
+    }
+    case WL_IMAGE:
+      XPutImage(dpy, win, gc, images[frame % NUM_IMAGES], 0, 0, 0, 0, w, h);
+      break;
+  }
+}
+
+
+static void drawMarker(Display *dpy, Window win, GC gc, int frame)
+{
+  int i, bits = (frame << 1) | 1;
+
+  for (i = 0; i < MARKER_BITS; i++) {
+    XSetForeground(dpy, gc, (bits & (1 << i)) ?
+                   WhitePixel(dpy, DefaultScreen(dpy)) :
+                   BlackPixel(dpy, DefaultScreen(dpy)));
+    XFillRectangle(dpy, win, gc, i * MARKER_BLOCK, 0, MARKER_BLOCK,
+                   MARKER_H);
+  }
+}
+
+
+static Window createWindow(Display *dpy, int x, int y, int w, int h)
+{
+  XSetWindowAttributes attr;
+  Window win;
+
+  attr.override_redirect = True;
+  attr.background_pixel = BlackPixel(dpy, DefaultScreen(dpy));
+  win = XCreateWindow(dpy, DefaultRootWindow(dpy), x, y, w, h, 0,
+                      CopyFromParent, InputOutput, CopyFromParent,
+                      CWOverrideRedirect | CWBackPixel, &attr);
+  XMapRaised(dpy, win);
+  return win;
+}
+
+
+/*
+ * Test driver
+ */
+
+static int compareDouble(const void *a, const void *b)
+{
+  double da = *(const double *)a, db = *(const double *)b;
+
+  return da < db ? -1 : (da > db ? 1 : 0);
+}
+
+
+static double percentile(double *samples, int n, double p)
+{
+  int i;
+
+  if (n < 1) return 0.;
+  i = (int)ceil(p / 100. * (double)n) - 1;
+  if (i < 0) i = 0;
+  if (i >= n) i = n - 1;
+  return samples[i];
+}
+
+
+static int runTest(Display *dpy, const EncConfig *ec, int workload,
+                   double testTime, double fps, const char *glCmd,
+                   XFontStruct *font, int csv)
+{
+  Client client;
+  Window markerWin, workWin = 0;
+  GC gc;
+  XGCValues gcv;
+  XImage **images = NULL;
+  int w = DisplayWidth(dpy, DefaultScreen(dpy)),
+    h = DisplayHeight(dpy, DefaultScreen(dpy)) - MARKER_H, frame, i,
+    gotUpdate, shown;
+  double start, elapsed, drawTime = 0., sum = 0.;
+
+  if (clientConnect(&client, ec) < 0) {
+    fprintf(stderr, "%s: %s\n", programName, client.errorMsg);
+    clientClose(&client);
+    return -1;
+  }
+
+  markerWin = createWindow(dpy, 0, 0, MARKER_W, MARKER_H);
+  if (workload == WL_GL)
+    startCommand(glCmd);
+  else
+    workWin = createWindow(dpy, 0, MARKER_H, w, h);
+  gcv.graphics_exposures = False;
+  gcv.font = font->fid;
+  gc = XCreateGC(dpy, markerWin, GCGraphicsExposures | GCFont, &gcv);
+  if (workload == WL_IMAGE)
+    images = createImages(dpy, DefaultVisual(dpy, DefaultScreen(dpy)), w, h);
+  drawMarker(dpy, markerWin, gc, 0);
+  XSync(dpy, False);
+  /* Give the OpenGL application time to start. */
+  if (workload == WL_GL) sleep(2);
+
+  memset(stats.issueTime, 0, (MAX_FRAMES + 1) * sizeof(double));
+  stats.framesDrawn = stats.framesShown = stats.lastShown = 0;
+  stats.updates = stats.updateBytes = 0;
+  stats.decodeTime = 0.;
+
+  /* Synchronize the client with the initial state of the screen before
+     starting the clock. */
+  if (requestUpdate(&client, 0) < 0) goto bailout;
+  do {
+    if (readMessage(&client, &gotUpdate) < 0) goto bailout;
+  } while (!gotUpdate);
+  stats.updates = stats.updateBytes = 0;
+  stats.decodeTime = 0.;
+  if (pthread_create(&client.thread, NULL, clientThread, &client) != 0) {
+    snprintf(client.errorMsg, 256, "Could not create thread");
+    goto bailout;
+  }
+
+  start = getTime();
+  for (frame = 1; frame <= MAX_FRAMES; frame++) {
+    double t;
+
+    if (fps > 0.) sleepUntil(start + (double)(frame - 1) / fps);
+    if (getTime() - start >= testTime || client.errorMsg[0]) break;
+
+    pthread_mutex_lock(&stats.mutex);
+    t = stats.issueTime[frame] = getTime();
+    stats.framesDrawn = frame;
+    pthread_mutex_unlock(&stats.mutex);
+
+    if (workload != WL_GL)
+      drawWorkload(dpy, workWin, gc, font, images, workload, frame, w, h);
+    else
+      XRaiseWindow(dpy, markerWin);
+    drawMarker(dpy, markerWin, gc, frame);
+    XSync(dpy, False);
+    drawTime += getTime() - t;
+  }
+  frame--;
+
+  /* Wait for the last frame to be displayed */
+  for (i = 0; i < 100; i++) {
+    pthread_mutex_lock(&stats.mutex);
+    shown = stats.lastShown;
+    pthread_mutex_unlock(&stats.mutex);
+    if (shown >= frame) break;
+    usleep(10000);
+  }
+  elapsed = getTime() - start;
+
+  client.stop = 1;
+  shutdown(client.fd, SHUT_RDWR);
+  pthread_join(client.thread, NULL);
+  if (client.errorMsg[0]) goto bailout;
+
+  qsort(stats.latency, stats.framesShown, sizeof(double), compareDouble);
+  for (i = 0; i < stats.framesShown; i++) sum += stats.latency[i];
+  shown = stats.framesShown;
+  if (csv)
+    printf("%s,%s,%d,%d,%.2f,%.3f,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%.1f\n",
+           ec->name, workloadNames[workload], frame, shown,
+           (double)shown / elapsed, frame ? drawTime * 1000. / frame : 0.,
+           shown ? sum / shown : 0.,
+           percentile(stats.latency, shown, 50.),
+           percentile(stats.latency, shown, 90.),
+           percentile(stats.latency, shown, 99.),
+           shown ? stats.latency[shown - 1] : 0.,
+           stats.updates ? stats.decodeTime * 1000. / stats.updates : 0.,
+           shown ? (double)stats.updateBytes / 1024. / shown : 0.);
+  else
+    printf("%-20s %-6s %6d %6d %7.2f %7.3f %7.2f %7.2f %7.2f %7.2f %7.2f %7.2f %9.1f\n",
+           ec->name, workloadNames[workload], frame, shown,
+           (double)shown / elapsed, frame ? drawTime * 1000. / frame : 0.,
+           shown ? sum / shown : 0.,
+           percentile(stats.latency, shown, 50.),
+           percentile(stats.latency, shown, 90.),
+           percentile(stats.latency, shown, 99.),
+           shown ? stats.latency[shown - 1] : 0.,
+           stats.updates ? stats.decodeTime * 1000. / stats.updates : 0.,
+           shown ? (double)stats.updateBytes / 1024. / shown : 0.);
+  fflush(stdout);
+
+  bailout:
+  if (client.errorMsg[0])
+    fprintf(stderr, "%s: %s (%s, %s)\n", programName, client.errorMsg,
+            ec->name, workloadNames[workload]);
+  i = client.errorMsg[0] ? -1 : 0;
+  stopCommand();
+  if (images) {
+    int j;
+
+    for (j = 0; j < NUM_IMAGES; j++) XDestroyImage(images[j]);
+    free(images);
+  }
+  XFreeGC(dpy, gc);
+  if (workWin) XDestroyWindow(dpy, workWin);
+  XDestroyWindow(dpy, markerWin);
+  XSync(dpy, False);
+  clientClose(&client);
+  return i;
+}
+
+
+static int parseList(char *list, const char *name, int (*lookup)(const char *),
+                     int *result, int max)
+{
+  char *item;
+  int n = 0;
+
+  for (item = strtok(list, ","); item && n < max; item = strtok(NULL, ",")) {
+    if ((result[n] = lookup(item)) < 0) {
+      fprintf(stderr, "%s: Unknown %s \"%s\"\n", programName, name, item);
+      usage();
+    }
+    n++;
+  }
+  return n;
+}
+
+
+static int lookupEnc(const char *name)
+{
+  int i;
+
+  for (i = 0; encConfigs[i].name; i++)
+    if (!strcasecmp(name, encConfigs[i].name)) return i;
+  return -1;
+}
+
+
+static int lookupWorkload(const char *name)
+{
+  int i;
+
+  for (i = 0; workloadNames[i]; i++)
+    if (!strcasecmp(name, workloadNames[i])) return i;
+  return -1;
+}
+
+
+int main(int argc, char **argv)
+{
+  char *xvnc = NULL, *serverArgs = NULL, *glCmd = "glxspheres64",
+    defXvnc[1024], *slash;
+  int width = 1240, height = 900, encs[32], nEncs = 0, workloads[32],
+    nWorkloads = 0, csv = 0, i, j, status = 0;
+  double testTime = 10., fps = 60.;
+  union { CARD32 i; char c[4]; } endianTest;
+  Display *dpy;
+  XFontStruct *font;
+  Visual *visual;
+
+  programName = argv[0];
+  endianTest.i = 1;
+  bigEndian = endianTest.c[0] == 0;
+
+  for (i = 1; i < argc; i++) {
+    if (!strcasecmp(argv[i], "-xvnc") && i < argc - 1)
+      xvnc = argv[++i];
+    else if (!strcasecmp(argv[i], "-display") && i < argc - 1) {
+      displayNum = atoi(argv[++i][0] == ':' ? &argv[i][1] : argv[i]);
+      if (displayNum < 0) usage();
+    } else if (!strcasecmp(argv[i], "-geometry") && i < argc - 1) {
+      if (sscanf(argv[++i], "%dx%d", &width, &height) != 2 ||
+          width < MARKER_W || height < MARKER_H + 200)
+        usage();
+    } else if (!strcasecmp(argv[i], "-serverargs") && i < argc - 1)
+      serverArgs = argv[++i];
+    else if (!strcasecmp(argv[i], "-enc") && i < argc - 1)
+      nEncs = parseList(argv[++i], "encoding configuration", lookupEnc, encs,
+                        32);
+    else if (!strcasecmp(argv[i], "-workload") && i < argc - 1)
+      nWorkloads = parseList(argv[++i], "workload", lookupWorkload, workloads,
+                             32);
+    else if (!strcasecmp(argv[i], "-glcmd") && i < argc - 1)
+      glCmd = argv[++i];
+    else if (!strcasecmp(argv[i], "-time") && i < argc - 1) {
+      if ((testTime = atof(argv[++i])) <= 0.) usage();
+    } else if (!strcasecmp(argv[i], "-fps") && i < argc - 1) {
+      if ((fps = atof(argv[++i])) < 0.) usage();
+    } else if (!strcasecmp(argv[i], "-csv"))
+      csv = 1;
+    else usage();
+  }
+
+  if (nEncs == 0)
+    for (nEncs = 0; encConfigs[nEncs].name; nEncs++) encs[nEncs] = nEncs;
+  if (nWorkloads == 0)
+    for (nWorkloads = 0; nWorkloads < WL_GL; nWorkloads++)
+      workloads[nWorkloads] = nWorkloads;
+
+  if (!xvnc) {
+    xvnc = "Xvnc";
+    if ((slash = strrchr(programName, '/')) != NULL) {
+      snprintf(defXvnc, 1024, "%.*s/Xvnc", (int)(slash - programName),
+               programName);
+      if (access(defXvnc, X_OK) == 0) xvnc = defXvnc;
+    }
+  }
+
+  if (!(stats.issueTime = (double *)malloc((MAX_FRAMES + 1) * sizeof(double)))
+      || !(stats.latency = (double *)malloc((MAX_FRAMES + 1) *
+                                            sizeof(double))))
+    fatal("Memory allocation failure%s", "");
+  pthread_mutex_init(&stats.mutex, NULL);
+
+  atexit(cleanup);
+  signal(SIGINT, handler);
+  signal(SIGTERM, handler);
+  signal(SIGPIPE, SIG_IGN);
+
+  dpy = startXvnc(xvnc, width, height, serverArgs);
+  visual = DefaultVisual(dpy, DefaultScreen(dpy));
+  if (DefaultDepth(dpy, DefaultScreen(dpy)) != 24 ||
+      visual->red_mask != 0xFF0000 || visual->green_mask != 0xFF00 ||
+      visual->blue_mask != 0xFF)
+    fatal("Xvnc must use a 24-bit RGB visual%s", "");
+  if (!(font = XLoadQueryFont(dpy, "fixed")))
+    fatal("Could not load font \"fixed\"%s", "");
+
+  printf("Xvnc: %s (display :%d, %dx%d)\n", xvnc, displayNum, width, height);
+  printf("Test time: %.1f s, frame rate limit: ", testTime);
+  if (fps > 0.) printf("%.1f fps\n\n", fps);
+  else printf("none\n\n");
+  if (csv)
+    printf("Encoding,Workload,Frames drawn,Frames shown,FPS,Draw (ms),"
+           "Latency avg (ms),p50 (ms),p90 (ms),p99 (ms),max (ms),"
+           "Update (ms),KB/frame\n");
+  else {
+    printf("%-20s %-6s %6s %6s %7s %7s %7s %7s %7s %7s %7s %7s %9s\n", "", "",
+           "Frames", "Frames", "", "Draw", "Latency", "", "", "", "",
+           "Update", "");
+    printf("%-20s %-6s %6s %6s %7s %7s %7s %7s %7s %7s %7s %7s %9s\n",
+           "Encoding", "Load", "drawn", "shown", "FPS", "(ms)", "avg", "p50",
+           "p90", "p99", "max", "(ms)", "KB/frame");
+  }
+  fflush(stdout);
+
+  for (i = 0; i < nEncs; i++) {
+    for (j = 0; j < nWorkloads; j++) {
+      if (runTest(dpy, &encConfigs[encs[i]], workloads[j], testTime, fps,
+                  glCmd, font, csv) < 0)
+        status = 1;
+    }
+  }
+
+  XFreeFont(dpy, font);
+  XCloseDisplay(dpy);
+  cleanup();
+  if (status == 0) unlink(logFileName);
+  return status;
+}